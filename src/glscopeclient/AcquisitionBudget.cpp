@@ -0,0 +1,242 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of AcquisitionBudget
+ */
+#include "../scopehal/scopehal.h"
+#include "AcquisitionBudget.h"
+
+using namespace std;
+
+AcquisitionBudget g_acquisitionBudget;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+AcquisitionBudget::AcquisitionBudget()
+	: m_instrumentBudget(2048LL * 1024 * 1024)
+	, m_globalBudget(4096LL * 1024 * 1024)
+{
+}
+
+AcquisitionBudget::~AcquisitionBudget()
+{
+	for(auto it : m_states)
+		delete it.second;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+/**
+	@brief Gets the queue state for an instrument, creating it if this is the first time we've seen the instrument
+ */
+InstrumentQueueState* AcquisitionBudget::GetState(Oscilloscope* scope)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	auto it = m_states.find(scope);
+	if(it != m_states.end())
+		return it->second;
+
+	auto state = new InstrumentQueueState;
+	m_states[scope] = state;
+	return state;
+}
+
+/**
+	@brief Throws away the queue state for an instrument which is about to be deleted
+
+	Must only be called once nothing else is using the instrument (its ScopeThread has exited and nothing from it is
+	still queued), otherwise the next GetState() call will quietly start over from an empty state. A new instrument
+	which happens to be allocated at the same address then starts out with clean counters.
+ */
+void AcquisitionBudget::RemoveInstrument(Oscilloscope* scope)
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+
+		auto it = m_states.find(scope);
+		if(it == m_states.end())
+			return;
+		delete it->second;
+		m_states.erase(it);
+	}
+
+	//Anything waiting on the global budget may have room now
+	NotifySpaceAvailable();
+}
+
+/**
+	@brief Gets the total size of all queued waveforms across every instrument
+ */
+size_t AcquisitionBudget::GetGlobalBytesQueued()
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	size_t total = 0;
+	for(auto it : m_states)
+		total += it.second->GetBytesQueued();
+	return total;
+}
+
+/**
+	@brief Checks if acquiring one more waveform from an instrument would put us over budget
+ */
+bool AcquisitionBudget::IsOverBudget(Oscilloscope* scope)
+{
+	auto state = GetState(scope);
+	size_t next = state->m_bytesPerWaveform;
+
+	if(state->GetBytesQueued() + next > m_instrumentBudget)
+		return true;
+	if(GetGlobalBytesQueued() + next > m_globalBudget)
+		return true;
+
+	return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Flow control
+
+/**
+	@brief Blocks until some queued data has been consumed, or a short timeout passes
+ */
+void AcquisitionBudget::WaitForSpace()
+{
+	unique_lock<mutex> lock(m_mutex);
+	m_spaceAvailable.wait_for(lock, chrono::milliseconds(50));
+}
+
+/**
+	@brief Wakes up any ScopeThread waiting for queued data to be consumed
+ */
+void AcquisitionBudget::NotifySpaceAvailable()
+{
+	//Hold the lock so a waiter can't miss the notification between checking the budget and going to sleep
+	lock_guard<mutex> lock(m_mutex);
+	m_spaceAvailable.notify_all();
+}
+
+/**
+	@brief Records waveforms which were thrown away without being processed
+ */
+void AcquisitionBudget::OnWaveformsDiscarded(Oscilloscope* scope, size_t count)
+{
+	if(count == 0)
+		return;
+
+	GetState(scope)->m_drops += count;
+	NotifySpaceAvailable();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory accounting helpers
+
+/**
+	@brief Calculates the RAM used by a waveform (rough estimate, only counts sample buffers)
+ */
+size_t GetWaveformMemoryUsage(WaveformBase* wfm)
+{
+	size_t bytes_used = 0;
+
+	auto acap = dynamic_cast<AnalogWaveform*>(wfm);
+	if(acap != NULL)
+	{
+		//Add static size of the capture object
+		bytes_used += sizeof(AnalogWaveform);
+
+		//Add size of each sample
+		bytes_used += sizeof(float) * acap->m_samples.capacity();
+		bytes_used += sizeof(int64_t) * acap->m_offsets.capacity();
+		bytes_used += sizeof(int64_t) * acap->m_durations.capacity();
+	}
+
+	auto dcap = dynamic_cast<DigitalWaveform*>(wfm);
+	if(dcap != NULL)
+	{
+		//Add static size of the capture object
+		bytes_used += sizeof(DigitalWaveform);
+
+		//Add size of each sample
+		bytes_used += sizeof(bool) * dcap->m_samples.capacity();
+		bytes_used += sizeof(int64_t) * dcap->m_offsets.capacity();
+		bytes_used += sizeof(int64_t) * dcap->m_durations.capacity();
+	}
+
+	auto bcap = dynamic_cast<DigitalBusWaveform*>(wfm);
+	if(bcap != NULL)
+	{
+		//Add static size of the capture object
+		bytes_used += sizeof(DigitalBusWaveform);
+
+		if(!bcap->m_samples.empty())
+		{
+			//Add size of each sample
+			bytes_used +=
+				(bcap->m_samples[0].size() * sizeof(bool) + sizeof(vector<bool>))
+				* bcap->m_samples.capacity();
+			bytes_used += sizeof(int64_t) * bcap->m_offsets.capacity();
+			bytes_used += sizeof(int64_t) * bcap->m_durations.capacity();
+		}
+	}
+
+	return bytes_used;
+}
+
+/**
+	@brief Estimates the size of one waveform from an instrument given its current configuration
+
+	Assumes every enabled channel captures the full sample depth, with sparse timestamps.
+ */
+size_t EstimateWaveformMemoryUsage(Oscilloscope* scope)
+{
+	size_t depth = scope->GetSampleDepth();
+
+	size_t bytes_used = 0;
+	for(size_t i=0; i<scope->GetChannelCount(); i++)
+	{
+		if(!scope->IsChannelEnabled(i))
+			continue;
+
+		auto chan = scope->GetChannel(i);
+		size_t samplesize = 2*sizeof(int64_t);
+		if(chan->GetType() == OscilloscopeChannel::CHANNEL_TYPE_ANALOG)
+			samplesize += sizeof(float);
+		else
+			samplesize += sizeof(bool);
+
+		bytes_used += depth * samplesize;
+	}
+
+	return bytes_used;
+}
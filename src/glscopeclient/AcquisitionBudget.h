@@ -0,0 +1,135 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of AcquisitionBudget
+ */
+#ifndef AcquisitionBudget_h
+#define AcquisitionBudget_h
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+/**
+	@brief Backpressure state for a single instrument's acquisition queue
+
+	Written by the ScopeThread, the waveform processing thread, and the UI thread, so everything is atomic.
+ */
+class InstrumentQueueState
+{
+public:
+	InstrumentQueueState()
+	: m_bytesPerWaveform(0)
+	, m_driverQueueBytes(0)
+	, m_stagedBytes(0)
+	, m_blocked(false)
+	, m_blockedMicroseconds(0)
+	, m_drops(0)
+	{}
+
+	size_t GetBytesQueued()
+	{ return m_driverQueueBytes + m_stagedBytes; }
+
+	///@brief Estimated size of one waveform, updated by the ScopeThread after each acquisition
+	std::atomic<size_t> m_bytesPerWaveform;
+
+	///@brief Estimated size of all waveforms in the driver's pending queue
+	std::atomic<size_t> m_driverQueueBytes;
+
+	///@brief Actual size of all waveforms from this instrument staged in the WaveformPipeline
+	std::atomic<size_t> m_stagedBytes;
+
+	///@brief True if the ScopeThread is currently waiting for the queue to drain
+	std::atomic<bool> m_blocked;
+
+	///@brief Total time the ScopeThread has spent waiting for the queue to drain
+	std::atomic<int64_t> m_blockedMicroseconds;
+
+	///@brief Number of acquired waveforms thrown away without being processed
+	std::atomic<size_t> m_drops;
+};
+
+/**
+	@brief Memory budget for waveforms which have been acquired but not yet processed
+
+	Each ScopeThread stops pulling data from its instrument once that instrument's queue, or the total queued across
+	all instruments, would go over budget.
+ */
+class AcquisitionBudget
+{
+public:
+	AcquisitionBudget();
+	~AcquisitionBudget();
+
+	void SetInstrumentBudget(size_t bytes)
+	{ m_instrumentBudget = bytes; }
+
+	size_t GetInstrumentBudget()
+	{ return m_instrumentBudget; }
+
+	void SetGlobalBudget(size_t bytes)
+	{ m_globalBudget = bytes; }
+
+	size_t GetGlobalBudget()
+	{ return m_globalBudget; }
+
+	InstrumentQueueState* GetState(Oscilloscope* scope);
+	void RemoveInstrument(Oscilloscope* scope);
+	size_t GetGlobalBytesQueued();
+
+	bool IsOverBudget(Oscilloscope* scope);
+	void WaitForSpace();
+	void NotifySpaceAvailable();
+
+	void OnWaveformsDiscarded(Oscilloscope* scope, size_t count);
+
+protected:
+	std::mutex m_mutex;
+	std::condition_variable m_spaceAvailable;
+
+	///@brief Queue state for each instrument
+	std::map<Oscilloscope*, InstrumentQueueState*> m_states;
+
+	///@brief Max bytes queued for any one instrument
+	std::atomic<size_t> m_instrumentBudget;
+
+	///@brief Max bytes queued for all instruments combined
+	std::atomic<size_t> m_globalBudget;
+};
+
+size_t GetWaveformMemoryUsage(WaveformBase* wfm);
+size_t EstimateWaveformMemoryUsage(Oscilloscope* scope);
+
+extern AcquisitionBudget g_acquisitionBudget;
+
+#endif
@@ -46,6 +46,7 @@ ChannelPropertiesDialog::ChannelPropertiesDialog(
 	OscilloscopeChannel* chan)
 	: Gtk::Dialog(string("Channel properties"), *parent, Gtk::DIALOG_MODAL)
 	, m_groupList(1)
+	, m_parent(parent)
 	, m_chan(chan)
 	, m_hasThreshold(false)
 	, m_hasHysteresis(false)
@@ -372,6 +373,9 @@ void ChannelPropertiesDialog::ConfigureChannel()
 
 	if(m_hasMux)
 		m_chan->SetInputMux(m_muxBox.get_active_row_number());
+
+	//Anything fed by this channel has to be re-evaluated with the new settings
+	m_parent->GetFilterGraph().OnChannelChanged(m_chan);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -99,6 +99,7 @@ protected:
 		Gtk::Label m_autoZeroLabel;
 			Gtk::Button m_autoZeroButton;
 
+	OscilloscopeWindow* m_parent;
 	OscilloscopeChannel* m_chan;
 
 	bool m_hasThreshold;
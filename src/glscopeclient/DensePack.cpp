@@ -0,0 +1,123 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of dense pack detection
+ */
+#include "../scopehal/scopehal.h"
+#include "DensePack.h"
+#include <immintrin.h>
+
+using namespace std;
+
+static bool IsDensePackableGeneric(const int64_t* offsets, const int64_t* durations, size_t len)
+{
+	for(size_t i=0; i<len; i++)
+	{
+		if( (offsets[i] != static_cast<int64_t>(i)) || (durations[i] != 1) )
+			return false;
+	}
+	return true;
+}
+
+__attribute__((target("avx2")))
+static bool IsDensePackableAVX2(const int64_t* offsets, const int64_t* durations, size_t len)
+{
+	size_t end = len - (len % 4);
+
+	__m256i index = _mm256_set_epi64x(3, 2, 1, 0);
+	__m256i four = _mm256_set1_epi64x(4);
+	__m256i ones = _mm256_set1_epi64x(1);
+
+	//Only test the comparison results every so often, but often enough that a sparse waveform doesn't cost much
+	const size_t blocksize = 1024;
+	for(size_t i=0; i<end; )
+	{
+		size_t blockend = min(end, i + blocksize);
+		__m256i match = _mm256_set1_epi64x(-1);
+		for(; i<blockend; i += 4)
+		{
+			__m256i off = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets + i));
+			__m256i dur = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(durations + i));
+			match = _mm256_and_si256(match, _mm256_cmpeq_epi64(off, index));
+			match = _mm256_and_si256(match, _mm256_cmpeq_epi64(dur, ones));
+			index = _mm256_add_epi64(index, four);
+		}
+
+		if(_mm256_movemask_epi8(match) != -1)
+			return false;
+	}
+
+	//Last few samples
+	for(size_t i=end; i<len; i++)
+	{
+		if( (offsets[i] != static_cast<int64_t>(i)) || (durations[i] != 1) )
+			return false;
+	}
+	return true;
+}
+
+/**
+	@brief Checks if a waveform's offsets are 0, 1, 2... and every duration is 1
+
+	Empty waveforms don't count, there's nothing to be gained from packing them.
+ */
+bool IsDensePackable(WaveformBase* wfm)
+{
+	size_t len = wfm->m_offsets.size();
+	if( (len == 0) || (wfm->m_durations.size() != len) )
+		return false;
+
+	//Check the ends first, almost every sparse waveform fails here without us touching the rest of it
+	int64_t last = len - 1;
+	if( (wfm->m_offsets[0] != 0) || (wfm->m_offsets[last] != last) || (wfm->m_durations[last] != 1) )
+		return false;
+
+	if(g_hasAvx2)
+		return IsDensePackableAVX2(&wfm->m_offsets[0], &wfm->m_durations[0], len);
+	else
+		return IsDensePackableGeneric(&wfm->m_offsets[0], &wfm->m_durations[0], len);
+}
+
+/**
+	@brief Sets m_densePacked on a waveform if it can be
+
+	The offsets and durations are left alone, since filters and cursors still index them directly.
+
+	@return True if the flag was set, false if it was already set or the waveform isn't dense
+ */
+bool DetectDensePacked(WaveformBase* wfm)
+{
+	if(wfm->m_densePacked || !IsDensePackable(wfm))
+		return false;
+
+	wfm->m_densePacked = true;
+	return true;
+}
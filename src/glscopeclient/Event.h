@@ -45,7 +45,11 @@ public:
 	 */
 	void Signal()
 	{
-		m_ready = true;
+		//Update the flag under the lock so a receiver can't check it, miss the notify, and then sleep forever
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_ready = true;
+		}
 		m_cond.notify_one();
 	}
 
@@ -59,6 +63,21 @@ public:
 		m_ready = false;
 	}
 
+	/**
+		@brief Blocks until the event is signaled or the timeout expires
+
+		@return True if the event was signaled, false if we timed out
+	 */
+	template<class Rep, class Period>
+	bool Block(const std::chrono::duration<Rep, Period>& timeout)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if(!m_cond.wait_for(lock, timeout, [&]{ return m_ready.load(); }))
+			return false;
+		m_ready = false;
+		return true;
+	}
+
 	/**
 		@brief Checks if the event is signaled, and returns immediately if it's not
 	 */
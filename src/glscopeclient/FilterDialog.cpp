@@ -654,7 +654,7 @@ void FilterDialog::PopulateInputBox(
 	}
 
 	//Add filters
-	auto filters = Filter::GetAllInstances();
+	auto filters = g_filterRegistry.GetSessionFilters();
 	for(auto d : filters)
 	{
 		//Don't allow circular dependencies
@@ -801,6 +801,8 @@ void FilterDialog::ConfigureDecoder()
 		m_filter->SetDisplayName(dname);
 		m_filter->UseDefaultName(false);
 	}
+
+	m_parent->GetFilterGraph().OnFilterChanged(m_filter);
 }
 
 void FilterDialog::ConfigureInputs(FlowGraphNode* node, vector<ChannelSelectorRow*>& rows)
@@ -927,6 +929,7 @@ void FilterDialog::OnRefreshParameters()
 void FilterDialog::OnInputChanged()
 {
 	ConfigureInputs(m_filter, m_rows);
+	m_parent->GetFilterGraph().OnFilterChanged(m_filter);
 	m_parent->RefreshAllFilters();
 	m_parent->ClearAllPersistence();
 }
@@ -936,6 +939,7 @@ void FilterDialog::OnParameterChanged()
 	//TODO: Update the filter name?
 
 	//Re-run the filter graph
+	m_parent->GetFilterGraph().OnFilterChanged(m_filter);
 	m_parent->RefreshAllFilters();
 
 	//Did the number of output streams change since the filter was created?
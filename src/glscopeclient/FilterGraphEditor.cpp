@@ -44,23 +44,90 @@ using namespace std;
 FilterGraphEditor::FilterGraphEditor(OscilloscopeWindow* parent)
 	: m_parent(parent)
 	, m_editor(this)
+	, m_profileButton("Show Profile")
+	, m_resetProfileButton("Reset Profile")
+	, m_exportProfileButton("Export Profile")
 {
 	set_title("Filter Graph Editor");
 	set_size_request(320, 240);
 
-	add(m_scroller);
-		m_scroller.set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
-		m_scroller.add(m_editor);
+	add(m_vbox);
+		m_vbox.pack_start(m_scroller, Gtk::PACK_EXPAND_WIDGET);
+			m_scroller.set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
+			m_scroller.add(m_editor);
+		m_vbox.pack_start(m_buttonBox, Gtk::PACK_SHRINK);
+			m_buttonBox.pack_start(m_profileButton, Gtk::PACK_SHRINK);
+				m_profileButton.set_tooltip_text("Color each filter by run time, and show timing details on mouseover");
+				m_profileButton.signal_toggled().connect(
+					sigc::mem_fun(*this, &FilterGraphEditor::OnProfileToggled));
+			m_buttonBox.pack_end(m_exportProfileButton, Gtk::PACK_SHRINK);
+				m_exportProfileButton.signal_clicked().connect(
+					sigc::mem_fun(*this, &FilterGraphEditor::OnExportProfileClicked));
+			m_buttonBox.pack_end(m_resetProfileButton, Gtk::PACK_SHRINK);
+				m_resetProfileButton.signal_clicked().connect(
+					sigc::mem_fun(*this, &FilterGraphEditor::OnResetProfileClicked));
 
 	show_all();
 }
 
 FilterGraphEditor::~FilterGraphEditor()
 {
-
+	m_profileTimer.disconnect();
 }
 
 void FilterGraphEditor::Refresh()
 {
 	m_editor.Refresh();
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Profiling
+
+void FilterGraphEditor::OnProfileToggled()
+{
+	bool show = m_profileButton.get_active();
+	m_editor.SetShowProfile(show);
+
+	//Redraw periodically so the heat map keeps up with the data
+	m_profileTimer.disconnect();
+	if(show)
+		m_profileTimer = Glib::signal_timeout().connect(sigc::mem_fun(*this, &FilterGraphEditor::OnProfileTick), 250);
+}
+
+bool FilterGraphEditor::OnProfileTick()
+{
+	if(is_visible())
+		m_editor.queue_draw();
+	return true;
+}
+
+void FilterGraphEditor::OnResetProfileClicked()
+{
+	m_parent->GetFilterGraph().ResetProfiles();
+	m_editor.queue_draw();
+}
+
+void FilterGraphEditor::OnExportProfileClicked()
+{
+	//Prompt for the file
+	Gtk::FileChooserDialog dlg(*this, "Export Filter Profile", Gtk::FILE_CHOOSER_ACTION_SAVE);
+	auto filter = Gtk::FileFilter::create();
+	filter->add_pattern("*.csv");
+	filter->set_name("CSV files (*.csv)");
+	dlg.add_filter(filter);
+	dlg.add_button("Save", Gtk::RESPONSE_OK);
+	dlg.add_button("Cancel", Gtk::RESPONSE_CANCEL);
+	dlg.set_do_overwrite_confirmation();
+	auto response = dlg.run();
+	if(response != Gtk::RESPONSE_OK)
+		return;
+
+	auto fname = dlg.get_filename();
+	if(!m_parent->GetFilterGraph().WriteProfileReport(fname))
+	{
+		string msg = string("Output file ") + fname + " cannot be opened";
+		Gtk::MessageDialog errdlg(msg, false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK, true);
+		errdlg.set_title("Cannot export filter profile");
+		errdlg.run();
+	}
+}
@@ -55,8 +55,20 @@ public:
 protected:
 	OscilloscopeWindow* m_parent;
 
-	Gtk::ScrolledWindow m_scroller;
-		FilterGraphEditorWidget m_editor;
+	Gtk::VBox m_vbox;
+		Gtk::ScrolledWindow m_scroller;
+			FilterGraphEditorWidget m_editor;
+		Gtk::HBox m_buttonBox;
+			Gtk::CheckButton m_profileButton;
+			Gtk::Button m_resetProfileButton;
+			Gtk::Button m_exportProfileButton;
+
+	sigc::connection m_profileTimer;
+
+	void OnProfileToggled();
+	void OnResetProfileClicked();
+	void OnExportProfileClicked();
+	bool OnProfileTick();
 };
 
 #endif
@@ -331,6 +331,23 @@ void FilterGraphEditorNode::Render(const Cairo::RefPtr<Cairo::Context>& cr)
 	if(this == m_parent->GetSelectedNode() )
 		outline_color = line_highlight_color;
 
+	//Color the background by run time, relative to the slowest filter in the graph
+	if(m_parent->GetShowProfile() && (m_parent->GetMaxProfileTime() > 0) )
+	{
+		auto profile = m_parent->GetProfile(m_node);
+		if(profile && (profile->m_times.GetCount() > 0) )
+		{
+			auto cold_color = m_parent->GetPreferences().GetColor("Appearance.Filter Graph.profile_cold_color");
+			auto hot_color = m_parent->GetPreferences().GetColor("Appearance.Filter Graph.profile_hot_color");
+
+			double frac = min(1.0, profile->m_times.GetMean() / m_parent->GetMaxProfileTime());
+			fill_color.set_rgb_p(
+				cold_color.get_red_p() + (hot_color.get_red_p() - cold_color.get_red_p()) * frac,
+				cold_color.get_green_p() + (hot_color.get_green_p() - cold_color.get_green_p()) * frac,
+				cold_color.get_blue_p() + (hot_color.get_blue_p() - cold_color.get_blue_p()) * frac);
+		}
+	}
+
 	//This is a bit messy... but there's no other good way to figure out what type of input a port wants!
 	OscilloscopeChannel dummy_analog(NULL, "", OscilloscopeChannel::CHANNEL_TYPE_ANALOG, "");
 	OscilloscopeChannel dummy_digital(NULL, "", OscilloscopeChannel::CHANNEL_TYPE_DIGITAL, "");
@@ -509,6 +526,8 @@ FilterGraphEditorWidget::FilterGraphEditorWidget(FilterGraphEditor* parent)
 	, m_selectedNode(NULL)
 	, m_dragDeltaY(0)
 	, m_sourcePort(0)
+	, m_showProfile(false)
+	, m_maxProfileTime(0)
 {
 	add_events(Gdk::BUTTON_PRESS_MASK | Gdk::BUTTON_RELEASE_MASK | Gdk::POINTER_MOTION_MASK);
 
@@ -543,6 +562,27 @@ PreferenceManager& FilterGraphEditorWidget::GetPreferences()
 	return m_parent->GetParent()->GetPreferences();
 }
 
+/**
+	@brief Gets the profiling data for a node, or NULL if it's not a filter or hasn't been evaluated yet
+ */
+shared_ptr<FilterProfile> FilterGraphEditorWidget::GetProfile(FlowGraphNode* node)
+{
+	auto f = dynamic_cast<Filter*>(node);
+	if(!f)
+		return NULL;
+	return m_parent->GetParent()->GetGraphExecutor().GetProfile(f);
+}
+
+/**
+	@brief Turns the profiling overlay (heat map coloring and per-node tooltips) on or off
+ */
+void FilterGraphEditorWidget::SetShowProfile(bool show)
+{
+	m_showProfile = show;
+	set_has_tooltip(show);
+	queue_draw();
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Top level updating
 
@@ -576,7 +616,7 @@ void FilterGraphEditorWidget::RemoveStaleNodes()
 		channelsToRemove.emplace(it.first);
 
 	//Keep all filters
-	auto filters = Filter::GetAllInstances();
+	auto filters = g_filterRegistry.GetSessionFilters();
 	for(auto f : filters)
 		channelsToRemove.erase(f);
 
@@ -607,7 +647,7 @@ void FilterGraphEditorWidget::RemoveStaleNodes()
 void FilterGraphEditorWidget::CreateNodes()
 {
 	//Add all filters
-	auto filters = Filter::GetAllInstances();
+	auto filters = g_filterRegistry.GetSessionFilters();
 	for(auto f : filters)
 	{
 		if(m_nodes.find(f) == m_nodes.end())
@@ -1172,6 +1212,18 @@ bool FilterGraphEditorWidget::on_draw(const Cairo::RefPtr<Cairo::Context>& cr)
 	cr->line_to(0, h);
 	cr->fill();
 
+	//Scale the profiling heat map to the slowest filter
+	m_maxProfileTime = 0;
+	if(m_showProfile)
+	{
+		for(auto it : m_nodes)
+		{
+			auto profile = GetProfile(it.first);
+			if(profile && (profile->m_times.GetCount() > 0) )
+				m_maxProfileTime = max(m_maxProfileTime, profile->m_times.GetMean());
+		}
+	}
+
 	//Draw each node
 	for(auto it : m_nodes)
 		it.second->Render(cr);
@@ -1285,6 +1337,7 @@ void FilterGraphEditorWidget::OnLeftClick(GdkEventButton* event)
 						if(f->IsUsingDefaultName())
 							f->UseDefaultName(true);
 
+						m_parent->GetParent()->GetFilterGraph().OnFilterChanged(f);
 						m_parent->GetParent()->RefreshAllFilters();
 						m_parent->GetParent()->RefreshAllViews();
 					}
@@ -1421,6 +1474,42 @@ bool FilterGraphEditorWidget::on_motion_notify_event(GdkEventMotion* event)
 	return true;
 }
 
+bool FilterGraphEditorWidget::on_query_tooltip(
+	int x,
+	int y,
+	bool keyboard_tooltip,
+	const Glib::RefPtr<Gtk::Tooltip>& tooltip)
+{
+	if(!m_showProfile || keyboard_tooltip)
+		return false;
+
+	auto node = HitTestNode(x, y);
+	if(!node)
+		return false;
+	auto profile = GetProfile(node->m_node);
+	if(!profile || (profile->m_times.GetCount() == 0) )
+		return false;
+
+	Unit fs(Unit::UNIT_FS);
+	auto& h = profile->m_times;
+	char tmp[128];
+	string text;
+	text += string("Last: ") + fs.PrettyPrint(profile->m_lastTime * FS_PER_SECOND) + "\n";
+	text += string("Average: ") + fs.PrettyPrint(h.GetMean() * FS_PER_SECOND) + "\n";
+	text += string("p99: ") + fs.PrettyPrint(h.GetPercentile(99) * FS_PER_SECOND) + "\n";
+	snprintf(tmp, sizeof(tmp), "Evaluations: %lu\n", static_cast<unsigned long>(h.GetCount()));
+	text += tmp;
+	snprintf(tmp, sizeof(tmp), "Output: %zu samples, %.2f MB\n",
+		(size_t)profile->m_outputSamples,
+		profile->m_outputBytes / (1024.0 * 1024.0));
+	text += tmp;
+	snprintf(tmp, sizeof(tmp), "Allocated: %.2f MB", profile->m_allocBytes / (1024.0 * 1024.0));
+	text += tmp;
+
+	tooltip->set_text(text);
+	return true;
+}
+
 void FilterGraphEditorWidget::OnDoubleClick(GdkEventButton* event)
 {
 	//See what we hit
@@ -141,6 +141,17 @@ public:
 
 	PreferenceManager& GetPreferences();
 
+	std::shared_ptr<FilterProfile> GetProfile(FlowGraphNode* node);
+
+	void SetShowProfile(bool show);
+
+	bool GetShowProfile()
+	{ return m_showProfile; }
+
+	///@brief Mean run time of the slowest filter in the graph, as of the last redraw
+	double GetMaxProfileTime()
+	{ return m_maxProfileTime; }
+
 	void OnNodeDeleted(FilterGraphEditorNode* node);
 
 	//Drag mode
@@ -168,6 +179,7 @@ protected:
 	void OnRightClick(GdkEventButton* event);
 	virtual bool on_button_release_event(GdkEventButton* event);
 	virtual bool on_motion_notify_event(GdkEventMotion* event);
+	virtual bool on_query_tooltip(int x, int y, bool keyboard_tooltip, const Glib::RefPtr<Gtk::Tooltip>& tooltip);
 	void OnDoubleClick(GdkEventButton* event);
 	bool OnFilterPropertiesDialogClosed(GdkEventAny* ignored);
 	void OnChannelPropertiesDialogResponse(int response);
@@ -222,6 +234,10 @@ protected:
 
 	//Current mouse position
 	vec2f m_mousePosition;
+
+	//Profiling overlay
+	bool m_showProfile;
+	double m_maxProfileTime;
 };
 
 #endif
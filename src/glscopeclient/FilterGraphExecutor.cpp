@@ -0,0 +1,1078 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of FilterGraphExecutor
+ */
+#include "../scopehal/scopehal.h"
+#include "../scopehal/Filter.h"
+#include "DensePack.h"
+#include "FilterGraphExecutor.h"
+#include "FilterRegistry.h"
+#include "ThreadBudget.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+FilterGraphExecutor::FilterGraphExecutor()
+	: m_scheduleValid(false)
+	, m_scheduleBuildCount(0)
+	, m_registryGeneration(0)
+	, m_allDirty(false)
+	, m_lastEvaluatedCount(0)
+	, m_lastCachedCount(0)
+	, m_lastSkippedCount(0)
+	, m_onDemand(false)
+	, m_tileSize(0)
+	, m_tileMinDepth(0)
+	, m_tileOverlap(0)
+	, m_lastTiledCount(0)
+	, m_nextGeneration(1)
+	, m_memoizing(false)
+	, m_clearAnalysisCache(true)
+	, m_threadCount(g_threadBudget.GetThreadCount(ThreadBudget::ROLE_FILTER))
+	, m_queuedCount(0)
+	, m_terminating(false)
+	, m_remaining(0)
+{
+}
+
+FilterGraphExecutor::~FilterGraphExecutor()
+{
+	StopThreads();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Thread pool
+
+/**
+	@brief Sets the number of worker threads used to evaluate filters
+ */
+void FilterGraphExecutor::SetThreadCount(size_t threads)
+{
+	threads = max(threads, (size_t)1);
+	if(threads == m_threadCount)
+		return;
+
+	//Workers are restarted lazily on the next refresh
+	StopThreads();
+	m_threadCount = threads;
+}
+
+void FilterGraphExecutor::StartThreads()
+{
+	if(!m_threads.empty())
+		return;
+
+	m_terminating = false;
+	m_queuedCount = 0;
+	for(size_t i=0; i<m_threadCount; i++)
+		m_queues.push_back(unique_ptr<WorkQueue>(new WorkQueue));
+	for(size_t i=0; i<m_threadCount; i++)
+		m_threads.push_back(thread(&FilterGraphExecutor::WorkerThread, this, i));
+}
+
+void FilterGraphExecutor::StopThreads()
+{
+	{
+		lock_guard<mutex> lock(m_workMutex);
+		m_terminating = true;
+	}
+	m_workCond.notify_all();
+
+	for(auto& t : m_threads)
+		t.join();
+	m_threads.clear();
+	m_queues.clear();
+}
+
+/**
+	@brief Adds a runnable filter to a worker's queue
+ */
+void FilterGraphExecutor::Push(size_t worker, size_t node)
+{
+	{
+		auto& q = *m_queues[worker];
+		lock_guard<mutex> lock(q.m_mutex);
+		q.m_heap.push_back(pair<double, size_t>(m_priorities[node], node));
+		push_heap(q.m_heap.begin(), q.m_heap.end());
+	}
+
+	{
+		lock_guard<mutex> lock(m_workMutex);
+		m_queuedCount ++;
+	}
+	m_workCond.notify_one();
+}
+
+/**
+	@brief Takes the most critical filter from a worker's own queue, or steals one from another worker if it's empty.
+
+	Must only be called after claiming a filter from m_queuedCount, so there's guaranteed to be one somewhere.
+ */
+size_t FilterGraphExecutor::Pop(size_t worker)
+{
+	while(true)
+	{
+		for(size_t i=0; i<m_threadCount; i++)
+		{
+			auto& q = *m_queues[(worker + i) % m_threadCount];
+			lock_guard<mutex> lock(q.m_mutex);
+			if(q.m_heap.empty())
+				continue;
+
+			pop_heap(q.m_heap.begin(), q.m_heap.end());
+			size_t node = q.m_heap.back().second;
+			q.m_heap.pop_back();
+			return node;
+		}
+
+		//Whoever queued the filter we claimed hasn't finished pushing it yet
+		this_thread::yield();
+	}
+}
+
+void FilterGraphExecutor::WorkerThread(size_t id)
+{
+	pthread_setname_np_compat("FilterWorker");
+
+	while(true)
+	{
+		//Wait for something to do, and claim it
+		{
+			unique_lock<mutex> lock(m_workMutex);
+			m_workCond.wait(lock, [&]{ return m_terminating || (m_queuedCount > 0); });
+			if(m_terminating)
+				return;
+			m_queuedCount --;
+		}
+
+		//Stay on the filtering cores (picking up any change to them since last time).
+		//Filters run on several workers at once, so don't let each one spawn a full OpenMP team of its own.
+		//This is the same as when filters were refreshed from inside a parallel loop.
+		g_threadBudget.BindThread(ThreadBudget::ROLE_FILTER, 1);
+
+		//Evaluate it
+		size_t node = Pop(id);
+		Evaluate(node);
+
+		//Anything waiting on only this filter can run now.
+		//Keep it on this worker, since its input data is probably still in our cache.
+		for(auto c : m_consumers[node])
+		{
+			if(m_dirty[c] && (--m_pendingInputs[c] == 0) )
+				Push(id, c);
+		}
+
+		if(--m_remaining == 0)
+		{
+			lock_guard<mutex> lock(m_doneMutex);
+			m_doneCond.notify_all();
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Evaluation
+
+/**
+	@brief Re-evaluates every filter in the set whose output may have changed since the last refresh, blocking until done.
+
+	The caller is responsible for making sure the inputs of every filter don't change during the refresh.
+
+	@param filters	The filters to evaluate
+	@param memoize	If true, reuse filter outputs from the output cache where possible, and cache anything evaluated.
+					Worth doing when the same input waveforms are likely to come around again, like when browsing
+					history, but just churns the cache for live data.
+ */
+void FilterGraphExecutor::RunBlocking(const set<Filter*>& filters, bool memoize)
+{
+	GetSchedule(filters);
+	size_t ndirty = FindDirtyFilters();
+	ndirty -= SkipUnusedFilters();
+
+	//Pull anything we've already computed for the current inputs out of the cache.
+	//These are done in dependency order so the key of everything upstream is up to date.
+	m_memoizing = memoize && m_outputCache.IsEnabled();
+	m_lastCachedCount = 0;
+	if(m_memoizing && (ndirty > 0) )
+	{
+		UpdateKeys();
+		for(auto i : m_order)
+		{
+			if(m_dirty[i] && m_outputCache.Lookup(m_scheduledFilters[i], m_keys[i]))
+			{
+				m_dirty[i] = false;
+				m_lastCachedCount ++;
+				ndirty --;
+			}
+		}
+	}
+
+	m_lastEvaluatedCount = ndirty;
+	m_lastTiledCount = 0;
+	if(ndirty == 0)
+		return;
+
+	if(m_clearAnalysisCache)
+		Filter::ClearAnalysisCache();
+
+	//Deep waveforms through tileable filters go first, since they only read from outside the graph
+	ndirty -= RunTiled();
+
+	size_t nfilters = m_scheduledFilters.size();
+	for(size_t i=0; i<nfilters; i++)
+	{
+		if(m_dirty[i])
+			m_scheduledFilters[i]->SetDirty();
+	}
+
+	size_t nsched = ndirty;
+	for(auto i : m_cyclic)
+	{
+		if(m_dirty[i])
+			nsched --;
+	}
+	if(nsched > 0)
+	{
+		UpdatePriorities();
+		StartThreads();
+
+		//Each dirty filter has to wait for its dirty inputs. Clean inputs already have their final output.
+		//(Consumers of a dirty filter are usually dirty too, but not if they were served from the cache or skipped.)
+		for(size_t i=0; i<nfilters; i++)
+			m_pendingInputs[i] = 0;
+		for(size_t i=0; i<nfilters; i++)
+		{
+			if(!m_dirty[i])
+				continue;
+			for(auto c : m_consumers[i])
+			{
+				if(m_dirty[c])
+					m_pendingInputs[c] ++;
+			}
+		}
+		m_remaining = nsched;
+
+		//Deal out the filters that are ready to go, most critical first
+		vector<pair<double, size_t> > roots;
+		for(auto i : m_order)
+		{
+			if(m_dirty[i] && (m_pendingInputs[i] == 0) )
+				roots.push_back(pair<double, size_t>(m_priorities[i], i));
+		}
+		sort(roots.rbegin(), roots.rend());
+		for(size_t i=0; i<roots.size(); i++)
+			Push(i % m_threadCount, roots[i].second);
+
+		unique_lock<mutex> lock(m_doneMutex);
+		m_doneCond.wait(lock, [&]{ return m_remaining == 0; });
+	}
+
+	//Anything in a cycle gets whatever its inputs happen to have
+	for(auto i : m_cyclic)
+	{
+		if(m_dirty[i])
+			Evaluate(i);
+	}
+}
+
+/**
+	@brief Gets the size of a waveform's sample buffers
+
+	Protocol waveforms have samples of arbitrary type, so only their timestamps are counted.
+
+	@param wfm			The waveform
+	@param used			Number of bytes of sample data actually in use
+	@param allocated	Number of bytes of memory allocated for the sample buffers
+ */
+void FilterGraphExecutor::GetBufferSize(WaveformBase* wfm, size_t& used, size_t& allocated)
+{
+	used = sizeof(int64_t) * (wfm->m_offsets.size() + wfm->m_durations.size());
+	allocated = sizeof(int64_t) * (wfm->m_offsets.capacity() + wfm->m_durations.capacity());
+
+	auto acap = dynamic_cast<AnalogWaveform*>(wfm);
+	if(acap != NULL)
+	{
+		used += sizeof(float) * acap->m_samples.size();
+		allocated += sizeof(float) * acap->m_samples.capacity();
+	}
+
+	auto dcap = dynamic_cast<DigitalWaveform*>(wfm);
+	if(dcap != NULL)
+	{
+		used += sizeof(bool) * dcap->m_samples.size();
+		allocated += sizeof(bool) * dcap->m_samples.capacity();
+	}
+}
+
+/**
+	@brief Evaluates a single filter, and updates its profiling data
+ */
+void FilterGraphExecutor::Evaluate(size_t node)
+{
+	auto f = m_scheduledFilters[node];
+	auto& profile = *m_profiles[node];
+
+	//If the current outputs are cached, make the filter allocate new ones rather than overwriting them.
+	//Cycles have no well defined key, so never cache them.
+	bool memoize = m_memoizing && (m_keys[node] != 0);
+	if(memoize)
+		m_outputCache.Release(f);
+	else if(m_outputCache.IsEnabled())
+		m_outputCache.Forget(f);
+
+	//Note what the output buffers looked like going in, so we can tell how much the filter allocated
+	size_t nstreams = f->GetStreamCount();
+	vector<pair<WaveformBase*, size_t> > before(nstreams, pair<WaveformBase*, size_t>(NULL, 0));
+	for(size_t i=0; i<nstreams; i++)
+	{
+		auto data = f->GetData(i);
+		if(data == NULL)
+			continue;
+
+		size_t used;
+		before[i].first = data;
+		GetBufferSize(data, used, before[i].second);
+	}
+
+	//Outputs we flagged as dense last time go back to how the filter left them, in case it reuses them for sparse data
+	auto& autoDense = m_autoDense[node];
+	autoDense.resize(nstreams, NULL);
+	for(size_t i=0; i<nstreams; i++)
+	{
+		if( (autoDense[i] != NULL) && (autoDense[i] == before[i].first) )
+			autoDense[i]->m_densePacked = false;
+		autoDense[i] = NULL;
+	}
+
+	auto start = chrono::steady_clock::now();
+	f->RefreshIfDirty();
+	double dt = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	m_runtimes[node] = dt;
+
+	//Let renderers and downstream filters take the dense path, even if the filter didn't say it could
+	for(size_t i=0; i<nstreams; i++)
+	{
+		auto data = f->GetData(i);
+		if( (data != NULL) && DetectDensePacked(data) )
+			autoDense[i] = data;
+	}
+
+	//A buffer we haven't seen before was allocated from scratch, otherwise count only how much it grew.
+	//(Waveforms recycled through the pool count as fresh allocations too, which slightly overestimates.)
+	size_t samples = 0;
+	size_t bytes = 0;
+	size_t alloc = 0;
+	size_t total = 0;
+	for(size_t i=0; i<nstreams; i++)
+	{
+		auto data = f->GetData(i);
+		if(data == NULL)
+			continue;
+
+		size_t used;
+		size_t allocated;
+		GetBufferSize(data, used, allocated);
+		samples += data->m_offsets.size();
+		bytes += used;
+		total += allocated;
+
+		if(data != before[i].first)
+			alloc += allocated;
+		else if(allocated > before[i].second)
+			alloc += allocated - before[i].second;
+	}
+
+	profile.m_times.Record(dt);
+	profile.m_lastTime = dt;
+	profile.m_outputSamples = samples;
+	profile.m_outputBytes = bytes;
+	profile.m_allocBytes = alloc;
+	profile.m_totalAllocBytes += alloc;
+
+	if(memoize)
+		m_outputCache.Store(f, m_keys[node], total);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Profiling
+
+/**
+	@brief Gets the profiling data for a filter, or NULL if it hasn't been part of a refresh yet
+ */
+shared_ptr<FilterProfile> FilterGraphExecutor::GetProfile(Filter* f)
+{
+	lock_guard<mutex> lock(m_profileMutex);
+	auto it = m_profileMap.find(f);
+	if(it == m_profileMap.end())
+		return NULL;
+	return it->second;
+}
+
+/**
+	@brief Discards all profiling data collected so far
+ */
+void FilterGraphExecutor::ResetProfiles()
+{
+	lock_guard<mutex> lock(m_profileMutex);
+	for(auto it : m_profileMap)
+	{
+		auto& profile = *it.second;
+		profile.m_times.Reset();
+		profile.m_lastTime = 0;
+		profile.m_outputSamples = 0;
+		profile.m_outputBytes = 0;
+		profile.m_allocBytes = 0;
+		profile.m_totalAllocBytes = 0;
+	}
+}
+
+/**
+	@brief Writes the profiling data for a set of filters to a CSV file
+
+	The caller is responsible for making sure none of the filters are deleted while the report is being written.
+
+	@return True on success, false if the file couldn't be opened
+ */
+bool FilterGraphExecutor::WriteProfileReport(const string& path, const set<Filter*>& filters)
+{
+	FILE* fp = fopen(path.c_str(), "w");
+	if(!fp)
+		return false;
+
+	fprintf(fp, "filter,protocol,count,last_us,mean_us,p50_us,p99_us,max_us,"
+		"output_samples,output_bytes,alloc_bytes,total_alloc_bytes\n");
+	for(auto f : filters)
+	{
+		auto profile = GetProfile(f);
+		if(!profile)
+			continue;
+
+		auto& h = profile->m_times;
+		fprintf(fp, "\"%s\",\"%s\",%lu,%.3f,%.3f,%.3f,%.3f,%.3f,%zu,%zu,%zu,%zu\n",
+			f->GetDisplayName().c_str(),
+			f->GetProtocolDisplayName().c_str(),
+			static_cast<unsigned long>(h.GetCount()),
+			profile->m_lastTime * 1e6,
+			h.GetMean() * 1e6,
+			h.GetPercentile(50) * 1e6,
+			h.GetPercentile(99) * 1e6,
+			h.GetMax() * 1e6,
+			(size_t)profile->m_outputSamples,
+			(size_t)profile->m_outputBytes,
+			(size_t)profile->m_allocBytes,
+			(size_t)profile->m_totalAllocBytes);
+	}
+
+	fclose(fp);
+	return true;
+}
+
+/**
+	@brief Sets the nodes whose outputs are actually used, so anything not feeding one of them can be skipped.
+
+	Takes effect on the next refresh. Nodes which aren't filters (scope channels) are ignored.
+ */
+void FilterGraphExecutor::SetSinks(const set<FlowGraphNode*>& sinks)
+{
+	lock_guard<mutex> lock(m_sinkMutex);
+	m_sinks = sinks;
+	m_onDemand = true;
+}
+
+/**
+	@brief Goes back to evaluating every filter, whether anything uses its output or not
+ */
+void FilterGraphExecutor::ClearSinks()
+{
+	lock_guard<mutex> lock(m_sinkMutex);
+	m_sinks.clear();
+	m_onDemand = false;
+}
+
+/**
+	@brief Forces a filter, and everything downstream of it, to be re-evaluated on the next refresh.
+
+	Input reconnections and stream count changes are picked up automatically, but nothing else is: whoever changes a
+	filter's parameters, clears its accumulated sweeps, etc. has to call this, with the waveform data lock held so
+	it can't race a refresh in progress.
+ */
+void FilterGraphExecutor::MarkDirty(Filter* f)
+{
+	lock_guard<mutex> lock(m_dirtyMutex);
+	m_markedDirty.emplace(f);
+}
+
+/**
+	@brief Forces every filter to be re-evaluated on the next refresh
+ */
+void FilterGraphExecutor::MarkAllDirty()
+{
+	lock_guard<mutex> lock(m_dirtyMutex);
+	m_allDirty = true;
+}
+
+/**
+	@brief Figures out which filters need to be re-evaluated during this refresh
+
+	@return Number of dirty filters
+ */
+size_t FilterGraphExecutor::FindDirtyFilters()
+{
+	size_t nfilters = m_scheduledFilters.size();
+	m_dirty.assign(nfilters, false);
+
+	//Anything marked by hand.
+	//Whatever we have cached for these filters was computed with the old settings, so throw it out.
+	{
+		lock_guard<mutex> lock(m_dirtyMutex);
+		if(m_allDirty || !m_markedDirty.empty())
+		{
+			for(size_t i=0; i<nfilters; i++)
+			{
+				auto f = m_scheduledFilters[i];
+				if(m_allDirty || (m_markedDirty.find(f) != m_markedDirty.end()) )
+				{
+					m_dirty[i] = true;
+					m_generations[i] = m_nextGeneration ++;
+					m_outputCache.Remove(f);
+				}
+			}
+		}
+		m_allDirty = false;
+		m_markedDirty.clear();
+	}
+
+	//Anything with a new waveform coming in from outside the graph
+	size_t k = 0;
+	for(size_t i=0; i<nfilters; i++)
+	{
+		for(size_t j=0; j<m_scheduledPorts[i].first; j++, k++)
+		{
+			if(m_inputProducers[k] != SIZE_MAX)
+				continue;
+
+			auto& in = m_scheduledInputs[k];
+			InputVersion version(in.m_channel ? in.m_channel->GetData(in.m_stream) : NULL);
+			if(version != m_inputVersions[k])
+			{
+				m_inputVersions[k] = version;
+				m_dirty[i] = true;
+			}
+		}
+	}
+
+	//Anything we didn't get around to last time because nothing was using it
+	if(!m_skipped.empty())
+	{
+		for(size_t i=0; i<nfilters; i++)
+		{
+			if(m_skipped.find(m_scheduledFilters[i]) != m_skipped.end())
+				m_dirty[i] = true;
+		}
+		m_skipped.clear();
+	}
+
+	//Anything whose output was thrown away after tiling, which something is now looking at
+	if(!m_tileDropped.empty())
+	{
+		lock_guard<mutex> lock(m_sinkMutex);
+		for(size_t i=0; i<nfilters; i++)
+		{
+			auto f = m_scheduledFilters[i];
+			if(m_tileDropped.find(f) == m_tileDropped.end())
+				continue;
+			if(!m_onDemand || (m_sinks.find(f) != m_sinks.end()) )
+			{
+				m_dirty[i] = true;
+				m_tileDropped.erase(f);
+			}
+		}
+	}
+
+	//Cycles have no well defined order, so always re-evaluate them
+	for(auto i : m_cyclic)
+		m_dirty[i] = true;
+
+	//Everything downstream of a dirty filter is dirty too
+	for(auto i : m_order)
+	{
+		if(!m_dirty[i])
+			continue;
+		for(auto c : m_consumers[i])
+			m_dirty[c] = true;
+	}
+
+	size_t ndirty = 0;
+	for(size_t i=0; i<nfilters; i++)
+	{
+		if(m_dirty[i])
+			ndirty ++;
+	}
+	return ndirty;
+}
+
+/**
+	@brief Un-dirties every filter which doesn't feed, directly or indirectly, one of the sinks.
+
+	They're remembered, and treated as dirty again next time, so they catch up as soon as something consumes them.
+
+	@return Number of filters skipped
+ */
+size_t FilterGraphExecutor::SkipUnusedFilters()
+{
+	m_lastSkippedCount = 0;
+
+	lock_guard<mutex> lock(m_sinkMutex);
+	if(!m_onDemand)
+		return 0;
+
+	//Walk upstream from every sink. Anything a needed filter reads from is needed too.
+	size_t nfilters = m_scheduledFilters.size();
+	vector<bool> needed(nfilters, false);
+	vector<size_t> pending;
+	for(size_t i=0; i<nfilters; i++)
+	{
+		if(m_sinks.find(m_scheduledFilters[i]) != m_sinks.end())
+		{
+			needed[i] = true;
+			pending.push_back(i);
+		}
+	}
+	while(!pending.empty())
+	{
+		size_t i = pending.back();
+		pending.pop_back();
+
+		size_t base = m_inputBases[i];
+		for(size_t j=0; j<m_scheduledPorts[i].first; j++)
+		{
+			auto producer = m_inputProducers[base + j];
+			if( (producer != SIZE_MAX) && !needed[producer])
+			{
+				needed[producer] = true;
+				pending.push_back(producer);
+			}
+		}
+	}
+
+	for(size_t i=0; i<nfilters; i++)
+	{
+		if(m_dirty[i] && !needed[i])
+		{
+			m_dirty[i] = false;
+			m_skipped.emplace(m_scheduledFilters[i]);
+			m_lastSkippedCount ++;
+		}
+	}
+	return m_lastSkippedCount;
+}
+
+/**
+	@brief Recalculates the output cache key of every filter.
+
+	The key covers the filter's own generation plus, for each input, either the timestamp and length of the waveform
+	on it (for inputs from outside the graph) or the key of the filter feeding it. So it changes if anything upstream
+	could have changed, but not if the same acquisition shows up again in a different waveform object.
+ */
+void FilterGraphExecutor::UpdateKeys()
+{
+	auto mix = [](uint64_t h, uint64_t v)
+	{
+		//Combine, then run the splitmix64 finalizer so small changes (a stream index, a timestamp) affect the whole key
+		h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+		h ^= h >> 30;
+		h *= 0xbf58476d1ce4e5b9ULL;
+		h ^= h >> 27;
+		h *= 0x94d049bb133111ebULL;
+		h ^= h >> 31;
+		return h;
+	};
+
+	//Cycles are left at zero, meaning "never cache"
+	m_keys.assign(m_scheduledFilters.size(), 0);
+	for(auto i : m_order)
+	{
+		uint64_t key = mix(0, m_generations[i]);
+		size_t base = m_inputBases[i];
+		for(size_t j=0; j<m_scheduledPorts[i].first; j++)
+		{
+			size_t k = base + j;
+			auto producer = m_inputProducers[k];
+			if(producer != SIZE_MAX)
+			{
+				key = mix(key, m_keys[producer]);
+				key = mix(key, m_scheduledInputs[k].m_stream);
+			}
+			else
+			{
+				//Not the pointer: waveform objects are recycled, and a history entry may be reloaded into a new one
+				auto& version = m_inputVersions[k];
+				key = mix(key, version.m_timestamp);
+				key = mix(key, version.m_femtoseconds);
+				key = mix(key, version.m_length);
+			}
+		}
+
+		//Make sure a real key is never zero
+		m_keys[i] = key | 1;
+	}
+}
+
+/**
+	@brief Recalculates the critical path through each filter, based on how long each one took last time
+ */
+void FilterGraphExecutor::UpdatePriorities()
+{
+	//Walk backwards so everything downstream of a filter is done before the filter itself.
+	//Never count a filter as free, so graphs we have no timing for yet are still ordered by depth.
+	for(auto it = m_order.rbegin(); it != m_order.rend(); it++)
+	{
+		size_t i = *it;
+		double downstream = 0;
+		for(auto c : m_consumers[i])
+			downstream = max(downstream, m_priorities[c]);
+		m_priorities[i] = max(m_runtimes[i], 1e-6) + downstream;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scheduling
+
+/**
+	@brief Gets the evaluation order for a set of filters, rebuilding it only if the graph has changed since last time
+
+	@return Blocks of filters. Every filter in a block only depends on filters in earlier blocks, so each block can be
+			evaluated in parallel.
+ */
+const vector<FilterGraphExecutor::FilterBlock>& FilterGraphExecutor::GetSchedule(const set<Filter*>& filters)
+{
+	if(!IsScheduleCurrent(filters))
+		BuildSchedule(filters);
+	return m_blocks;
+}
+
+/**
+	@brief Checks if the cached schedule was built from the same graph we have now.
+
+	Filter inputs are connected by libscopehal, not us, so rather than trying to hook every way the graph can change
+	we compare against a flat snapshot of it. This is a single linear pass over arrays with no allocations or lookups,
+	a tiny fraction of the cost of actually re-sorting.
+ */
+bool FilterGraphExecutor::IsScheduleCurrent(const set<Filter*>& filters)
+{
+	if(!m_scheduleValid)
+		return false;
+
+	//A filter created since last time may be at the same address as one we scheduled, but it's not the same filter
+	if(g_filterRegistry.GetGeneration() != m_registryGeneration)
+		return false;
+	if(filters.size() != m_scheduledFilters.size())
+		return false;
+
+	size_t i = 0;
+	size_t k = 0;
+	for(auto f : filters)
+	{
+		if(f != m_scheduledFilters[i])
+			return false;
+
+		size_t nin = f->GetInputCount();
+		if( (nin != m_scheduledPorts[i].first) || (f->GetStreamCount() != m_scheduledPorts[i].second) )
+			return false;
+
+		for(size_t j=0; j<nin; j++, k++)
+		{
+			auto in = f->GetInput(j);
+			if( (in.m_channel != m_scheduledInputs[k].m_channel) || (in.m_stream != m_scheduledInputs[k].m_stream) )
+				return false;
+		}
+
+		i++;
+	}
+
+	return true;
+}
+
+/**
+	@brief Topologically sorts filter nodes into blocks capable of parallel evaluation.
+
+	Block 0 may only depend on physical scope channels.
+	Block 1 may depend on decodes in block 0 or physical channels.
+	Block 2 may depend on 1/0/physical, etc.
+
+	Each filter goes in the block one past the latest of its inputs, found with a single pass in dependency order
+	(Kahn's algorithm), so this is linear in the size of the graph.
+ */
+void FilterGraphExecutor::BuildSchedule(const set<Filter*>& filters)
+{
+	m_scheduleBuildCount ++;
+
+	//Anything registered after this point forces another rebuild next time
+	m_registryGeneration = g_filterRegistry.GetGeneration();
+
+	//Remember how long each filter took, so a graph edit doesn't throw away all of our timing data.
+	//Also remember what each filter's inputs were, and what was on them, so we can tell which filters changed.
+	//All of this is by filter ID, since a new filter may have been created at the address of a deleted one.
+	unordered_map<uint64_t, double> runtimes;
+	unordered_map<uint64_t, uint64_t> generations;
+	unordered_map<uint64_t, vector<WaveformBase*> > autoDense;
+	unordered_map<uint64_t, shared_ptr<FilterProfile> > oldProfiles;
+	for(size_t i=0; i<m_runtimes.size(); i++)
+	{
+		auto id = m_scheduledIDs[i];
+		runtimes[id] = m_runtimes[i];
+		generations[id] = m_generations[i];
+		autoDense[id] = m_autoDense[i];
+		oldProfiles[id] = m_profiles[i];
+	}
+
+	unordered_map<uint64_t, pair<size_t, size_t> > oldPorts;
+	unordered_map<uint64_t, size_t> oldInputBase;
+	unordered_map<uint64_t, Filter*> oldFilters;
+	auto oldInputs = m_scheduledInputs;
+	auto oldVersions = m_inputVersions;
+	size_t base = 0;
+	for(size_t i=0; i<m_scheduledFilters.size(); i++)
+	{
+		auto id = m_scheduledIDs[i];
+		oldPorts[id] = m_scheduledPorts[i];
+		oldInputBase[id] = base;
+		oldFilters[id] = m_scheduledFilters[i];
+		base += m_scheduledPorts[i].first;
+	}
+
+	//Snapshot the graph so we can tell when it changes
+	m_scheduledFilters.assign(filters.begin(), filters.end());
+	m_scheduledIDs.clear();
+	m_scheduledPorts.clear();
+	m_scheduledInputs.clear();
+	for(auto f : m_scheduledFilters)
+	{
+		m_scheduledIDs.push_back(g_filterRegistry.GetID(f));
+		size_t nin = f->GetInputCount();
+		m_scheduledPorts.push_back(pair<size_t, size_t>(nin, f->GetStreamCount()));
+		for(size_t j=0; j<nin; j++)
+			m_scheduledInputs.push_back(f->GetInput(j));
+	}
+
+	//Index every filter
+	size_t nfilters = m_scheduledFilters.size();
+	unordered_map<FlowGraphNode*, size_t> indexes;
+	unordered_set<uint64_t> ids;
+	indexes.reserve(nfilters);
+	for(size_t i=0; i<nfilters; i++)
+	{
+		indexes[m_scheduledFilters[i]] = i;
+		ids.emplace(m_scheduledIDs[i]);
+	}
+
+	//Count how many inputs of each filter come from other filters in the set, and make the reverse edges.
+	//Anything else (scope channels, or filters not being evaluated) is treated as already up to date.
+	vector<size_t> pending(nfilters, 0);
+	m_consumers.assign(nfilters, vector<size_t>());
+	size_t k = 0;
+	for(size_t i=0; i<nfilters; i++)
+	{
+		for(size_t j=0; j<m_scheduledPorts[i].first; j++, k++)
+		{
+			auto it = indexes.find(m_scheduledInputs[k].m_channel);
+			if(it == indexes.end())
+				continue;
+
+			pending[i] ++;
+			m_consumers[it->second].push_back(i);
+		}
+	}
+	m_filterInputCounts = pending;
+
+	//Anything new or reconnected needs to be evaluated.
+	//Otherwise, carry over what we last saw on the inputs from outside the graph.
+	m_inputProducers.assign(m_scheduledInputs.size(), SIZE_MAX);
+	m_inputVersions.assign(m_scheduledInputs.size(), InputVersion());
+	m_inputBases.resize(nfilters);
+	m_generations.resize(nfilters);
+	k = 0;
+	for(size_t i=0; i<nfilters; i++)
+	{
+		auto f = m_scheduledFilters[i];
+		auto id = m_scheduledIDs[i];
+		size_t nin = m_scheduledPorts[i].first;
+		m_inputBases[i] = k;
+
+		auto git = generations.find(id);
+		if(git != generations.end())
+			m_generations[i] = git->second;
+		else
+			m_generations[i] = m_nextGeneration ++;
+
+		bool changed = true;
+		auto it = oldPorts.find(id);
+		if( (it != oldPorts.end()) && (it->second == m_scheduledPorts[i]) )
+		{
+			changed = false;
+			size_t obase = oldInputBase[id];
+			for(size_t j=0; j<nin; j++)
+			{
+				auto& a = oldInputs[obase + j];
+				auto& b = m_scheduledInputs[k + j];
+				if( (a.m_channel != b.m_channel) || (a.m_stream != b.m_stream) )
+					changed = true;
+			}
+			if(!changed)
+			{
+				for(size_t j=0; j<nin; j++)
+					m_inputVersions[k + j] = oldVersions[obase + j];
+			}
+		}
+		if(changed)
+			MarkDirty(f);
+
+		for(size_t j=0; j<nin; j++)
+		{
+			auto pit = indexes.find(m_scheduledInputs[k + j].m_channel);
+			if(pit != indexes.end())
+				m_inputProducers[k + j] = pit->second;
+		}
+		k += nin;
+	}
+
+	//Cached outputs of deleted filters are no use to anyone.
+	//(Including any at the address of a new filter, since they were computed by the old one.)
+	for(auto it : oldFilters)
+	{
+		if(ids.find(it.first) == ids.end())
+			m_outputCache.Remove(it.second);
+	}
+
+	//A filter whose output was dropped after tiling may have picked up a new consumer, so bring it back
+	for(auto f : m_tileDropped)
+	{
+		if(indexes.find(f) != indexes.end())
+			MarkDirty(f);
+	}
+	m_tileDropped.clear();
+
+	//Everything with no pending inputs goes in block 0, then peel off one level at a time
+	m_blocks.clear();
+	m_roots.clear();
+	m_order.clear();
+	FilterBlock current_block;
+	for(size_t i=0; i<nfilters; i++)
+	{
+		if(pending[i] == 0)
+		{
+			current_block.push_back(m_scheduledFilters[i]);
+			m_roots.push_back(i);
+		}
+	}
+
+	size_t nscheduled = 0;
+	while(!current_block.empty())
+	{
+		FilterBlock next_block;
+		for(auto f : current_block)
+		{
+			size_t i = indexes[f];
+			m_order.push_back(i);
+			for(auto c : m_consumers[i])
+			{
+				if(--pending[c] == 0)
+					next_block.push_back(m_scheduledFilters[c]);
+			}
+		}
+
+		nscheduled += current_block.size();
+		m_blocks.push_back(current_block);
+		current_block.swap(next_block);
+	}
+
+	//Anything left over is part of a cycle and can never be evaluated in order.
+	//Run it last rather than hanging.
+	m_cyclic.clear();
+	if(nscheduled != nfilters)
+	{
+		LogWarning("Filter graph contains a cycle, %zu filters will be evaluated out of order\n",
+			nfilters - nscheduled);
+
+		FilterBlock leftovers;
+		for(size_t i=0; i<nfilters; i++)
+		{
+			if(pending[i] != 0)
+			{
+				leftovers.push_back(m_scheduledFilters[i]);
+				m_cyclic.push_back(i);
+			}
+		}
+		m_blocks.push_back(leftovers);
+	}
+
+	//Set up per-refresh state
+	m_pendingInputs = unique_ptr<atomic<size_t>[]>(new atomic<size_t>[nfilters]);
+	m_priorities.assign(nfilters, 0);
+	m_runtimes.assign(nfilters, 0);
+	m_autoDense.assign(nfilters, vector<WaveformBase*>());
+	for(size_t i=0; i<nfilters; i++)
+	{
+		auto it = runtimes.find(m_scheduledIDs[i]);
+		if(it != runtimes.end())
+			m_runtimes[i] = it->second;
+
+		auto jt = autoDense.find(m_scheduledIDs[i]);
+		if(jt != autoDense.end())
+			m_autoDense[i] = jt->second;
+	}
+
+	//Profiling data for filters we already knew about carries over, new ones start from scratch
+	{
+		lock_guard<mutex> lock(m_profileMutex);
+		map<Filter*, shared_ptr<FilterProfile> > profiles;
+		m_profiles.resize(nfilters);
+		for(size_t i=0; i<nfilters; i++)
+		{
+			auto it = oldProfiles.find(m_scheduledIDs[i]);
+			if(it != oldProfiles.end())
+				m_profiles[i] = it->second;
+			else
+				m_profiles[i] = make_shared<FilterProfile>();
+			profiles[m_scheduledFilters[i]] = m_profiles[i];
+		}
+		m_profileMap = profiles;
+	}
+
+	m_scheduleValid = true;
+}
@@ -0,0 +1,371 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of FilterGraphExecutor
+ */
+#ifndef FilterGraphExecutor_h
+#define FilterGraphExecutor_h
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "LatencyHistogram.h"
+#include "FilterOutputCache.h"
+
+/**
+	@brief Run time and memory statistics for one filter, updated every time the executor evaluates it.
+
+	Written by the worker threads and read by the UI, so everything is atomic.
+ */
+class FilterProfile
+{
+public:
+	FilterProfile()
+	: m_lastTime(0)
+	, m_outputSamples(0)
+	, m_outputBytes(0)
+	, m_allocBytes(0)
+	, m_totalAllocBytes(0)
+	{}
+
+	///@brief Run time of every evaluation
+	LatencyHistogram m_times;
+
+	///@brief Run time of the most recent evaluation, in seconds
+	std::atomic<double> m_lastTime;
+
+	///@brief Total number of samples in all output streams after the most recent evaluation
+	std::atomic<size_t> m_outputSamples;
+
+	///@brief Total size of all output streams after the most recent evaluation
+	std::atomic<size_t> m_outputBytes;
+
+	///@brief Number of bytes of output buffer allocated by the most recent evaluation
+	std::atomic<size_t> m_allocBytes;
+
+	///@brief Number of bytes of output buffer allocated by every evaluation so far
+	std::atomic<size_t> m_totalAllocBytes;
+};
+
+/**
+	@brief Evaluates a set of filters in dependency order.
+
+	Filters are run on a pool of worker threads. Each filter becomes runnable the moment the last of its inputs has
+	finished, rather than waiting for a whole level of the graph, so one slow filter only holds up the filters that
+	actually depend on it. Runnable filters are taken longest-remaining-critical-path first (using how long each filter
+	took last time), and idle workers steal from busy ones.
+
+	Only filters whose output could have changed are re-evaluated: those with a new waveform on an input from outside
+	the graph (typically a scope channel), a changed input connection, or anything explicitly marked dirty (parameter
+	edits, cleared sweeps, etc).
+	Everything downstream of those is re-evaluated too, and the rest of the graph keeps its existing output.
+
+	Every evaluation is timed, and the size of the filter's output and how much memory it had to allocate recorded,
+	in a FilterProfile for that filter.
+
+	If a set of sinks (views, analyzers, etc.) has been provided, only filters feeding one of them are evaluated at
+	all. Anything else stays dirty until something starts consuming it.
+
+	Very deep waveforms can optionally be evaluated in tiles. Connected groups of filters whose protocols are known to
+	work on any slice of their input (element-wise math, thresholding, etc) are run over one tile of the input at a
+	time, and only the outputs something outside the group needs are stitched back together. Everything in between
+	only ever holds one tile, so memory use is bounded by the tile size rather than the capture length.
+
+	Optionally, filter outputs can be memoized in a FilterOutputCache, keyed by the waveforms feeding everything
+	upstream. Revisiting a set of input waveforms (say, flipping between history entries) then skips every filter
+	which has already been evaluated on them.
+
+	The topological sort is cached between refreshes, and only rebuilt when the graph has actually changed (a filter
+	was created or deleted, an input was reconnected, or a filter's stream count changed).
+
+	Has no GUI dependencies, so it can be shared by the main window and headless mode.
+ */
+class FilterGraphExecutor
+{
+public:
+	FilterGraphExecutor();
+	~FilterGraphExecutor();
+
+	typedef std::vector<Filter*> FilterBlock;
+
+	void RunBlocking(const std::set<Filter*>& filters, bool memoize = false);
+
+	void MarkDirty(Filter* f);
+	void MarkAllDirty();
+
+	///@brief Number of filters actually evaluated during the last refresh
+	size_t GetLastEvaluatedCount()
+	{ return m_lastEvaluatedCount; }
+
+	///@brief Number of filters whose output was pulled from the cache during the last refresh
+	size_t GetLastCachedCount()
+	{ return m_lastCachedCount; }
+
+	///@brief Number of filters which needed to be evaluated during the last refresh, but nothing was consuming them
+	size_t GetLastSkippedCount()
+	{ return m_lastSkippedCount; }
+
+	///@brief Number of filters evaluated one tile at a time during the last refresh
+	size_t GetLastTiledCount()
+	{ return m_lastTiledCount; }
+
+	void SetSinks(const std::set<FlowGraphNode*>& sinks);
+	void ClearSinks();
+
+	void SetTiling(size_t tileSize, size_t minDepth, size_t overlap);
+	void SetTileableProtocols(const std::set<std::string>& protocols);
+	bool IsTileable(Filter* f);
+
+	FilterOutputCache& GetOutputCache()
+	{ return m_outputCache; }
+
+	const std::vector<FilterBlock>& GetSchedule(const std::set<Filter*>& filters);
+
+	///@brief Forces the schedule to be rebuilt on the next refresh
+	void InvalidateSchedule()
+	{ m_scheduleValid = false; }
+
+	///@brief Number of times the schedule has been rebuilt
+	size_t GetScheduleBuildCount()
+	{ return m_scheduleBuildCount; }
+
+	void SetThreadCount(size_t threads);
+
+	size_t GetThreadCount()
+	{ return m_threadCount; }
+
+	/**
+		@brief Sets whether Filter::ClearAnalysisCache() is called before each refresh
+
+		The analysis cache is global. An executor running alongside the main one (e.g. on history that's never
+		modified while it's being evaluated) should leave it alone, which also turns tiling off since slices can be
+		recycled at the address of a previous tile.
+	 */
+	void SetClearAnalysisCache(bool clear)
+	{ m_clearAnalysisCache = clear; }
+
+	std::shared_ptr<FilterProfile> GetProfile(Filter* f);
+	void ResetProfiles();
+	bool WriteProfileReport(const std::string& path, const std::set<Filter*>& filters);
+
+protected:
+	bool IsScheduleCurrent(const std::set<Filter*>& filters);
+	void BuildSchedule(const std::set<Filter*>& filters);
+	void UpdatePriorities();
+	size_t FindDirtyFilters();
+	size_t SkipUnusedFilters();
+	void UpdateKeys();
+
+	size_t RunTiled();
+	void FindTileRegions(std::vector<std::vector<size_t> >& regions);
+	bool EvaluateRegion(const std::vector<size_t>& region, size_t tileSize, size_t overlap);
+	static WaveformBase* SliceWaveform(WaveformBase* wfm, int64_t start, int64_t end);
+	static bool AppendWaveform(WaveformBase* dst, WaveformBase* src, int64_t start, int64_t end);
+	static void ReserveWaveform(WaveformBase* wfm, size_t len);
+
+	void StartThreads();
+	void StopThreads();
+	void WorkerThread(size_t id);
+	void Push(size_t worker, size_t node);
+	size_t Pop(size_t worker);
+	void Evaluate(size_t node);
+	static void GetBufferSize(WaveformBase* wfm, size_t& used, size_t& allocated);
+
+	///@brief The cached schedule
+	std::vector<FilterBlock> m_blocks;
+	bool m_scheduleValid;
+	size_t m_scheduleBuildCount;
+
+	///@brief Every filter in the graph the schedule was built from, in set order
+	std::vector<Filter*> m_scheduledFilters;
+
+	///@brief FilterRegistry ID of each filter in m_scheduledFilters
+	std::vector<uint64_t> m_scheduledIDs;
+
+	///@brief FilterRegistry generation when the schedule was built
+	uint64_t m_registryGeneration;
+
+	///@brief Number of inputs and streams of each filter in m_scheduledFilters
+	std::vector<std::pair<size_t, size_t> > m_scheduledPorts;
+
+	///@brief Every input of every filter in m_scheduledFilters, in order
+	std::vector<StreamDescriptor> m_scheduledInputs;
+
+	/**
+		@brief Identifies the waveform on a filter input, so we can tell when a new one shows up
+
+		The pointer alone isn't enough since waveform objects get recycled.
+	 */
+	class InputVersion
+	{
+	public:
+		InputVersion(WaveformBase* data = NULL)
+			: m_data(data)
+			, m_timestamp(data ? data->m_startTimestamp : 0)
+			, m_femtoseconds(data ? data->m_startFemtoseconds : 0)
+			, m_length(data ? data->m_offsets.size() : 0)
+		{}
+
+		bool operator!=(const InputVersion& rhs) const
+		{
+			return (m_data != rhs.m_data) || (m_timestamp != rhs.m_timestamp) ||
+				(m_femtoseconds != rhs.m_femtoseconds) || (m_length != rhs.m_length);
+		}
+
+		WaveformBase* m_data;
+		time_t m_timestamp;
+		int64_t m_femtoseconds;
+		size_t m_length;
+	};
+
+	///@brief Last waveform seen on each input in m_scheduledInputs which comes from outside the graph
+	std::vector<InputVersion> m_inputVersions;
+
+	///@brief Index of the first input of each filter in m_scheduledInputs
+	std::vector<size_t> m_inputBases;
+
+	///@brief Index of the filter feeding each input in m_scheduledInputs, or SIZE_MAX if it's from outside the graph
+	std::vector<size_t> m_inputProducers;
+
+	///@brief Filters marked dirty since the last refresh
+	std::mutex m_dirtyMutex;
+	std::set<Filter*> m_markedDirty;
+	bool m_allDirty;
+
+	///@brief Filters which need to be evaluated during the current refresh
+	std::vector<bool> m_dirty;
+	size_t m_lastEvaluatedCount;
+	size_t m_lastCachedCount;
+	size_t m_lastSkippedCount;
+
+	///@brief Nodes whose output is actually used by something outside the graph, if we're evaluating on demand
+	std::mutex m_sinkMutex;
+	std::set<FlowGraphNode*> m_sinks;
+	bool m_onDemand;
+
+	///@brief Dirty filters which weren't evaluated last time because nothing needed them
+	std::set<Filter*> m_skipped;
+
+	///@brief Tiling configuration
+	std::mutex m_tilingMutex;
+	size_t m_tileSize;
+	size_t m_tileMinDepth;
+	size_t m_tileOverlap;
+	std::set<std::string> m_tileableProtocols;
+	size_t m_lastTiledCount;
+
+	///@brief Filters which were evaluated in tiles, but whose outputs were thrown away since nothing was using them
+	std::set<Filter*> m_tileDropped;
+
+	/**
+		@brief Changes whenever a filter's output may change for a reason other than its input waveforms.
+
+		(A parameter change, a reconnection, etc.) Never reused, even by a new filter at the same address.
+	 */
+	std::vector<uint64_t> m_generations;
+	uint64_t m_nextGeneration;
+
+	///@brief Identity of each filter's generation and everything upstream of it, used as the output cache key
+	std::vector<uint64_t> m_keys;
+
+	///@brief Memoized filter outputs
+	FilterOutputCache m_outputCache;
+	bool m_memoizing;
+
+	///@brief True to clear the global analysis cache before each refresh
+	bool m_clearAnalysisCache;
+
+	///@brief Indexes of the filters fed by each filter
+	std::vector<std::vector<size_t> > m_consumers;
+
+	///@brief Number of inputs of each filter which come from other filters in the graph
+	std::vector<size_t> m_filterInputCounts;
+
+	///@brief Filters with no inputs from other filters
+	std::vector<size_t> m_roots;
+
+	///@brief Every schedulable filter, in dependency order
+	std::vector<size_t> m_order;
+
+	///@brief Filters which are part of a dependency cycle, and have to be run by themselves at the end
+	std::vector<size_t> m_cyclic;
+
+	///@brief Run time of each filter last time it was evaluated, in seconds
+	std::vector<double> m_runtimes;
+
+	///@brief Outputs of each filter which we flagged as dense packed, rather than the filter itself
+	std::vector<std::vector<WaveformBase*> > m_autoDense;
+
+	///@brief Profiling data for each filter
+	std::vector<std::shared_ptr<FilterProfile> > m_profiles;
+
+	///@brief Profiling data for each filter, by filter, so the UI can look it up while the schedule is being rebuilt
+	std::mutex m_profileMutex;
+	std::map<Filter*, std::shared_ptr<FilterProfile> > m_profileMap;
+
+	///@brief Total run time of each filter plus the slowest chain of filters downstream of it
+	std::vector<double> m_priorities;
+
+	///@brief Number of inputs of each filter still waiting to be evaluated during this refresh
+	std::unique_ptr<std::atomic<size_t>[]> m_pendingInputs;
+
+	///@brief Runnable filters for one worker, as a max-heap of (priority, index)
+	class WorkQueue
+	{
+	public:
+		std::mutex m_mutex;
+		std::vector<std::pair<double, size_t> > m_heap;
+	};
+
+	size_t m_threadCount;
+	std::vector<std::thread> m_threads;
+	std::vector<std::unique_ptr<WorkQueue> > m_queues;
+
+	///@brief Number of filters in all of the work queues, not yet claimed by a worker
+	size_t m_queuedCount;
+	bool m_terminating;
+	std::mutex m_workMutex;
+	std::condition_variable m_workCond;
+
+	///@brief Number of filters not yet evaluated during this refresh
+	std::atomic<size_t> m_remaining;
+	std::mutex m_doneMutex;
+	std::condition_variable m_doneCond;
+};
+
+#endif
@@ -0,0 +1,586 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Tiled evaluation of deep waveforms for FilterGraphExecutor
+ */
+#include "../scopehal/scopehal.h"
+#include "../scopehal/Filter.h"
+#include "DensePack.h"
+#include "FilterGraphExecutor.h"
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Configuration
+
+/**
+	@brief Configures tiled evaluation
+
+	@param tileSize		Number of samples of the deepest input in each tile, or zero to disable tiling
+	@param minDepth		Only tile groups of filters whose deepest input has at least this many samples
+	@param overlap		Number of samples before the start of each tile to include as context, so filters which
+						look back (edge detection, hysteresis) start each tile in the right state
+ */
+void FilterGraphExecutor::SetTiling(size_t tileSize, size_t minDepth, size_t overlap)
+{
+	lock_guard<mutex> lock(m_tilingMutex);
+	m_tileSize = tileSize;
+	m_tileMinDepth = minDepth;
+	m_tileOverlap = overlap;
+}
+
+/**
+	@brief Sets the protocol names of filters which are safe to evaluate one slice of their input at a time
+ */
+void FilterGraphExecutor::SetTileableProtocols(const set<string>& protocols)
+{
+	lock_guard<mutex> lock(m_tilingMutex);
+	m_tileableProtocols = protocols;
+}
+
+bool FilterGraphExecutor::IsTileable(Filter* f)
+{
+	lock_guard<mutex> lock(m_tilingMutex);
+	return m_tileableProtocols.find(f->GetProtocolDisplayName()) != m_tileableProtocols.end();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Evaluation
+
+/**
+	@brief Evaluates every group of dirty tileable filters with deep enough inputs, one tile at a time
+
+	@return Number of filters evaluated
+ */
+size_t FilterGraphExecutor::RunTiled()
+{
+	size_t tileSize;
+	size_t minDepth;
+	size_t overlap;
+	{
+		lock_guard<mutex> lock(m_tilingMutex);
+		tileSize = m_tileSize;
+		minDepth = m_tileMinDepth;
+		overlap = m_tileOverlap;
+		if( (tileSize == 0) || m_tileableProtocols.empty() || !m_clearAnalysisCache)
+			return 0;
+	}
+
+	vector<vector<size_t> > regions;
+	FindTileRegions(regions);
+
+	for(auto& region : regions)
+	{
+		//Only worth it if the inputs are actually deep
+		size_t depth = 0;
+		for(auto i : region)
+		{
+			size_t base = m_inputBases[i];
+			for(size_t j=0; j<m_scheduledPorts[i].first; j++)
+			{
+				auto producer = m_inputProducers[base + j];
+				if( (producer != SIZE_MAX) && m_dirty[producer])
+					continue;
+				auto data = m_scheduledInputs[base + j].GetData();
+				if(data)
+					depth = max(depth, data->m_offsets.size());
+			}
+		}
+		if( (depth < minDepth) || (depth <= tileSize) )
+			continue;
+
+		if(EvaluateRegion(region, tileSize, overlap))
+		{
+			for(auto i : region)
+				m_dirty[i] = false;
+			m_lastTiledCount += region.size();
+		}
+	}
+
+	return m_lastTiledCount;
+}
+
+/**
+	@brief Finds connected groups of dirty tileable filters whose inputs from outside the group are already up to date
+
+	@param regions	Each group, in dependency order
+ */
+void FilterGraphExecutor::FindTileRegions(vector<vector<size_t> >& regions)
+{
+	size_t nfilters = m_scheduledFilters.size();
+
+	//A filter can be tiled if it's tileable, all of its inputs are analog or digital, and everything feeding it is
+	//either up to date or tiled too. Cycles are never in m_order so never get tiled.
+	vector<bool> member(nfilters, false);
+	for(auto i : m_order)
+	{
+		if(!m_dirty[i] || !IsTileable(m_scheduledFilters[i]))
+			continue;
+
+		bool ok = true;
+		size_t base = m_inputBases[i];
+		for(size_t j=0; j<m_scheduledPorts[i].first; j++)
+		{
+			auto producer = m_inputProducers[base + j];
+			if(producer != SIZE_MAX)
+			{
+				if(member[producer])
+					continue;
+				if(m_dirty[producer])
+				{
+					ok = false;
+					break;
+				}
+			}
+
+			auto data = m_scheduledInputs[base + j].GetData();
+			if( (dynamic_cast<AnalogWaveform*>(data) == NULL) && (dynamic_cast<DigitalWaveform*>(data) == NULL) )
+			{
+				ok = false;
+				break;
+			}
+		}
+		member[i] = ok;
+	}
+
+	//Group them by connectivity
+	vector<size_t> group(nfilters, SIZE_MAX);
+	function<size_t(size_t)> find = [&](size_t i)
+	{
+		while(group[i] != i)
+			i = group[i] = group[group[i]];
+		return i;
+	};
+	for(size_t i=0; i<nfilters; i++)
+	{
+		if(member[i])
+			group[i] = i;
+	}
+	for(auto i : m_order)
+	{
+		if(!member[i])
+			continue;
+		for(auto c : m_consumers[i])
+		{
+			if(member[c])
+				group[find(c)] = find(i);
+		}
+	}
+
+	map<size_t, size_t> regionIndexes;
+	for(auto i : m_order)
+	{
+		if(!member[i])
+			continue;
+
+		size_t root = find(i);
+		auto it = regionIndexes.find(root);
+		if(it == regionIndexes.end())
+		{
+			regionIndexes[root] = regions.size();
+			regions.push_back(vector<size_t>());
+			regions.back().push_back(i);
+		}
+		else
+			regions[it->second].push_back(i);
+	}
+}
+
+/**
+	@brief Evaluates a group of filters over one tile of their inputs at a time.
+
+	Each input from outside the group is temporarily swapped for a slice covering the tile (plus the overlap before
+	it), then every filter in the group is refreshed in order. Outputs something outside the group can see are trimmed
+	to the tile and appended to a full length copy, sized for the whole record after the first tile; the rest are
+	thrown away after the last tile. Peak memory is the original inputs and stitched outputs plus one tile.
+
+	@return True if the group was evaluated, false if it turned out not to be tileable (leaving it dirty)
+ */
+bool FilterGraphExecutor::EvaluateRegion(const vector<size_t>& region, size_t tileSize, size_t overlap)
+{
+	set<size_t> members(region.begin(), region.end());
+
+	//Collect the distinct inputs from outside the group, and pick the deepest one to define the tiles
+	vector<StreamDescriptor> inputs;
+	for(auto i : region)
+	{
+		size_t base = m_inputBases[i];
+		for(size_t j=0; j<m_scheduledPorts[i].first; j++)
+		{
+			auto producer = m_inputProducers[base + j];
+			if( (producer != SIZE_MAX) && (members.find(producer) != members.end()) )
+				continue;
+			auto& in = m_scheduledInputs[base + j];
+			bool found = false;
+			for(auto& s : inputs)
+			{
+				if( (s.m_channel == in.m_channel) && (s.m_stream == in.m_stream) )
+					found = true;
+			}
+			if(!found)
+				inputs.push_back(in);
+		}
+	}
+
+	vector<WaveformBase*> originals;
+	WaveformBase* primary = NULL;
+	size_t iprimary = 0;
+	for(auto& in : inputs)
+	{
+		auto data = in.GetData();
+		if( (primary == NULL) || (data->m_offsets.size() > primary->m_offsets.size()) )
+		{
+			primary = data;
+			iprimary = originals.size();
+		}
+		originals.push_back(data);
+	}
+	size_t depth = primary->m_offsets.size();
+	size_t ntiles = (depth + tileSize - 1) / tileSize;
+	int64_t overlapTime = overlap * primary->m_timescale;
+
+	//Decide which outputs to keep: anything read from outside the group, or by a sink.
+	//With no sinks we can't tell who's looking at what, so keep everything.
+	vector<bool> keep(m_scheduledFilters.size(), true);
+	{
+		lock_guard<mutex> lock(m_sinkMutex);
+		if(m_onDemand)
+		{
+			for(auto i : region)
+			{
+				bool external = m_sinks.find(m_scheduledFilters[i]) != m_sinks.end();
+				for(auto c : m_consumers[i])
+				{
+					if(members.find(c) == members.end())
+						external = true;
+				}
+				keep[i] = external;
+			}
+		}
+	}
+
+	//Cached outputs must not be overwritten by the first tile
+	for(auto i : region)
+	{
+		auto f = m_scheduledFilters[i];
+		if(m_memoizing && (m_keys[i] != 0) )
+			m_outputCache.Release(f);
+		else if(m_outputCache.IsEnabled())
+			m_outputCache.Forget(f);
+	}
+
+	//Swap out the inputs
+	for(auto& in : inputs)
+		in.m_channel->Detach(in.m_stream);
+
+	map<pair<size_t, size_t>, WaveformBase*> outputs;
+	vector<double> runtimes(m_scheduledFilters.size(), 0);
+	bool ok = true;
+	for(size_t t=0; (t<ntiles) && ok; t++)
+	{
+		//Time range covered by this tile. The first and last tiles are open ended.
+		int64_t start = INT64_MIN;
+		int64_t end = INT64_MAX;
+		if(t > 0)
+			start = primary->m_offsets[t*tileSize] * primary->m_timescale + primary->m_triggerPhase;
+		if(t+1 < ntiles)
+			end = primary->m_offsets[(t+1)*tileSize] * primary->m_timescale + primary->m_triggerPhase;
+		int64_t sliceStart = (t > 0) ? (start - overlapTime) : INT64_MIN;
+
+		//Free the last tile's slices before making the next ones, so only one tile of input is ever copied
+		for(size_t k=0; k<inputs.size(); k++)
+			inputs[k].m_channel->SetData(NULL, inputs[k].m_stream);
+		for(size_t k=0; k<inputs.size(); k++)
+			inputs[k].m_channel->SetData(SliceWaveform(originals[k], sliceStart, end), inputs[k].m_stream);
+		size_t sliceLen = inputs[iprimary].GetData()->m_offsets.size();
+
+		//Slices can land at the same address as one from the last tile, so don't trust anything cached for them
+		Filter::ClearAnalysisCache();
+
+		for(auto i : region)
+		{
+			auto f = m_scheduledFilters[i];
+			auto tstart = chrono::steady_clock::now();
+			f->SetDirty();
+			f->RefreshIfDirty();
+			runtimes[i] += chrono::duration<double>(chrono::steady_clock::now() - tstart).count();
+
+			if(!keep[i])
+				continue;
+
+			for(size_t s=0; s<f->GetStreamCount(); s++)
+			{
+				auto data = f->GetData(s);
+				if(data == NULL)
+					continue;
+
+				//Start the full length copy off with the same type and metadata as the first tile
+				auto key = pair<size_t, size_t>(i, s);
+				auto it = outputs.find(key);
+				if(it == outputs.end())
+				{
+					WaveformBase* acc;
+					if(dynamic_cast<AnalogWaveform*>(data))
+						acc = new AnalogWaveform;
+					else if(dynamic_cast<DigitalWaveform*>(data))
+						acc = new DigitalWaveform;
+					else
+					{
+						LogDebug("Filter %s output isn't analog or digital, not tiling it\n",
+							f->GetDisplayName().c_str());
+						ok = false;
+						break;
+					}
+					acc->m_timescale = data->m_timescale;
+					acc->m_startTimestamp = data->m_startTimestamp;
+					acc->m_startFemtoseconds = data->m_startFemtoseconds;
+					acc->m_triggerPhase = data->m_triggerPhase;
+					acc->m_densePacked = data->m_densePacked;
+
+					//Size it for the whole record up front, assuming the output scales with the input the same
+					//way it did for this tile, so stitching doesn't keep reallocating (and briefly doubling) it
+					size_t estimate = data->m_offsets.size();
+					if(sliceLen)
+						estimate = (estimate * depth + sliceLen - 1) / sliceLen;
+					ReserveWaveform(acc, estimate);
+
+					it = outputs.emplace(key, acc).first;
+				}
+
+				if(!AppendWaveform(it->second, data, start, end))
+				{
+					ok = false;
+					break;
+				}
+			}
+			if(!ok)
+				break;
+		}
+	}
+
+	//Put the real inputs back (deleting the last slices)
+	for(size_t k=0; k<inputs.size(); k++)
+		inputs[k].m_channel->SetData(originals[k], inputs[k].m_stream);
+	Filter::ClearAnalysisCache();
+
+	if(!ok)
+	{
+		for(auto it : outputs)
+			delete it.second;
+		return false;
+	}
+
+	//Install the stitched outputs, and free the intermediate ones
+	for(auto i : region)
+	{
+		auto f = m_scheduledFilters[i];
+		size_t nstreams = f->GetStreamCount();
+
+		size_t samples = 0;
+		size_t bytes = 0;
+		size_t total = 0;
+		m_autoDense[i].assign(nstreams, NULL);
+		for(size_t s=0; s<nstreams; s++)
+		{
+			auto it = outputs.find(pair<size_t, size_t>(i, s));
+			auto data = (it != outputs.end()) ? it->second : NULL;
+			f->SetData(data, s);
+			if(data == NULL)
+				continue;
+
+			//Same as Evaluate(): the stitched copy may be dense even if the filter didn't flag its tiles as such
+			if(DetectDensePacked(data))
+				m_autoDense[i][s] = data;
+
+			size_t used;
+			size_t allocated;
+			GetBufferSize(data, used, allocated);
+			samples += data->m_offsets.size();
+			bytes += used;
+			total += allocated;
+		}
+
+		if(keep[i])
+		{
+			if(m_memoizing && (m_keys[i] != 0) )
+				m_outputCache.Store(f, m_keys[i], total);
+		}
+		else
+			m_tileDropped.emplace(f);
+
+		auto& profile = *m_profiles[i];
+		m_runtimes[i] = runtimes[i];
+		profile.m_times.Record(runtimes[i]);
+		profile.m_lastTime = runtimes[i];
+		profile.m_outputSamples = samples;
+		profile.m_outputBytes = bytes;
+		profile.m_allocBytes = total;
+		profile.m_totalAllocBytes += total;
+	}
+
+	LogTrace("Evaluated %zu filters in %zu tiles\n", region.size(), ntiles);
+	return true;
+}
+
+/**
+	@brief Copies the samples of a waveform in a time range, plus the one before it (which may extend into the range)
+
+	Offsets are rebased to start at zero, with the trigger phase moved to match, so every sample keeps the same
+	timestamp and dense packed waveforms stay dense packed.
+
+	@param wfm		An analog or digital waveform
+	@param start	Start of the range, in fs from the trigger
+	@param end		End of the range, in fs from the trigger
+ */
+WaveformBase* FilterGraphExecutor::SliceWaveform(WaveformBase* wfm, int64_t start, int64_t end)
+{
+	auto timeOf = [&](int64_t offset) { return offset * wfm->m_timescale + wfm->m_triggerPhase; };
+	auto first = lower_bound(wfm->m_offsets.begin(), wfm->m_offsets.end(), start,
+		[&](int64_t offset, int64_t t) { return timeOf(offset) < t; });
+	auto last = lower_bound(first, wfm->m_offsets.end(), end,
+		[&](int64_t offset, int64_t t) { return timeOf(offset) < t; });
+	size_t ifirst = first - wfm->m_offsets.begin();
+	size_t ilast = last - wfm->m_offsets.begin();
+	if(ifirst > 0)
+		ifirst --;
+	size_t len = ilast - ifirst;
+
+	WaveformBase* slice;
+	auto acap = dynamic_cast<AnalogWaveform*>(wfm);
+	auto dcap = dynamic_cast<DigitalWaveform*>(wfm);
+	if(acap)
+	{
+		auto cap = new AnalogWaveform;
+		cap->m_samples.resize(len);
+		if(len)
+			memcpy(&cap->m_samples[0], &acap->m_samples[ifirst], len * sizeof(float));
+		slice = cap;
+	}
+	else
+	{
+		auto cap = new DigitalWaveform;
+		cap->m_samples.resize(len);
+		for(size_t i=0; i<len; i++)
+			cap->m_samples[i] = dcap->m_samples[ifirst + i];
+		slice = cap;
+	}
+
+	int64_t base = len ? wfm->m_offsets[ifirst] : 0;
+	slice->m_timescale = wfm->m_timescale;
+	slice->m_startTimestamp = wfm->m_startTimestamp;
+	slice->m_startFemtoseconds = wfm->m_startFemtoseconds;
+	slice->m_triggerPhase = wfm->m_triggerPhase + base * wfm->m_timescale;
+	slice->m_densePacked = wfm->m_densePacked;
+	slice->m_offsets.resize(len);
+	slice->m_durations.resize(len);
+	for(size_t i=0; i<len; i++)
+		slice->m_offsets[i] = wfm->m_offsets[ifirst + i] - base;
+	if(len)
+		memcpy(&slice->m_durations[0], &wfm->m_durations[ifirst], len * sizeof(int64_t));
+	return slice;
+}
+
+/**
+	@brief Reserves room for a number of samples in an analog or digital waveform
+ */
+void FilterGraphExecutor::ReserveWaveform(WaveformBase* wfm, size_t len)
+{
+	wfm->m_offsets.reserve(len);
+	wfm->m_durations.reserve(len);
+
+	auto acap = dynamic_cast<AnalogWaveform*>(wfm);
+	if(acap)
+		acap->m_samples.reserve(len);
+	auto dcap = dynamic_cast<DigitalWaveform*>(wfm);
+	if(dcap)
+		dcap->m_samples.reserve(len);
+}
+
+/**
+	@brief Appends the samples of one tile's output which start in the tile's time range to a full length output.
+
+	A sample cut off by the end of the previous tile is stretched to meet the first sample of this one.
+
+	@return False if the waveforms aren't the same type
+ */
+bool FilterGraphExecutor::AppendWaveform(WaveformBase* dst, WaveformBase* src, int64_t start, int64_t end)
+{
+	auto asrc = dynamic_cast<AnalogWaveform*>(src);
+	auto adst = dynamic_cast<AnalogWaveform*>(dst);
+	auto dsrc = dynamic_cast<DigitalWaveform*>(src);
+	auto ddst = dynamic_cast<DigitalWaveform*>(dst);
+	if( !(asrc && adst) && !(dsrc && ddst) )
+		return false;
+
+	bool first = true;
+	size_t len = src->m_offsets.size();
+	for(size_t i=0; i<len; i++)
+	{
+		int64_t t = src->m_offsets[i] * src->m_timescale + src->m_triggerPhase;
+		if( (t < start) || (t >= end) )
+			continue;
+
+		//Convert to the destination timebase, if different
+		int64_t offset = src->m_offsets[i];
+		int64_t duration = src->m_durations[i];
+		if( (src->m_timescale != dst->m_timescale) || (src->m_triggerPhase != dst->m_triggerPhase) )
+		{
+			offset = (t - dst->m_triggerPhase) / dst->m_timescale;
+			duration = duration * src->m_timescale / dst->m_timescale;
+		}
+
+		size_t n = dst->m_offsets.size();
+		if(first && (n > 0) )
+		{
+			auto& lastDuration = dst->m_durations[n-1];
+			int64_t gap = offset - dst->m_offsets[n-1];
+			if(lastDuration < gap)
+			{
+				int64_t lastEnd = (dst->m_offsets[n-1] + lastDuration) * dst->m_timescale + dst->m_triggerPhase;
+				if(lastEnd + dst->m_timescale >= start)
+					lastDuration = gap;
+			}
+		}
+		first = false;
+
+		dst->m_offsets.push_back(offset);
+		dst->m_durations.push_back(duration);
+		if(asrc)
+			adst->m_samples.push_back(asrc->m_samples[i]);
+		else
+			ddst->m_samples.push_back(dsrc->m_samples[i]);
+	}
+
+	return true;
+}
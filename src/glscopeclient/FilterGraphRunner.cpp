@@ -0,0 +1,146 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of FilterGraphRunner
+ */
+#include "../scopehal/scopehal.h"
+#include "../scopehal/Filter.h"
+#include "FilterRegistry.h"
+#include "FilterGraphRunner.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+FilterGraphRunner::FilterGraphRunner(recursive_mutex& dataMutex)
+	: m_dataMutex(dataMutex)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Evaluation
+
+/**
+	@brief Re-evaluates every dirty filter in the session
+
+	@param memoize	Reuse (and save) filter outputs from the output cache
+ */
+void FilterGraphRunner::Refresh(bool memoize)
+{
+	lock_guard<recursive_mutex> lock(m_dataMutex);
+	m_executor.RunBlocking(g_filterRegistry.GetSessionFilters(), memoize);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Change notification
+
+/**
+	@brief Call after changing a filter's parameters or inputs, so it and everything downstream gets re-evaluated
+ */
+void FilterGraphRunner::OnFilterChanged(Filter* f)
+{
+	lock_guard<recursive_mutex> lock(m_dataMutex);
+	m_executor.MarkDirty(f);
+}
+
+/**
+	@brief Call after changing a channel's settings, so everything it feeds gets re-evaluated
+
+	Handles filters as well as scope channels.
+ */
+void FilterGraphRunner::OnChannelChanged(OscilloscopeChannel* chan)
+{
+	lock_guard<recursive_mutex> lock(m_dataMutex);
+
+	auto f = dynamic_cast<Filter*>(chan);
+	if(f)
+		m_executor.MarkDirty(f);
+
+	for(auto g : g_filterRegistry.GetSessionFilters())
+	{
+		for(size_t i=0; i<g->GetInputCount(); i++)
+		{
+			if(g->GetInput(i).m_channel == chan)
+				m_executor.MarkDirty(g);
+		}
+	}
+}
+
+/**
+	@brief Throws away the accumulated data of every filter in the session (eye patterns, averages, etc)
+ */
+void FilterGraphRunner::OnSweepsCleared()
+{
+	lock_guard<recursive_mutex> lock(m_dataMutex);
+
+	for(auto f : g_filterRegistry.GetSessionFilters())
+	{
+		f->ClearSweeps();
+		m_executor.MarkDirty(f);
+	}
+}
+
+/**
+	@brief Call when the set of things looking at filter outputs (views, analyzers, etc) changes
+
+	Filters not feeding any of them are skipped until something does.
+ */
+void FilterGraphRunner::SetSinks(const set<FlowGraphNode*>& sinks)
+{
+	lock_guard<recursive_mutex> lock(m_dataMutex);
+	m_executor.SetSinks(sinks);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Profiling
+
+/**
+	@brief Clears the run time and allocation statistics of every filter
+ */
+void FilterGraphRunner::ResetProfiles()
+{
+	m_executor.ResetProfiles();
+}
+
+/**
+	@brief Writes the run time and allocation statistics of every filter in the session to a CSV file
+
+	@param path	Output file name
+	@return		False if the file couldn't be written
+ */
+bool FilterGraphRunner::WriteProfileReport(const string& path)
+{
+	//Hold the data lock so no filter can be deleted, or half evaluated, while we're reading it
+	lock_guard<recursive_mutex> lock(m_dataMutex);
+	return m_executor.WriteProfileReport(path, g_filterRegistry.GetSessionFilters());
+}
@@ -0,0 +1,79 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of FilterGraphRunner
+ */
+#ifndef FilterGraphRunner_h
+#define FilterGraphRunner_h
+
+#include <mutex>
+#include <set>
+#include <string>
+#include "FilterGraphExecutor.h"
+
+/**
+	@brief Ties the filter graph executor to the user's session: which filters it runs, and what marks them dirty.
+
+	The executor only re-evaluates filters it has been told are dirty (beyond new input waveforms and reconnections,
+	which it spots on its own). Everything that edits a filter goes through here so the right filters are marked,
+	with the waveform data lock held so a mark can't land in the middle of a refresh.
+
+	All of these are meant to be called from the UI thread. Has no GUI dependencies, so it can be tested on its own.
+ */
+class FilterGraphRunner
+{
+public:
+	FilterGraphRunner(std::recursive_mutex& dataMutex);
+
+	void Refresh(bool memoize = false);
+
+	void OnFilterChanged(Filter* f);
+	void OnChannelChanged(OscilloscopeChannel* chan);
+	void OnSweepsCleared();
+
+	void SetSinks(const std::set<FlowGraphNode*>& sinks);
+
+	void ResetProfiles();
+	bool WriteProfileReport(const std::string& path);
+
+	FilterGraphExecutor& GetExecutor()
+	{ return m_executor; }
+
+protected:
+
+	///@brief Lock on all waveform data, shared with whoever owns the session
+	std::recursive_mutex& m_dataMutex;
+
+	FilterGraphExecutor m_executor;
+};
+
+#endif
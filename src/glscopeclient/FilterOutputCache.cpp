@@ -0,0 +1,262 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of FilterOutputCache
+ */
+#include "../scopehal/scopehal.h"
+#include "../scopehal/Filter.h"
+#include "FilterOutputCache.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+FilterOutputCache::FilterOutputCache()
+	: m_maxBytes(512LL * 1024 * 1024)
+	, m_bytes(0)
+	, m_hits(0)
+	, m_misses(0)
+{
+}
+
+FilterOutputCache::~FilterOutputCache()
+{
+	Clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+size_t FilterOutputCache::GetEntryCount()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_entries.size();
+}
+
+double FilterOutputCache::GetHitRate()
+{
+	size_t total = m_hits + m_misses;
+	if(total == 0)
+		return 0;
+	return m_hits * 1.0 / total;
+}
+
+void FilterOutputCache::ResetCounters()
+{
+	m_hits = 0;
+	m_misses = 0;
+}
+
+/**
+	@brief Sets the max size of waveforms held in the cache. Zero disables caching entirely.
+ */
+void FilterOutputCache::SetMaxBytes(size_t bytes)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_maxBytes = bytes;
+	EnforceBudget();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Cache operations
+
+/**
+	@brief Installs the cached outputs of a filter for the given key, if there are any
+
+	@return True on a hit (the filter now has the cached outputs and doesn't need to be evaluated), false on a miss
+ */
+bool FilterOutputCache::Lookup(Filter* f, uint64_t key)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	auto it = m_index.find(pair<Filter*, uint64_t>(f, key));
+	if(it == m_index.end())
+	{
+		m_misses ++;
+		return false;
+	}
+
+	//If the number of outputs changed, this entry is no good any more
+	auto entry = it->second;
+	size_t nstreams = f->GetStreamCount();
+	if(entry->m_outputs.size() != nstreams)
+	{
+		Evict(entry);
+		m_misses ++;
+		return false;
+	}
+
+	//Swap in the cached outputs, unless they're already there.
+	//Anything the filter had before that isn't cached is deleted by SetData().
+	auto lit = m_live.find(f);
+	if( (lit == m_live.end()) || (lit->second != entry) )
+	{
+		ReleaseLive(f);
+		for(size_t i=0; i<nstreams; i++)
+			f->SetData(entry->m_outputs[i], i);
+		m_live[f] = entry;
+	}
+
+	m_entries.splice(m_entries.begin(), m_entries, entry);
+	m_hits ++;
+	return true;
+}
+
+/**
+	@brief Takes ownership of the current outputs of a filter, which was just evaluated with the given key
+
+	The outputs stay installed in the filter, and become its live entry.
+
+	@param f		The filter
+	@param key		Key of the filter's inputs
+	@param bytes	Total size of the filter's outputs
+ */
+void FilterOutputCache::Store(Filter* f, uint64_t key, size_t bytes)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	//Shouldn't happen since we'd have had a hit, but don't leave a stale entry behind
+	auto it = m_index.find(pair<Filter*, uint64_t>(f, key));
+	if(it != m_index.end())
+		Evict(it->second);
+
+	//Caller should have released the old live entry before evaluating, but if not, the filter owns it again now
+	auto lit = m_live.find(f);
+	if(lit != m_live.end())
+		Evict(lit->second);
+
+	Entry entry;
+	entry.m_filter = f;
+	entry.m_key = key;
+	entry.m_bytes = bytes;
+	for(size_t i=0; i<f->GetStreamCount(); i++)
+		entry.m_outputs.push_back(f->GetData(i));
+
+	m_entries.push_front(entry);
+	m_index[pair<Filter*, uint64_t>(f, key)] = m_entries.begin();
+	m_live[f] = m_entries.begin();
+	m_bytes += bytes;
+
+	EnforceBudget();
+}
+
+/**
+	@brief Detaches a filter's cached outputs, if it has any, so it can be evaluated without overwriting them
+ */
+void FilterOutputCache::Release(Filter* f)
+{
+	lock_guard<mutex> lock(m_mutex);
+	ReleaseLive(f);
+}
+
+/**
+	@brief Drops a filter's live entry from the cache, leaving the filter owning the outputs
+ */
+void FilterOutputCache::Forget(Filter* f)
+{
+	lock_guard<mutex> lock(m_mutex);
+	auto it = m_live.find(f);
+	if(it != m_live.end())
+		Evict(it->second);
+}
+
+/**
+	@brief Drops every entry for a filter.
+
+	Safe to call after the filter has been deleted, since only the entries which aren't installed in the filter are
+	freed.
+ */
+void FilterOutputCache::Remove(Filter* f)
+{
+	lock_guard<mutex> lock(m_mutex);
+	auto it = m_index.lower_bound(pair<Filter*, uint64_t>(f, 0));
+	while( (it != m_index.end()) && (it->first.first == f) )
+	{
+		auto entry = it->second;
+		it++;
+		Evict(entry);
+	}
+}
+
+/**
+	@brief Drops every entry
+ */
+void FilterOutputCache::Clear()
+{
+	lock_guard<mutex> lock(m_mutex);
+	while(!m_entries.empty())
+		Evict(m_entries.begin());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers (caller must hold m_mutex)
+
+void FilterOutputCache::ReleaseLive(Filter* f)
+{
+	auto it = m_live.find(f);
+	if(it == m_live.end())
+		return;
+
+	size_t n = min(it->second->m_outputs.size(), f->GetStreamCount());
+	for(size_t i=0; i<n; i++)
+		f->Detach(i);
+	m_live.erase(it);
+}
+
+/**
+	@brief Removes an entry. The waveforms are freed, unless they're installed in the filter which still owns them.
+ */
+void FilterOutputCache::Evict(EntryList::iterator it)
+{
+	auto lit = m_live.find(it->m_filter);
+	if( (lit != m_live.end()) && (lit->second == it) )
+		m_live.erase(lit);
+	else
+	{
+		for(auto w : it->m_outputs)
+			delete w;
+	}
+
+	m_bytes -= it->m_bytes;
+	m_index.erase(pair<Filter*, uint64_t>(it->m_filter, it->m_key));
+	m_entries.erase(it);
+}
+
+/**
+	@brief Evicts least recently used entries until we're under budget
+ */
+void FilterOutputCache::EnforceBudget()
+{
+	while( (m_bytes > m_maxBytes) && !m_entries.empty() )
+		Evict(prev(m_entries.end()));
+}
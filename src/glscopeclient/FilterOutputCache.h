@@ -0,0 +1,128 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of FilterOutputCache
+ */
+#ifndef FilterOutputCache_h
+#define FilterOutputCache_h
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/**
+	@brief Bounded LRU cache of filter outputs, keyed by filter and by the identity of everything upstream of it.
+
+	Lets the filter graph redisplay a historical waveform it has already processed without running any filters.
+
+	The cache owns every waveform stored in it. At most one entry per filter is "live", meaning its waveforms are the
+	ones currently installed as the filter's outputs. A live entry has to be released before the filter runs again,
+	otherwise the filter would overwrite the cached data in place.
+
+	Has no GUI dependencies, so it can be shared by the main window and headless mode.
+ */
+class FilterOutputCache
+{
+public:
+	FilterOutputCache();
+	~FilterOutputCache();
+
+	bool Lookup(Filter* f, uint64_t key);
+	void Store(Filter* f, uint64_t key, size_t bytes);
+	void Release(Filter* f);
+	void Forget(Filter* f);
+	void Remove(Filter* f);
+	void Clear();
+
+	void SetMaxBytes(size_t bytes);
+
+	size_t GetMaxBytes()
+	{ return m_maxBytes; }
+
+	///@brief True if the cache is allowed to hold anything at all
+	bool IsEnabled()
+	{ return m_maxBytes > 0; }
+
+	///@brief Total size of the waveforms currently held in the cache
+	size_t GetBytes()
+	{ return m_bytes; }
+
+	size_t GetEntryCount();
+
+	///@brief Number of filter evaluations skipped because the output was already cached
+	size_t GetHitCount()
+	{ return m_hits; }
+
+	///@brief Number of lookups which had to run the filter
+	size_t GetMissCount()
+	{ return m_misses; }
+
+	double GetHitRate();
+	void ResetCounters();
+
+protected:
+	class Entry
+	{
+	public:
+		Filter* m_filter;
+		uint64_t m_key;
+		std::vector<WaveformBase*> m_outputs;
+		size_t m_bytes;
+	};
+
+	typedef std::list<Entry> EntryList;
+
+	void Evict(EntryList::iterator it);
+	void EnforceBudget();
+	void ReleaseLive(Filter* f);
+
+	std::mutex m_mutex;
+
+	///@brief Every entry, most recently used first
+	EntryList m_entries;
+
+	///@brief Index of m_entries by filter and key
+	std::map<std::pair<Filter*, uint64_t>, EntryList::iterator> m_index;
+
+	///@brief The entry currently installed as each filter's output, if any
+	std::map<Filter*, EntryList::iterator> m_live;
+
+	std::atomic<size_t> m_maxBytes;
+	std::atomic<size_t> m_bytes;
+
+	std::atomic<size_t> m_hits;
+	std::atomic<size_t> m_misses;
+};
+
+#endif
@@ -0,0 +1,187 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of FilterRegistry
+ */
+#include "../scopehal/scopehal.h"
+#include "../scopehal/Filter.h"
+#include "FilterRegistry.h"
+
+using namespace std;
+
+FilterRegistry g_filterRegistry;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+FilterRegistry::FilterRegistry()
+	: m_nextID(1)
+	, m_generation(1)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Filter creation
+
+/**
+	@brief Creates a filter which is part of the user's session, and gives it a new ID
+
+	@return The new filter, or NULL if the protocol doesn't exist
+ */
+Filter* FilterRegistry::CreateFilter(const string& protocol, const string& color)
+{
+	return Create(protocol, color, false);
+}
+
+/**
+	@brief Creates a filter for the application's own use, which GetSessionFilters() never returns
+
+	Free it with ReleasePrivateFilter().
+
+	@return The new filter, or NULL if the protocol doesn't exist
+ */
+Filter* FilterRegistry::CreatePrivateFilter(const string& protocol, const string& color)
+{
+	return Create(protocol, color, true);
+}
+
+Filter* FilterRegistry::Create(const string& protocol, const string& color, bool isPrivate)
+{
+	//Hold the lock while creating the filter, so GetSessionFilters() on another thread can't see a private filter
+	//before it's been flagged as such
+	lock_guard<mutex> lock(m_mutex);
+
+	auto f = Filter::CreateFilter(protocol, color);
+	if(f == NULL)
+		return NULL;
+
+	RegisterLocked(f, Filter::GetAllInstances(), isPrivate);
+	return f;
+}
+
+/**
+	@brief Drops a reference to a private filter, and forgets about it once it's been deleted
+ */
+void FilterRegistry::ReleasePrivateFilter(Filter* f)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	f->Release();
+	if(Filter::GetAllInstances().count(f) == 0)
+	{
+		m_private.erase(f);
+		m_ids.erase(f);
+	}
+}
+
+/**
+	@brief Gives a newly created filter a new ID, replacing whatever a deleted filter at the same address had
+ */
+void FilterRegistry::Register(Filter* f)
+{
+	auto filters = Filter::GetAllInstances();
+
+	lock_guard<mutex> lock(m_mutex);
+	RegisterLocked(f, filters, false);
+}
+
+void FilterRegistry::RegisterLocked(Filter* f, const set<Filter*>& filters, bool isPrivate)
+{
+	//Forget filters that have been deleted since last time, so the tables don't grow forever
+	for(auto it = m_ids.begin(); it != m_ids.end(); )
+	{
+		if(filters.find(it->first) == filters.end())
+			it = m_ids.erase(it);
+		else
+			++it;
+	}
+	for(auto it = m_private.begin(); it != m_private.end(); )
+	{
+		if(filters.find(*it) == filters.end())
+			it = m_private.erase(it);
+		else
+			++it;
+	}
+
+	m_ids[f] = m_nextID ++;
+
+	//Private filters are never part of the session graph, so there's no need to make its executor look for changes.
+	//Menus create a private instance of every protocol, which would otherwise force a schedule rebuild each time.
+	if(isPrivate)
+		m_private.emplace(f);
+	else
+	{
+		m_private.erase(f);
+		m_generation ++;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+/**
+	@brief Gets the ID of a filter, assigning one if this is the first time we've seen it
+ */
+uint64_t FilterRegistry::GetID(Filter* f)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	auto it = m_ids.find(f);
+	if(it != m_ids.end())
+		return it->second;
+
+	uint64_t id = m_nextID ++;
+	m_ids[f] = id;
+	return id;
+}
+
+/**
+	@brief Checks if a filter was created with CreatePrivateFilter()
+ */
+bool FilterRegistry::IsPrivate(Filter* f)
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_private.find(f) != m_private.end();
+}
+
+/**
+	@brief Returns every filter which is part of the user's session, leaving out the application's private ones
+ */
+set<Filter*> FilterRegistry::GetSessionFilters()
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	auto filters = Filter::GetAllInstances();
+	for(auto f : m_private)
+		filters.erase(f);
+	return filters;
+}
@@ -0,0 +1,97 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of FilterRegistry
+ */
+#ifndef FilterRegistry_h
+#define FilterRegistry_h
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+/**
+	@brief Gives every filter an ID which is never reused, even by a new filter at the same address.
+
+	Anything that keeps per-filter state between refreshes (the graph executor's schedule, generations, profiles)
+	keys it on the ID rather than the filter pointer, so a filter created where a deleted one used to be starts from
+	scratch instead of inheriting the old filter's state.
+
+	libscopehal doesn't tell us when filters are created or destroyed, so every filter the application creates has to
+	go through CreateFilter() here. Filters created any other way get an ID the first time they're looked up.
+
+	Filters the application creates for its own use (the replay workers' copies of the decode graph, throwaway
+	instances used to check which inputs a protocol accepts) are created with CreatePrivateFilter() instead. They're
+	left out of GetSessionFilters(), which is what anything dealing with the user's filter graph should use in place of
+	Filter::GetAllInstances(): saving sessions, menus, the graph editor, the main window's refresh, etc.
+
+	Has no GUI dependencies, so it can be shared by the window, headless mode, and the filter graph executor.
+ */
+class FilterRegistry
+{
+public:
+	FilterRegistry();
+
+	Filter* CreateFilter(const std::string& protocol, const std::string& color);
+	Filter* CreatePrivateFilter(const std::string& protocol, const std::string& color);
+	void ReleasePrivateFilter(Filter* f);
+	void Register(Filter* f);
+
+	uint64_t GetID(Filter* f);
+	bool IsPrivate(Filter* f);
+	std::set<Filter*> GetSessionFilters();
+
+	///@brief Changes every time a session filter is registered, so callers can tell if any IDs might have changed
+	uint64_t GetGeneration()
+	{ return m_generation; }
+
+protected:
+	Filter* Create(const std::string& protocol, const std::string& color, bool isPrivate);
+	void RegisterLocked(Filter* f, const std::set<Filter*>& filters, bool isPrivate);
+
+	std::mutex m_mutex;
+
+	///@brief ID of every filter we've seen
+	std::map<Filter*, uint64_t> m_ids;
+
+	///@brief Filters which aren't part of the user's session
+	std::set<Filter*> m_private;
+
+	uint64_t m_nextID;
+	std::atomic<uint64_t> m_generation;
+};
+
+extern FilterRegistry g_filterRegistry;
+
+#endif
@@ -105,7 +105,7 @@ void HaltConditionsDialog::RefreshChannels()
 	}
 
 	//Populate filters
-	auto filters = Filter::GetAllInstances();
+	auto filters = g_filterRegistry.GetSessionFilters();
 	for(auto d : filters)
 	{
 		auto nstreams = d->GetStreamCount();
@@ -48,6 +48,9 @@ public:
 	void RefreshChannels();
 
 	bool ShouldHalt(int64_t& timestamp);
+
+	bool IsHaltEnabled()
+	{ return m_haltEnabledButton.get_active(); }
 	bool ShouldMoveToHalt()
 	{ return m_moveToEventButton.get_active(); }
 
@@ -0,0 +1,725 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of HeadlessSession
+ */
+#include "../scopehal/scopehal.h"
+#include "../scopehal/Filter.h"
+#include "../scopehal/PacketDecoder.h"
+#include "../scopehal/Statistic.h"
+#include "SessionLoader.h"
+#include "ThreadBudget.h"
+#include "WaveformSerializer.h"
+#include "WaveformPool.h"
+#include "FilterRegistry.h"
+#include "HeadlessSession.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+double GetTime();
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+HeadlessSession::HeadlessSession()
+	: m_statsFile(NULL)
+	, m_totalSamples(0)
+	, m_totalRefreshTime(0)
+{
+}
+
+HeadlessSession::~HeadlessSession()
+{
+	for(auto stat : m_statistics)
+		delete stat;
+	m_statistics.clear();
+
+	for(auto f : m_filters)
+		f->Release();
+	m_filters.clear();
+
+	for(auto scope : m_scopes)
+		delete scope;
+	m_scopes.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Session loading
+
+/**
+	@brief Loads instruments, filters, and (optionally) saved waveform metadata from a session file
+ */
+bool HeadlessSession::Load(const string& filename, bool reconnect, bool loadWaveforms)
+{
+	try
+	{
+		auto docs = YAML::LoadAllFromFile(filename);
+
+		//Only open the first doc, our file format doesn't ever generate multiple docs in a file.
+		auto node = docs[0];
+
+		vector<string> errors;
+		m_scopes = SessionLoader::LoadInstruments(node["instruments"], reconnect, m_table, errors);
+		m_filters = SessionLoader::LoadDecodes(node["decodes"], m_table, errors);
+		for(auto& e : errors)
+			LogError("%s\n", e.c_str());
+
+		//Hold a reference to each filter so it doesn't get garbage collected out from under us
+		for(auto f : m_filters)
+			f->AddRef();
+
+		LoadStatistics(node["ui_config"]);
+	}
+	catch(const YAML::BadFile& ex)
+	{
+		LogError("Unable to open session file %s\n", filename.c_str());
+		return false;
+	}
+
+	if(m_scopes.empty())
+	{
+		LogError("Session %s did not contain any usable instruments\n", filename.c_str());
+		return false;
+	}
+
+	if(!loadWaveforms)
+		return true;
+
+	//Figure out data directory
+	string base = filename.substr(0, filename.length() - strlen(".scopesession"));
+	m_inputDataDir = base + "_data";
+
+	//Read the list of saved waveforms for each instrument, but don't load any sample data yet
+	for(auto scope : m_scopes)
+	{
+		char tmp[512];
+		snprintf(tmp, sizeof(tmp), "%s/scope_%d_metadata.yml", m_inputDataDir.c_str(), m_table[scope]);
+
+		try
+		{
+			auto docs = YAML::LoadAllFromFile(tmp);
+			auto& waveforms = m_savedWaveforms[scope];
+			for(auto it : docs[0]["waveforms"])
+				waveforms.push_back(it.second);
+		}
+		catch(const YAML::BadFile& ex)
+		{
+			LogWarning("No saved waveform data for instrument %s\n", scope->m_nickname.c_str());
+		}
+	}
+
+	return true;
+}
+
+/**
+	@brief Finds the streams which have statistics enabled in the session's waveform groups
+ */
+void HeadlessSession::LoadStatistics(const YAML::Node& node)
+{
+	auto groups = node["groups"];
+	for(auto it : groups)
+	{
+		auto stats = it.second["stats"];
+		for(auto jt : stats)
+		{
+			auto chan = static_cast<OscilloscopeChannel*>(m_table[jt.second["channel"].as<int>()]);
+			if(!chan)
+				continue;
+			size_t stream = 0;
+			if(jt.second["stream"])
+				stream = jt.second["stream"].as<int>();
+
+			m_statStreams.push_back(StreamDescriptor(chan, stream));
+		}
+	}
+
+	if(m_statStreams.empty())
+		return;
+
+	//Same set of statistics a waveform group shows by default
+	m_statistics.push_back(Statistic::CreateStatistic("Maximum"));
+	m_statistics.push_back(Statistic::CreateStatistic("Average"));
+	m_statistics.push_back(Statistic::CreateStatistic("Minimum"));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Acquisition
+
+bool HeadlessSession::HasOnlineScopes()
+{
+	for(auto scope : m_scopes)
+	{
+		if(!scope->IsOffline())
+			return true;
+	}
+	return false;
+}
+
+/**
+	@brief Arms the instruments for continuous acquisition
+ */
+void HeadlessSession::StartAcquisition()
+{
+	size_t nonline = 0;
+	for(auto scope : m_scopes)
+	{
+		if(!scope->IsOffline())
+			nonline ++;
+	}
+
+	//Multiple instruments are armed one trigger at a time by AcquireLive() to keep them in lockstep
+	if(nonline != 1)
+		return;
+
+	for(auto scope : m_scopes)
+	{
+		if(!scope->IsOffline())
+			scope->Start();
+	}
+}
+
+/**
+	@brief Waits until every online instrument has a waveform, then installs them in the channels
+ */
+bool HeadlessSession::AcquireLive()
+{
+	size_t nonline = 0;
+	for(auto scope : m_scopes)
+	{
+		if(!scope->IsOffline())
+			nonline ++;
+	}
+
+	//Arm secondaries first, then the primary, so nobody misses the trigger
+	if(nonline > 1)
+	{
+		for(ssize_t i=m_scopes.size()-1; i>=0; i--)
+		{
+			if(!m_scopes[i]->IsOffline())
+				m_scopes[i]->StartSingleTrigger();
+		}
+	}
+
+	while(true)
+	{
+		bool ready = true;
+		bool triggered = false;
+		for(auto scope : m_scopes)
+		{
+			if(scope->IsOffline() || scope->GetPendingWaveformCount() != 0)
+				continue;
+
+			ready = false;
+			if(scope->PollTrigger() == Oscilloscope::TRIGGER_MODE_TRIGGERED)
+			{
+				if(!scope->AcquireData())
+				{
+					LogError("Failed to acquire data from %s\n", scope->m_nickname.c_str());
+					return false;
+				}
+				triggered = true;
+			}
+		}
+
+		if(ready)
+			break;
+
+		//Don't hammer the instruments if nothing is happening
+		if(!triggered)
+			this_thread::sleep_for(chrono::milliseconds(1));
+	}
+
+	for(auto scope : m_scopes)
+	{
+		if(!scope->IsOffline())
+			scope->PopPendingWaveform();
+	}
+
+	return true;
+}
+
+/**
+	@brief Loads one saved waveform from the session's data directory into each instrument
+ */
+bool HeadlessSession::LoadSavedWaveform(size_t index)
+{
+	for(auto scope : m_scopes)
+	{
+		auto it = m_savedWaveforms.find(scope);
+		if( (it == m_savedWaveforms.end()) || (index >= it->second.size()) )
+			continue;
+
+		//Recycle the previous waveform, nobody else owns it
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto chan = scope->GetChannel(i);
+			for(size_t j=0; j<chan->GetStreamCount(); j++)
+			{
+				g_waveformPool.Return(chan->GetData(j));
+				chan->Detach(j);
+			}
+		}
+
+		//Create the waveforms and load their metadata
+		TimePoint time;
+		bool pinned;
+		string label;
+		vector<pair<int, int>> channels;	//pair<channel, stream>
+		vector<string> formats;
+		int waveform_id = WaveformSerializer::LoadWaveformMetadata(
+			it->second[index],
+			scope,
+			time,
+			pinned,
+			label,
+			channels,
+			formats);
+
+		//Load sample data for each channel in parallel
+		int scope_id = m_table[scope];
+		size_t nchans = channels.size();
+		vector<float> progress(nchans, 0);
+		vector<int> done(nchans, 0);
+		#pragma omp parallel for
+		for(size_t i=0; i<nchans; i++)
+		{
+			WaveformSerializer::LoadStream(
+				channels[i].first,
+				channels[i].second,
+				scope,
+				m_inputDataDir,
+				scope_id,
+				waveform_id,
+				formats[i],
+				&progress[i],
+				&done[i]);
+		}
+	}
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Main loop
+
+/**
+	@brief Acquires or replays waveforms, runs the filter graph on each, and writes the results to outdir.
+
+	@param count	Number of waveforms to process. Zero means one waveform when acquiring live, or every saved
+					waveform when replaying.
+	@param outdir	Directory to write results to (created if it does not exist)
+ */
+bool HeadlessSession::Run(size_t count, const string& outdir)
+{
+	//Loading and saving waveforms happens on this thread, the filter graph has its own workers
+	g_threadBudget.BindThread(ThreadBudget::ROLE_ACQUISITION);
+
+	if(!OpenOutputs(outdir))
+		return false;
+
+	//Replay saved data if nothing is live
+	bool live = HasOnlineScopes();
+	size_t nsaved = 0;
+	if(!live && !m_savedWaveforms.empty())
+	{
+		nsaved = SIZE_MAX;
+		for(auto& it : m_savedWaveforms)
+			nsaved = min(nsaved, it.second.size());
+	}
+
+	if(count == 0)
+	{
+		if(live || (nsaved == 0))
+			count = 1;
+		else
+			count = nsaved;
+	}
+
+	if(live)
+	{
+		LogNotice("Acquiring %zu waveforms\n", count);
+		StartAcquisition();
+	}
+	else if(nsaved)
+		LogNotice("Replaying %zu saved waveforms\n", count);
+	else
+		LogNotice("No live instruments or saved waveforms, running filter graph %zu times\n", count);
+
+	double tstart = GetTime();
+	size_t nprocessed = 0;
+	for(size_t i=0; i<count; i++)
+	{
+		if(live)
+		{
+			if(!AcquireLive())
+				break;
+		}
+
+		//Loop over the saved data if we were asked for more waveforms than we have
+		else if(nsaved)
+			LoadSavedWaveform(i % nsaved);
+
+		ProcessWaveform(i);
+		nprocessed ++;
+	}
+	double dt = GetTime() - tstart;
+
+	if(live)
+	{
+		for(auto scope : m_scopes)
+		{
+			if(!scope->IsOffline())
+				scope->Stop();
+		}
+	}
+
+	LogNotice("Processed %zu waveforms in %.3f s (%.2f WFM/s)\n",
+		nprocessed, dt, nprocessed / dt);
+	if(nprocessed)
+	{
+		LogNotice("Filter graph: %.3f ms/WFM, %.2f MS/s of input data\n",
+			m_totalRefreshTime * 1e3 / nprocessed,
+			m_totalSamples * 1e-6 / m_totalRefreshTime);
+	}
+
+	if(!CloseOutputs())
+		return false;
+	return (nprocessed == count);
+}
+
+/**
+	@brief Runs the filter graph on the waveforms currently in the channels and writes the results
+ */
+void HeadlessSession::ProcessWaveform(size_t index)
+{
+	double tstart = GetTime();
+	m_executor.RunBlocking(g_filterRegistry.GetSessionFilters());
+	double dt = GetTime() - tstart;
+	m_totalRefreshTime += dt;
+
+	WriteWaveforms(index);
+	WritePackets(index);
+	WriteStatistics(index, dt);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Output
+
+bool HeadlessSession::OpenOutputs(const string& outdir)
+{
+	m_outputDir = outdir;
+	m_outputFileName = outdir + "/capture.scopesession";
+	m_outputDataDir = outdir + "/capture_data";
+
+#ifdef _WIN32
+	mkdir(outdir.c_str());
+	mkdir(m_outputDataDir.c_str());
+#else
+	mkdir(outdir.c_str(), 0755);
+	mkdir(m_outputDataDir.c_str(), 0755);
+#endif
+
+	for(auto scope : m_scopes)
+	{
+		char tmp[512];
+		snprintf(tmp, sizeof(tmp), "%s/scope_%d_waveforms", m_outputDataDir.c_str(), m_table[scope]);
+
+#ifdef _WIN32
+		mkdir(tmp);
+#else
+		mkdir(tmp, 0755);
+#endif
+
+		m_waveformMetadata[scope] = "waveforms:\n";
+	}
+
+	string fname = outdir + "/stats.csv";
+	m_statsFile = fopen(fname.c_str(), "w");
+	if(!m_statsFile)
+	{
+		LogError("Could not create %s\n", fname.c_str());
+		return false;
+	}
+
+	fprintf(m_statsFile, "waveform,timestamp,refresh_ms");
+	for(auto stream : m_statStreams)
+	{
+		for(auto stat : m_statistics)
+		{
+			string name = stream.GetName() + " " + stat->GetStatisticDisplayName();
+			fprintf(m_statsFile, ",%s", EscapeCSV(name).c_str());
+		}
+	}
+	fprintf(m_statsFile, "\n");
+
+	return true;
+}
+
+/**
+	@brief Saves the instrument waveforms in the same format as the GUI's File | Save
+ */
+void HeadlessSession::WriteWaveforms(size_t index)
+{
+	int id = index + 1;
+
+	for(auto scope : m_scopes)
+	{
+		map<StreamDescriptor, WaveformBase*> data;
+		TimePoint key(0, 0);
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto chan = scope->GetChannel(i);
+			for(size_t j=0; j<chan->GetStreamCount(); j++)
+			{
+				auto wave = chan->GetData(j);
+				if(!wave)
+					continue;
+
+				if(data.empty())
+					key = TimePoint(wave->m_startTimestamp, wave->m_startFemtoseconds);
+				data[StreamDescriptor(chan, j)] = wave;
+				m_totalSamples += wave->m_offsets.size();
+			}
+		}
+		if(data.empty())
+			continue;
+
+		m_waveformMetadata[scope] += WaveformSerializer::SerializeWaveformMetadata(id, key, false, "", data);
+
+		char tmp[512];
+		snprintf(tmp, sizeof(tmp), "%s/scope_%d_waveforms/waveform_%d", m_outputDataDir.c_str(), m_table[scope], id);
+
+#ifdef _WIN32
+		mkdir(tmp);
+#else
+		mkdir(tmp, 0755);
+#endif
+
+		string wname = tmp;
+
+		//Save each channel in parallel
+		vector<pair<StreamDescriptor, WaveformBase*> > streams(data.begin(), data.end());
+		#pragma omp parallel for
+		for(size_t i=0; i<streams.size(); i++)
+		{
+			float progress = 0;
+			int done = 0;
+			WaveformSerializer::SaveStream(wname, streams[i].first, streams[i].second, &progress, &done);
+		}
+	}
+}
+
+/**
+	@brief Appends packets from each protocol decoder to its CSV file
+ */
+void HeadlessSession::WritePackets(size_t index)
+{
+	for(auto f : m_filters)
+	{
+		auto decoder = dynamic_cast<PacketDecoder*>(f);
+		if(!decoder)
+			continue;
+
+		auto headers = decoder->GetHeaders();
+
+		//Open the output file the first time we see this decoder
+		auto& fp = m_packetFiles[decoder];
+		if(!fp)
+		{
+			string name = decoder->GetDisplayName();
+			for(auto& c : name)
+			{
+				if(!isalnum(c))
+					c = '_';
+			}
+			string fname = m_outputDir + "/packets_" + name + ".csv";
+
+			fp = fopen(fname.c_str(), "w");
+			if(!fp)
+			{
+				LogError("Could not create %s\n", fname.c_str());
+				continue;
+			}
+
+			fprintf(fp, "waveform,timestamp,offset_fs,len_fs");
+			for(auto& h : headers)
+				fprintf(fp, ",%s", EscapeCSV(h).c_str());
+			fprintf(fp, ",data\n");
+		}
+
+		auto data = decoder->GetData(0);
+		time_t timestamp = data ? data->m_startTimestamp : 0;
+		int64_t fs = data ? data->m_startFemtoseconds : 0;
+
+		for(auto p : decoder->GetPackets())
+		{
+			fprintf(fp, "%zu,%ld,%lld,%lld",
+				index,
+				(long)timestamp,
+				(long long)(fs + p->m_offset),
+				(long long)p->m_len);
+
+			for(auto& h : headers)
+				fprintf(fp, ",%s", EscapeCSV(p->m_headers[h]).c_str());
+
+			fprintf(fp, ",");
+			for(auto b : p->m_data)
+				fprintf(fp, "%02x", b);
+			fprintf(fp, "\n");
+		}
+	}
+}
+
+/**
+	@brief Appends filter graph timing and the session's statistics to stats.csv
+ */
+void HeadlessSession::WriteStatistics(size_t index, double tRefresh)
+{
+	//Timestamp of the first waveform we can find
+	time_t timestamp = 0;
+	for(auto scope : m_scopes)
+	{
+		for(size_t i=0; (i<scope->GetChannelCount()) && !timestamp; i++)
+		{
+			auto data = scope->GetChannel(i)->GetData(0);
+			if(data)
+				timestamp = data->m_startTimestamp;
+		}
+	}
+
+	fprintf(m_statsFile, "%zu,%ld,%.3f", index, (long)timestamp, tRefresh * 1e3);
+	for(auto stream : m_statStreams)
+	{
+		for(auto stat : m_statistics)
+		{
+			double value;
+			if(stat->Calculate(stream, value))
+				fprintf(m_statsFile, ",%g", value);
+			else
+				fprintf(m_statsFile, ",");
+		}
+	}
+	fprintf(m_statsFile, "\n");
+}
+
+/**
+	@brief Writes the session file and waveform metadata, then closes all output files
+ */
+bool HeadlessSession::CloseOutputs()
+{
+	bool ok = true;
+
+	for(auto scope : m_scopes)
+	{
+		char tmp[512];
+		snprintf(tmp, sizeof(tmp), "%s/scope_%d_metadata.yml", m_outputDataDir.c_str(), m_table[scope]);
+		FILE* fp = fopen(tmp, "w");
+		if(!fp)
+		{
+			LogError("Could not create %s\n", tmp);
+			ok = false;
+			continue;
+		}
+		auto& config = m_waveformMetadata[scope];
+		if(config.length() != fwrite(config.c_str(), 1, config.length(), fp))
+		{
+			LogError("Error writing to %s\n", tmp);
+			ok = false;
+		}
+		fclose(fp);
+	}
+
+	//Session file, so the capture can be opened in the GUI
+	string config = "instruments:\n";
+	for(auto scope : m_scopes)
+		config += scope->SerializeConfiguration(m_table);
+	auto filters = g_filterRegistry.GetSessionFilters();
+	if(!filters.empty())
+	{
+		config += "decodes:\n";
+		for(auto d : filters)
+			config += d->SerializeConfiguration(m_table);
+	}
+
+	FILE* fp = fopen(m_outputFileName.c_str(), "w");
+	if(!fp)
+	{
+		LogError("Could not create %s\n", m_outputFileName.c_str());
+		ok = false;
+	}
+	else
+	{
+		if(config.length() != fwrite(config.c_str(), 1, config.length(), fp))
+		{
+			LogError("Error writing to %s\n", m_outputFileName.c_str());
+			ok = false;
+		}
+		fclose(fp);
+	}
+
+	for(auto it : m_packetFiles)
+	{
+		if(it.second)
+			fclose(it.second);
+	}
+	m_packetFiles.clear();
+
+	if(m_statsFile)
+		fclose(m_statsFile);
+	m_statsFile = NULL;
+
+	return ok;
+}
+
+/**
+	@brief Quotes a string for use as a CSV field, if needed
+ */
+string HeadlessSession::EscapeCSV(const string& str)
+{
+	if(str.find_first_of(",\"\n") == string::npos)
+		return str;
+
+	string ret = "\"";
+	for(auto c : str)
+	{
+		if(c == '"')
+			ret += "\"\"";
+		else
+			ret += c;
+	}
+	ret += "\"";
+	return ret;
+}
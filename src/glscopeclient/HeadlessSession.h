@@ -0,0 +1,114 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of HeadlessSession
+ */
+#ifndef HeadlessSession_h
+#define HeadlessSession_h
+
+#include <map>
+#include <string>
+#include <vector>
+#include "FilterGraphExecutor.h"
+
+/**
+	@brief Runs a .scopesession's instruments and filter graph without any GUI.
+
+	Waveforms are either acquired from the live instruments or replayed from the session's saved data, run through the
+	filter graph as fast as possible, and written to an output directory:
+		capture.scopesession / capture_data/	Instrument waveforms, in a session that can be opened in the GUI
+		packets_<filter>.csv					Packets from each protocol decoder
+		stats.csv								Per-waveform timing, plus the measurements the session has enabled
+ */
+class HeadlessSession
+{
+public:
+	HeadlessSession();
+	~HeadlessSession();
+
+	bool Load(const std::string& filename, bool reconnect, bool loadWaveforms);
+	bool Run(size_t count, const std::string& outdir);
+
+protected:
+	void LoadStatistics(const YAML::Node& node);
+
+	bool HasOnlineScopes();
+	void StartAcquisition();
+	bool AcquireLive();
+	bool LoadSavedWaveform(size_t index);
+
+	bool OpenOutputs(const std::string& outdir);
+	void ProcessWaveform(size_t index);
+	void WriteWaveforms(size_t index);
+	void WritePackets(size_t index);
+	void WriteStatistics(size_t index, double tRefresh);
+	bool CloseOutputs();
+
+	static std::string EscapeCSV(const std::string& str);
+
+	///@brief Instruments in the session, online or mock
+	std::vector<Oscilloscope*> m_scopes;
+
+	///@brief Filters in the session
+	std::vector<Filter*> m_filters;
+
+	///@brief ID table for everything loaded from the session
+	IDTable m_table;
+
+	FilterGraphExecutor m_executor;
+
+	///@brief Streams with statistics enabled in the session
+	std::vector<StreamDescriptor> m_statStreams;
+
+	///@brief Statistics calculated for each stream
+	std::vector<Statistic*> m_statistics;
+
+	///@brief Data directory of the session we loaded, if we're replaying saved waveforms
+	std::string m_inputDataDir;
+
+	///@brief Saved waveform metadata for each instrument, if we're replaying saved waveforms
+	std::map<Oscilloscope*, std::vector<YAML::Node> > m_savedWaveforms;
+
+	//Output state
+	std::string m_outputDir;
+	std::string m_outputFileName;
+	std::string m_outputDataDir;
+	std::map<Oscilloscope*, std::string> m_waveformMetadata;
+	std::map<PacketDecoder*, FILE*> m_packetFiles;
+	FILE* m_statsFile;
+
+	//Counters
+	size_t m_totalSamples;
+	double m_totalRefreshTime;
+};
+
+#endif
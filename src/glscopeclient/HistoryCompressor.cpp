@@ -0,0 +1,670 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of CompressedWaveform and HistoryCompressor
+ */
+#include "../scopehal/scopehal.h"
+#include "HistoryCompressor.h"
+#include "ThreadBudget.h"
+#include "WaveformPool.h"
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Encoding helpers
+
+static void WriteVarint(vector<uint8_t>& buf, uint64_t v)
+{
+	while(v >= 0x80)
+	{
+		buf.push_back( (v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	buf.push_back(v);
+}
+
+static uint64_t ReadVarint(const uint8_t*& p)
+{
+	uint64_t v = 0;
+	for(int shift = 0; ; shift += 7)
+	{
+		uint8_t b = *(p++);
+		v |= static_cast<uint64_t>(b & 0x7f) << shift;
+		if(!(b & 0x80))
+			break;
+	}
+	return v;
+}
+
+///@brief Maps signed values to unsigned so small negative numbers stay small
+static uint64_t ZigZag(int64_t v)
+{
+	return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+static int64_t UnZigZag(uint64_t v)
+{
+	return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+static uint32_t FloatToBits(float f)
+{
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+static float BitsToFloat(uint32_t u)
+{
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+/**
+	@brief Packs values of arbitrary width into a byte stream, LSB first
+ */
+class BitWriter
+{
+public:
+	BitWriter(vector<uint8_t>& buf)
+	: m_buf(buf)
+	, m_acc(0)
+	, m_bits(0)
+	{}
+
+	void Write(uint32_t v, int bits)
+	{
+		m_acc |= static_cast<uint64_t>(v) << m_bits;
+		m_bits += bits;
+		while(m_bits >= 8)
+		{
+			m_buf.push_back(m_acc & 0xff);
+			m_acc >>= 8;
+			m_bits -= 8;
+		}
+	}
+
+	void Flush()
+	{
+		if(m_bits > 0)
+			m_buf.push_back(m_acc & 0xff);
+		m_acc = 0;
+		m_bits = 0;
+	}
+
+protected:
+	vector<uint8_t>& m_buf;
+	uint64_t m_acc;
+	int m_bits;
+};
+
+class BitReader
+{
+public:
+	BitReader(const uint8_t* p)
+	: m_p(p)
+	, m_acc(0)
+	, m_bits(0)
+	{}
+
+	uint32_t Read(int bits)
+	{
+		while(m_bits < bits)
+		{
+			m_acc |= static_cast<uint64_t>(*(m_p++)) << m_bits;
+			m_bits += 8;
+		}
+		uint32_t v = m_acc & ((static_cast<uint64_t>(1) << bits) - 1);
+		m_acc >>= bits;
+		m_bits -= bits;
+		return v;
+	}
+
+protected:
+	const uint8_t* m_p;
+	uint64_t m_acc;
+	int m_bits;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CompressedWaveform
+
+CompressedWaveform::CompressedWaveform()
+	: m_format(FORMAT_DIGITAL)
+	, m_size(0)
+	, m_rawSize(0)
+	, m_timescale(0)
+	, m_startTimestamp(0)
+	, m_startFemtoseconds(0)
+	, m_triggerPhase(0)
+	, m_densePacked(false)
+	, m_implicitTiming(false)
+{
+}
+
+/**
+	@brief Compresses a waveform
+
+	@return The compressed copy, or NULL if it's not a type we know how to compress
+ */
+CompressedWaveform* CompressedWaveform::Compress(WaveformBase* wfm)
+{
+	auto awfm = dynamic_cast<AnalogWaveform*>(wfm);
+	auto dwfm = dynamic_cast<DigitalWaveform*>(wfm);
+	if(!awfm && !dwfm)
+		return NULL;
+
+	auto ret = new CompressedWaveform;
+	ret->m_timescale = wfm->m_timescale;
+	ret->m_startTimestamp = wfm->m_startTimestamp;
+	ret->m_startFemtoseconds = wfm->m_startFemtoseconds;
+	ret->m_triggerPhase = wfm->m_triggerPhase;
+	ret->m_densePacked = wfm->m_densePacked;
+	ret->m_size = wfm->m_offsets.size();
+	ret->CompressTiming(wfm);
+
+	if(dwfm)
+	{
+		ret->m_format = FORMAT_DIGITAL;
+		ret->m_rawSize = sizeof(DigitalWaveform) + ret->m_size * (sizeof(bool) + 2*sizeof(int64_t));
+
+		ret->m_samples.reserve( (ret->m_size + 7) / 8);
+		BitWriter writer(ret->m_samples);
+		for(size_t i=0; i<ret->m_size; i++)
+			writer.Write(dwfm->m_samples[i] ? 1 : 0, 1);
+		writer.Flush();
+	}
+	else
+	{
+		ret->m_rawSize = sizeof(AnalogWaveform) + ret->m_size * (sizeof(float) + 2*sizeof(int64_t));
+
+		if(ret->CompressCodes(awfm))
+			ret->m_format = FORMAT_ADC_CODES;
+		else
+		{
+			ret->m_format = FORMAT_FLOAT_XOR;
+			ret->CompressFloats(awfm);
+		}
+	}
+
+	ret->m_timing.shrink_to_fit();
+	ret->m_samples.shrink_to_fit();
+	ret->m_exceptions.shrink_to_fit();
+	ret->m_codeTable.shrink_to_fit();
+	return ret;
+}
+
+void CompressedWaveform::CompressTiming(WaveformBase* wfm)
+{
+	auto& offsets = wfm->m_offsets;
+	auto& durations = wfm->m_durations;
+
+	//Dense packed waveforms have been checked already
+	m_implicitTiming = true;
+	if(wfm->m_densePacked)
+		return;
+	for(size_t i=0; i<m_size; i++)
+	{
+		if( (offsets[i] != static_cast<int64_t>(i)) || (durations[i] != 1) )
+		{
+			m_implicitTiming = false;
+			break;
+		}
+	}
+	if(m_implicitTiming)
+		return;
+
+	//Offsets as deltas from the previous sample
+	m_timing.reserve(m_size * 2);
+	int64_t last = 0;
+	for(size_t i=0; i<m_size; i++)
+	{
+		WriteVarint(m_timing, ZigZag(offsets[i] - last));
+		last = offsets[i];
+	}
+
+	//Durations almost always run up to the next sample, so store the difference
+	for(size_t i=0; i<m_size; i++)
+	{
+		int64_t gap = 0;
+		if(i+1 < m_size)
+			gap = offsets[i+1] - offsets[i];
+		WriteVarint(m_timing, ZigZag(durations[i] - gap));
+	}
+}
+
+/**
+	@brief Tries to store analog samples as ADC codes
+
+	@return False if the samples aren't quantized enough for this to work
+ */
+bool CompressedWaveform::CompressCodes(AnalogWaveform* wfm)
+{
+	auto& samples = wfm->m_samples;
+	if(m_size < 2)
+		return false;
+
+	//The smallest step between adjacent samples is our best guess at one LSB
+	float vmin = samples[0];
+	float vmax = samples[0];
+	float step = FLT_MAX;
+	for(size_t i=1; i<m_size; i++)
+	{
+		float v = samples[i];
+		vmin = min(vmin, v);
+		vmax = max(vmax, v);
+		float delta = fabs(v - samples[i-1]);
+		if( (delta > 0) && (delta < step) )
+			step = delta;
+	}
+	if(!std::isfinite(vmin) || !std::isfinite(vmax) || (step == FLT_MAX) )
+		return false;
+
+	//More than 16 bits worth of codes, it's probably not from an ADC
+	double range = floor( (vmax - vmin) / step) + 1;
+	if(range > 65536)
+		return false;
+	int64_t ncodes = range;
+
+	//Which code a sample falls into doesn't have to be exact, since we always store the actual value for the code.
+	//Anything that lands in the same bucket as a different value just becomes an exception.
+	vector<bool> used(ncodes, false);
+	m_codeTable.resize(ncodes, 0);
+	m_samples.reserve(m_size);
+
+	size_t max_exceptions = m_size / 16;
+	size_t nexceptions = 0;
+	size_t last_exception = 0;
+	int64_t last = 0;
+	for(size_t i=0; i<m_size; i++)
+	{
+		float v = samples[i];
+		int64_t code = llround( (v - vmin) / step);
+		bool match = false;
+		if( (code >= 0) && (code < ncodes) )
+		{
+			if(!used[code])
+			{
+				used[code] = true;
+				m_codeTable[code] = v;
+				match = true;
+			}
+			else
+				match = (FloatToBits(m_codeTable[code]) == FloatToBits(v));
+		}
+
+		//Doesn't fit the table. Store it verbatim, and repeat the previous code so the delta stream stays small
+		if(!match)
+		{
+			nexceptions ++;
+			if(nexceptions > max_exceptions)
+			{
+				m_samples.clear();
+				m_exceptions.clear();
+				m_codeTable.clear();
+				return false;
+			}
+
+			WriteVarint(m_exceptions, i - last_exception);
+			last_exception = i;
+			uint32_t bits = FloatToBits(v);
+			for(int j=0; j<4; j++)
+				m_exceptions.push_back( (bits >> (j*8)) & 0xff);
+
+			code = last;
+		}
+
+		WriteVarint(m_samples, ZigZag(code - last));
+		last = code;
+	}
+
+	return true;
+}
+
+/**
+	@brief Stores analog samples as the XOR with the previous sample, trimmed to the bits that changed
+ */
+void CompressedWaveform::CompressFloats(AnalogWaveform* wfm)
+{
+	auto& samples = wfm->m_samples;
+
+	m_samples.reserve(m_size * 2);
+	BitWriter writer(m_samples);
+	uint32_t prev = 0;
+	for(size_t i=0; i<m_size; i++)
+	{
+		uint32_t bits = FloatToBits(samples[i]);
+		uint32_t x = bits ^ prev;
+		prev = bits;
+
+		//Same as last time
+		if(x == 0)
+		{
+			writer.Write(0, 1);
+			continue;
+		}
+
+		//Trim zeroes off both ends
+		int lz = 0;
+		while(!(x & (0x80000000 >> lz)))
+			lz ++;
+		int tz = 0;
+		while(!(x & (1u << tz)))
+			tz ++;
+		int len = 32 - lz - tz;
+
+		writer.Write(1, 1);
+		writer.Write(tz, 5);
+		writer.Write(len - 1, 5);
+		writer.Write(x >> tz, len);
+	}
+	writer.Flush();
+}
+
+/**
+	@brief Decompresses into a new waveform (taken from the waveform pool)
+ */
+WaveformBase* CompressedWaveform::Decompress()
+{
+	WaveformBase* ret;
+	if(m_format == FORMAT_DIGITAL)
+	{
+		auto dwfm = g_waveformPool.GetDigital(m_size);
+		dwfm->Resize(m_size);
+
+		BitReader reader(m_samples.empty() ? NULL : &m_samples[0]);
+		for(size_t i=0; i<m_size; i++)
+			dwfm->m_samples[i] = (reader.Read(1) != 0);
+		ret = dwfm;
+	}
+
+	else
+	{
+		auto awfm = g_waveformPool.GetAnalog(m_size);
+		awfm->Resize(m_size);
+		auto& samples = awfm->m_samples;
+
+		if(m_format == FORMAT_ADC_CODES)
+		{
+			const uint8_t* p = m_samples.empty() ? NULL : &m_samples[0];
+			int64_t code = 0;
+			for(size_t i=0; i<m_size; i++)
+			{
+				code += UnZigZag(ReadVarint(p));
+				samples[i] = m_codeTable[code];
+			}
+
+			//Patch up anything the table couldn't represent
+			const uint8_t* e = m_exceptions.empty() ? NULL : &m_exceptions[0];
+			const uint8_t* end = e + m_exceptions.size();
+			size_t i = 0;
+			while(e < end)
+			{
+				i += ReadVarint(e);
+				uint32_t bits = 0;
+				for(int j=0; j<4; j++)
+					bits |= static_cast<uint32_t>(*(e++)) << (j*8);
+				samples[i] = BitsToFloat(bits);
+			}
+		}
+
+		else
+		{
+			BitReader reader(m_samples.empty() ? NULL : &m_samples[0]);
+			uint32_t prev = 0;
+			for(size_t i=0; i<m_size; i++)
+			{
+				if(reader.Read(1))
+				{
+					int tz = reader.Read(5);
+					int len = reader.Read(5) + 1;
+					prev ^= reader.Read(len) << tz;
+				}
+				samples[i] = BitsToFloat(prev);
+			}
+		}
+
+		ret = awfm;
+	}
+
+	ret->m_timescale = m_timescale;
+	ret->m_startTimestamp = m_startTimestamp;
+	ret->m_startFemtoseconds = m_startFemtoseconds;
+	ret->m_triggerPhase = m_triggerPhase;
+	ret->m_densePacked = m_densePacked;
+	DecompressTiming(ret);
+	return ret;
+}
+
+void CompressedWaveform::DecompressTiming(WaveformBase* wfm)
+{
+	auto& offsets = wfm->m_offsets;
+	auto& durations = wfm->m_durations;
+
+	if(m_implicitTiming)
+	{
+		for(size_t i=0; i<m_size; i++)
+		{
+			offsets[i] = i;
+			durations[i] = 1;
+		}
+		return;
+	}
+
+	const uint8_t* p = m_timing.empty() ? NULL : &m_timing[0];
+	int64_t last = 0;
+	for(size_t i=0; i<m_size; i++)
+	{
+		last += UnZigZag(ReadVarint(p));
+		offsets[i] = last;
+	}
+	for(size_t i=0; i<m_size; i++)
+	{
+		int64_t gap = 0;
+		if(i+1 < m_size)
+			gap = offsets[i+1] - offsets[i];
+		durations[i] = gap + UnZigZag(ReadVarint(p));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// HistoryCompressor
+
+HistoryCompressor::HistoryCompressor()
+	: m_busy(false)
+	, m_busyKey(0, 0)
+	, m_busyCancelled(false)
+	, m_terminating(false)
+{
+	m_thread = thread(&HistoryCompressor::WorkerThread, this);
+}
+
+HistoryCompressor::~HistoryCompressor()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_terminating = true;
+		m_queue.clear();
+		m_busyCancelled = true;
+	}
+	m_jobReady.notify_all();
+	m_thread.join();
+}
+
+/**
+	@brief Queues a history entry for compression
+ */
+void HistoryCompressor::Submit(TimePoint key, const map<StreamDescriptor, WaveformBase*>& data)
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_queue.push_back(Job(key, data));
+	}
+	m_jobReady.notify_one();
+}
+
+/**
+	@brief Checks if an entry is queued, being compressed, or has a result waiting to be collected
+ */
+bool HistoryCompressor::IsPending(TimePoint key)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	if(m_busy && (m_busyKey == key) )
+		return true;
+	for(auto& j : m_queue)
+	{
+		if(j.first == key)
+			return true;
+	}
+	for(auto& r : m_results)
+	{
+		if(r.first == key)
+			return true;
+	}
+	return false;
+}
+
+/**
+	@brief Forgets about an entry. Once this returns, its waveforms are no longer being read and may be freed.
+ */
+void HistoryCompressor::Cancel(TimePoint key)
+{
+	unique_lock<mutex> lock(m_mutex);
+
+	for(auto it = m_queue.begin(); it != m_queue.end(); )
+	{
+		if(it->first == key)
+			it = m_queue.erase(it);
+		else
+			it++;
+	}
+
+	if(m_busy && (m_busyKey == key) )
+	{
+		m_busyCancelled = true;
+		m_jobDone.wait(lock, [&]{ return !m_busy || (m_busyKey != key); });
+	}
+
+	for(auto it = m_results.begin(); it != m_results.end(); )
+	{
+		if(it->first == key)
+			it = m_results.erase(it);
+		else
+			it++;
+	}
+}
+
+/**
+	@brief Forgets about every entry. Once this returns, no submitted waveforms are being read.
+ */
+void HistoryCompressor::CancelAll()
+{
+	unique_lock<mutex> lock(m_mutex);
+
+	m_queue.clear();
+	if(m_busy)
+	{
+		m_busyCancelled = true;
+		m_jobDone.wait(lock, [&]{ return !m_busy; });
+	}
+	m_results.clear();
+}
+
+/**
+	@brief Gets a finished result, if there is one
+ */
+bool HistoryCompressor::PopResult(TimePoint& key, CompressedHistory& result)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	if(m_results.empty())
+		return false;
+
+	key = m_results.front().first;
+	result = m_results.front().second;
+	m_results.pop_front();
+	return true;
+}
+
+void HistoryCompressor::WorkerThread()
+{
+	pthread_setname_np_compat("HistoryCompress");
+
+	while(true)
+	{
+		Job job;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_jobReady.wait(lock, [&]{ return m_terminating || !m_queue.empty(); });
+			if(m_terminating)
+				break;
+
+			job = m_queue.front();
+			m_queue.pop_front();
+			m_busy = true;
+			m_busyKey = job.first;
+			m_busyCancelled = false;
+		}
+
+		//Don't compete with the filter graph for more than one core
+		g_threadBudget.BindThread(ThreadBudget::ROLE_FILTER, 1);
+
+		CompressedHistory result;
+		for(auto it : job.second)
+		{
+			if(!it.second)
+				continue;
+
+			auto c = CompressedWaveform::Compress(it.second);
+			if(c)
+				result[it.first] = shared_ptr<CompressedWaveform>(c);
+
+			//Give up early if we've been cancelled, the data may be about to be freed
+			lock_guard<mutex> lock(m_mutex);
+			if(m_busyCancelled)
+				break;
+		}
+
+		{
+			lock_guard<mutex> lock(m_mutex);
+			if(!m_busyCancelled)
+				m_results.push_back(pair<TimePoint, CompressedHistory>(job.first, result));
+			m_busy = false;
+		}
+		m_jobDone.notify_all();
+	}
+}
@@ -0,0 +1,166 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of CompressedWaveform and HistoryCompressor
+ */
+#ifndef HistoryCompressor_h
+#define HistoryCompressor_h
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::pair<time_t, int64_t> TimePoint;
+
+/**
+	@brief Losslessly compressed copy of an analog or digital waveform
+
+	Timestamps are dropped entirely if the waveform is dense packed. Otherwise offsets are stored as varint deltas, and
+	durations as the (usually zero) difference from the gap to the next sample.
+
+	Analog samples are usually an ADC code times a scale plus an offset, so we first try storing them as varint deltas
+	of the code, plus a table of the exact value of each code seen. Any sample which doesn't match the table entry for
+	its code bit for bit is stored verbatim as an exception. If there are too many exceptions, or the samples don't look
+	quantized at all, we fall back to XORing each sample with the previous one and storing only the meaningful bits.
+
+	Digital samples are packed one per bit.
+ */
+class CompressedWaveform
+{
+public:
+	static CompressedWaveform* Compress(WaveformBase* wfm);
+	WaveformBase* Decompress();
+
+	///@brief Approximate RAM used by the compressed data
+	size_t GetCompressedSize()
+	{
+		return sizeof(CompressedWaveform) + m_timing.capacity() + m_samples.capacity() + m_exceptions.capacity() +
+			m_codeTable.capacity() * sizeof(float);
+	}
+
+	///@brief Approximate RAM used by the waveform before compression
+	size_t GetRawSize()
+	{ return m_rawSize; }
+
+protected:
+	CompressedWaveform();
+
+	enum SampleFormat
+	{
+		FORMAT_DIGITAL,
+		FORMAT_ADC_CODES,
+		FORMAT_FLOAT_XOR
+	};
+
+	void CompressTiming(WaveformBase* wfm);
+	void DecompressTiming(WaveformBase* wfm);
+	bool CompressCodes(AnalogWaveform* wfm);
+	void CompressFloats(AnalogWaveform* wfm);
+
+	SampleFormat m_format;
+	size_t m_size;
+	size_t m_rawSize;
+
+	int64_t m_timescale;
+	time_t m_startTimestamp;
+	int64_t m_startFemtoseconds;
+	int64_t m_triggerPhase;
+	bool m_densePacked;
+
+	///@brief True if offsets are 0...n-1 and every duration is 1, so nothing needs to be stored
+	bool m_implicitTiming;
+
+	///@brief Exact sample value for each ADC code
+	std::vector<float> m_codeTable;
+
+	std::vector<uint8_t> m_timing;
+	std::vector<uint8_t> m_samples;
+
+	///@brief Samples which FORMAT_ADC_CODES doesn't reproduce exactly (varint index delta, then raw float)
+	std::vector<uint8_t> m_exceptions;
+};
+
+typedef std::map<StreamDescriptor, std::shared_ptr<CompressedWaveform> > CompressedHistory;
+
+/**
+	@brief Compresses history entries on a background thread
+
+	The caller must not free or modify a submitted waveform until its result has been collected with PopResult(), or
+	the job has been cancelled.
+
+	Has no GUI dependencies.
+ */
+class HistoryCompressor
+{
+public:
+	HistoryCompressor();
+	~HistoryCompressor();
+
+	void Submit(TimePoint key, const std::map<StreamDescriptor, WaveformBase*>& data);
+	bool IsPending(TimePoint key);
+	void Cancel(TimePoint key);
+	void CancelAll();
+	bool PopResult(TimePoint& key, CompressedHistory& result);
+
+protected:
+	void WorkerThread();
+
+	typedef std::pair<TimePoint, std::map<StreamDescriptor, WaveformBase*> > Job;
+
+	std::mutex m_mutex;
+
+	///@brief Signalled when a job is submitted, or we're shutting down
+	std::condition_variable m_jobReady;
+
+	///@brief Signalled when the worker finishes a job
+	std::condition_variable m_jobDone;
+
+	std::deque<Job> m_queue;
+
+	///@brief True if the worker is currently compressing m_busyKey
+	bool m_busy;
+	TimePoint m_busyKey;
+
+	///@brief Set if the job currently being compressed was cancelled, so its result should be discarded
+	bool m_busyCancelled;
+
+	std::deque<std::pair<TimePoint, CompressedHistory> > m_results;
+
+	bool m_terminating;
+	std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,486 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of HistoryReplayer
+ */
+#include "../scopehal/scopehal.h"
+#include "../scopehal/Filter.h"
+#include "../scopehal/PacketDecoder.h"
+#include "../scopeprotocols/scopeprotocols.h"
+#include "FilterRegistry.h"
+#include "HistoryReplayer.h"
+#include "ThreadBudget.h"
+#include <unordered_map>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+HistoryReplayer::HistoryReplayer()
+	: m_nextEntry(0)
+	, m_completed(0)
+	, m_nextResult(0)
+	, m_cancel(false)
+{
+}
+
+HistoryReplayer::~HistoryReplayer()
+{
+	Stop();
+}
+
+HistoryReplayer::Result::~Result()
+{
+	for(auto& it : m_packets)
+	{
+		for(auto& g : it.second)
+		{
+			delete g.m_header;
+			for(auto p : g.m_packets)
+				delete p;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Graph analysis
+
+/**
+	@brief Finds every filter a given filter depends on (including itself), and the non-filter streams feeding them
+ */
+void HistoryReplayer::FindUpstream(Filter* f, set<Filter*>& filters, set<StreamDescriptor>& inputs)
+{
+	if(filters.find(f) != filters.end())
+		return;
+	filters.emplace(f);
+
+	for(size_t i=0; i<f->GetInputCount(); i++)
+	{
+		auto in = f->GetInput(i);
+		if(in.m_channel == NULL)
+			continue;
+
+		auto upstream = dynamic_cast<Filter*>(in.m_channel);
+		if(upstream)
+			FindUpstream(upstream, filters, inputs);
+		else
+			inputs.emplace(in);
+	}
+}
+
+/**
+	@brief Checks whether a decoder's output depends only on a single acquisition, so entries can be decoded out of order
+
+	@param decoder		The decoder to check
+	@param available	Streams which are stored in the history being replayed
+ */
+bool HistoryReplayer::CanReplay(PacketDecoder* decoder, const set<StreamDescriptor>& available)
+{
+	set<Filter*> filters;
+	set<StreamDescriptor> inputs;
+	FindUpstream(decoder, filters, inputs);
+
+	//Eye patterns and waterfalls integrate over many acquisitions, so anything downstream of them has to see
+	//every entry in sequence
+	for(auto f : filters)
+	{
+		auto type = f->GetType();
+		if( (type == OscilloscopeChannel::CHANNEL_TYPE_EYE) || (type == OscilloscopeChannel::CHANNEL_TYPE_WATERFALL) )
+			return false;
+	}
+
+	//Proxies only have a single stream, and we need the data for all of them
+	for(auto in : inputs)
+	{
+		if(in.m_stream != 0)
+			return false;
+		if(available.find(in) == available.end())
+			return false;
+	}
+
+	return true;
+}
+
+/**
+	@brief Groups a decoder's packets into the rows a protocol analyzer displays
+
+	Merged header packets are newly allocated and must be deleted by the caller.
+ */
+void HistoryReplayer::GroupPackets(PacketDecoder* decoder, const vector<Packet*>& packets, vector<PacketGroup>& groups)
+{
+	Packet* first_packet_in_group = NULL;
+	Packet* last_packet = NULL;
+
+	auto npackets = packets.size();
+	for(size_t i=0; i<npackets; i++)
+	{
+		auto p = packets[i];
+
+		//See if we should start a new merge group
+		bool starting_new_group;
+		if(i+1 >= npackets)									//No next packet to merge with
+			starting_new_group = false;
+		else if(!decoder->CanMerge(p, p, packets[i+1]))		//This packet isn't compatible with the next
+			starting_new_group = false;
+		else if(first_packet_in_group == NULL)				//If we get here, we're merging. But are we already?
+			starting_new_group = true;
+		else												//Already in a group, but it's not the same as the new one
+			starting_new_group = !decoder->CanMerge(first_packet_in_group, last_packet, p);
+
+		if(starting_new_group)
+		{
+			first_packet_in_group = p;
+			groups.push_back(PacketGroup(decoder->CreateMergedHeader(p, i)));
+		}
+
+		//End a merge group
+		else if( (first_packet_in_group != NULL) && !decoder->CanMerge(first_packet_in_group, last_packet, p) )
+			first_packet_in_group = NULL;
+
+		//Add the packet to the current group, or on its own if we're not merging
+		if(first_packet_in_group == NULL)
+			groups.push_back(PacketGroup());
+		groups.back().m_packets.push_back(p);
+
+		last_packet = p;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Control
+
+/**
+	@brief Starts decoding a set of history entries
+
+	Must be called from the UI thread, since it creates filters.
+
+	@param decoders		The decoders to replay. All of them must pass CanReplay().
+	@param entries		The history to replay
+	@param threads		Number of worker threads to use
+	@param notify		Called from a worker thread whenever an entry finishes decoding. Must be thread safe.
+ */
+void HistoryReplayer::Start(
+	const set<PacketDecoder*>& decoders,
+	const vector<Entry>& entries,
+	size_t threads,
+	function<void()> notify)
+{
+	Stop();
+
+	m_decoders = decoders;
+	m_entries = entries;
+	m_results.resize(m_entries.size());
+	m_nextEntry = 0;
+	m_completed = 0;
+	m_nextResult = 0;
+	m_cancel = false;
+	m_notify = notify;
+
+	if(m_entries.empty() || m_decoders.empty())
+		return;
+
+	//Find everything the decoders depend on
+	set<Filter*> filters;
+	set<StreamDescriptor> inputs;
+	for(auto d : m_decoders)
+		FindUpstream(d, filters, inputs);
+
+	//No point in having more workers than entries.
+	//Each worker has a full copy of the subgraph, so this is also a memory tradeoff.
+	threads = max(min(threads, m_entries.size()), (size_t)1);
+
+	for(size_t i=0; i<threads; i++)
+	{
+		m_workers.push_back(unique_ptr<Worker>(new Worker));
+		CreateWorker(*m_workers.back(), filters);
+	}
+
+	for(auto& w : m_workers)
+		w->m_thread = thread(&HistoryReplayer::WorkerThread, this, w.get());
+}
+
+/**
+	@brief Cancels any entries not yet decoded, waits for the workers to exit, and frees everything
+
+	Must be called from the UI thread.
+ */
+void HistoryReplayer::Stop()
+{
+	m_cancel = true;
+	for(auto& w : m_workers)
+	{
+		if(w->m_thread.joinable())
+			w->m_thread.join();
+	}
+
+	for(auto& w : m_workers)
+		DestroyWorker(*w);
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_results.clear();
+	}
+	m_workers.clear();
+	m_entries.clear();
+	m_decoders.clear();
+	m_notify = nullptr;
+	m_nextResult = 0;
+}
+
+/**
+	@brief Returns the result for the next entry, or NULL if it hasn't finished decoding yet
+ */
+unique_ptr<HistoryReplayer::Result> HistoryReplayer::PopResult()
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	if( (m_nextResult >= m_results.size()) || !m_results[m_nextResult] )
+		return NULL;
+	return move(m_results[m_nextResult ++]);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Worker management
+
+/**
+	@brief Makes a private copy of a set of filters, with proxies standing in for the scope channels feeding them
+
+	The copies are configured by round tripping each filter's parameters through the same YAML used by session files.
+ */
+void HistoryReplayer::CreateWorker(Worker& worker, const set<Filter*>& filters)
+{
+	IDTable table;
+	for(auto f : filters)
+	{
+		auto node = YAML::Load(string("decodes:\n") + f->SerializeConfiguration(table));
+		auto config = node["decodes"].begin()->second;
+
+		auto clone = g_filterRegistry.CreatePrivateFilter(f->GetProtocolDisplayName(), f->m_displaycolor);
+		if(clone == NULL)
+			continue;
+		clone->AddRef();
+		clone->LoadParameters(config, table);
+
+		worker.m_clones[f] = clone;
+		worker.m_filters.emplace(clone);
+	}
+
+	//Hook up the inputs once everything exists
+	for(auto it : worker.m_clones)
+	{
+		auto f = it.first;
+		for(size_t i=0; i<f->GetInputCount(); i++)
+		{
+			auto in = f->GetInput(i);
+			if(in.m_channel == NULL)
+				continue;
+
+			auto upstream = dynamic_cast<Filter*>(in.m_channel);
+			if(upstream)
+			{
+				it.second->SetInput(i, StreamDescriptor(worker.m_clones[upstream], in.m_stream), true);
+				continue;
+			}
+
+			auto& proxy = worker.m_proxies[in.m_channel];
+			if(proxy == NULL)
+			{
+				auto chan = in.m_channel;
+				proxy = new OscilloscopeChannel(
+					chan->GetScope(),
+					chan->GetHwname(),
+					chan->GetType(),
+					chan->m_displaycolor,
+					chan->GetIndex(),
+					false);
+				proxy->SetXAxisUnits(chan->GetXAxisUnits());
+				proxy->SetYAxisUnits(chan->GetYAxisUnits(0), 0);
+			}
+			it.second->SetInput(i, StreamDescriptor(proxy, in.m_stream), true);
+		}
+	}
+
+	worker.m_executor.SetThreadCount(1);
+	worker.m_executor.SetClearAnalysisCache(false);
+}
+
+/**
+	@brief Frees a worker's copy of the graph. The thread must have already exited.
+ */
+void HistoryReplayer::DestroyWorker(Worker& worker)
+{
+	for(auto it : worker.m_clones)
+		g_filterRegistry.ReleasePrivateFilter(it.second);
+	worker.m_clones.clear();
+	worker.m_filters.clear();
+
+	//The proxies only ever borrow history waveforms, so detach them before deleting
+	for(auto it : worker.m_proxies)
+	{
+		it.second->Detach(0);
+		delete it.second;
+	}
+	worker.m_proxies.clear();
+}
+
+/**
+	@brief Frees a waveform's sample buffers, but not the waveform object itself
+ */
+void HistoryReplayer::FreeSamples(WaveformBase* wfm)
+{
+	auto awfm = dynamic_cast<AnalogWaveform*>(wfm);
+	if(awfm)
+		decltype(awfm->m_samples)().swap(awfm->m_samples);
+	auto dwfm = dynamic_cast<DigitalWaveform*>(wfm);
+	if(dwfm)
+		decltype(dwfm->m_samples)().swap(dwfm->m_samples);
+
+	decltype(wfm->m_offsets)().swap(wfm->m_offsets);
+	decltype(wfm->m_durations)().swap(wfm->m_durations);
+}
+
+/**
+	@brief Makes a deep copy of a packet, preserving its type
+ */
+Packet* HistoryReplayer::CopyPacket(Packet* p)
+{
+	auto vp = dynamic_cast<VideoScanlinePacket*>(p);
+	if(vp)
+		return new VideoScanlinePacket(*vp);
+	return new Packet(*p);
+}
+
+void HistoryReplayer::WorkerThread(Worker* worker)
+{
+	pthread_setname_np_compat("HistoryReplay");
+	g_threadBudget.BindThread(ThreadBudget::ROLE_FILTER, 1);
+
+	//Waveforms we decompressed for the current entry
+	vector<WaveformBase*> temps;
+
+	//Waveforms we decompressed for earlier entries. The global analysis cache is keyed by waveform address, and we
+	//don't clear it, so a waveform recycled into the next entry could pick up zero crossings etc. from this one. Only
+	//the sample buffers are freed until the run is over, so no two entries' inputs can ever share an address.
+	vector<WaveformBase*> retired;
+
+	while(!m_cancel)
+	{
+		size_t i = m_nextEntry ++;
+		if(i >= m_entries.size())
+			break;
+		auto& entry = m_entries[i];
+
+		//Point the proxies at this entry's waveforms, decompressing or paging in anything which was evicted from RAM.
+		//The history still owns the rest, so detach first to make sure SetData() never frees anything.
+		for(auto it : worker->m_proxies)
+			it.second->Detach(0);
+		for(auto w : temps)
+		{
+			FreeSamples(w);
+			retired.push_back(w);
+		}
+		temps.clear();
+		for(auto it : worker->m_proxies)
+		{
+			StreamDescriptor stream(it.first, 0);
+			WaveformBase* data = NULL;
+			auto jt = entry.m_data.find(stream);
+			if(jt != entry.m_data.end())
+				data = jt->second;
+			if(data == NULL)
+			{
+				auto ct = entry.m_compressed.find(stream);
+				if(ct != entry.m_compressed.end())
+				{
+					data = ct->second->Decompress();
+					temps.push_back(data);
+				}
+			}
+			if(data == NULL)
+			{
+				auto st = entry.m_spilled.find(stream);
+				if(st != entry.m_spilled.end())
+				{
+					data = st->second.Load();
+					if(data)
+						temps.push_back(data);
+				}
+			}
+			if(data)
+				it.second->SetData(data, 0);
+		}
+
+		worker->m_executor.RunBlocking(worker->m_filters);
+
+		//Copy the packets out, since the decoders will free them on the next entry
+		auto result = unique_ptr<Result>(new Result);
+		result->m_stamp = entry.m_stamp;
+		for(auto d : m_decoders)
+		{
+			auto clone = dynamic_cast<PacketDecoder*>(worker->m_clones[d]);
+			if( (clone == NULL) || (clone->GetData(0) == NULL) )
+				continue;
+
+			auto& packets = clone->GetPackets();
+			if(packets.empty())
+				continue;
+
+			auto& groups = result->m_packets[d];
+			GroupPackets(clone, packets, groups);
+
+			unordered_map<Packet*, Packet*> copies;
+			for(auto p : packets)
+				copies[p] = CopyPacket(p);
+			for(auto& g : groups)
+			{
+				for(auto& p : g.m_packets)
+					p = copies[p];
+			}
+		}
+
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_results[i] = move(result);
+		}
+		m_completed ++;
+
+		if(m_notify)
+			m_notify();
+	}
+
+	for(auto it : worker->m_proxies)
+		it.second->Detach(0);
+	for(auto w : temps)
+		delete w;
+	for(auto w : retired)
+		delete w;
+}
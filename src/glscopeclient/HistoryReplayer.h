@@ -0,0 +1,195 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of HistoryReplayer
+ */
+#ifndef HistoryReplayer_h
+#define HistoryReplayer_h
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include "FilterGraphExecutor.h"
+#include "HistorySpillStore.h"
+
+/**
+	@brief A run of packets which a protocol analyzer displays together
+
+	If m_header is NULL, m_packets contains a single standalone packet. Otherwise, m_header is the summary row for
+	a merge group (owned by whoever called GroupPackets()) and m_packets are its children.
+ */
+class PacketGroup
+{
+public:
+	PacketGroup(Packet* header = NULL)
+	: m_header(header)
+	{}
+
+	Packet* m_header;
+	std::vector<Packet*> m_packets;
+};
+
+/**
+	@brief Runs protocol decoders over stored history in parallel
+
+	Each worker thread gets a private copy of the decoders and everything upstream of them, with the scope channels
+	replaced by proxy channels. The copies are private filters, so they never show up in the user's session. Workers
+	claim history entries one at a time, point the proxies at that entry's waveforms, evaluate their copy of the graph,
+	and stash a copy of the resulting packets. The UI thread collects results with PopResult(), which always returns
+	them in the order the entries were passed to Start(). A callback passed to Start() is run (on the worker thread)
+	every time an entry finishes, so the UI can wake up and collect results without polling.
+
+	The waveforms in the history entries are only borrowed, and must stay alive until Stop() returns.
+
+	Has no GUI dependencies.
+ */
+class HistoryReplayer
+{
+public:
+	HistoryReplayer();
+	~HistoryReplayer();
+
+	///@brief One stored acquisition
+	class Entry
+	{
+	public:
+		Entry(TimePoint stamp, const std::map<StreamDescriptor, WaveformBase*>& data)
+		: m_stamp(stamp)
+		, m_data(data)
+		{}
+
+		TimePoint m_stamp;
+		std::map<StreamDescriptor, WaveformBase*> m_data;
+
+		///@brief Compressed copies of streams which are NULL in m_data
+		CompressedHistory m_compressed;
+
+		///@brief Copies of streams which are NULL in m_data and have been written out to disk
+		SpilledHistory m_spilled;
+	};
+
+	///@brief Decoded packets for one entry, keyed by the original (not cloned) decoder
+	class Result
+	{
+	public:
+		~Result();
+
+		TimePoint m_stamp;
+		std::map<PacketDecoder*, std::vector<PacketGroup> > m_packets;
+	};
+
+	static bool CanReplay(PacketDecoder* decoder, const std::set<StreamDescriptor>& available);
+
+	void Start(
+		const std::set<PacketDecoder*>& decoders,
+		const std::vector<Entry>& entries,
+		size_t threads,
+		std::function<void()> notify = nullptr);
+	void Stop();
+
+	std::unique_ptr<Result> PopResult();
+
+	///@brief Returns true if every entry has been decoded and collected
+	bool IsDone()
+	{ return m_nextResult >= m_entries.size(); }
+
+	///@brief Number of entries which have finished decoding
+	size_t GetCompletedCount()
+	{ return m_completed; }
+
+	///@brief Number of entries being replayed
+	size_t GetTotalCount()
+	{ return m_entries.size(); }
+
+	static void GroupPackets(PacketDecoder* decoder, const std::vector<Packet*>& packets, std::vector<PacketGroup>& groups);
+
+protected:
+
+	///@brief Private copy of the decode subgraph owned by a single worker thread
+	class Worker
+	{
+	public:
+		std::thread m_thread;
+
+		///@brief Maps original filters to our copies of them
+		std::map<Filter*, Filter*> m_clones;
+
+		///@brief Maps scope channels to the proxies standing in for them
+		std::map<OscilloscopeChannel*, OscilloscopeChannel*> m_proxies;
+
+		std::set<Filter*> m_filters;
+		FilterGraphExecutor m_executor;
+	};
+
+	static void FindUpstream(Filter* f, std::set<Filter*>& filters, std::set<StreamDescriptor>& inputs);
+	void CreateWorker(Worker& worker, const std::set<Filter*>& filters);
+	void DestroyWorker(Worker& worker);
+	void WorkerThread(Worker* worker);
+	static Packet* CopyPacket(Packet* p);
+	static void FreeSamples(WaveformBase* wfm);
+
+	///@brief The decoders being replayed
+	std::set<PacketDecoder*> m_decoders;
+
+	///@brief The entries being replayed
+	std::vector<Entry> m_entries;
+
+	///@brief Index of the next entry to be claimed by a worker
+	std::atomic<size_t> m_nextEntry;
+
+	///@brief Number of entries decoded so far
+	std::atomic<size_t> m_completed;
+
+	///@brief Index of the next result to be returned by PopResult()
+	size_t m_nextResult;
+
+	///@brief Set to stop workers early
+	std::atomic<bool> m_cancel;
+
+	///@brief Called by workers after each entry is decoded
+	std::function<void()> m_notify;
+
+	std::vector<std::unique_ptr<Worker> > m_workers;
+
+	///@brief Mutex protecting m_results
+	std::mutex m_mutex;
+
+	///@brief Finished results, indexed by entry
+	std::vector<std::unique_ptr<Result> > m_results;
+};
+
+#endif
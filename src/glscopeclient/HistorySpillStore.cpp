@@ -0,0 +1,513 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of SpilledWaveform and HistorySpillStore
+ */
+#include "../scopehal/scopehal.h"
+#include "FileSystem.h"
+#include "HistorySpillStore.h"
+#include "ThreadBudget.h"
+#include "WaveformPool.h"
+#include "WaveformSerializer.h"
+#include <atomic>
+#include <set>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static void MakeDirectory(const string& path)
+{
+#ifdef _WIN32
+	mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SpilledWaveform
+
+SpilledWaveform::SpilledWaveform()
+	: m_analog(true)
+	, m_timescale(0)
+	, m_startTimestamp(0)
+	, m_startFemtoseconds(0)
+	, m_triggerPhase(0)
+	, m_rawSize(0)
+{
+}
+
+/**
+	@brief Creates an empty waveform with the same type, timebase and timestamp as the spilled one
+ */
+WaveformBase* SpilledWaveform::CreateEmpty()
+{
+	WaveformBase* ret;
+	if(m_analog)
+		ret = new AnalogWaveform;
+	else
+		ret = new DigitalWaveform;
+
+	ret->m_timescale = m_timescale;
+	ret->m_startTimestamp = m_startTimestamp;
+	ret->m_startFemtoseconds = m_startFemtoseconds;
+	ret->m_triggerPhase = m_triggerPhase;
+	ret->m_densePacked = (m_format == "densev1");
+	return ret;
+}
+
+/**
+	@brief Maps the spilled file back in, and copies it into a waveform from the pool
+
+	@return The waveform, or NULL if the file couldn't be read
+ */
+WaveformBase* SpilledWaveform::Load()
+{
+	auto like = CreateEmpty();
+	float progress = 0;
+	auto ret = WaveformSerializer::LoadStreamFile(m_fname, m_format, like, &progress);
+	delete like;
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+HistorySpillStore::HistorySpillStore()
+	: m_busy(false)
+	, m_busyKey(0, 0)
+	, m_busyCancelled(false)
+	, m_nextID(1)
+	, m_terminating(false)
+{
+	m_thread = thread(&HistorySpillStore::WorkerThread, this);
+}
+
+HistorySpillStore::~HistorySpillStore()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_terminating = true;
+		m_queue.clear();
+		m_busyCancelled = true;
+	}
+	m_jobReady.notify_all();
+	m_thread.join();
+
+	//Nothing we spilled is any use to anyone else
+	for(auto& dir : m_dirs)
+		::RemoveDirectory(dir);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Job control
+
+/**
+	@brief Sets the directory spilled waveforms are written to
+
+	Each store creates its own subdirectory under this, which is deleted when the store is destroyed. If empty, the
+	system temporary directory is used. Waveforms already spilled stay where they are.
+ */
+void HistorySpillStore::SetDirectory(const string& root)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_root = root;
+}
+
+/**
+	@brief Queues a history entry to be written out
+
+	@param key			Timestamp of the entry
+	@param data			Waveforms which are resident in RAM
+	@param compressed	Compressed copies, used for any streams which aren't resident
+ */
+void HistorySpillStore::Submit(
+	TimePoint key,
+	const map<StreamDescriptor, WaveformBase*>& data,
+	const CompressedHistory& compressed)
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		Job job;
+		job.m_key = key;
+		job.m_data = data;
+		job.m_compressed = compressed;
+		m_queue.push_back(job);
+	}
+	m_jobReady.notify_one();
+}
+
+/**
+	@brief Checks if an entry is queued, being written, or has a result waiting to be collected
+ */
+bool HistorySpillStore::IsPending(TimePoint key)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	if(m_busy && (m_busyKey == key) )
+		return true;
+	for(auto& j : m_queue)
+	{
+		if(j.m_key == key)
+			return true;
+	}
+	for(auto& r : m_results)
+	{
+		if(r.m_key == key)
+			return true;
+	}
+	return false;
+}
+
+/**
+	@brief Forgets about an entry, deleting anything written for it
+
+	Once this returns, its waveforms are no longer being read and may be freed.
+ */
+void HistorySpillStore::Cancel(TimePoint key)
+{
+	unique_lock<mutex> lock(m_mutex);
+
+	for(auto it = m_queue.begin(); it != m_queue.end(); )
+	{
+		if(it->m_key == key)
+			it = m_queue.erase(it);
+		else
+			it++;
+	}
+
+	if(m_busy && (m_busyKey == key) )
+	{
+		m_busyCancelled = true;
+		m_jobDone.wait(lock, [&]{ return !m_busy || (m_busyKey != key); });
+	}
+
+	for(auto it = m_results.begin(); it != m_results.end(); )
+	{
+		if(it->m_key == key)
+		{
+			Remove(it->m_spilled);
+			it = m_results.erase(it);
+		}
+		else
+			it++;
+	}
+}
+
+/**
+	@brief Forgets about every entry. Once this returns, no submitted waveforms are being read.
+ */
+void HistorySpillStore::CancelAll()
+{
+	unique_lock<mutex> lock(m_mutex);
+
+	m_queue.clear();
+	if(m_busy)
+	{
+		m_busyCancelled = true;
+		m_jobDone.wait(lock, [&]{ return !m_busy; });
+	}
+	for(auto& r : m_results)
+		Remove(r.m_spilled);
+	m_results.clear();
+}
+
+/**
+	@brief Gets a finished result, if there is one
+
+	@param key		Timestamp of the entry
+	@param result	Spilled copy of each stream. Streams which can't be spilled (not analog or digital) are left out.
+	@param ok		False if the entry couldn't be written, in which case result is empty
+
+	@return True if there was a result
+ */
+bool HistorySpillStore::PopResult(TimePoint& key, SpilledHistory& result, bool& ok)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	if(m_results.empty())
+		return false;
+
+	key = m_results.front().m_key;
+	result = m_results.front().m_spilled;
+	ok = m_results.front().m_ok;
+	m_results.pop_front();
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// File management
+
+/**
+	@brief Deletes the files for a spilled history entry
+ */
+void HistorySpillStore::Remove(const SpilledHistory& spilled)
+{
+	string dir;
+	for(auto it : spilled)
+	{
+		::remove(it.second.m_fname.c_str());
+
+		auto pos = it.second.m_fname.rfind('/');
+		if(pos != string::npos)
+			dir = it.second.m_fname.substr(0, pos);
+	}
+
+	if(!dir.empty())
+		::RemoveDirectory(dir);
+}
+
+/**
+	@brief Puts a copy of a spilled waveform's sample data at a new location, e.g. in a session being saved
+
+	The file is hard linked if possible, which is about as cheap as a rename but leaves the spilled copy in place.
+	If that fails (different filesystem etc) it's copied instead.
+
+	@return True on success
+ */
+bool HistorySpillStore::Export(const SpilledWaveform& wfm, const string& fname)
+{
+#ifndef _WIN32
+	::remove(fname.c_str());
+	if(0 == link(wfm.m_fname.c_str(), fname.c_str()))
+		return true;
+#endif
+
+	FILE* fin = fopen(wfm.m_fname.c_str(), "rb");
+	if(!fin)
+	{
+		LogError("couldn't open %s\n", wfm.m_fname.c_str());
+		return false;
+	}
+	FILE* fout = fopen(fname.c_str(), "wb");
+	if(!fout)
+	{
+		LogError("couldn't create %s\n", fname.c_str());
+		fclose(fin);
+		return false;
+	}
+
+	bool ok = true;
+	vector<char> buf(1024 * 1024);
+	while(true)
+	{
+		size_t len = fread(&buf[0], 1, buf.size(), fin);
+		if(len == 0)
+			break;
+		if(len != fwrite(&buf[0], 1, len, fout))
+		{
+			LogError("file write error\n");
+			ok = false;
+			break;
+		}
+	}
+
+	fclose(fin);
+	if(0 != fclose(fout))
+		ok = false;
+	return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Worker
+
+/**
+	@brief Writes every stream of one history entry to a directory
+
+	@return True on success. On failure, anything which was written is deleted again.
+ */
+bool HistorySpillStore::Spill(
+	const string& dir,
+	const map<StreamDescriptor, WaveformBase*>& data,
+	const CompressedHistory& compressed,
+	SpilledHistory& result)
+{
+	MakeDirectory(dir);
+
+	set<StreamDescriptor> streams;
+	for(auto it : data)
+	{
+		if(it.second)
+			streams.emplace(it.first);
+	}
+	for(auto it : compressed)
+		streams.emplace(it.first);
+
+	bool ok = true;
+	for(auto stream : streams)
+	{
+		//Expand evicted waveforms just long enough to write them
+		WaveformBase* wfm = NULL;
+		bool temp = false;
+		auto it = data.find(stream);
+		if( (it != data.end()) && it->second)
+			wfm = it->second;
+		else
+		{
+			wfm = compressed.find(stream)->second->Decompress();
+			temp = true;
+		}
+		if(!wfm)
+			continue;
+
+		//Only analog and digital waveforms can be saved for now. Anything else stays in RAM.
+		auto awfm = dynamic_cast<AnalogWaveform*>(wfm);
+		auto dwfm = dynamic_cast<DigitalWaveform*>(wfm);
+		if(awfm || dwfm)
+		{
+			SpilledWaveform s;
+			s.m_fname = WaveformSerializer::GetStreamFileName(dir, stream.m_channel->GetIndex(), stream.m_stream);
+			s.m_format = WaveformSerializer::GetStreamFormat(wfm);
+			s.m_analog = (awfm != NULL);
+			s.m_timescale = wfm->m_timescale;
+			s.m_startTimestamp = wfm->m_startTimestamp;
+			s.m_startFemtoseconds = wfm->m_startFemtoseconds;
+			s.m_triggerPhase = wfm->m_triggerPhase;
+			if(awfm)
+				s.m_rawSize = sizeof(AnalogWaveform) + wfm->m_offsets.size() * (sizeof(float) + 2*sizeof(int64_t));
+			else
+				s.m_rawSize = sizeof(DigitalWaveform) + wfm->m_offsets.size() * (sizeof(bool) + 2*sizeof(int64_t));
+
+			float progress = 0;
+			int done = 0;
+			if(WaveformSerializer::SaveStream(dir, stream, wfm, &progress, &done))
+				result[stream] = s;
+			else
+				ok = false;
+		}
+
+		if(temp)
+			g_waveformPool.Return(wfm);
+
+		//Give up early if we've been cancelled, the data may be about to be freed
+		lock_guard<mutex> lock(m_mutex);
+		if(m_busyCancelled || !ok)
+			break;
+	}
+
+	//Don't leave partial entries lying around
+	if(!ok)
+	{
+		Remove(result);
+		result.clear();
+		::RemoveDirectory(dir);
+	}
+	return ok;
+}
+
+void HistorySpillStore::WorkerThread()
+{
+	pthread_setname_np_compat("HistorySpill");
+
+	//Disambiguate multiple stores (one per instrument), and multiple instances of the application
+	static atomic<int> nextInstance(1);
+	int instance = nextInstance ++;
+#ifdef _WIN32
+	int pid = _getpid();
+#else
+	int pid = getpid();
+#endif
+
+	string scratch;
+	string scratchRoot;
+	while(true)
+	{
+		Job job;
+		string root;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_jobReady.wait(lock, [&]{ return m_terminating || !m_queue.empty(); });
+			if(m_terminating)
+				break;
+
+			job = m_queue.front();
+			m_queue.pop_front();
+			m_busy = true;
+			m_busyKey = job.m_key;
+			m_busyCancelled = false;
+			root = m_root;
+		}
+
+		//Don't compete with the filter graph for more than one core
+		g_threadBudget.BindThread(ThreadBudget::ROLE_FILTER, 1);
+
+		//Make our scratch directory the first time we need it, or if the location changed
+		if(scratch.empty() || (root != scratchRoot))
+		{
+			scratchRoot = root;
+			if(root.empty())
+			{
+				const char* tmp = getenv("TMPDIR");
+				if(!tmp)
+					tmp = getenv("TEMP");
+				if(!tmp)
+					tmp = "/tmp";
+				root = tmp;
+			}
+
+			char tmp[512];
+			snprintf(tmp, sizeof(tmp), "%s/glscopeclient-history-%d-%d", root.c_str(), pid, instance);
+			scratch = tmp;
+			MakeDirectory(scratch);
+
+			lock_guard<mutex> lock(m_mutex);
+			if(find(m_dirs.begin(), m_dirs.end(), scratch) == m_dirs.end())
+				m_dirs.push_back(scratch);
+		}
+
+		char tmp[512];
+		snprintf(tmp, sizeof(tmp), "%s/waveform_%zu", scratch.c_str(), m_nextID++);
+
+		Result result;
+		result.m_key = job.m_key;
+		result.m_ok = Spill(tmp, job.m_data, job.m_compressed, result.m_spilled);
+
+		{
+			lock_guard<mutex> lock(m_mutex);
+			if(m_busyCancelled)
+			{
+				Remove(result.m_spilled);
+				::RemoveDirectory(tmp);
+			}
+			else
+				m_results.push_back(result);
+			m_busy = false;
+		}
+		m_jobDone.notify_all();
+	}
+}
@@ -0,0 +1,167 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of SpilledWaveform and HistorySpillStore
+ */
+#ifndef HistorySpillStore_h
+#define HistorySpillStore_h
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "HistoryCompressor.h"
+
+/**
+	@brief One stream of a history entry which has been written out to the scratch directory
+
+	The file is in the same format as a saved session, so it can be mapped straight back in, or linked into a session
+	data directory instead of being written again.
+ */
+class SpilledWaveform
+{
+public:
+	SpilledWaveform();
+
+	WaveformBase* Load();
+	WaveformBase* CreateEmpty();
+
+	///@brief Path to the sample data
+	std::string m_fname;
+
+	///@brief Storage format of the sample data, as used in the session metadata
+	std::string m_format;
+
+	///@brief True for analog waveforms, false for digital
+	bool m_analog;
+
+	int64_t m_timescale;
+	time_t m_startTimestamp;
+	int64_t m_startFemtoseconds;
+	int64_t m_triggerPhase;
+
+	///@brief Approximate RAM used by the waveform once it's loaded again
+	size_t m_rawSize;
+};
+
+typedef std::map<StreamDescriptor, SpilledWaveform> SpilledHistory;
+
+/**
+	@brief Writes history entries out to a scratch directory on a background thread
+
+	Each entry gets its own waveform_N directory, laid out like one waveform of a saved session. Streams which were
+	evicted from RAM are expanded from their compressed copy just long enough to be written.
+
+	The caller must not free or modify a submitted waveform until its result has been collected with PopResult(), or
+	the job has been cancelled.
+
+	Has no GUI dependencies.
+ */
+class HistorySpillStore
+{
+public:
+	HistorySpillStore();
+	~HistorySpillStore();
+
+	void SetDirectory(const std::string& root);
+
+	void Submit(
+		TimePoint key,
+		const std::map<StreamDescriptor, WaveformBase*>& data,
+		const CompressedHistory& compressed);
+	bool IsPending(TimePoint key);
+	void Cancel(TimePoint key);
+	void CancelAll();
+	bool PopResult(TimePoint& key, SpilledHistory& result, bool& ok);
+
+	static void Remove(const SpilledHistory& spilled);
+	static bool Export(const SpilledWaveform& wfm, const std::string& fname);
+
+protected:
+	void WorkerThread();
+	bool Spill(
+		const std::string& dir,
+		const std::map<StreamDescriptor, WaveformBase*>& data,
+		const CompressedHistory& compressed,
+		SpilledHistory& result);
+
+	class Job
+	{
+	public:
+		TimePoint m_key;
+		std::map<StreamDescriptor, WaveformBase*> m_data;
+		CompressedHistory m_compressed;
+	};
+
+	class Result
+	{
+	public:
+		TimePoint m_key;
+		SpilledHistory m_spilled;
+		bool m_ok;
+	};
+
+	std::mutex m_mutex;
+
+	///@brief Signalled when a job is submitted, or we're shutting down
+	std::condition_variable m_jobReady;
+
+	///@brief Signalled when the worker finishes a job
+	std::condition_variable m_jobDone;
+
+	std::deque<Job> m_queue;
+
+	///@brief True if the worker is currently writing m_busyKey
+	bool m_busy;
+	TimePoint m_busyKey;
+
+	///@brief Set if the job currently being written was cancelled, so its files should be deleted
+	bool m_busyCancelled;
+
+	std::deque<Result> m_results;
+
+	///@brief Directory the scratch directory is created in
+	std::string m_root;
+
+	///@brief Scratch directories we've created, which are deleted when we're done
+	std::vector<std::string> m_dirs;
+
+	///@brief ID of the next waveform_N directory
+	size_t m_nextID;
+
+	bool m_terminating;
+	std::thread m_thread;
+};
+
+#endif
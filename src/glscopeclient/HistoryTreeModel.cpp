@@ -0,0 +1,593 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of HistoryTreeModel
+ */
+#include "glscopeclient.h"
+#include "HistoryWindow.h"
+#include <algorithm>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// HistoryTreeRow
+
+HistoryTreeRow::HistoryTreeRow()
+	: m_capturekey(0, 0)
+	, m_pinned(false)
+	, m_offset(0)
+	, m_marker(NULL)
+	, m_pinvisible(false)
+	, m_bytes(0)
+	, m_rawBytes(0)
+	, m_lastUsed(0)
+	, m_diskBytes(0)
+	, m_parent(NULL)
+{
+}
+
+HistoryTreeRow::~HistoryTreeRow()
+{
+	for(auto c : m_children)
+		delete c;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+HistoryTreeModel::HistoryTreeModel(const HistoryColumns& columns)
+	 : Glib::ObjectBase(typeid(HistoryTreeModel))
+	 , Gtk::TreeModel()
+	 , m_columns(columns)
+{
+}
+
+HistoryTreeModel::~HistoryTreeModel()
+{
+	for(auto r : m_rows)
+		delete r;
+}
+
+Glib::RefPtr<HistoryTreeModel> HistoryTreeModel::create(const HistoryColumns& columns)
+{
+	return Glib::RefPtr<HistoryTreeModel>(new HistoryTreeModel(columns));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Iterator helpers
+
+/*
+	Iterators hold a pointer to the row in user_data, and where we last saw it in user_data2 (the index among the top
+	level rows, or among its siblings for a marker). The index is only a hint, since rows move when older ones are
+	deleted, but it's right almost every time and saves a binary search.
+ */
+
+void HistoryTreeModel::SetIter(GtkTreeIter* iter, const HistoryTreeRow* row, size_t index)
+{
+	iter->user_data = const_cast<HistoryTreeRow*>(row);
+	iter->user_data2 = GSIZE_TO_POINTER(index);
+	iter->user_data3 = NULL;
+	iter->stamp = 1;
+}
+
+void HistoryTreeModel::ClearIter(GtkTreeIter* iter)
+{
+	iter->user_data = NULL;
+	iter->user_data2 = NULL;
+	iter->user_data3 = NULL;
+	iter->stamp = 0;
+}
+
+/**
+	@brief Converts an iterator to the underlying row object
+ */
+HistoryTreeRow* HistoryTreeModel::GetRow(const iterator& iter) const
+{
+	return static_cast<HistoryTreeRow*>(iter.gobj()->user_data);
+}
+
+/**
+	@brief Finds where a row is among its siblings
+
+	@param row	The row
+	@param hint	Where the row probably is
+ */
+size_t HistoryTreeModel::GetIndex(const HistoryTreeRow* row, size_t hint) const
+{
+	//Markers: there are only ever a few under each row, so just look
+	if(row->m_parent)
+	{
+		auto& siblings = row->m_parent->m_children;
+		if( (hint < siblings.size()) && (siblings[hint] == row) )
+			return hint;
+		return find(siblings.begin(), siblings.end(), row) - siblings.begin();
+	}
+
+	if( (hint < m_rows.size()) && (m_rows[hint] == row) )
+		return hint;
+
+	//Binary search by timestamp, then step over any other rows with the same timestamp
+	auto it = lower_bound(
+		m_rows.begin(),
+		m_rows.end(),
+		row->m_capturekey,
+		[](const HistoryTreeRow* r, const TimePoint& key) { return r->m_capturekey < key; });
+	while( (it != m_rows.end()) && (*it != row) )
+		it++;
+	return it - m_rows.begin();
+}
+
+size_t HistoryTreeModel::GetIndex(const iterator& iter) const
+{
+	return GetIndex(GetRow(iter), GPOINTER_TO_SIZE(iter.gobj()->user_data2));
+}
+
+Gtk::TreePath HistoryTreeModel::GetPath(const HistoryTreeRow* row, size_t hint) const
+{
+	Gtk::TreePath path;
+	if(row->m_parent)
+	{
+		path.push_back(GetIndex(row->m_parent, 0));
+		path.push_back(GetIndex(row, hint));
+	}
+	else
+		path.push_back(GetIndex(row, hint));
+	return path;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Gtk::TreeModel interface
+
+Gtk::TreeModelFlags HistoryTreeModel::get_flags_vfunc() const
+{
+	//Iterators point at the row itself, so they're only invalidated by deleting that row
+	return Gtk::TREE_MODEL_ITERS_PERSIST;
+}
+
+int HistoryTreeModel::get_n_columns_vfunc() const
+{
+	return m_columns.size();
+}
+
+GType HistoryTreeModel::get_column_type_vfunc(int index) const
+{
+	return m_columns.types()[index];
+}
+
+bool HistoryTreeModel::iter_next_vfunc(const iterator& iter, iterator& iter_next) const
+{
+	auto row = GetRow(iter);
+	size_t index = GetIndex(iter) + 1;
+
+	auto g = iter_next.gobj();
+	if(row->m_parent)
+	{
+		if(index < row->m_parent->m_children.size())
+		{
+			SetIter(g, row->m_parent->m_children[index], index);
+			return true;
+		}
+	}
+	else if(index < m_rows.size())
+	{
+		SetIter(g, m_rows[index], index);
+		return true;
+	}
+
+	ClearIter(g);
+	return false;
+}
+
+bool HistoryTreeModel::iter_children_vfunc(const iterator& parent, iterator& iter) const
+{
+	return iter_nth_child_vfunc(parent, 0, iter);
+}
+
+bool HistoryTreeModel::iter_has_child_vfunc(const iterator& iter) const
+{
+	return !GetRow(iter)->m_children.empty();
+}
+
+int HistoryTreeModel::iter_n_children_vfunc(const iterator& iter) const
+{
+	return GetRow(iter)->m_children.size();
+}
+
+int HistoryTreeModel::iter_n_root_children_vfunc() const
+{
+	return m_rows.size();
+}
+
+bool HistoryTreeModel::iter_nth_child_vfunc(const iterator& parent, int n, iterator& iter) const
+{
+	auto& children = GetRow(parent)->m_children;
+	auto g = iter.gobj();
+	if( (n < 0) || (n >= (int)children.size()) )
+	{
+		ClearIter(g);
+		return false;
+	}
+
+	SetIter(g, children[n], n);
+	return true;
+}
+
+bool HistoryTreeModel::iter_nth_root_child_vfunc(int n, iterator& iter) const
+{
+	auto g = iter.gobj();
+	if( (n < 0) || (n >= (int)m_rows.size()) )
+	{
+		ClearIter(g);
+		return false;
+	}
+
+	SetIter(g, m_rows[n], n);
+	return true;
+}
+
+bool HistoryTreeModel::iter_parent_vfunc(const iterator& child, iterator& iter) const
+{
+	auto parent = GetRow(child)->m_parent;
+	auto g = iter.gobj();
+	if(parent == NULL)
+	{
+		ClearIter(g);
+		return false;
+	}
+
+	SetIter(g, parent, GetIndex(parent, 0));
+	return true;
+}
+
+Gtk::TreePath HistoryTreeModel::get_path_vfunc(const iterator& iter) const
+{
+	return GetPath(GetRow(iter), GPOINTER_TO_SIZE(iter.gobj()->user_data2));
+}
+
+bool HistoryTreeModel::get_iter_vfunc(const Gtk::TreePath& path, iterator& iter) const
+{
+	auto g = iter.gobj();
+	if( (path.size() < 1) || (path.size() > 2) || (path[0] < 0) || (path[0] >= (int)m_rows.size()) )
+	{
+		ClearIter(g);
+		return false;
+	}
+
+	auto row = m_rows[path[0]];
+	if(path.size() == 1)
+	{
+		SetIter(g, row, path[0]);
+		return true;
+	}
+
+	if( (path[1] < 0) || (path[1] >= (int)row->m_children.size()) )
+	{
+		ClearIter(g);
+		return false;
+	}
+	SetIter(g, row->m_children[path[1]], path[1]);
+	return true;
+}
+
+void HistoryTreeModel::set_value_impl(const iterator& row, int column, const Glib::ValueBase& value)
+{
+	auto p = GetRow(row);
+
+	//Column numbers are in the order they're added in the HistoryColumns constructor
+	switch(column)
+	{
+		case 0:
+			p->m_timestamp = reinterpret_cast<const Gtk::TreeModelColumn<Glib::ustring>::ValueType&>(value).get();
+			break;
+
+		case 1:
+			p->m_datestamp = reinterpret_cast<const Gtk::TreeModelColumn<Glib::ustring>::ValueType&>(value).get();
+			break;
+
+		case 2:
+			{
+				//Top level rows are sorted by this, so it can only be set by Insert()
+				TimePoint key = reinterpret_cast<const Gtk::TreeModelColumn<TimePoint>::ValueType&>(value).get();
+				if(p->m_parent == NULL)
+				{
+					if(key != p->m_capturekey)
+						LogError("HistoryTreeModel: can't change the timestamp of a history row\n");
+					return;
+				}
+				p->m_capturekey = key;
+			}
+			break;
+
+		case 3:
+			p->m_history = reinterpret_cast<const Gtk::TreeModelColumn<WaveformHistory>::ValueType&>(value).get();
+			break;
+
+		case 4:
+			{
+				bool pinned = reinterpret_cast<const Gtk::TreeModelColumn<bool>::ValueType&>(value).get();
+				if( (p->m_parent == NULL) && (pinned != p->m_pinned) )
+				{
+					if(pinned)
+						m_unpinned.erase(make_pair(p->m_capturekey, p));
+					else
+						m_unpinned.emplace(p->m_capturekey, p);
+				}
+				p->m_pinned = pinned;
+			}
+			break;
+
+		case 5:
+			p->m_label = reinterpret_cast<const Gtk::TreeModelColumn<Glib::ustring>::ValueType&>(value).get();
+			break;
+
+		case 6:
+			p->m_offset = reinterpret_cast<const Gtk::TreeModelColumn<int64_t>::ValueType&>(value).get();
+			break;
+
+		case 7:
+			p->m_marker = reinterpret_cast<const Gtk::TreeModelColumn<Marker*>::ValueType&>(value).get();
+			break;
+
+		case 8:
+			p->m_pinvisible = reinterpret_cast<const Gtk::TreeModelColumn<bool>::ValueType&>(value).get();
+			break;
+
+		case 9:
+			p->m_compressed = reinterpret_cast<const Gtk::TreeModelColumn<CompressedHistory>::ValueType&>(value).get();
+			break;
+
+		case 10:
+			p->m_bytes = reinterpret_cast<const Gtk::TreeModelColumn<size_t>::ValueType&>(value).get();
+			break;
+
+		case 11:
+			p->m_rawBytes = reinterpret_cast<const Gtk::TreeModelColumn<size_t>::ValueType&>(value).get();
+			break;
+
+		case 12:
+			p->m_lastUsed = reinterpret_cast<const Gtk::TreeModelColumn<uint64_t>::ValueType&>(value).get();
+			break;
+
+		case 13:
+			p->m_spilled = reinterpret_cast<const Gtk::TreeModelColumn<SpilledHistory>::ValueType&>(value).get();
+			break;
+
+		case 14:
+			p->m_diskBytes = reinterpret_cast<const Gtk::TreeModelColumn<size_t>::ValueType&>(value).get();
+			break;
+
+		default:
+			return;
+	}
+
+	row_changed(get_path_vfunc(row), row);
+}
+
+void HistoryTreeModel::get_value_vfunc(const TreeModel::iterator& iter, int column, Glib::ValueBase& value) const
+{
+	auto p = GetRow(iter);
+	value.init(m_columns.types()[column]);
+
+	switch(column)
+	{
+		case 0:
+			reinterpret_cast<Gtk::TreeModelColumn<Glib::ustring>::ValueType&>(value).set(p->m_timestamp);
+			break;
+
+		case 1:
+			reinterpret_cast<Gtk::TreeModelColumn<Glib::ustring>::ValueType&>(value).set(p->m_datestamp);
+			break;
+
+		case 2:
+			reinterpret_cast<Gtk::TreeModelColumn<TimePoint>::ValueType&>(value).set(p->m_capturekey);
+			break;
+
+		case 3:
+			reinterpret_cast<Gtk::TreeModelColumn<WaveformHistory>::ValueType&>(value).set(p->m_history);
+			break;
+
+		case 4:
+			reinterpret_cast<Gtk::TreeModelColumn<bool>::ValueType&>(value).set(p->m_pinned);
+			break;
+
+		case 5:
+			reinterpret_cast<Gtk::TreeModelColumn<Glib::ustring>::ValueType&>(value).set(p->m_label);
+			break;
+
+		case 6:
+			reinterpret_cast<Gtk::TreeModelColumn<int64_t>::ValueType&>(value).set(p->m_offset);
+			break;
+
+		case 7:
+			reinterpret_cast<Gtk::TreeModelColumn<Marker*>::ValueType&>(value).set(p->m_marker);
+			break;
+
+		case 8:
+			reinterpret_cast<Gtk::TreeModelColumn<bool>::ValueType&>(value).set(p->m_pinvisible);
+			break;
+
+		case 9:
+			reinterpret_cast<Gtk::TreeModelColumn<CompressedHistory>::ValueType&>(value).set(p->m_compressed);
+			break;
+
+		case 10:
+			reinterpret_cast<Gtk::TreeModelColumn<size_t>::ValueType&>(value).set(p->m_bytes);
+			break;
+
+		case 11:
+			reinterpret_cast<Gtk::TreeModelColumn<size_t>::ValueType&>(value).set(p->m_rawBytes);
+			break;
+
+		case 12:
+			reinterpret_cast<Gtk::TreeModelColumn<uint64_t>::ValueType&>(value).set(p->m_lastUsed);
+			break;
+
+		case 13:
+			reinterpret_cast<Gtk::TreeModelColumn<SpilledHistory>::ValueType&>(value).set(p->m_spilled);
+			break;
+
+		case 14:
+			reinterpret_cast<Gtk::TreeModelColumn<size_t>::ValueType&>(value).set(p->m_diskBytes);
+			break;
+
+		default:
+			break;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Editing
+
+/**
+	@brief Adds a new history row, in timestamp order
+
+	Rows normally arrive in order, so this is almost always an append.
+ */
+Gtk::TreeModel::iterator HistoryTreeModel::Insert(TimePoint key)
+{
+	auto pos = upper_bound(
+		m_rows.begin(),
+		m_rows.end(),
+		key,
+		[](const TimePoint& k, const HistoryTreeRow* r) { return k < r->m_capturekey; });
+	size_t index = pos - m_rows.begin();
+
+	auto row = new HistoryTreeRow;
+	row->m_capturekey = key;
+	m_rows.insert(pos, row);
+	m_unpinned.emplace(key, row);
+
+	//Update the view
+	Gtk::TreePath path;
+	path.push_back(index);
+	auto it = get_iter(path);
+	row_inserted(path, it);
+	return it;
+}
+
+/**
+	@brief Adds a marker under a history row
+ */
+Gtk::TreeModel::iterator HistoryTreeModel::append(const Gtk::TreeNodeChildren& node)
+{
+	auto parent = static_cast<HistoryTreeRow*>(node.gobj()->user_data);
+	if( (parent == NULL) || (parent->m_parent != NULL) )
+	{
+		LogError("HistoryTreeModel: markers can only be added under history rows\n");
+		return iterator();
+	}
+
+	auto row = new HistoryTreeRow;
+	row->m_parent = parent;
+	parent->m_children.push_back(row);
+
+	//Update the view
+	auto path = GetPath(row, parent->m_children.size() - 1);
+	auto it = get_iter(path);
+	row_inserted(path, it);
+	if(parent->m_children.size() == 1)
+	{
+		path.up();
+		row_has_child_toggled(path, get_iter(path));
+	}
+	return it;
+}
+
+/**
+	@brief Deletes a row, and any markers under it
+
+	@return Iterator to the next row at the same level, if there is one
+ */
+Gtk::TreeModel::iterator HistoryTreeModel::erase(const iterator& iter)
+{
+	auto row = GetRow(iter);
+	auto path = get_path_vfunc(iter);
+	size_t index = path.back();
+	auto parent = row->m_parent;
+
+	if(parent)
+		parent->m_children.erase(parent->m_children.begin() + index);
+	else
+	{
+		m_rows.erase(m_rows.begin() + index);
+		m_unpinned.erase(make_pair(row->m_capturekey, row));
+	}
+	delete row;
+
+	//Tell the view
+	row_deleted(path);
+	if(parent && parent->m_children.empty())
+	{
+		auto ppath = path;
+		ppath.up();
+		row_has_child_toggled(ppath, get_iter(ppath));
+	}
+
+	//Whatever came after the deleted row is now in its place
+	return get_iter(path);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Lookup
+
+/**
+	@brief Finds the history row with a given timestamp
+
+	@return The row, or an invalid iterator if there isn't one
+ */
+Gtk::TreeModel::iterator HistoryTreeModel::Find(TimePoint key)
+{
+	auto it = lower_bound(
+		m_rows.begin(),
+		m_rows.end(),
+		key,
+		[](const HistoryTreeRow* r, const TimePoint& k) { return r->m_capturekey < k; });
+	if( (it == m_rows.end()) || ((*it)->m_capturekey != key) )
+		return iterator();
+
+	Gtk::TreePath path;
+	path.push_back(it - m_rows.begin());
+	return get_iter(path);
+}
+
+/**
+	@brief Finds the oldest history row which isn't pinned
+
+	@return The row, or an invalid iterator if every row is pinned
+ */
+Gtk::TreeModel::iterator HistoryTreeModel::FindOldestUnpinned()
+{
+	if(m_unpinned.empty())
+		return iterator();
+
+	auto row = m_unpinned.begin()->second;
+	return get_iter(GetPath(row, 0));
+}
@@ -35,7 +35,9 @@
 #include "glscopeclient.h"
 #include "OscilloscopeWindow.h"
 #include "HistoryWindow.h"
+#include "DensePack.h"
 #include "FileProgressDialog.h"
+#include "WaveformSerializer.h"
 
 using namespace std;
 
@@ -44,6 +46,7 @@ using namespace std;
 
 HistoryColumns::HistoryColumns()
 {
+	//Order matters: HistoryTreeModel looks columns up by index
 	add(m_timestamp);
 	add(m_datestamp);
 	add(m_capturekey);
@@ -53,8 +56,16 @@ HistoryColumns::HistoryColumns()
 	add(m_offset);
 	add(m_marker);
 	add(m_pinvisible);
+	add(m_compressed);
+	add(m_bytes);
+	add(m_rawBytes);
+	add(m_lastUsed);
+	add(m_spilled);
+	add(m_diskBytes);
 }
 
+uint64_t HistoryWindow::m_nextUseStamp = 1;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
@@ -63,6 +74,16 @@ HistoryWindow::HistoryWindow(OscilloscopeWindow* parent, Oscilloscope* scope)
 	, m_parent(parent)
 	, m_scope(scope)
 	, m_updating(false)
+	, m_compress(false)
+	, m_uncompressedDepth(1)
+	, m_spill(false)
+	, m_historyBorrowed(0)
+	, m_replaying(false)
+	, m_bytesUsed(0)
+	, m_bytesRaw(0)
+	, m_bytesOnDisk(0)
+	, m_bytesSpilling(0)
+	, m_memoryBudget(0)
 {
 	set_skip_taskbar_hint();
 	set_type_hint(Gdk::WINDOW_TYPE_HINT_DIALOG);
@@ -70,7 +91,7 @@ HistoryWindow::HistoryWindow(OscilloscopeWindow* parent, Oscilloscope* scope)
 	set_default_size(450, 800);
 
 	//Set up the tree view
-	m_model = Gtk::TreeStore::create(m_columns);
+	m_model = HistoryTreeModel::create(m_columns);
 	m_tree.set_model(m_model);
 	m_tree.get_selection()->signal_changed().connect(sigc::mem_fun(*this, &HistoryWindow::OnSelectionChanged));
 	m_tree.signal_button_press_event().connect_notify(sigc::mem_fun(*this, &HistoryWindow::OnTreeButtonPressEvent));
@@ -98,6 +119,9 @@ HistoryWindow::HistoryWindow(OscilloscopeWindow* parent, Oscilloscope* scope)
 		m_scroller.set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
 			m_tree.get_selection()->set_mode(Gtk::SELECTION_BROWSE);
 	get_vbox()->pack_start(m_status, Gtk::PACK_SHRINK);
+		m_status.pack_start(m_replayProgress, Gtk::PACK_EXPAND_WIDGET);
+			m_replayProgress.set_show_text();
+			m_replayProgress.set_no_show_all();
 		m_status.pack_end(m_memoryLabel, Gtk::PACK_SHRINK);
 			m_memoryLabel.set_text("");
 	show_all();
@@ -112,10 +136,21 @@ HistoryWindow::HistoryWindow(OscilloscopeWindow* parent, Oscilloscope* scope)
 
 	m_lastHistoryKey.first = 0;
 	m_lastHistoryKey.second = 0;
+
+	SyncPreferences();
+	m_backgroundTimer = Glib::signal_timeout().connect(
+		sigc::mem_fun(*this, &HistoryWindow::OnBackgroundTimer), 250);
+	m_replayDispatcher.connect(sigc::mem_fun(*this, &HistoryWindow::OnReplayProgress));
 }
 
 HistoryWindow::~HistoryWindow()
 {
+	//Make sure nothing is still reading the waveforms before we free them
+	m_backgroundTimer.disconnect();
+	m_replayer.Stop();
+	m_compressor.CancelAll();
+	m_spillStore.CancelAll();
+
 	//Delete old waveform data
 	auto children = m_model->children();
 	for(auto it : children)
@@ -137,6 +172,27 @@ void HistoryWindow::SetMaxWaveforms(int n)
 	m_maxBox.set_text(tmp);
 }
 
+int HistoryWindow::GetMaxWaveforms()
+{
+	return atoi(m_maxBox.get_text().c_str());
+}
+
+/**
+	@brief Update compression settings from the preferences manager
+ */
+void HistoryWindow::SyncPreferences()
+{
+	auto& prefs = m_parent->GetPreferences();
+	m_compress = prefs.GetBool("Acquisition.History.compress");
+	m_uncompressedDepth = max(static_cast<size_t>(prefs.GetReal("Acquisition.History.uncompressed_depth")), (size_t)1);
+	m_memoryBudget = static_cast<size_t>(prefs.GetReal("Acquisition.History.instrument_budget") * 1024 * 1024);
+	m_spill = prefs.GetBool("Acquisition.History.spill");
+	m_spillStore.SetDirectory(prefs.GetString("Acquisition.History.spill_directory"));
+
+	CompressOldHistory();
+	EnforceMemoryBudget();
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Event handlers
 
@@ -217,11 +273,10 @@ void HistoryWindow::OnWaveformDataReady(bool loading, bool pin, const string& la
 
 	//Create the row
 	m_updating = true;
-	auto rowit = m_model->append();
+	auto rowit = m_model->Insert(key);
 	auto row = *rowit;
 	row[m_columns.m_timestamp] = FormatTimestamp(data->m_startTimestamp, data->m_startFemtoseconds);
 	row[m_columns.m_datestamp] = FormatDate(data->m_startTimestamp, data->m_startFemtoseconds);
-	row[m_columns.m_capturekey] = key;
 	row[m_columns.m_pinned] = pin;
 	row[m_columns.m_label] = label;
 	row[m_columns.m_pinvisible] = true;
@@ -244,12 +299,17 @@ void HistoryWindow::OnWaveformDataReady(bool loading, bool pin, const string& la
 			hist[StreamDescriptor(c, j)] = dat;
 
 			//Clear excess space out of the waveform buffer
-			auto adat = dynamic_cast<AnalogWaveform*>(data);
+			auto adat = dynamic_cast<AnalogWaveform*>(dat);
 			if(adat)
 				adat->m_samples.shrink_to_fit();
+
+			//Flag it as dense packed if the driver didn't, so it's drawn, compressed and saved that way
+			DetectDensePacked(dat);
 		}
 	}
 	row[m_columns.m_history] = hist;
+	UpdateRowMemoryUsage(row);
+	TouchRow(rowit);
 
 	//auto scroll to bottom
 	auto adj = m_scroller.get_vadjustment();
@@ -264,13 +324,17 @@ void HistoryWindow::OnWaveformDataReady(bool loading, bool pin, const string& la
 	{
 		string smax = m_maxBox.get_text();
 		size_t nmax = atoi(smax.c_str());
-		auto nchildren = m_model->children().size();
-		if(nmax < nchildren)
-			m_maxBox.set_text(to_string(nchildren));
+		auto nrows = m_model->GetRowCount();
+		if(nmax < nrows)
+			m_maxBox.set_text(to_string(nrows));
 	}
 	else
+	{
 		ClearOldHistoryItems();
+		EnforceMemoryBudget();
+	}
 
+	CompressOldHistory();
 	UpdateMemoryUsageEstimate();
 
 	m_updating = false;
@@ -278,7 +342,6 @@ void HistoryWindow::OnWaveformDataReady(bool loading, bool pin, const string& la
 
 void HistoryWindow::ClearOldHistoryItems()
 {
-	auto children = m_model->children();
 	string smax = m_maxBox.get_text();
 	size_t nmax = atoi(smax.c_str());
 
@@ -289,108 +352,500 @@ void HistoryWindow::ClearOldHistoryItems()
 		nmax = 1;
 	}
 
-	while(children.size() > nmax)
+	//Rows can't be deleted while a replay or save is reading them. We'll catch up on the next waveform.
+	if(m_historyBorrowed)
+		return;
+
+	while(m_model->GetRowCount() > nmax)
 	{
-		bool deletedSomething = false;
+		//Delete the oldest un-pinned entry.
+		//If everything we could have deleted was pinned, give up
+		auto it = m_model->FindOldestUnpinned();
+		if(!it)
+			break;
+		DeleteHistoryRow(it);
+	}
+}
 
-		//Look for the oldest un-pinned entry
-		for(auto it = children.begin(); (bool)it; it++)
-		{
-			//Skip pinned rows
-			if( (*it)[m_columns.m_pinned] )
-				continue;
+/**
+	@brief Deletes the least recently used rows until we're within the memory budget
+ */
+void HistoryWindow::EnforceMemoryBudget()
+{
+	if(m_memoryBudget != 0)
+	{
+		while( (GetMemoryUsage() > m_memoryBudget) && FreeLeastRecentlyUsed() )
+		{}
+	}
 
-			//Not pinned, eligible to delete
-			DeleteHistoryRow(it);
-			deletedSomething = true;
-			break;
-		}
+	//We might be within our own budget but still need to make room for other instruments
+	m_parent->EnforceHistoryBudget();
 
-		//everything we could have deleted was pinned, give up
-		if(!deletedSomething)
-			break;
+	UpdateMemoryUsageEstimate();
+}
+
+/**
+	@brief Finds the least recently used row which may be deleted
+
+	Pinned rows are never deleted, nor is the most recently used row (which is normally the one being displayed).
+	Nothing is deleted while the history is being replayed or saved.
+ */
+map<uint64_t, Gtk::TreeModel::iterator>::iterator HistoryWindow::FindLeastRecentlyUsed()
+{
+	if(m_lruRows.empty() || m_historyBorrowed)
+		return m_lruRows.end();
+
+	auto newest = prev(m_lruRows.end());
+	for(auto it = m_lruRows.begin(); it != newest; it++)
+	{
+		if(!(*it->second)[m_columns.m_pinned])
+			return it;
 	}
+	return m_lruRows.end();
+}
+
+/**
+	@brief Gets the last use stamp of the least recently used row which may be deleted
+
+	@return False if there is no such row
+ */
+bool HistoryWindow::GetLeastRecentlyUsed(uint64_t& stamp)
+{
+	auto it = FindLeastRecentlyUsed();
+	if(it == m_lruRows.end())
+		return false;
+	stamp = it->first;
+	return true;
+}
+
+/**
+	@brief Frees the RAM used by the least recently used row which may be deleted
+
+	If spilling is enabled, the row is written to disk. Otherwise it's deleted.
+
+	@return False if there was nothing we could free
+ */
+bool HistoryWindow::FreeLeastRecentlyUsed()
+{
+	auto it = FindLeastRecentlyUsed();
+	if(it == m_lruRows.end())
+		return false;
+
+	if(m_spill)
+		SpillRow(it->second);
+	else
+		DeleteHistoryRow(it->second);
+	UpdateMemoryUsageEstimate();
+	return true;
+}
+
+/**
+	@brief Moves a row out of RAM and onto disk
+
+	If the row was spilled before (and has since been paged back in) the copy on disk is still good, so the RAM is
+	freed immediately. Otherwise it's queued for the spill store, and freed once it's been written.
+ */
+void HistoryWindow::SpillRow(const Gtk::TreeModel::iterator& it)
+{
+	auto row = *it;
+	TimePoint key = row[m_columns.m_capturekey];
+	uint64_t stamp = row[m_columns.m_lastUsed];
+	m_lruRows.erase(stamp);
+
+	SpilledHistory spilled = row[m_columns.m_spilled];
+	if(!spilled.empty())
+	{
+		EvictHistory(row);
+		return;
+	}
+
+	//Anything evicted from RAM is written from its compressed copy
+	WaveformHistory hist = row[m_columns.m_history];
+	WaveformHistory data;
+	for(auto jt : hist)
+	{
+		if(jt.second)
+			data[jt.first] = jt.second;
+	}
+	CompressedHistory compressed = row[m_columns.m_compressed];
+	m_spillStore.Submit(key, data, compressed);
+
+	//Count the row as free already, so we don't spill more than we need to while this one is being written
+	size_t bytes = row[m_columns.m_bytes];
+	m_spillingBytes[key] = bytes;
+	m_bytesSpilling += bytes;
+}
+
+/**
+	@brief Marks a top level row as the most recently used
+ */
+void HistoryWindow::TouchRow(const Gtk::TreeModel::iterator& it)
+{
+	//If the row was on its way to disk, it's going to stay in RAM now
+	TimePoint key = (*it)[m_columns.m_capturekey];
+	auto st = m_spillingBytes.find(key);
+	if(st != m_spillingBytes.end())
+	{
+		m_bytesSpilling -= st->second;
+		m_spillingBytes.erase(st);
+	}
+
+	uint64_t stamp = (*it)[m_columns.m_lastUsed];
+	m_lruRows.erase(stamp);
+
+	stamp = m_nextUseStamp ++;
+	(*it)[m_columns.m_lastUsed] = stamp;
+	m_lruRows[stamp] = it;
 }
 
 void HistoryWindow::DeleteHistoryRow(const Gtk::TreeModel::iterator& it)
 {
 	//Delete any protocol analyzer state from the waveform being deleted
-	auto key = (*it)[m_columns.m_capturekey];
+	TimePoint key = (*it)[m_columns.m_capturekey];
 	m_parent->RemoveProtocolHistoryFrom(key);
 	m_parent->RemoveMarkersFrom(key);
 
-	//Delete the history data
+	//Stop tracking the row
+	uint64_t stamp = (*it)[m_columns.m_lastUsed];
+	m_lruRows.erase(stamp);
+	m_rawRows.erase(key);
+	size_t bytes = (*it)[m_columns.m_bytes];
+	size_t rawBytes = (*it)[m_columns.m_rawBytes];
+	size_t diskBytes = (*it)[m_columns.m_diskBytes];
+	m_bytesUsed -= bytes;
+	m_bytesRaw -= rawBytes;
+	m_bytesOnDisk -= diskBytes;
+	auto st = m_spillingBytes.find(key);
+	if(st != m_spillingBytes.end())
+	{
+		m_bytesSpilling -= st->second;
+		m_spillingBytes.erase(st);
+	}
+
+	//Recycle the history data, once the compressor and spill store are done looking at it
+	m_compressor.Cancel(key);
+	m_spillStore.Cancel(key);
+	SpilledHistory spilled = (*it)[m_columns.m_spilled];
+	HistorySpillStore::Remove(spilled);
 	WaveformHistory hist = (*it)[m_columns.m_history];
 	for(auto w : hist)
-		delete w.second;
+		g_waveformPool.Return(w.second);
 
 	//and remove the row from the tree view
 	m_model->erase(it);
 }
 
+/**
+	@brief Formats a byte count as MB or GB for the status bar
+ */
+static string FormatMemorySize(size_t bytes)
+{
+	char tmp[64];
+	float mb = bytes / (1024.0f * 1024.0f);
+	float gb = mb / 1024;
+	if(gb > 1)
+		snprintf(tmp, sizeof(tmp), "%.2f GB", gb);
+	else
+		snprintf(tmp, sizeof(tmp), "%.0f MB", mb);
+	return tmp;
+}
+
 void HistoryWindow::UpdateMemoryUsageEstimate()
 {
-	auto children = m_model->children();
+	//Totals are kept up to date as rows change, so we don't have to walk the tree (which is slow with lots of history)
+	string label = to_string(m_model->GetRowCount()) + " WFM / " + FormatMemorySize(m_bytesUsed);
+	if( (m_bytesRaw != m_bytesUsed) || (m_bytesOnDisk != 0) )
+	{
+		label += " (" + FormatMemorySize(m_bytesRaw) + " raw";
+		if(m_bytesOnDisk != 0)
+			label += ", " + FormatMemorySize(m_bytesOnDisk) + " on disk";
+		label += ")";
+	}
+	m_memoryLabel.set_label(label);
+}
 
-	//Calculate our RAM usage (rough estimate)
-	size_t bytes_used = 0;
-	for(auto it : children)
+/**
+	@brief Recalculates the RAM used by one row of history, and updates the totals to match
+
+	This only needs to be called when the row's waveforms, compressed or spilled copies change, so keeping the totals
+	up to date costs O(1) per waveform no matter how much history we have.
+ */
+void HistoryWindow::UpdateRowMemoryUsage(const Gtk::TreeRow& row)
+{
+	WaveformHistory hist = row[m_columns.m_history];
+	CompressedHistory compressed = row[m_columns.m_compressed];
+	SpilledHistory spilled = row[m_columns.m_spilled];
+
+	size_t bytes = 0;
+	size_t rawBytes = 0;
+	size_t diskBytes = 0;
+	bool resident = false;
+	for(auto it : hist)
 	{
-		WaveformHistory hist = (*it)[m_columns.m_history];
+		auto ct = compressed.find(it.first);
+		auto st = spilled.find(it.first);
+		if(ct != compressed.end())
+			bytes += ct->second->GetCompressedSize();
+
+		if(it.second)
+		{
+			size_t size = GetWaveformMemoryUsage(it.second);
+			bytes += size;
+			rawBytes += size;
+			resident = true;
+		}
+		else if(ct != compressed.end())
+			rawBytes += ct->second->GetRawSize();
+		else if(st != spilled.end())
+			rawBytes += st->second.m_rawSize;
+
+		//Spilled files are about the same size as the waveform in RAM
+		if(st != spilled.end())
+			diskBytes += st->second.m_rawSize;
+	}
+
+	size_t oldBytes = row[m_columns.m_bytes];
+	size_t oldRawBytes = row[m_columns.m_rawBytes];
+	size_t oldDiskBytes = row[m_columns.m_diskBytes];
+	m_bytesUsed = m_bytesUsed - oldBytes + bytes;
+	m_bytesRaw = m_bytesRaw - oldRawBytes + rawBytes;
+	m_bytesOnDisk = m_bytesOnDisk - oldDiskBytes + diskBytes;
+
+	//Avoid firing row-changed signals if nothing moved
+	if(bytes != oldBytes)
+		row[m_columns.m_bytes] = bytes;
+	if(rawBytes != oldRawBytes)
+		row[m_columns.m_rawBytes] = rawBytes;
+	if(diskBytes != oldDiskBytes)
+		row[m_columns.m_diskBytes] = diskBytes;
+
+	//Keep track of which rows CompressOldHistory() has anything to do for
+	TimePoint key = row[m_columns.m_capturekey];
+	if(resident)
+		m_rawRows.emplace(key);
+	else
+		m_rawRows.erase(key);
+}
+
+/**
+	@brief Gets the waveforms for a history row, decompressing or paging in any which were evicted from RAM
+
+	Restored waveforms are stored back into the row, so they stay resident until EvictHistory() is called.
+ */
+WaveformHistory HistoryWindow::GetHistory(const Gtk::TreeRow& row)
+{
+	WaveformHistory hist = row[m_columns.m_history];
+	CompressedHistory compressed = row[m_columns.m_compressed];
+	SpilledHistory spilled = row[m_columns.m_spilled];
+
+	bool changed = false;
+	for(auto& it : hist)
+	{
+		if(it.second)
+			continue;
+
+		auto ct = compressed.find(it.first);
+		if(ct != compressed.end())
+		{
+			it.second = ct->second->Decompress();
+			changed = true;
+			continue;
+		}
+
+		auto st = spilled.find(it.first);
+		if(st != spilled.end())
+		{
+			it.second = st->second.Load();
+			changed = true;
+		}
+	}
+
+	if(changed)
+	{
+		row[m_columns.m_history] = hist;
+		UpdateRowMemoryUsage(row);
+	}
+	return hist;
+}
+
+/**
+	@brief Frees the uncompressed copy of any waveforms in a row which have a compressed or spilled copy, and aren't
+	being displayed
+ */
+void HistoryWindow::EvictHistory(const Gtk::TreeRow& row)
+{
+	//The compressor or spill store might still be reading it
+	TimePoint key = row[m_columns.m_capturekey];
+	if(m_compressor.IsPending(key) || m_spillStore.IsPending(key))
+		return;
+
+	WaveformHistory hist = row[m_columns.m_history];
+	CompressedHistory compressed = row[m_columns.m_compressed];
+	SpilledHistory spilled = row[m_columns.m_spilled];
+
+	bool changed = false;
+	for(auto& it : hist)
+	{
+		if(!it.second)
+			continue;
+		if( (compressed.find(it.first) == compressed.end()) && (spilled.find(it.first) == spilled.end()) )
+			continue;
+		if(it.first.m_channel->GetData(it.first.m_stream) == it.second)
+			continue;
+
+		g_waveformPool.Return(it.second);
+		it.second = NULL;
+		changed = true;
+	}
+
+	if(changed)
+	{
+		row[m_columns.m_history] = hist;
+		UpdateRowMemoryUsage(row);
+	}
+}
+
+/**
+	@brief Compresses, or evicts the uncompressed copy of, everything but the most recent few history entries
+ */
+void HistoryWindow::CompressOldHistory()
+{
+	if(!m_compress || m_historyBorrowed)
+		return;
+
+	//Only rows with uncompressed waveforms in RAM have anything to do, so don't look at the rest
+	size_t nrows = m_model->GetRowCount();
+	if(nrows <= m_uncompressedDepth)
+		return;
+	TimePoint newest = m_model->GetKey(nrows - m_uncompressedDepth);
+	vector<TimePoint> keys;
+	for(auto key : m_rawRows)
+	{
+		if(!(key < newest))
+			break;
+		keys.push_back(key);
+	}
+
+	for(auto key : keys)
+	{
+		auto it = m_model->Find(key);
+		if(!it)
+			continue;
+		auto row = *it;
+
+		//Already compressed or on disk? Just make sure we're not holding the uncompressed copy too
+		CompressedHistory compressed = row[m_columns.m_compressed];
+		SpilledHistory spilled = row[m_columns.m_spilled];
+		if(!compressed.empty() || !spilled.empty())
+		{
+			EvictHistory(row);
+			continue;
+		}
+
+		//No point compressing something that's about to go to disk
+		if(m_compressor.IsPending(key) || (m_spillingBytes.find(key) != m_spillingBytes.end()) )
+			continue;
+
+		//Only submit waveforms we actually have
+		WaveformHistory hist = row[m_columns.m_history];
+		WaveformHistory data;
 		for(auto jt : hist)
 		{
-			auto acap = dynamic_cast<AnalogWaveform*>(jt.second);
-			if(acap != NULL)
-			{
-				//Add static size of the capture object
-				bytes_used += sizeof(AnalogWaveform);
+			if(jt.second)
+				data[jt.first] = jt.second;
+		}
+		if(!data.empty())
+			m_compressor.Submit(key, data);
+	}
+}
 
-				//Add size of each sample
-				bytes_used += sizeof(float) * acap->m_samples.capacity();
-				bytes_used += sizeof(int64_t) * acap->m_offsets.capacity();
-				bytes_used += sizeof(int64_t) * acap->m_durations.capacity();
-			}
+/**
+	@brief Collects finished compression and spill jobs
+ */
+bool HistoryWindow::OnBackgroundTimer()
+{
+	bool changed = false;
 
-			auto dcap = dynamic_cast<DigitalWaveform*>(jt.second);
-			if(dcap != NULL)
-			{
-				//Add static size of the capture object
-				bytes_used += sizeof(DigitalWaveform);
+	TimePoint key;
+	CompressedHistory compressed;
+	while(m_compressor.PopResult(key, compressed))
+	{
+		//Find the row. It might have been deleted in the meantime, if so there's nothing to do.
+		//If it was spilled in the meantime, the compressed copy isn't needed.
+		auto it = m_model->Find(key);
+		if(!it)
+			continue;
+		auto row = *it;
+		SpilledHistory spilled = row[m_columns.m_spilled];
+		if(!spilled.empty())
+			continue;
 
-				//Add size of each sample
-				bytes_used += sizeof(bool) * dcap->m_samples.capacity();
-				bytes_used += sizeof(int64_t) * dcap->m_offsets.capacity();
-				bytes_used += sizeof(int64_t) * dcap->m_durations.capacity();
-			}
+		row[m_columns.m_compressed] = compressed;
+		UpdateRowMemoryUsage(row);
+		changed = true;
+	}
 
-			auto bcap = dynamic_cast<DigitalBusWaveform*>(jt.second);
-			if(bcap != NULL)
-			{
-				//Add static size of the capture object
-				bytes_used += sizeof(DigitalBusWaveform);
+	//Don't free anything while the history is borrowed, collect the results once it's back
+	SpilledHistory spilled;
+	bool ok;
+	while(!m_historyBorrowed && m_spillStore.PopResult(key, spilled, ok))
+	{
+		//Deleted rows cancel their spill job, so this shouldn't happen, but don't leak the files if it does
+		auto it = m_model->Find(key);
+		if(!it)
+		{
+			HistorySpillStore::Remove(spilled);
+			continue;
+		}
+		auto row = *it;
 
-				if(!bcap->m_samples.empty())
-				{
-					//Add size of each sample
-					bytes_used +=
-						(bcap->m_samples[0].size() * sizeof(bool) + sizeof(vector<bool>))
-						* bcap->m_samples.capacity();
-					bytes_used += sizeof(int64_t) * bcap->m_offsets.capacity();
-					bytes_used += sizeof(int64_t) * bcap->m_durations.capacity();
-				}
+		//If the row wasn't used while it was being written, it's no longer in the LRU list and should leave RAM.
+		//Otherwise it stays, but we keep the spilled copy so it can be freed instantly later.
+		bool evict = false;
+		auto st = m_spillingBytes.find(key);
+		if(st != m_spillingBytes.end())
+		{
+			m_bytesSpilling -= st->second;
+			m_spillingBytes.erase(st);
+			evict = true;
+		}
+
+		if(!ok)
+		{
+			LogError("Couldn't write history to disk, keeping it in RAM from now on\n");
+			m_spill = false;
+
+			//Put the row back where it was in the LRU list
+			if(evict)
+			{
+				uint64_t stamp = row[m_columns.m_lastUsed];
+				m_lruRows[stamp] = it;
 			}
+			continue;
 		}
+
+		row[m_columns.m_spilled] = spilled;
+		if(evict)
+		{
+			//Compressed copies of spilled streams are no longer needed either
+			CompressedHistory rowCompressed = row[m_columns.m_compressed];
+			for(auto jt : spilled)
+				rowCompressed.erase(jt.first);
+			row[m_columns.m_compressed] = rowCompressed;
+
+			EvictHistory(row);
+		}
+		UpdateRowMemoryUsage(row);
+		changed = true;
 	}
 
-	//Convert to MB/GB
-	char tmp[128];
-	float mb = bytes_used / (1024.0f * 1024.0f);
-	float gb = mb / 1024;
-	if(gb > 1)
-		snprintf(tmp, sizeof(tmp), "%u WFM / %.2f GB", children.size(), gb);
-	else
-		snprintf(tmp, sizeof(tmp), "%u WFM / %.0f MB", children.size(), mb);
-	m_memoryLabel.set_label(tmp);
+	if(changed)
+	{
+		CompressOldHistory();
+		UpdateMemoryUsageEstimate();
+	}
+
+	return true;
 }
 
 bool HistoryWindow::on_delete_event(GdkEventAny* /*ignored*/)
@@ -421,7 +876,8 @@ void HistoryWindow::OnSelectionChanged()
 	}
 
 	auto row = *sel;
-	WaveformHistory hist = row[m_columns.m_history];
+	TouchRow(sel);
+	WaveformHistory hist = GetHistory(row);
 	m_lastHistoryKey = row[m_columns.m_capturekey];
 
 	//Reload the scope with the saved waveforms
@@ -440,8 +896,14 @@ void HistoryWindow::OnSelectionChanged()
 
 	//Tell the window to refresh everything
 	if(actuallyChanged)
+	{
 		m_parent->OnHistoryUpdated();
 
+		//Whatever was displayed before can go back to being compressed
+		CompressOldHistory();
+		UpdateMemoryUsageEstimate();
+	}
+
 	//Move the view to the correct timestamp
 	if(jumpToTime)
 		m_parent->JumpToMarker(m);
@@ -449,18 +911,9 @@ void HistoryWindow::OnSelectionChanged()
 
 void HistoryWindow::JumpToHistory(TimePoint timestamp)
 {
-	//TODO: is there a way to binary search a tree view?
-	//Or get *stable* iterators that aren't invalidated by adding/removing items?
-	auto children = m_model->children();
-	for(auto it : children)
-	{
-		TimePoint key = (*it)[m_columns.m_capturekey];
-		if(key == timestamp)
-		{
-			m_tree.get_selection()->select(it);
-			break;
-		}
-	}
+	auto it = m_model->Find(timestamp);
+	if(it)
+		m_tree.get_selection()->select(it);
 }
 
 
@@ -469,24 +922,169 @@ void HistoryWindow::ReplayHistory()
 	//Special case if we only have one waveform
 	//(select handler won't fire if we're already active)
 	auto children = m_model->children();
+	if(children.empty())
+		return;
 	if(children.size() == 1)
 	{
 		m_parent->OnHistoryUpdated();
 		m_parent->RefreshProtocolAnalyzers();
+		return;
 	}
 
-	//No, iterate over everything
-	else
+	//See which analyzers we can decode out of order, on worker threads.
+	//If any of them depend on something we don't have a copy of, fall back to walking the history in order.
+	set<StreamDescriptor> available;
+	WaveformHistory first = (*children.begin())[m_columns.m_history];
+	for(auto it : first)
+		available.emplace(it.first);
+	set<PacketDecoder*> decoders;
+	for(auto a : m_parent->GetProtocolAnalyzers())
 	{
-		for(auto it : children)
+		if(!HistoryReplayer::CanReplay(a->GetDecoder(), available))
 		{
-			//Select will update all the protocol decoders etc
+			ReplayHistorySequentially();
+			return;
+		}
+		decoders.emplace(a->GetDecoder());
+	}
+	if(!decoders.empty())
+		ReplayDecoders(decoders);
+
+	//Eye patterns etc integrate over every waveform, so they still have to see each one in order.
+	//This is still much faster than before since the analyzers are already done.
+	bool accumulating = false;
+	for(auto f : g_filterRegistry.GetSessionFilters())
+	{
+		auto type = f->GetType();
+		if( (type == OscilloscopeChannel::CHANNEL_TYPE_EYE) || (type == OscilloscopeChannel::CHANNEL_TYPE_WATERFALL) )
+			accumulating = true;
+	}
+	if(accumulating)
+	{
+		for(auto it : children)
 			m_tree.get_selection()->select(it);
+		return;
+	}
 
-			//Update analyzers
-			m_parent->RefreshProtocolAnalyzers();
+	//Otherwise, only the newest waveform needs to go through the full filter graph.
+	//If it's already loaded the select handler won't fire, so refresh manually.
+	Gtk::TreePath lastPath;
+	lastPath.push_back(m_model->GetRowCount() - 1);
+	auto last = m_model->get_iter(lastPath);
+	WaveformHistory hist = (*last)[m_columns.m_history];
+	bool current = true;
+	for(auto it : hist)
+	{
+		if(it.first.m_channel->GetData(it.first.m_stream) != it.second)
+			current = false;
+	}
+	m_tree.get_selection()->select(last);
+	if(current)
+		m_parent->OnHistoryUpdated();
+}
+
+/**
+	@brief Replays history by selecting every row in turn, updating the analyzers as we go
+ */
+void HistoryWindow::ReplayHistorySequentially()
+{
+	auto children = m_model->children();
+	for(auto it : children)
+	{
+		//Select will update all the protocol decoders etc
+		m_tree.get_selection()->select(it);
+
+		//Update analyzers
+		m_parent->RefreshProtocolAnalyzers();
+	}
+}
+
+/**
+	@brief Starts running every row of history through a set of decoders on worker threads
+
+	Packets are added to the analyzers by OnReplayProgress() as they come in, so the UI stays live while this runs.
+ */
+void HistoryWindow::ReplayDecoders(const set<PacketDecoder*>& decoders)
+{
+	StopReplay();
+
+	//Workers decompress or page in evicted waveforms themselves, so we never need the whole history in RAM at once
+	vector<HistoryReplayer::Entry> entries;
+	for(auto it : m_model->children())
+	{
+		TimePoint key = (*it)[m_columns.m_capturekey];
+		WaveformHistory hist = (*it)[m_columns.m_history];
+		entries.push_back(HistoryReplayer::Entry(key, hist));
+		entries.back().m_compressed = (*it)[m_columns.m_compressed];
+		entries.back().m_spilled = (*it)[m_columns.m_spilled];
+	}
+
+	//The workers are borrowing the history waveforms, so nothing can be deleted until they're done
+	m_historyBorrowed ++;
+	m_replaying = true;
+
+	m_replayProgress.set_fraction(0);
+	m_replayProgress.set_text("Decoding history");
+	m_replayProgress.show();
+
+	m_replayer.Start(
+		decoders,
+		entries,
+		g_threadBudget.GetThreadCount(ThreadBudget::ROLE_FILTER),
+		[this]() { m_replayDispatcher.emit(); });
+
+	//No workers were started, so nothing will ever wake us up
+	if(m_replayer.IsDone())
+		StopReplay();
+}
+
+/**
+	@brief Adds newly decoded history to the analyzers, and cleans up once the replay is done
+ */
+void HistoryWindow::OnReplayProgress()
+{
+	if(!m_replaying)
+		return;
+
+	//Add finished results to the analyzers in order.
+	//Look up the analyzers every time, in case one was closed since the last batch.
+	unique_ptr<HistoryReplayer::Result> result;
+	while( (result = m_replayer.PopResult()) != NULL)
+	{
+		for(auto a : m_parent->GetProtocolAnalyzers())
+		{
+			auto it = result->m_packets.find(a->GetDecoder());
+			if(it != result->m_packets.end())
+				a->AppendPackets(result->m_stamp, it->second);
 		}
 	}
+
+	char tmp[128];
+	snprintf(tmp, sizeof(tmp), "Decoding waveform %zu of %zu",
+		m_replayer.GetCompletedCount(), m_replayer.GetTotalCount());
+	m_replayProgress.set_text(tmp);
+	m_replayProgress.set_fraction(m_replayer.GetCompletedCount() * 1.0f / m_replayer.GetTotalCount());
+
+	if(!m_replayer.IsDone())
+		return;
+
+	StopReplay();
+	for(auto a : m_parent->GetProtocolAnalyzers())
+		a->ScrollToEnd();
+}
+
+/**
+	@brief Stops any replay in progress and gives the history back
+ */
+void HistoryWindow::StopReplay()
+{
+	if(!m_replaying)
+		return;
+
+	m_replayer.Stop();
+	m_replaying = false;
+	m_historyBorrowed --;
+	m_replayProgress.hide();
 }
 
 void HistoryWindow::OnTreeButtonPressEvent(GdkEventButton* event)
@@ -512,8 +1110,8 @@ void HistoryWindow::OnDelete()
 		m_model->erase(sel);
 	}
 
-	//It's a history row
-	else
+	//It's a history row. Leave it alone if a replay or save is still reading it.
+	else if(!m_historyBorrowed)
 		DeleteHistoryRow(sel);
 }
 
@@ -549,58 +1147,45 @@ void HistoryWindow::OnRowChanged(const Gtk::TreeModel::Path& path, const Gtk::Tr
 void HistoryWindow::AddMarker(TimePoint stamp, int64_t offset, string name, Marker* m)
 {
 	//Find the node to add it under (not necessarily the current selection)
-	auto children = m_model->children();
-	for(auto jt : children)
-	{
-		auto parent = *jt;
-		TimePoint pstamp = parent[m_columns.m_capturekey];
-		if(pstamp != stamp)
-			continue;
-
-		//Parent node is now pinned
-		parent[m_columns.m_pinned] = true;
-
-		//Add the child item
-		auto it = m_model->append(parent.children());
-		auto row = *it;
-		int64_t fs = stamp.second + offset;
-		row[m_columns.m_capturekey] = stamp;
-		row[m_columns.m_offset] = offset;
-		row[m_columns.m_label] = name;
-		row[m_columns.m_marker] = m;
-		row[m_columns.m_pinvisible] = false;
-		row[m_columns.m_datestamp] = FormatDate(stamp.first, fs);
-		row[m_columns.m_timestamp] = FormatTimestamp(stamp.first, fs);
+	auto jt = m_model->Find(stamp);
+	if(!jt)
+		return;
+	auto parent = *jt;
 
-		//Make sure the row is visible
-		m_tree.expand_to_path(m_model->get_path(it));
+	//Parent node is now pinned
+	parent[m_columns.m_pinned] = true;
 
-		break;
-	}
+	//Add the child item
+	auto it = m_model->append(parent.children());
+	auto row = *it;
+	int64_t fs = stamp.second + offset;
+	row[m_columns.m_capturekey] = stamp;
+	row[m_columns.m_offset] = offset;
+	row[m_columns.m_label] = name;
+	row[m_columns.m_marker] = m;
+	row[m_columns.m_pinvisible] = false;
+	row[m_columns.m_datestamp] = FormatDate(stamp.first, fs);
+	row[m_columns.m_timestamp] = FormatTimestamp(stamp.first, fs);
+
+	//Make sure the row is visible
+	m_tree.expand_to_path(m_model->get_path(it));
 }
 
 void HistoryWindow::OnMarkerMoved(Marker* m)
 {
-	//TODO: faster way to find this?
+	auto it = m_model->Find(m->m_point);
+	if(!it)
+		return;
 
-	auto children = m_model->children();
-	for(auto it : children)
+	auto mchildren = (*it).children();
+	for(auto jt : mchildren)
 	{
-		TimePoint key = (*it)[m_columns.m_capturekey];
-		if(key == m->m_point)
+		auto row = (*jt);
+		if(row[m_columns.m_marker] == m)
 		{
-			auto mchildren = (*it).children();
-			for(auto jt : mchildren)
-			{
-				auto row = (*jt);
-				if(row[m_columns.m_marker] == m)
-				{
-					int64_t fs = m->m_point.second + m->m_offset;
-					row[m_columns.m_datestamp] = FormatDate(m->m_point.first, fs);
-					row[m_columns.m_timestamp] = FormatTimestamp(m->m_point.first, fs);
-					break;
-				}
-			}
+			int64_t fs = m->m_point.second + m->m_offset;
+			row[m_columns.m_datestamp] = FormatDate(m->m_point.first, fs);
+			row[m_columns.m_timestamp] = FormatTimestamp(m->m_point.first, fs);
 			break;
 		}
 	}
@@ -638,29 +1223,46 @@ void HistoryWindow::SerializeWaveforms(
 	int id = 1;
 	size_t iwave = 0;
 	float waveform_progress = progress_range / children.size();
+	m_historyBorrowed ++;
 	for(auto it : children)
 	{
 		auto& row = *it;
 
+		//Spilled streams are already on disk in the same format, so they only need to be linked into place.
+		//Metadata for them comes from empty placeholder waveforms.
+		//Anything else which was evicted is decompressed one entry at a time while saving.
 		TimePoint key = row[m_columns.m_capturekey];
+		WaveformHistory history = row[m_columns.m_history];
+		CompressedHistory compressed = row[m_columns.m_compressed];
+		SpilledHistory spilled = row[m_columns.m_spilled];
+		vector<WaveformBase*> placeholders;
+		vector<WaveformBase*> temps;
+		for(auto& jt : history)
+		{
+			if(jt.second)
+				continue;
+
+			auto st = spilled.find(jt.first);
+			auto ct = compressed.find(jt.first);
+			if(st != spilled.end())
+			{
+				jt.second = st->second.CreateEmpty();
+				placeholders.push_back(jt.second);
+			}
+			else if(ct != compressed.end())
+			{
+				jt.second = ct->second->Decompress();
+				temps.push_back(jt.second);
+			}
+		}
 
 		//Save metadata
-		snprintf(tmp, sizeof(tmp), "    wfm%d:\n", id);
-		config += tmp;
-		snprintf(tmp, sizeof(tmp), "        timestamp: %ld\n", key.first);
-		config += tmp;
-		snprintf(tmp, sizeof(tmp), "        time_fsec: %ld\n", key.second);
-		config += tmp;
-		snprintf(tmp, sizeof(tmp), "        id:        %d\n", id);
-		config += tmp;
-		if((*it)[m_columns.m_pinned])
-			config += "        pinned:    1\n";
-		else
-			config += "        pinned:    0\n";
-		string label = str_replace("\"", "\\\"", static_cast<Glib::ustring>(row[m_columns.m_label]));
-		snprintf(tmp, sizeof(tmp), "        label:     \"%s\"\n", label.c_str());
-		config += tmp;
-		config += "        channels:\n";
+		config += WaveformSerializer::SerializeWaveformMetadata(
+			id,
+			key,
+			row[m_columns.m_pinned],
+			static_cast<Glib::ustring>(row[m_columns.m_label]),
+			history);
 
 		//Format directory for this waveform
 		snprintf(tmp, sizeof(tmp), "%s/waveform_%d", dname.c_str(), id);
@@ -675,7 +1277,6 @@ void HistoryWindow::SerializeWaveforms(
 
 		//Kick off a thread to save data for each channel
 		vector<thread*> threads;
-		WaveformHistory history = row[m_columns.m_history];
 		size_t nchans = history.size();
 		volatile float* channel_progress = new float[nchans];
 		volatile int* channel_done = new int[nchans];
@@ -685,53 +1286,36 @@ void HistoryWindow::SerializeWaveforms(
 			channel_progress[i] = 0;
 			channel_done[i] = 0;
 
-			auto chan = jt.first.m_channel;
-			auto wave = jt.second;
-			if((wave == NULL) || wave->m_densePacked)
-			{
-				threads.push_back(new thread(
-					&HistoryWindow::DoSaveWaveformDataForDenseStream,
-					wname,
-					jt.first,
-					jt.second,
-					channel_progress + i,
-					channel_done + i
-					));
-			}
-			else
+			//Link spilled streams. If that fails, load them back in and save as usual.
+			auto st = spilled.find(jt.first);
+			if(st != spilled.end())
 			{
-				threads.push_back(new thread(
-					&HistoryWindow::DoSaveWaveformDataForSparseStream,
-					wname,
-					jt.first,
-					jt.second,
-					channel_progress + i,
-					channel_done + i
-					));
-			}
-			i++;
+				auto fname = WaveformSerializer::GetStreamFileName(
+					wname, jt.first.m_channel->GetIndex(), jt.first.m_stream);
+				if(HistorySpillStore::Export(st->second, fname))
+				{
+					channel_progress[i] = 1;
+					channel_done[i] = 1;
+					i++;
+					continue;
+				}
 
-			//Save channel metadata
-			int index = chan->GetIndex();
-			size_t nstream = jt.first.m_stream;
-			if(wave == NULL)
-				continue;
+				if(find(placeholders.begin(), placeholders.end(), jt.second) != placeholders.end())
+				{
+					jt.second = st->second.Load();
+					temps.push_back(jt.second);
+				}
+			}
 
-			snprintf(tmp, sizeof(tmp), "            ch%ds%zu:\n", index, nstream);
-			config += tmp;
-			if(wave->m_densePacked)
-				snprintf(tmp, sizeof(tmp), "                format:       densev1\n");
-			else
-				snprintf(tmp, sizeof(tmp), "                format:       sparsev1\n");
-			config += tmp;
-			snprintf(tmp, sizeof(tmp), "                index:        %d\n", index);
-			config += tmp;
-			snprintf(tmp, sizeof(tmp), "                stream:       %zu\n", nstream);
-			config += tmp;
-			snprintf(tmp, sizeof(tmp), "                timescale:    %ld\n", wave->m_timescale);
-			config += tmp;
-			snprintf(tmp, sizeof(tmp), "                trigphase:    %zd\n", wave->m_triggerPhase);
-			config += tmp;
+			threads.push_back(new thread(
+				&WaveformSerializer::SaveStream,
+				wname,
+				jt.first,
+				jt.second,
+				channel_progress + i,
+				channel_done + i
+				));
+			i++;
 		}
 
 		//Process events and update the display with each thread's progress
@@ -775,9 +1359,15 @@ void HistoryWindow::SerializeWaveforms(
 			delete t;
 		}
 
+		for(auto w : placeholders)
+			delete w;
+		for(auto w : temps)
+			g_waveformPool.Return(w);
+
 		id ++;
 		iwave ++;
 	}
+	m_historyBorrowed --;
 
 	//Save waveform metadata
 	FILE* fp = fopen(fname.c_str(), "w");
@@ -798,202 +1388,3 @@ void HistoryWindow::SerializeWaveforms(
 	}
 	fclose(fp);
 }
-
-/**
-	@brief Saves waveform sample data in the "sparsev1" file format.
-
-	Interleaved (slow):
-		int64 offset
-		int64 len
-		for analog
-			float voltage
-		for digital
-			bool voltage
- */
-void HistoryWindow::DoSaveWaveformDataForSparseStream(
-	std::string wname,
-	StreamDescriptor stream,
-	WaveformBase* wave,
-	volatile float* progress,
-	volatile int* done
-	)
-{
-	auto chan = stream.m_channel;
-	int index = chan->GetIndex();
-	size_t nstream = stream.m_stream;
-	if(wave == NULL)		//trigger, disabled, etc
-	{
-		*done = 1;
-		*progress = 1;
-		return;
-	}
-
-	//First stream has no suffix for compat
-	char tmp[512];
-	if(nstream == 0)
-		snprintf(tmp, sizeof(tmp), "%s/channel_%d.bin", wname.c_str(), index);
-	else
-		snprintf(tmp, sizeof(tmp), "%s/channel_%d_stream%zu.bin", wname.c_str(), index, nstream);
-
-	FILE* fp = fopen(tmp, "wb");
-
-	auto achan = dynamic_cast<AnalogWaveform*>(wave);
-	auto dchan = dynamic_cast<DigitalWaveform*>(wave);
-	size_t len = wave->m_offsets.size();
-
-	//Analog channels
-	const size_t samples_per_block = 10000;
-	if(achan)
-	{
-		#pragma pack(push, 1)
-		class asample_t
-		{
-		public:
-			int64_t off;
-			int64_t dur;
-			float voltage;
-
-			asample_t(int64_t o=0, int64_t d=0, float v=0)
-			: off(o), dur(d), voltage(v)
-			{}
-		};
-		#pragma pack(pop)
-
-		//Copy sample data
-		vector<asample_t,	AlignedAllocator<asample_t, 64 > > samples;
-		samples.reserve(len);
-		for(size_t i=0; i<len; i++)
-			samples.push_back(asample_t(wave->m_offsets[i], wave->m_durations[i], achan->m_samples[i]));
-
-		//Write it
-		for(size_t i=0; i<len; i+= samples_per_block)
-		{
-			*progress = i * 1.0 / len;
-			size_t blocklen = min(len-i, samples_per_block);
-
-			if(blocklen != fwrite(&samples[i], sizeof(asample_t), blocklen, fp))
-				LogError("file write error\n");
-		}
-	}
-	else if(dchan)
-	{
-		#pragma pack(push, 1)
-		class dsample_t
-		{
-		public:
-			int64_t off;
-			int64_t dur;
-			bool voltage;
-
-			dsample_t(int64_t o=0, int64_t d=0, bool v=0)
-			: off(o), dur(d), voltage(v)
-			{}
-		};
-		#pragma pack(pop)
-
-		//Copy sample data
-		vector<dsample_t,	AlignedAllocator<dsample_t, 64 > > samples;
-		samples.reserve(len);
-		for(size_t i=0; i<len; i++)
-			samples.push_back(dsample_t(wave->m_offsets[i], wave->m_durations[i], dchan->m_samples[i]));
-
-		//Write it
-		for(size_t i=0; i<len; i+= samples_per_block)
-		{
-			*progress = i * 1.0 / len;
-			size_t blocklen = min(len-i, samples_per_block);
-
-			if(blocklen != fwrite(&samples[i], sizeof(dsample_t), blocklen, fp))
-				LogError("file write error\n");
-		}
-	}
-	else
-	{
-		//TODO: support other waveform types (buses, eyes, etc)
-		LogError("unrecognized sample type\n");
-	}
-
-	fclose(fp);
-
-	*done = 1;
-	*progress = 1;
-}
-
-/**
-	@brief Saves waveform sample data in the "densev1" file format.
-
-	for analog
-		float[] voltage
-	for digital
-		bool[] voltage
-
-	Durations are implied {1....1} and offsets are implied {0...n-1}.
- */
-void HistoryWindow::DoSaveWaveformDataForDenseStream(
-	std::string wname,
-	StreamDescriptor stream,
-	WaveformBase* wave,
-	volatile float* progress,
-	volatile int* done
-	)
-{
-	auto chan = stream.m_channel;
-	int index = chan->GetIndex();
-	size_t nstream = stream.m_stream;
-	if(wave == NULL)		//trigger, disabled, etc
-	{
-		*done = 1;
-		*progress = 1;
-		return;
-	}
-
-	//First stream has no suffix for compat
-	char tmp[512];
-	if(nstream == 0)
-		snprintf(tmp, sizeof(tmp), "%s/channel_%d.bin", wname.c_str(), index);
-	else
-		snprintf(tmp, sizeof(tmp), "%s/channel_%d_stream%zu.bin", wname.c_str(), index, nstream);
-
-	FILE* fp = fopen(tmp, "wb");
-
-	auto achan = dynamic_cast<AnalogWaveform*>(wave);
-	auto dchan = dynamic_cast<DigitalWaveform*>(wave);
-	size_t len = wave->m_offsets.size();
-
-	//Analog channels
-	const size_t samples_per_block = 10000;
-	if(achan)
-	{
-		//Write it
-		for(size_t i=0; i<len; i+= samples_per_block)
-		{
-			*progress = i * 1.0 / len;
-			size_t blocklen = min(len-i, samples_per_block);
-
-			if(blocklen != fwrite(&achan->m_samples[i], sizeof(float), blocklen, fp))
-				LogError("file write error\n");
-		}
-	}
-	else if(dchan)
-	{
-		//Write it
-		for(size_t i=0; i<len; i+= samples_per_block)
-		{
-			*progress = i * 1.0 / len;
-			size_t blocklen = min(len-i, samples_per_block);
-
-			if(blocklen != fwrite(&dchan->m_samples[i], sizeof(bool), blocklen, fp))
-				LogError("file write error\n");
-		}
-	}
-	else
-	{
-		//TODO: support other waveform types (buses, eyes, etc)
-		LogError("unrecognized sample type\n");
-	}
-
-	fclose(fp);
-
-	*done = 1;
-	*progress = 1;
-}
@@ -36,6 +36,11 @@
 #ifndef HistoryWindow_h
 #define HistoryWindow_h
 
+#include "HistoryReplayer.h"
+#include "HistorySpillStore.h"
+#include <deque>
+#include <set>
+
 class OscilloscopeWindow;
 class FileProgressDialog;
 class Marker;
@@ -58,12 +63,120 @@ public:
 	//only valid for top level nodes
 	Gtk::TreeModelColumn<bool>				m_pinned;
 	Gtk::TreeModelColumn<WaveformHistory>	m_history;
+	Gtk::TreeModelColumn<CompressedHistory>	m_compressed;
+	Gtk::TreeModelColumn<SpilledHistory>	m_spilled;
+	Gtk::TreeModelColumn<size_t>			m_bytes;
+	Gtk::TreeModelColumn<size_t>			m_rawBytes;
+	Gtk::TreeModelColumn<size_t>			m_diskBytes;
+	Gtk::TreeModelColumn<uint64_t>			m_lastUsed;
 
 	//only valid for marker nodes
 	Gtk::TreeModelColumn<int64_t>			m_offset;
 	Gtk::TreeModelColumn<Marker*>			m_marker;
 };
 
+/**
+	@brief Contents of one row of history, or of a marker under one
+ */
+class HistoryTreeRow
+{
+public:
+	HistoryTreeRow();
+	~HistoryTreeRow();
+
+	std::string			m_timestamp;
+	std::string			m_datestamp;
+	TimePoint			m_capturekey;
+	WaveformHistory		m_history;
+	bool				m_pinned;
+	std::string			m_label;
+	int64_t				m_offset;
+	Marker*				m_marker;
+	bool				m_pinvisible;
+	CompressedHistory	m_compressed;
+	size_t				m_bytes;
+	size_t				m_rawBytes;
+	uint64_t			m_lastUsed;
+	SpilledHistory		m_spilled;
+	size_t				m_diskBytes;
+
+	///@brief The history row a marker belongs to, or NULL for history rows
+	HistoryTreeRow*					m_parent;
+	std::vector<HistoryTreeRow*>	m_children;
+};
+
+/**
+	@brief Tree model for the history window
+
+	Same idea as ProtocolTreeModel. A TreeStore has to be walked from the start to find anything, which gets very
+	slow with tens of thousands of rows of history. Here the top level rows are kept in timestamp order, so a row can
+	be found by timestamp, and a row's position found from the row, with a binary search.
+
+	Iterators point at the row itself, so they stay valid until that row is deleted.
+ */
+class HistoryTreeModel :
+	public Gtk::TreeModel,
+	public Glib::Object
+{
+private:
+	HistoryTreeModel(const HistoryColumns& columns);
+
+public:
+	virtual ~HistoryTreeModel();
+
+	static Glib::RefPtr<HistoryTreeModel> create(const HistoryColumns& columns);
+
+	virtual Gtk::TreeModelFlags get_flags_vfunc() const;
+	virtual int get_n_columns_vfunc() const;
+	virtual GType get_column_type_vfunc(int index) const;
+	virtual void get_value_vfunc(const TreeModel::iterator& iter, int column, Glib::ValueBase& value) const;
+	virtual void set_value_impl(const iterator& row, int column, const Glib::ValueBase& value);
+
+	virtual bool iter_next_vfunc(const iterator& iter, iterator& iter_next) const;
+
+	virtual bool iter_children_vfunc(const iterator& parent, iterator& iter) const;
+	virtual bool iter_has_child_vfunc(const iterator& iter) const;
+	virtual int iter_n_children_vfunc(const iterator& iter) const;
+	virtual int iter_n_root_children_vfunc() const;
+	virtual bool iter_nth_child_vfunc(const iterator& parent, int n, iterator& iter) const;
+	virtual bool iter_nth_root_child_vfunc(int n, iterator& iter) const;
+	virtual bool iter_parent_vfunc(const iterator& child, iterator& iter) const;
+
+	virtual Gtk::TreePath get_path_vfunc(const iterator& iter) const;
+	virtual bool get_iter_vfunc(const Gtk::TreePath& path, iterator& iter) const;
+
+	iterator Insert(TimePoint key);
+	iterator append(const Gtk::TreeNodeChildren& node);
+	iterator erase(const iterator& iter);
+
+	iterator Find(TimePoint key);
+	iterator FindOldestUnpinned();
+
+	///@brief Number of top level rows
+	size_t GetRowCount() const
+	{ return m_rows.size(); }
+
+	///@brief Timestamp of the Nth oldest top level row
+	TimePoint GetKey(size_t n) const
+	{ return m_rows[n]->m_capturekey; }
+
+protected:
+	const HistoryColumns& m_columns;
+
+	HistoryTreeRow* GetRow(const iterator& iter) const;
+	size_t GetIndex(const HistoryTreeRow* row, size_t hint) const;
+	size_t GetIndex(const iterator& iter) const;
+	Gtk::TreePath GetPath(const HistoryTreeRow* row, size_t hint) const;
+	static void SetIter(GtkTreeIter* iter, const HistoryTreeRow* row, size_t index);
+	static void ClearIter(GtkTreeIter* iter);
+
+	///@brief Top level rows, oldest first
+	std::deque<HistoryTreeRow*> m_rows;
+
+	///@brief Top level rows which aren't pinned, oldest first
+	std::set<std::pair<TimePoint, HistoryTreeRow*> > m_unpinned;
+};
+
 /**
 	@brief Window containing a protocol analyzer
  */
@@ -81,6 +194,20 @@ public:
 	void OnMarkerMoved(Marker* m);
 
 	void SetMaxWaveforms(int n);
+	int GetMaxWaveforms();
+
+	void SyncPreferences();
+
+	/**
+		@brief Gets the RAM used by this instrument's history, including compressed copies
+
+		Rows which are on their way to disk are not counted.
+	 */
+	size_t GetMemoryUsage()
+	{ return m_bytesUsed - m_bytesSpilling; }
+
+	bool GetLeastRecentlyUsed(uint64_t& stamp);
+	bool FreeLeastRecentlyUsed();
 
 	void SerializeWaveforms(
 		std::string dir,
@@ -98,31 +225,22 @@ protected:
 
 	void DeleteHistoryRow(const Gtk::TreeModel::iterator& it);
 
+	void ReplayHistorySequentially();
+	void ReplayDecoders(const std::set<PacketDecoder*>& decoders);
+	void OnReplayProgress();
+	void StopReplay();
+
 	std::string FormatTimestamp(time_t base, int64_t offset);
 	std::string FormatDate(time_t base, int64_t offset);
 
-	static void DoSaveWaveformDataForSparseStream(
-		std::string wname,
-		StreamDescriptor stream,
-		WaveformBase* wave,
-		volatile float* progress,
-		volatile int* done
-		);
-	static void DoSaveWaveformDataForDenseStream(
-		std::string wname,
-		StreamDescriptor stream,
-		WaveformBase* wave,
-		volatile float* progress,
-		volatile int* done
-		);
-
 	Gtk::HBox m_hbox;
 		Gtk::Label m_maxLabel;
 		Gtk::Entry m_maxBox;
 	Gtk::ScrolledWindow m_scroller;
 		Gtk::TreeView m_tree;
-	Glib::RefPtr<Gtk::TreeStore> m_model;
+	Glib::RefPtr<HistoryTreeModel> m_model;
 	Gtk::HBox m_status;
+		Gtk::ProgressBar m_replayProgress;
 		Gtk::Label m_memoryLabel;
 	HistoryColumns m_columns;
 
@@ -130,7 +248,65 @@ protected:
 		Gtk::MenuItem m_deleteItem;
 
 	void ClearOldHistoryItems();
+	void EnforceMemoryBudget();
 	void UpdateMemoryUsageEstimate();
+	void UpdateRowMemoryUsage(const Gtk::TreeRow& row);
+	void TouchRow(const Gtk::TreeModel::iterator& it);
+	std::map<uint64_t, Gtk::TreeModel::iterator>::iterator FindLeastRecentlyUsed();
+
+	WaveformHistory GetHistory(const Gtk::TreeRow& row);
+	void EvictHistory(const Gtk::TreeRow& row);
+	void CompressOldHistory();
+	void SpillRow(const Gtk::TreeModel::iterator& it);
+	bool OnBackgroundTimer();
+
+	HistoryCompressor m_compressor;
+	HistorySpillStore m_spillStore;
+	sigc::connection m_backgroundTimer;
+
+	///@brief True if history older than the most recent few entries should be compressed
+	bool m_compress;
+
+	///@brief Number of most recent entries kept uncompressed
+	size_t m_uncompressedDepth;
+
+	///@brief True if rows over the memory budget should be written to disk rather than deleted
+	bool m_spill;
+
+	///@brief Number of things (replays, saves) reading history waveforms. Nothing may be deleted or evicted until zero.
+	size_t m_historyBorrowed;
+
+	///@brief Decodes history on worker threads for the protocol analyzers
+	HistoryReplayer m_replayer;
+	bool m_replaying;
+
+	///@brief Woken by the replay workers whenever an entry has been decoded
+	Glib::Dispatcher m_replayDispatcher;
+
+	///@brief Top level rows with uncompressed waveforms in RAM, by timestamp
+	std::set<TimePoint> m_rawRows;
+
+	///@brief RAM used by every row of history, including compressed copies
+	size_t m_bytesUsed;
+
+	///@brief RAM the history would use if nothing was compressed or spilled
+	size_t m_bytesRaw;
+
+	///@brief Disk space used by spilled rows
+	size_t m_bytesOnDisk;
+
+	///@brief RAM used by rows which are being written to disk, when they were submitted
+	std::map<TimePoint, size_t> m_spillingBytes;
+	size_t m_bytesSpilling;
+
+	///@brief Maximum RAM used by this instrument's history, in bytes (zero for no limit)
+	size_t m_memoryBudget;
+
+	///@brief Top level rows holding RAM, ordered from least to most recently used. Spilled rows aren't included.
+	std::map<uint64_t, Gtk::TreeModel::iterator> m_lruRows;
+
+	///@brief Next value for m_lastUsed, shared by all instruments so their rows can be compared
+	static uint64_t m_nextUseStamp;
 
 	OscilloscopeWindow* m_parent;
 	Oscilloscope* m_scope;
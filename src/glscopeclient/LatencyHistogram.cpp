@@ -0,0 +1,159 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of LatencyHistogram
+ */
+#include "../scopehal/scopehal.h"
+#include "LatencyHistogram.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+LatencyHistogram::LatencyHistogram()
+{
+	Reset();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Recording
+
+/**
+	@brief Adds a single sample to the histogram
+ */
+void LatencyHistogram::Record(double seconds)
+{
+	uint64_t ns = 0;
+	if(seconds > 0)
+		ns = static_cast<uint64_t>(seconds * 1e9);
+
+	m_buckets[GetBucketIndex(ns)].fetch_add(1, memory_order_relaxed);
+	m_count.fetch_add(1, memory_order_relaxed);
+	m_sum.fetch_add(ns, memory_order_relaxed);
+
+	uint64_t oldmax = m_max.load(memory_order_relaxed);
+	while( (ns > oldmax) && !m_max.compare_exchange_weak(oldmax, ns, memory_order_relaxed) )
+	{}
+}
+
+/**
+	@brief Throws away all samples.
+
+	Not atomic with respect to concurrent Record() calls, a sample recorded during the reset may be partially kept.
+ */
+void LatencyHistogram::Reset()
+{
+	for(auto& b : m_buckets)
+		b = 0;
+	m_count = 0;
+	m_sum = 0;
+	m_max = 0;
+}
+
+/**
+	@brief Figures out which bucket a sample goes in
+ */
+size_t LatencyHistogram::GetBucketIndex(uint64_t ns)
+{
+	//Small values get one bucket each
+	if(ns < SUB_BUCKET_COUNT)
+		return ns;
+
+	//Find the most significant bit, then use the next SUB_BUCKET_BITS bits below it as the sub-bucket index
+	size_t msb = 63;
+	while( (ns >> msb) == 0)
+		msb --;
+	size_t sub = (ns >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1);
+	return (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT + sub;
+}
+
+/**
+	@brief Gets the value in the middle of a bucket's range
+ */
+uint64_t LatencyHistogram::GetBucketMidpoint(size_t index)
+{
+	if(index < SUB_BUCKET_COUNT)
+		return index;
+
+	size_t shift = index / SUB_BUCKET_COUNT - 1;
+	uint64_t sub = index % SUB_BUCKET_COUNT;
+	uint64_t base = (SUB_BUCKET_COUNT + sub) << shift;
+	return base + ( (1ULL << shift) / 2);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Statistics
+
+/**
+	@brief Gets the average of all samples, in seconds
+ */
+double LatencyHistogram::GetMean()
+{
+	uint64_t count = m_count;
+	if(count == 0)
+		return 0;
+	return m_sum * 1e-9 / count;
+}
+
+/**
+	@brief Gets the largest sample, in seconds
+ */
+double LatencyHistogram::GetMax()
+{
+	return m_max * 1e-9;
+}
+
+/**
+	@brief Gets the value (in seconds) which the given percentage of samples are less than or equal to
+ */
+double LatencyHistogram::GetPercentile(double percentile)
+{
+	uint64_t count = m_count;
+	if(count == 0)
+		return 0;
+
+	uint64_t target = static_cast<uint64_t>(ceil(count * percentile / 100));
+	if(target < 1)
+		target = 1;
+
+	uint64_t total = 0;
+	for(size_t i=0; i<BUCKET_COUNT; i++)
+	{
+		total += m_buckets[i];
+		if(total >= target)
+			return min(GetBucketMidpoint(i), m_max.load()) * 1e-9;
+	}
+
+	//Samples were being recorded while we looked, the max is the best answer we have
+	return GetMax();
+}
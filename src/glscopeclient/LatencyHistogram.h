@@ -0,0 +1,86 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of LatencyHistogram
+ */
+#ifndef LatencyHistogram_h
+#define LatencyHistogram_h
+
+#include <atomic>
+#include <cstdint>
+
+/**
+	@brief Log-linear histogram of latency samples, safe to record into from any thread without locking.
+
+	Each power of two is split into 16 linear sub-buckets, so any percentile is accurate to within 1/16 (6.25%)
+	of its value no matter how large the range of samples is.
+ */
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	void Record(double seconds);
+	void Reset();
+
+	uint64_t GetCount()
+	{ return m_count; }
+
+	double GetMean();
+	double GetMax();
+	double GetPercentile(double percentile);
+
+protected:
+	enum
+	{
+		SUB_BUCKET_BITS = 4,
+		SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS,
+		BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT
+	};
+
+	static size_t GetBucketIndex(uint64_t ns);
+	static uint64_t GetBucketMidpoint(size_t index);
+
+	///@brief Number of samples in each bucket
+	std::atomic<uint64_t> m_buckets[BUCKET_COUNT];
+
+	///@brief Total number of samples
+	std::atomic<uint64_t> m_count;
+
+	///@brief Sum of all samples, in ns
+	std::atomic<uint64_t> m_sum;
+
+	///@brief Largest sample seen, in ns
+	std::atomic<uint64_t> m_max;
+};
+
+#endif
@@ -0,0 +1,174 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of LatencyTracker
+ */
+#include "../scopehal/scopehal.h"
+#include "LatencyTracker.h"
+
+using namespace std;
+
+LatencyTracker g_latencyTracker;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+LatencyTracker::LatencyTracker()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+const char* LatencyTracker::GetStageName(LatencyStage stage)
+{
+	switch(stage)
+	{
+		case LATENCY_POLL_TRIGGER:
+			return "Poll trigger";
+		case LATENCY_ACQUIRE:
+			return "Acquire data";
+		case LATENCY_QUEUE:
+			return "Driver queue";
+		case LATENCY_DOWNLOAD:
+			return "Download";
+		case LATENCY_STAGED:
+			return "Pipeline queue";
+		case LATENCY_FILTER:
+			return "Filter graph";
+		case LATENCY_UI_WAKEUP:
+			return "UI wakeup";
+		case LATENCY_GEOMETRY:
+			return "Prepare geometry";
+		case LATENCY_RENDER:
+			return "Render";
+		case LATENCY_TRIGGER_TO_DISPLAY:
+			return "Trigger to display";
+
+		default:
+			return "Unknown";
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Statistics
+
+void LatencyTracker::Reset()
+{
+	for(auto& h : m_histograms)
+		h.Reset();
+}
+
+/**
+	@brief Writes a text summary of every stage to a file
+
+	@return True on success, false if the file couldn't be written
+ */
+bool LatencyTracker::WriteReport(const string& path)
+{
+	FILE* fp = fopen(path.c_str(), "w");
+	if(!fp)
+		return false;
+
+	fprintf(fp, "stage,count,mean_us,p50_us,p90_us,p99_us,p999_us,max_us\n");
+	for(int i=0; i<LATENCY_STAGE_COUNT; i++)
+	{
+		auto& h = m_histograms[i];
+		fprintf(fp, "%s,%lu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+			GetStageName(static_cast<LatencyStage>(i)),
+			static_cast<unsigned long>(h.GetCount()),
+			h.GetMean() * 1e6,
+			h.GetPercentile(50) * 1e6,
+			h.GetPercentile(90) * 1e6,
+			h.GetPercentile(99) * 1e6,
+			h.GetPercentile(99.9) * 1e6,
+			h.GetMax() * 1e6);
+	}
+
+	fclose(fp);
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Per-acquisition timestamps
+
+/**
+	@brief Records the timestamps for a waveform which was just added to an instrument's pending queue
+ */
+void LatencyTracker::OnAcquisition(Oscilloscope* scope, double tTrigger, double tAcquired)
+{
+	m_histograms[LATENCY_ACQUIRE].Record(tAcquired - tTrigger);
+
+	lock_guard<mutex> lock(m_mutex);
+	auto& fifo = m_acquisitions[scope];
+	fifo.push_back(AcquisitionTimestamps{tTrigger, tAcquired});
+
+	//Don't grow forever if nobody is popping (offline scopes, history browsing, etc)
+	while(fifo.size() > 1024)
+		fifo.pop_front();
+}
+
+/**
+	@brief Gets the timestamps for the waveform about to be popped from an instrument's pending queue
+
+	Some drivers push more than one waveform per AcquireData() call, so we resync with the driver's queue depth first
+	and throw away timestamps for waveforms which are no longer in it.
+
+	@param scope		The instrument
+	@param npending		Number of waveforms in the driver's queue, including the one about to be popped
+	@param stamps		Timestamps for the waveform
+
+	@return True if timestamps were found
+ */
+bool LatencyTracker::PopAcquisition(Oscilloscope* scope, size_t npending, AcquisitionTimestamps& stamps)
+{
+	lock_guard<mutex> lock(m_mutex);
+	auto& fifo = m_acquisitions[scope];
+	while(fifo.size() > npending)
+		fifo.pop_front();
+
+	if(fifo.empty())
+		return false;
+
+	stamps = fifo.front();
+	fifo.pop_front();
+	return true;
+}
+
+/**
+	@brief Throws away all timestamps for an instrument, after its pending queue has been cleared
+ */
+void LatencyTracker::DiscardAcquisitions(Oscilloscope* scope)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_acquisitions[scope].clear();
+}
@@ -0,0 +1,109 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of LatencyTracker
+ */
+#ifndef LatencyTracker_h
+#define LatencyTracker_h
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include "LatencyHistogram.h"
+
+/**
+	@brief Stages a waveform passes through between the trigger and the screen
+ */
+enum LatencyStage
+{
+	LATENCY_POLL_TRIGGER,		//PollTrigger() call
+	LATENCY_ACQUIRE,			//AcquireData() call
+	LATENCY_QUEUE,				//Waiting in the driver's pending queue
+	LATENCY_DOWNLOAD,			//DownloadWaveforms()
+	LATENCY_STAGED,				//Waiting in the WaveformPipeline
+	LATENCY_FILTER,				//RefreshAllFilters()
+	LATENCY_UI_WAKEUP,			//Filtered waveform ready until the UI thread starts processing it
+	LATENCY_GEOMETRY,			//PrepareGeometry() for all waveform areas
+	LATENCY_RENDER,				//WaveformArea::on_render()
+	LATENCY_TRIGGER_TO_DISPLAY,	//Trigger until the new waveform is first drawn
+
+	LATENCY_STAGE_COUNT
+};
+
+/**
+	@brief Timestamps for a single acquisition, recorded by the ScopeThread
+ */
+class AcquisitionTimestamps
+{
+public:
+	///@brief Time that PollTrigger() reported the trigger
+	double m_trigger;
+
+	///@brief Time that AcquireData() finished
+	double m_acquired;
+};
+
+/**
+	@brief Per-stage latency histograms for every waveform going through the acquisition and display pipeline
+ */
+class LatencyTracker
+{
+public:
+	LatencyTracker();
+
+	void Record(LatencyStage stage, double seconds)
+	{ m_histograms[stage].Record(seconds); }
+
+	LatencyHistogram& GetHistogram(LatencyStage stage)
+	{ return m_histograms[stage]; }
+
+	static const char* GetStageName(LatencyStage stage);
+
+	void Reset();
+	bool WriteReport(const std::string& path);
+
+	void OnAcquisition(Oscilloscope* scope, double tTrigger, double tAcquired);
+	bool PopAcquisition(Oscilloscope* scope, size_t npending, AcquisitionTimestamps& stamps);
+	void DiscardAcquisitions(Oscilloscope* scope);
+
+protected:
+	LatencyHistogram m_histograms[LATENCY_STAGE_COUNT];
+
+	std::mutex m_mutex;
+
+	///@brief Timestamps for each waveform in each instrument's pending queue, oldest first
+	std::map<Oscilloscope*, std::deque<AcquisitionTimestamps> > m_acquisitions;
+};
+
+extern LatencyTracker g_latencyTracker;
+
+#endif
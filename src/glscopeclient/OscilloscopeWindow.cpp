@@ -46,9 +46,13 @@
 #include "FileProgressDialog.h"
 #include "MultimeterDialog.h"
 #include "ScopeInfoWindow.h"
+#include "PerformanceWindow.h"
 #include "FunctionGeneratorDialog.h"
 #include "SCPIConsoleDialog.h"
 #include "FileSystem.h"
+#include "SessionLoader.h"
+#include "WaveformSerializer.h"
+#include "WaveformRecorder.h"
 #include <unistd.h>
 #include <fcntl.h>
 #include "../../lib/scopeprotocols/EyePattern.h"
@@ -71,11 +75,11 @@ using namespace std;
  */
 OscilloscopeWindow::OscilloscopeWindow(const vector<Oscilloscope*>& scopes)
 	: m_exportWizard(nullptr)
+	, m_filterGraph(m_waveformDataMutex)
 	, m_scopes(scopes)
 	, m_fullscreen(false)
 	, m_multiScopeFreeRun(false)
 	, m_scopeSyncWizard(NULL)
-	, m_syncComplete(false)
 	, m_graphEditor(NULL)
 	, m_haltConditionsDialog(this)
 	, m_timebasePropertiesDialog(NULL)
@@ -85,10 +89,12 @@ OscilloscopeWindow::OscilloscopeWindow(const vector<Oscilloscope*>& scopes)
 	, m_triggerOneShot(false)
 	, m_shuttingDown(false)
 	, m_loadInProgress(false)
+	, m_discardRequested(false)
 	, m_waveformProcessingThread(WaveformProcessingThread, this)
 	, m_cursorX(0)
 	, m_cursorY(0)
 	, m_nextMarker(1)
+	, m_historyBudget(0)
 {
 	SetTitle();
 	FindScopeFuncGens();
@@ -113,9 +119,9 @@ OscilloscopeWindow::OscilloscopeWindow(const vector<Oscilloscope*>& scopes)
 
 	m_totalWaveforms = 0;
 
-	//Start a timer for polling for scope updates
-	//TODO: can we use signals of some sort to avoid busy polling until a trigger event?
-	Glib::signal_timeout().connect(sigc::bind(sigc::mem_fun(*this, &OscilloscopeWindow::OnTimer), 1), 5);
+	//The waveform processing thread pokes us when a new waveform is ready
+	m_waveformReadyDispatcher.connect(sigc::mem_fun(*this, &OscilloscopeWindow::OnWaveformReady));
+	m_discardDispatcher.connect(sigc::mem_fun(*this, &OscilloscopeWindow::OnDiscardRequested));
 
 	add_events(Gdk::POINTER_MOTION_MASK);
 }
@@ -172,8 +178,11 @@ void OscilloscopeWindow::SetTitle()
  */
 OscilloscopeWindow::~OscilloscopeWindow()
 {
-	//Terminate the waveform processing thread
+	//Terminate the waveform processing thread.
+	//We may not have gone through on_delete_event(), so make sure it knows to exit when it wakes up.
+	m_shuttingDown = true;
 	g_waveformProcessedEvent.Signal();
+	g_waveformThreadWakeEvent.Signal();
 	m_waveformProcessingThread.join();
 }
 
@@ -182,8 +191,9 @@ OscilloscopeWindow::~OscilloscopeWindow()
  */
 void OscilloscopeWindow::CreateWidgets()
 {
-	//Initialize filter colors from preferences
+	//Initialize filter colors and acquisition settings from preferences
 	SyncFilterColors();
+	SyncAcquisitionPreferences();
 
 	//Initialize color ramps
 	m_eyeColor = "KRain";
@@ -249,6 +259,10 @@ void OscilloscopeWindow::CreateWidgets()
 							sigc::mem_fun(*this, &OscilloscopeWindow::OnFileSave),
 							false, true, true));
 					m_fileMenu.append(*item);
+					m_recordMenuItem.set_label("Record to Disk...");
+					m_recordMenuItem.signal_activate().connect(
+						sigc::mem_fun(*this, &OscilloscopeWindow::OnFileRecord));
+					m_fileMenu.append(m_recordMenuItem);
 
 					item = Gtk::manage(new Gtk::SeparatorMenuItem);
 					m_fileMenu.append(*item);
@@ -348,6 +362,10 @@ void OscilloscopeWindow::CreateWidgets()
 					m_windowMenu.append(m_windowScopeInfoMenuItem);
 						m_windowScopeInfoMenuItem.set_label("Scope Info");
 						m_windowScopeInfoMenuItem.set_submenu(m_windowScopeInfoMenu);
+					m_windowMenu.append(m_windowPerformanceMenuItem);
+						m_windowPerformanceMenuItem.set_label("Performance");
+						m_windowPerformanceMenuItem.signal_activate().connect(
+							sigc::mem_fun(*this, &OscilloscopeWindow::OnPerformance));
 
 					m_windowMenu.append(m_windowScpiConsoleMenuItem);
 						m_windowScpiConsoleMenuItem.set_label("SCPI Console");
@@ -390,6 +408,7 @@ void OscilloscopeWindow::CreateWidgets()
 			m_triggerConfigLabel.set_size_request(75, 1);
 			m_statusbar.pack_end(m_waveformRateLabel, Gtk::PACK_SHRINK);
 			m_waveformRateLabel.set_size_request(175, 1);
+			m_statusbar.pack_end(m_recordLabel, Gtk::PACK_SHRINK);
 
 	//Reconfigure menus
 	RefreshChannelsMenu();
@@ -595,67 +614,50 @@ void OscilloscopeWindow::CreateDefaultWaveformAreas(Gtk::Paned* split)
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Message handlers
 
-bool OscilloscopeWindow::OnTimer(int /*timer*/)
+/**
+	@brief Called on the UI thread by m_waveformReadyDispatcher when the waveform processing thread has new data
+ */
+void OscilloscopeWindow::OnWaveformReady()
 {
-	//Don't process any trigger events, etc during file load
-	if(m_loadInProgress)
-		return true;
-
-	if(m_shuttingDown)
-	{
-		for(auto it : m_historyWindows)
-			it.second->close();
-		return false;
-	}
-
-	if(m_triggerArmed)
-	{
-		if(g_waveformReadyEvent.Peek())
-		{
-			m_framesClock.Tick();
+	//Don't process any trigger events, etc during file load.
+	//The event stays signaled, and we get poked again once the load is done.
+	if(m_loadInProgress || m_shuttingDown || !m_triggerArmed)
+		return;
 
-			//Crunch the new waveform
-			{
-				lock_guard<recursive_mutex> lock2(m_waveformDataMutex);
+	if(!g_waveformReadyEvent.Peek())
+		return;
 
-				//Update the history windows
-				for(auto scope : m_scopes)
-				{
-					if(!scope->IsOffline())
-						m_historyWindows[scope]->OnWaveformDataReady();
-				}
+	g_latencyTracker.Record(LATENCY_UI_WAKEUP, GetTime() - m_tWaveformReady);
+	m_framesClock.Tick();
 
-				//Update filters etc once every instrument has been updated
-				OnAllWaveformsUpdated(false, false);
-			}
+	//Crunch the new waveform
+	{
+		lock_guard<recursive_mutex> lock2(m_waveformDataMutex);
 
-			//Release the waveform processing thread
-			g_waveformProcessedEvent.Signal();
+		//Update the history windows
+		for(auto scope : m_scopes)
+		{
+			if(!scope->IsOffline())
+				m_historyWindows[scope]->OnWaveformDataReady();
+		}
 
-			//In multi-scope free-run mode, re-arm every instrument's trigger after we've processed all data
-			if(m_multiScopeFreeRun)
-				ArmTrigger(TRIGGER_TYPE_NORMAL);
+		//Update filters etc once every instrument has been updated
+		OnAllWaveformsUpdated(false, false);
 
-			g_app->DispatchPendingEvents();
-		}
+		//Queue the new data (including filter outputs) to be written to disk
+		m_recorder.Record();
 	}
 
-	//Discard all pending waveform data if the trigger isn't armed.
-	//Failure to do this can lead to a spurious trigger after we wanted to stop.
-	else
-	{
-		for(auto scope : m_scopes)
-			scope->ClearPendingWaveforms();
-	}
+	//Latency is measured to the first time the new data is drawn
+	m_tDisplayTrigger = m_tInstalledTrigger;
 
-	//Clean up the scope sync wizard if it's completed
-	if(m_syncComplete && (m_scopeSyncWizard != NULL) )
-	{
-		delete m_scopeSyncWizard;
-		m_scopeSyncWizard = NULL;
-	}
+	//Release the waveform processing thread
+	g_waveformProcessedEvent.Signal();
+	g_waveformThreadWakeEvent.Signal();
 
-	return true;
+	//In multi-scope free-run mode, re-arm every instrument's trigger after we've processed all data
+	if(m_multiScopeFreeRun)
+		ArmTrigger(TRIGGER_TYPE_NORMAL);
 }
 
 void OscilloscopeWindow::OnPreferences()
@@ -708,6 +710,67 @@ void OscilloscopeWindow::SyncFilterColors()
 		m_preferences.GetColor("Appearance.Protocol Analyzer.command_color");
 }
 
+/**
+	@brief Update acquisition pipeline settings from the preferences manager
+ */
+void OscilloscopeWindow::SyncAcquisitionPreferences()
+{
+	m_waveformPipeline.SetDepth(static_cast<size_t>(m_preferences.GetReal("Acquisition.Pipeline.staged_waveforms")));
+
+	//Budgets are specified in MB
+	const double mb = 1024 * 1024;
+	g_acquisitionBudget.SetInstrumentBudget(
+		static_cast<size_t>(m_preferences.GetReal("Acquisition.Memory.instrument_budget") * mb));
+	g_acquisitionBudget.SetGlobalBudget(
+		static_cast<size_t>(m_preferences.GetReal("Acquisition.Memory.global_budget") * mb));
+	g_acquisitionBudget.NotifySpaceAvailable();
+	g_waveformPool.SetMaxBytes(static_cast<size_t>(m_preferences.GetReal("Acquisition.Memory.pool_budget") * mb));
+	m_filterGraph.GetExecutor().GetOutputCache().SetMaxBytes(
+		static_cast<size_t>(m_preferences.GetReal("Acquisition.Memory.filter_cache_budget") * mb));
+
+	g_threadBudget.SetTotalThreads(static_cast<size_t>(m_preferences.GetReal("Threading.total_threads")));
+	g_threadBudget.SetPhysicalCoresOnly(m_preferences.GetBool("Threading.physical_cores_only"));
+	g_threadBudget.SetReservation(ThreadBudget::ROLE_ACQUISITION,
+		static_cast<size_t>(m_preferences.GetReal("Threading.acquisition_threads")));
+	g_threadBudget.SetReservation(ThreadBudget::ROLE_FILTER,
+		static_cast<size_t>(m_preferences.GetReal("Threading.filter_threads")));
+	g_threadBudget.SetReservation(ThreadBudget::ROLE_GEOMETRY,
+		static_cast<size_t>(m_preferences.GetReal("Threading.geometry_threads")));
+	g_threadBudget.SetPinning(m_preferences.GetBool("Threading.pin_threads"));
+	g_threadBudget.SetNumaAware(m_preferences.GetBool("Threading.numa_aware"));
+	m_filterGraph.GetExecutor().SetThreadCount(g_threadBudget.GetThreadCount(ThreadBudget::ROLE_FILTER));
+
+	if(m_preferences.GetBool("Acquisition.Tiling.enabled"))
+	{
+		m_filterGraph.GetExecutor().SetTiling(
+			static_cast<size_t>(m_preferences.GetReal("Acquisition.Tiling.tile_size")),
+			static_cast<size_t>(m_preferences.GetReal("Acquisition.Tiling.min_depth")),
+			static_cast<size_t>(m_preferences.GetReal("Acquisition.Tiling.overlap")));
+	}
+	else
+		m_filterGraph.GetExecutor().SetTiling(0, 0, 0);
+	set<string> protocols;
+	for(auto& name : explode(m_preferences.GetString("Acquisition.Tiling.protocols"), ','))
+	{
+		while(!name.empty() && isspace(name[0]))
+			name.erase(0, 1);
+		while(!name.empty() && isspace(name[name.length()-1]))
+			name.pop_back();
+		if(!name.empty())
+			protocols.emplace(name);
+	}
+	m_filterGraph.GetExecutor().SetTileableProtocols(protocols);
+
+	m_historyBudget = static_cast<size_t>(m_preferences.GetReal("Acquisition.History.global_budget") * mb);
+	for(auto it : m_historyWindows)
+		it.second->SyncPreferences();
+
+	m_waveformMatcher.SetMaxSkew(static_cast<int64_t>(m_preferences.GetReal("Acquisition.Sync.max_skew")));
+	m_waveformMatcher.SetTimeout(m_preferences.GetReal("Acquisition.Sync.timeout") / FS_PER_SECOND);
+
+	m_displayDecimation = m_preferences.GetBool("Rendering.Performance.display_decimation");
+}
+
 void OscilloscopeWindow::OnPreferenceDialogResponse(int response)
 {
 	if(response == Gtk::RESPONSE_OK)
@@ -716,6 +779,7 @@ void OscilloscopeWindow::OnPreferenceDialogResponse(int response)
 
 		//Update the UI since we might have changed colors or other display settings
 		SyncFilterColors();
+		SyncAcquisitionPreferences();
 		PopulateToolbar();
 		SetTitle();
 		for(auto w : m_waveformAreas)
@@ -738,6 +802,7 @@ void OscilloscopeWindow::OnPreferenceDialogResponse(int response)
 bool OscilloscopeWindow::on_delete_event(GdkEventAny* /*any_event*/)
 {
 	m_shuttingDown = true;
+	g_waveformThreadWakeEvent.Signal();
 
 	CloseSession();
 	return false;
@@ -753,11 +818,18 @@ void OscilloscopeWindow::CloseSession()
 	//Stop the trigger so there's no pending waveforms
 	OnStop();
 
+	//Drop any deferred display update, the waveform areas are about to go away
+	m_displayUpdateConnection.disconnect();
+
+	//Finish writing out anything we were recording
+	StopRecording();
+
 	//Clear our trigger state
 	//Important to signal the WaveformProcessingThread so it doesn't block waiting on response that's not going to come
 	m_triggerArmed = false;
 	g_waveformReadyEvent.Clear();
 	g_waveformProcessedEvent.Signal();
+	g_waveformThreadWakeEvent.Signal();
 
     //Close popup dialogs, if they exist
     if(m_preferenceDialog)
@@ -830,6 +902,9 @@ void OscilloscopeWindow::CloseSession()
 	delete m_graphEditor;
 	m_graphEditor = NULL;
 
+	delete m_performanceWindow;
+	m_performanceWindow = NULL;
+
 	for(auto it : m_markers)
 	{
 		auto& markers = it.second;
@@ -841,6 +916,9 @@ void OscilloscopeWindow::CloseSession()
 
 	m_multiScopeFreeRun = false;
 
+	//Recycled buffers are sized for this session's instruments, don't hang on to them
+	g_waveformPool.Clear();
+
 	//Delete stuff from our UI
 	auto children = m_setupTriggerMenu.get_children();
 	for(auto c : children)
@@ -867,9 +945,13 @@ void OscilloscopeWindow::CloseSession()
 	}
 	m_meters.clear();
 
-	//Get rid of scopes
+	//Get rid of scopes, along with their queue state so a new scope at the same address doesn't inherit it.
+	//The ScopeThreads are gone and OnStop() threw away anything still queued, so nothing is using the state now.
 	for(auto scope : m_scopes)
+	{
+		g_acquisitionBudget.RemoveInstrument(scope);
 		delete scope;
+	}
 	m_scopes.clear();
 
 	SetTitle();
@@ -1270,6 +1352,7 @@ void OscilloscopeWindow::OnLoadComplete()
 	//Done loading, we can render everything for good now.
 	//Issue 2 render calls since the very first render does some setup stuff
 	m_loadInProgress = false;
+	m_waveformReadyDispatcher.emit();
 	ClearAllPersistence();
 	g_app->DispatchPendingEvents();
 	ClearAllPersistence();
@@ -1348,73 +1431,19 @@ void OscilloscopeWindow::LoadWaveformDataForScope(
 	{
 		iwave ++;
 
-		//Top level metadata
-		bool timebase_is_ps = true;
-		auto wfm = it.second;
-		time.first = wfm["timestamp"].as<long long>();
-		if(wfm["time_psec"])
-		{
-			time.second = wfm["time_psec"].as<long long>() * 1000;
-			timebase_is_ps = true;
-		}
-		else
-		{
-			time.second = wfm["time_fsec"].as<long long>();
-			timebase_is_ps = false;
-		}
-		int waveform_id = wfm["id"].as<int>();
-		bool pinned = false;
-		if(wfm["pinned"])
-			pinned = wfm["pinned"].as<int>();
+		//Create the waveforms and load their metadata
+		bool pinned;
 		string label;
-		if(wfm["label"])
-			label = wfm["label"].as<string>();
-
-		//Set up channel metadata first (serialized)
-		auto chans = wfm["channels"];
 		vector<pair<int, int>> channels;	//pair<channel, stream>
 		vector<string> formats;
-		for(auto jt : chans)
-		{
-			auto ch = jt.second;
-			int channel_index = ch["index"].as<int>();
-			int stream = 0;
-			if(ch["stream"])
-				stream = ch["stream"].as<int>();
-			auto chan = scope->GetChannel(channel_index);
-			channels.push_back(pair<int, int>(channel_index, stream));
-
-			//Waveform format defaults to sparsev1 as that's what was used before
-			//the metadata file contained a format ID at all
-			string format = "sparsev1";
-			if(ch["format"])
-				format = ch["format"].as<string>();
-			formats.push_back(format);
-
-			//TODO: support non-analog/digital captures (eyes, spectrograms, etc)
-			WaveformBase* cap = NULL;
-			AnalogWaveform* acap = NULL;
-			DigitalWaveform* dcap = NULL;
-			if(chan->GetType() == OscilloscopeChannel::CHANNEL_TYPE_ANALOG)
-				cap = acap = new AnalogWaveform;
-			else
-				cap = dcap = new DigitalWaveform;
-
-			//Channel waveform metadata
-			cap->m_timescale = ch["timescale"].as<long>();
-			cap->m_startTimestamp = time.first;
-			cap->m_startFemtoseconds = time.second;
-			if(timebase_is_ps)
-			{
-				cap->m_timescale *= 1000;
-				cap->m_triggerPhase = ch["trigphase"].as<float>() * 1000;
-			}
-			else
-				cap->m_triggerPhase = ch["trigphase"].as<long long>();
-
-			chan->Detach(stream);
-			chan->SetData(cap, stream);
-		}
+		int waveform_id = WaveformSerializer::LoadWaveformMetadata(
+			it.second,
+			scope,
+			time,
+			pinned,
+			label,
+			channels,
+			formats);
 
 		//Kick off a thread to load data for each channel
 		vector<thread*> threads;
@@ -1427,7 +1456,7 @@ void OscilloscopeWindow::LoadWaveformDataForScope(
 			channel_done[i] = 0;
 
 			threads.push_back(new thread(
-				&OscilloscopeWindow::DoLoadWaveformDataForScope,
+				&WaveformSerializer::LoadStream,
 				channels[i].first,
 				channels[i].second,
 				scope,
@@ -1498,297 +1527,19 @@ void OscilloscopeWindow::LoadWaveformDataForScope(
 	window->JumpToHistory(newest);
 }
 
-void OscilloscopeWindow::DoLoadWaveformDataForScope(
-	int channel_index,
-	int stream,
-	Oscilloscope* scope,
-	string datadir,
-	int scope_id,
-	int waveform_id,
-	string format,
-	volatile float* progress,
-	volatile int* done
-	)
-{
-	auto chan = scope->GetChannel(channel_index);
-
-	auto cap = chan->GetData(stream);
-	auto acap = dynamic_cast<AnalogWaveform*>(cap);
-	auto dcap = dynamic_cast<DigitalWaveform*>(cap);
-
-	//Load the actual sample data
-	char tmp[512];
-	if(stream == 0)
-	{
-		snprintf(tmp, sizeof(tmp), "%s/scope_%d_waveforms/waveform_%d/channel_%d.bin",
-			datadir.c_str(),
-			scope_id,
-			waveform_id,
-			channel_index);
-	}
-	else
-	{
-		snprintf(tmp, sizeof(tmp), "%s/scope_%d_waveforms/waveform_%d/channel_%d_stream%d.bin",
-			datadir.c_str(),
-			scope_id,
-			waveform_id,
-			channel_index,
-			stream);
-	}
-
-	//Load samples into memory
-	unsigned char* buf = NULL;
-
-	//Windows: use generic file reads for now
-	#ifdef _WIN32
-		FILE* fp = fopen(tmp, "rb");
-		if(!fp)
-		{
-			LogError("couldn't open %s\n", tmp);
-			return;
-		}
-
-		//Read the whole file into a buffer a megabyte at a time
-		fseek(fp, 0, SEEK_END);
-		long len = ftell(fp);
-		fseek(fp, 0, SEEK_SET);
-		buf = new unsigned char[len];
-		long len_remaining = len;
-		long blocksize = 1024*1024;
-		long read_offset = 0;
-		while(len_remaining > 0)
-		{
-			if(blocksize > len_remaining)
-				blocksize = len_remaining;
-
-			//Most time is spent on the fread's when using this path
-			*progress = read_offset * 1.0 / len;
-			fread(buf + read_offset, 1, blocksize, fp);
-
-			len_remaining -= blocksize;
-			read_offset += blocksize;
-		}
-		fclose(fp);
-
-	//On POSIX, just memory map the file
-	#else
-		int fd = open(tmp, O_RDONLY);
-		if(fd < 0)
-		{
-			LogError("couldn't open %s\n", tmp);
-			return;
-		}
-		size_t len = lseek(fd, 0, SEEK_END);
-		buf = (unsigned char*)mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
-
-		//For now, report progress complete upon the file being fully read
-		*progress = 1;
-	#endif
-
-	//Sparse interleaved
-	if(format == "sparsev1")
-	{
-		//Figure out how many samples we have
-		size_t samplesize = 2*sizeof(int64_t);
-		if(acap)
-			samplesize += sizeof(float);
-		else
-			samplesize += sizeof(bool);
-		size_t nsamples = len / samplesize;
-		cap->Resize(nsamples);
-
-		//TODO: AVX this?
-		for(size_t j=0; j<nsamples; j++)
-		{
-			size_t offset = j*samplesize;
-
-			//Read start time and duration
-			int64_t* stime = reinterpret_cast<int64_t*>(buf+offset);
-			offset += 2*sizeof(int64_t);
-			cap->m_offsets[j] = stime[0];
-			cap->m_durations[j] = stime[1];
-
-			//Read sample data
-			if(acap)
-			{
-				//The file format assumes "float" is IEEE754 32-bit float.
-				//If your platform doesn't do that, good luck.
-				//cppcheck-suppress invalidPointerCast
-				acap->m_samples[j] = *reinterpret_cast<float*>(buf+offset);
-			}
-
-			else
-				dcap->m_samples[j] = *reinterpret_cast<bool*>(buf+offset);
-
-			//TODO: progress updates
-		}
-
-		//Quickly check if the waveform is dense packed, even if it was stored as sparse.
-		//Since we know samples must be monotonic and non-overlapping, we don't have to check every single one!
-		int64_t nlast = nsamples - 1;
-		if( (cap->m_offsets[0] == 0) &&
-			(cap->m_offsets[nlast] == nlast) &&
-			(cap->m_durations[nlast] == 1) )
-		{
-			cap->m_densePacked = true;
-		}
-	}
-
-	//Dense packed
-	else if(format == "densev1")
-	{
-		cap->m_densePacked = true;
-
-		//Figure out length
-		size_t nsamples = 0;
-		if(acap)
-			nsamples = len / sizeof(float);
-		else if(dcap)
-			nsamples = len / sizeof(bool);
-		cap->Resize(nsamples);
-
-		//Read sample data
-		if(acap)
-			memcpy(&acap->m_samples[0], buf, nsamples*sizeof(float));
-		else
-			memcpy(&dcap->m_samples[0], buf, nsamples*sizeof(bool));
-
-		//TODO: vectorized initialization of timestamps and durations
-		for(size_t i=0; i<nsamples; i++)
-		{
-			cap->m_offsets[i] = i;
-			cap->m_durations[i] = 1;
-		}
-	}
-
-	else
-	{
-		LogError(
-			"Unknown waveform format \"%s\", perhaps this file was created by a newer version of glscopeclient?\n",
-			format.c_str());
-	}
-
-	#ifdef _WIN32
-		delete[] buf;
-	#else
-		munmap(buf, len);
-		::close(fd);
-	#endif
-
-	*done = 1;
-	*progress = 1;
-}
-
 /**
 	@brief Reconnect to existing instruments and reconfigure them
  */
 void OscilloscopeWindow::LoadInstruments(const YAML::Node& node, bool reconnect, IDTable& table)
 {
-	if(!node)
-	{
-		LogError("Save file missing instruments node\n");
-		return;
-	}
+	vector<string> errors;
+	auto scopes = SessionLoader::LoadInstruments(node, reconnect, table, errors);
+	m_scopes.insert(m_scopes.end(), scopes.begin(), scopes.end());
 
-	//Load each instrument
-	for(auto it : node)
+	for(auto& e : errors)
 	{
-		auto inst = it.second;
-
-		Oscilloscope* scope = NULL;
-
-		auto transtype = inst["transport"].as<string>();
-		auto driver = inst["driver"].as<string>();
-
-		if(reconnect)
-		{
-			if( (transtype == "null") && (driver != "demo") )
-			{
-				Gtk::MessageDialog dlg(
-					*this,
-					"Cannot reconnect to instrument because the .scopesession file does not contain any connection "
-					"information.\n\n"
-					"Loading file in offline mode.",
-					false,
-					Gtk::MESSAGE_ERROR,
-					Gtk::BUTTONS_OK,
-					true);
-				dlg.run();
-			}
-			else
-			{
-				//Create the scope
-				auto transport = SCPITransport::CreateTransport(transtype, inst["args"].as<string>());
-
-				//Check if the transport failed to initialize
-				if((transport == NULL) || !transport->IsConnected())
-				{
-					Gtk::MessageDialog dlg(
-						*this,
-						string("Failed to connect to instrument using connection string ") + inst["args"].as<string>(),
-						false,
-						Gtk::MESSAGE_ERROR,
-						Gtk::BUTTONS_OK,
-						true);
-					dlg.run();
-				}
-
-				//All good, try to connect
-				else
-				{
-					scope = Oscilloscope::CreateOscilloscope(driver, transport);
-
-					//Sanity check make/model/serial. If mismatch, stop
-					string message;
-					bool fail = false;
-					if(inst["name"].as<string>() != scope->GetName())
-					{
-						message = string("Unable to connect to oscilloscope: instrument has model name \"") +
-							scope->GetName() + "\", save file has model name \"" + inst["name"].as<string>()  + "\"";
-						fail = true;
-					}
-					else if(inst["vendor"].as<string>() != scope->GetVendor())
-					{
-						message = string("Unable to connect to oscilloscope: instrument has vendor \"") +
-							scope->GetVendor() + "\", save file has vendor \"" + inst["vendor"].as<string>()  + "\"";
-						fail = true;
-					}
-					else if(inst["serial"].as<string>() != scope->GetSerial())
-					{
-						message = string("Unable to connect to oscilloscope: instrument has serial \"") +
-							scope->GetSerial() + "\", save file has serial \"" + inst["serial"].as<string>()  + "\"";
-						fail = true;
-					}
-					if(fail)
-					{
-						Gtk::MessageDialog dlg(*this, message, false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK, true);
-						dlg.run();
-						delete scope;
-						scope = NULL;
-					}
-				}
-			}
-		}
-
-		if(!scope)
-		{
-			//Create the mock scope
-			scope = new MockOscilloscope(
-				inst["name"].as<string>(),
-				inst["vendor"].as<string>(),
-				inst["serial"].as<string>(),
-				transtype,
-				driver,
-				inst["args"].as<string>()
-				);
-		}
-
-		//All good. Add to our list of scopes etc
-		m_scopes.push_back(scope);
-		table.emplace(inst["id"].as<int>(), scope);
-
-		//Configure the scope
-		scope->LoadConfiguration(inst, table);
+		Gtk::MessageDialog dlg(*this, e, false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK, true);
+		dlg.run();
 	}
 }
 
@@ -1797,46 +1548,13 @@ void OscilloscopeWindow::LoadInstruments(const YAML::Node& node, bool reconnect,
  */
 void OscilloscopeWindow::LoadDecodes(const YAML::Node& node, IDTable& table)
 {
-	//No protocol decodes? Skip this section
-	if(!node)
-		return;
-
-	//Load each decode
-	for(auto it : node)
-	{
-		auto dnode = it.second;
+	vector<string> errors;
+	SessionLoader::LoadDecodes(node, table, errors);
 
-		//Create the decode
-		auto proto = dnode["protocol"].as<string>();
-		auto filter = Filter::CreateFilter(proto, dnode["color"].as<string>());
-		if(filter == NULL)
-		{
-			Gtk::MessageDialog dlg(
-				string("Unable to create filter \"") + proto + "\". Skipping...\n",
-				false,
-				Gtk::MESSAGE_ERROR,
-				Gtk::BUTTONS_OK,
-				true);
-			dlg.run();
-			continue;
-		}
-
-		table.emplace(dnode["id"].as<int>(), filter);
-
-		//Load parameters during the first pass.
-		//Parameters can't have dependencies on other channels etc.
-		//More importantly, parameters may change bus width etc
-		filter->LoadParameters(dnode, table);
-	}
-
-	//Make a second pass to configure the filter inputs, once all of them have been instantiated.
-	//Filters may depend on other filters as inputs, and serialization is not guaranteed to be a topological sort.
-	for(auto it : node)
+	for(auto& e : errors)
 	{
-		auto dnode = it.second;
-		auto filter = static_cast<Filter*>(table[dnode["id"].as<int>()]);
-		if(filter)
-			filter->LoadInputs(dnode, table);
+		Gtk::MessageDialog dlg(e, false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK, true);
+		dlg.run();
 	}
 }
 
@@ -2195,6 +1913,113 @@ void OscilloscopeWindow::OnFileSave(bool saveToCurrentFile, bool saveLayout, boo
 		SerializeWaveforms(table);
 }
 
+/**
+	@brief Starts or stops streaming waveforms to disk
+ */
+void OscilloscopeWindow::OnFileRecord()
+{
+	if(!m_recordMenuItem.get_active())
+	{
+		StopRecording();
+		return;
+	}
+	if(m_recorder.IsRecording())
+		return;
+
+	Gtk::FileChooserDialog dlg(*this, "Record to Disk", Gtk::FILE_CHOOSER_ACTION_SAVE);
+	auto filter = Gtk::FileFilter::create();
+	filter->add_pattern("*.scopesession");
+	filter->set_name("glscopeclient sessions (*.scopesession)");
+	dlg.add_filter(filter);
+	dlg.add_button("Record", Gtk::RESPONSE_OK);
+	dlg.add_button("Cancel", Gtk::RESPONSE_CANCEL);
+	dlg.set_do_overwrite_confirmation();
+	if(dlg.run() != Gtk::RESPONSE_OK)
+	{
+		m_recordMenuItem.set_active(false);
+		return;
+	}
+
+	string fname = dlg.get_filename();
+	static const char* extension = ".scopesession";
+	if(fname.find(extension) == string::npos)
+		fname += extension;
+
+	lock_guard<recursive_mutex> lock(m_waveformDataMutex);
+
+	//Serialize the configuration up front so the recording opens like any other saved session
+	IDTable table;
+	string config = SerializeConfiguration(true, table);
+
+	map<Oscilloscope*, int> scopes;
+	for(auto scope : m_scopes)
+		scopes[scope] = table[scope];
+
+	//Record outputs of any filters the user asked for, by name
+	map<Filter*, int> filters;
+	auto names = explode(m_preferences.GetString("Acquisition.Record.filters"), ',');
+	for(auto& name : names)
+	{
+		while(!name.empty() && isspace(name[0]))
+			name.erase(0, 1);
+		while(!name.empty() && isspace(name[name.length()-1]))
+			name.pop_back();
+
+		for(auto f : g_filterRegistry.GetSessionFilters())
+		{
+			if(f->GetDisplayName() == name)
+				filters[f] = table[f];
+		}
+	}
+
+	m_recorder.SetMaxQueueBytes(m_preferences.GetReal("Acquisition.Record.write_buffer") * 1024 * 1024);
+	if(!m_recorder.Start(fname, config, scopes, filters))
+	{
+		string msg = string("Could not create the recording ") + fname + "!";
+		Gtk::MessageDialog errdlg(msg, false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK, true);
+		errdlg.set_title("Cannot record session\n");
+		errdlg.run();
+		m_recordMenuItem.set_active(false);
+		return;
+	}
+
+	//Everything is going to disk, so only keep the most recent waveforms in memory
+	int depth = m_preferences.GetReal("Acquisition.Record.history_depth");
+	for(auto it : m_historyWindows)
+	{
+		m_preRecordHistoryDepth[it.first] = it.second->GetMaxWaveforms();
+		it.second->SetMaxWaveforms(depth);
+	}
+
+	UpdateStatusBar();
+}
+
+/**
+	@brief Finishes writing anything still queued, and restores the in-memory history depth
+ */
+void OscilloscopeWindow::StopRecording()
+{
+	if(!m_recorder.IsRecording())
+		return;
+
+	m_recorder.Stop();
+	LogNotice("Recorded %zu waveforms to %s (%zu dropped)\n",
+		m_recorder.GetWrittenCount(),
+		m_recorder.GetDataDirName().c_str(),
+		m_recorder.GetDroppedCount());
+
+	for(auto it : m_preRecordHistoryDepth)
+	{
+		if(m_historyWindows.find(it.first) != m_historyWindows.end())
+			m_historyWindows[it.first]->SetMaxWaveforms(it.second);
+	}
+	m_preRecordHistoryDepth.clear();
+
+	m_recordLabel.set_label("");
+	if(m_recordMenuItem.get_active())
+		m_recordMenuItem.set_active(false);
+}
+
 string OscilloscopeWindow::SerializeConfiguration(bool saveLayout, IDTable& table)
 {
 	string config = "";
@@ -2203,7 +2028,7 @@ string OscilloscopeWindow::SerializeConfiguration(bool saveLayout, IDTable& tabl
 	config += SerializeInstrumentConfiguration(table);
 
 	//Decodes depend on scope channels, but need to happen before UI elements that use them
-	if(!Filter::GetAllInstances().empty())
+	if(!g_filterRegistry.GetSessionFilters().empty())
 		config += SerializeFilterConfiguration(table);
 
 	//UI config
@@ -2233,7 +2058,7 @@ string OscilloscopeWindow::SerializeFilterConfiguration(IDTable& table)
 {
 	string config = "decodes:\n";
 
-	auto set = Filter::GetAllInstances();
+	auto set = g_filterRegistry.GetSessionFilters();
 	for(auto d : set)
 		config += d->SerializeConfiguration(table);
 
@@ -2795,10 +2620,8 @@ void OscilloscopeWindow::OnClearSweeps()
 
 	//TODO: clear regular waveform data and history too?
 
-	//Clear integrated data from all pfilters
-	auto filters = Filter::GetAllInstances();
-	for(auto f : filters)
-		f->ClearSweeps();
+	//Clear integrated data from all filters, and make sure they're re-evaluated from scratch
+	m_filterGraph.OnSweepsCleared();
 
 	//Clear persistence on all groups
 	for(auto g : m_waveformGroups)
@@ -3005,6 +2828,7 @@ void OscilloscopeWindow::ClearPersistence(WaveformGroup* group, bool geometry_di
 		}
 
 		//Do the updates in parallel
+		g_threadBudget.BindThread(ThreadBudget::ROLE_GEOMETRY);
 		#pragma omp parallel for
 		for(size_t i=0; i<data.size(); i++)
 			WaveformArea::PrepareGeometry(data[i], geometry_dirty, alpha, coeff);
@@ -3162,94 +2986,212 @@ bool OscilloscopeWindow::HasOnlineScopes()
 	return false;
 }
 
+/**
+	@brief Gets all online instruments, primary first
+ */
+vector<Oscilloscope*> OscilloscopeWindow::GetOnlineScopes()
+{
+	vector<Oscilloscope*> ret;
+	for(auto scope : m_scopes)
+	{
+		if(!scope->IsOffline())
+			ret.push_back(scope);
+	}
+	return ret;
+}
+
 /**
 	@brief See if we have waveforms ready to process
  */
 bool OscilloscopeWindow::CheckForPendingWaveforms()
 {
 	//No online scopes to poll? Re-run the filter graph
-	if(!HasOnlineScopes())
+	auto scopes = GetOnlineScopes();
+	if(scopes.empty())
 		return m_triggerArmed;
 
-	//Wait for every online scope to have triggered
-	for(auto scope : m_scopes)
+	//Pull everything the instruments have acquired into the matcher
+	for(auto scope : scopes)
 	{
-		if(scope->IsOffline())
-			continue;
-		if(!scope->HasPendingWaveforms())
-			return false;
+		while(scope->HasPendingWaveforms())
+			DownloadWaveform(scope);
 	}
 
-	//Keep track of when the primary instrument triggers.
-	if(m_multiScopeFreeRun)
+	//Done if we have a waveform from every instrument with matching timestamps
+	if(m_waveformMatcher.Align(scopes))
+		return true;
+
+	//If a waveform has waited too long for the other instruments, something went wrong (missed trigger etc).
+	//Throw away only the stale waveforms, and re-arm in case the instruments are stuck waiting for each other.
+	size_t expired = m_waveformMatcher.ExpireOrphans();
+	if(expired && m_multiScopeFreeRun)
 	{
-		//See when the primary triggered
-		if( (m_tPrimaryTrigger < 0) && m_scopes[0]->HasPendingWaveforms() )
-			m_tPrimaryTrigger = GetTime();
+		LogWarning("Timed out waiting for one or more instruments to trigger, discarded %zu unmatched waveforms. "
+			"Re-arming...\n", expired);
+		ArmTrigger(TRIGGER_TYPE_NORMAL);
+	}
+	return false;
+}
 
-		//All instruments should trigger within 1 sec (arbitrary threshold) of the primary.
-		//If it's been longer than that, something went wrong. Discard all pending data and re-arm the trigger.
-		double twait = GetTime() - m_tPrimaryTrigger;
-		if( (m_tPrimaryTrigger > 0) && ( twait > 1 ) )
-		{
-			LogWarning("Timed out waiting for one or more secondary instruments to trigger (%.2f ms). Resetting...\n",
-				twait*1000);
+/**
+	@brief Called by the waveform processing thread when it sees the trigger isn't armed
 
-			//Cancel any pending triggers
-			OnStop();
+	Only emits the dispatcher if there isn't already a request waiting, so a busy instrument can't flood the UI.
+ */
+void OscilloscopeWindow::RequestDiscard()
+{
+	if(!m_discardRequested.exchange(true))
+		m_discardDispatcher.emit();
+}
 
-			//Discard all pending waveform data
-			for(auto scope : m_scopes)
-			{
-				//Don't touch anything offline
-				if(scope->IsOffline())
-					continue;
+/**
+	@brief Called on the UI thread by m_discardDispatcher
+ */
+void OscilloscopeWindow::OnDiscardRequested()
+{
+	//Clear the request first, so anything arriving while we discard asks again
+	m_discardRequested = false;
 
-				scope->IDPing();
-				scope->ClearPendingWaveforms();
-			}
+	//Discard all pending waveform data if the trigger isn't armed.
+	//Failure to do this can lead to a spurious trigger after we wanted to stop.
+	if(!m_triggerArmed)
+		DiscardAllPendingWaveforms();
+}
 
-			//Re-arm the trigger and get back to polling
-			OnStart();
-			return false;
-		}
-	}
+/**
+	@brief Throws away every waveform which has been acquired but not yet processed
 
-	//If we get here, we had waveforms on all instruments
-	return true;
+	Must only be called from the UI thread.
+ */
+void OscilloscopeWindow::DiscardAllPendingWaveforms()
+{
+	for(auto scope : m_scopes)
+		DiscardPendingWaveforms(scope);
+	m_waveformMatcher.Clear();
+	m_waveformPipeline.Clear();
 }
 
 /**
-	@brief Pull the waveform data out of the queue and make it current
+	@brief Throws away all waveforms in an instrument's pending queue, and counts them as dropped
  */
-void OscilloscopeWindow::DownloadWaveforms()
+void OscilloscopeWindow::DiscardPendingWaveforms(Oscilloscope* scope)
 {
-	lock_guard<recursive_mutex> lock(m_waveformDataMutex);
+	size_t count = scope->GetPendingWaveformCount();
+	scope->ClearPendingWaveforms();
+	g_acquisitionBudget.OnWaveformsDiscarded(scope, count);
+	g_latencyTracker.DiscardAcquisitions(scope);
+}
+
+/**
+	@brief Pull one waveform out of an instrument's queue and hand it to the matcher.
+
+	The live channel data is left untouched so the UI can keep working on the previous waveform.
+ */
+void OscilloscopeWindow::DownloadWaveform(Oscilloscope* scope)
+{
+	map<StreamDescriptor, WaveformBase*> data;
+	double tstart = GetTime();
+	double ttrigger = -1;
 
-	//Process the waveform data from each instrument
-	for(auto scope : m_scopes)
 	{
-		//Don't touch anything offline
-		if(scope->IsOffline())
-			continue;
+		//Only held long enough to swap pointers, since PopPendingWaveform() writes straight to the channels
+		lock_guard<recursive_mutex> lock(m_waveformDataMutex);
 
-		//Make sure we don't free the old waveform data
+		//Save the current waveform data and make sure we don't free it
+		vector<WaveformBase*> current;
 		for(size_t i=0; i<scope->GetChannelCount(); i++)
 		{
 			auto chan = scope->GetChannel(i);
 			for(size_t j=0; j<chan->GetStreamCount(); j++)
+			{
+				current.push_back(chan->GetData(j));
 				chan->Detach(j);
+			}
+		}
+
+		//Figure out when this waveform was triggered
+		AcquisitionTimestamps stamps;
+		if(g_latencyTracker.PopAcquisition(scope, scope->GetPendingWaveformCount(), stamps))
+		{
+			g_latencyTracker.Record(LATENCY_QUEUE, tstart - stamps.m_acquired);
+			ttrigger = stamps.m_trigger;
 		}
 
 		//Download the data
 		scope->PopPendingWaveform();
+
+		//Move the new data out of the channels and put the current data back
+		size_t k = 0;
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto chan = scope->GetChannel(i);
+			for(size_t j=0; j<chan->GetStreamCount(); j++)
+			{
+				auto wave = chan->GetData(j);
+				if(wave)
+					data[StreamDescriptor(chan, j)] = wave;
+				chan->Detach(j);
+				chan->SetData(current[k++], j);
+			}
+		}
 	}
 
+	g_latencyTracker.Record(LATENCY_DOWNLOAD, GetTime() - tstart);
+	m_waveformMatcher.Add(scope, data, ttrigger);
+}
+
+/**
+	@brief Take the oldest matched set of waveforms and stage it in the waveform pipeline
+ */
+void OscilloscopeWindow::DownloadWaveforms()
+{
+	WaveformSet set;
+	double ttrigger = -1;
+
+	//With no online instruments, stage an empty set to re-run the filter graph
+	auto scopes = GetOnlineScopes();
+	if(!scopes.empty() && !m_waveformMatcher.Pop(scopes, set, ttrigger))
+		return;
+
+	m_waveformPipeline.Push(set, ttrigger);
+
 	//If we're in offline one-shot mode, disarm the trigger
 	if( (m_scopes.empty()) && m_triggerOneShot)
 		m_triggerArmed = false;
 }
 
+/**
+	@brief Moves the oldest staged waveform set into the live channels
+
+	@return True if a set was installed, false if nothing was staged
+ */
+bool OscilloscopeWindow::InstallStagedWaveforms()
+{
+	WaveformSet set;
+	if(!m_waveformPipeline.Pop(set, m_tInstalledTrigger))
+		return false;
+
+	lock_guard<recursive_mutex> lock(m_waveformDataMutex);
+
+	for(auto& it : set)
+	{
+		//Make sure we don't free the old waveform data, it's owned by the history.
+		//Streams with no new data are left empty, same as if the driver had popped them directly.
+		auto scope = it.first;
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto chan = scope->GetChannel(i);
+			for(size_t j=0; j<chan->GetStreamCount(); j++)
+				chan->Detach(j);
+		}
+
+		for(auto& jt : it.second)
+			jt.first.m_channel->SetData(jt.second, jt.first.m_stream);
+	}
+
+	return true;
+}
+
 /**
 	@brief Handles updating things after all instruments have downloaded their new waveforms
  */
@@ -3261,6 +3203,7 @@ void OscilloscopeWindow::OnAllWaveformsUpdated(bool reconfiguring, bool updateFi
 
 	//Update the status
 	UpdateStatusBar();
+	UpdateFilterSinks();
 	if(updateFilters)
 		RefreshAllFilters();
 
@@ -3277,46 +3220,11 @@ void OscilloscopeWindow::OnAllWaveformsUpdated(bool reconfiguring, bool updateFi
 	}
 
 	//Update waveform areas.
-	//Skip this if loading a file from the command line and loading isn't done
-	if(WaveformArea::IsGLInitComplete())
-	{
-		//Map all of the buffers we need to update in each area
-		for(auto w : m_waveformAreas)
-		{
-			w->OnWaveformDataReady();
-			w->CalculateOverlayPositions();
-			w->MapAllBuffers(true);
-		}
-
-		float alpha = GetTraceAlpha();
-
-		//Make the list of data to update (waveforms plus overlays)
-		vector<WaveformRenderData*> data;
-		float coeff = -1;
-		for(auto w : m_waveformAreas)
-		{
-			w->GetAllRenderData(data);
-
-			if(coeff < 0)
-				coeff = w->GetPersistenceDecayCoefficient();
-		}
-
-		//Do the updates in parallel
-		#pragma omp parallel for
-		for(size_t i=0; i<data.size(); i++)
-			WaveformArea::PrepareGeometry(data[i], true, alpha, coeff);
-
-		//Clean up
-		for(auto w : m_waveformAreas)
-		{
-			w->SetNotDirty();
-			w->UnmapAllBuffers(true);
-		}
-
-		//Submit update requests for each area
-		for(auto w : m_waveformAreas)
-			w->queue_draw();
-	}
+	//In display decimation mode, don't redraw any faster than the monitor can show it
+	if(m_displayDecimation && !reconfiguring)
+		ScheduleDisplayUpdate();
+	else
+		UpdateDisplay();
 
 	if(!reconfiguring)
 	{
@@ -3361,77 +3269,178 @@ void OscilloscopeWindow::OnAllWaveformsUpdated(bool reconfiguring, bool updateFi
 	}
 }
 
-void OscilloscopeWindow::RefreshAllFilters()
+/**
+	@brief Pushes the current waveform data to the GPU and redraws every waveform area
+ */
+void OscilloscopeWindow::UpdateDisplay()
 {
 	lock_guard<recursive_mutex> lock(m_waveformDataMutex);
 
-	SyncFilterColors();
+	//Skip this if loading a file from the command line and loading isn't done
+	if(!WaveformArea::IsGLInitComplete())
+		return;
 
-	Filter::ClearAnalysisCache();
+	m_tLastDisplayUpdate = GetTime();
+	m_displayClock.Tick();
 
-	set<Filter*> filters;
+	//Map all of the buffers we need to update in each area
+	for(auto w : m_waveformAreas)
 	{
-		lock_guard<mutex> lock2(m_filterUpdatingMutex);
-		filters = Filter::GetAllInstances();
+		w->OnWaveformDataReady();
+		w->CalculateOverlayPositions();
+		w->MapAllBuffers(true);
 	}
-	for(auto f : filters)
-		f->SetDirty();
 
-	//Prepare to topologically sort filter nodes into blocks capable of parallel evaluation.
-	//Block 0 may only depend on physical scope channels.
-	//Block 1 may depend on decodes in block 0 or physical channels.
-	//Block 2 may depend on 1/0/physical, etc.
-	typedef vector<Filter*> FilterBlock;
-	vector<FilterBlock> blocks;
+	float alpha = GetTraceAlpha();
 
-	//Working set starts out as all decoders
-	auto working = filters;
+	//Make the list of data to update (waveforms plus overlays)
+	vector<WaveformRenderData*> data;
+	float coeff = -1;
+	for(auto w : m_waveformAreas)
+	{
+		w->GetAllRenderData(data);
 
-	//Each iteration, put all decodes that only depend on previous blocks into this block.
-	for(int block=0; !working.empty(); block++)
+		if(coeff < 0)
+			coeff = w->GetPersistenceDecayCoefficient();
+	}
+
+	//Do the updates in parallel
+	double tstart = GetTime();
+	g_threadBudget.BindThread(ThreadBudget::ROLE_GEOMETRY);
+	#pragma omp parallel for
+	for(size_t i=0; i<data.size(); i++)
+		WaveformArea::PrepareGeometry(data[i], true, alpha, coeff);
+
+	//Clean up
+	for(auto w : m_waveformAreas)
 	{
-		FilterBlock current_block;
-		for(auto w : working)
-		{
-			auto d = static_cast<Filter*>(w);
+		w->SetNotDirty();
+		w->UnmapAllBuffers(true);
+	}
+	g_latencyTracker.Record(LATENCY_GEOMETRY, GetTime() - tstart);
 
-			//Check if we have any inputs that are still in the working set.
-			bool ok = true;
-			for(size_t i=0; i<d->GetInputCount(); i++)
-			{
-				auto in = d->GetInput(i).m_channel;
-				if(working.find((Filter*)in) != working.end())
-				{
-					ok = false;
-					break;
-				}
-			}
+	//Submit update requests for each area
+	for(auto w : m_waveformAreas)
+		w->queue_draw();
+}
 
-			//All inputs are in previous blocks, we're good to go for the current block
-			if(ok)
-				current_block.push_back(d);
-		}
+/**
+	@brief Updates the display now if it's been at least one monitor refresh since the last update.
 
-		//Anything we assigned this iteration shouldn't be in the working set for next time.
-		//It does, however, have to get saved in the output block.
-		for(auto d : current_block)
-			working.erase(d);
-		blocks.push_back(current_block);
+	Otherwise, a timer is started to update it at the next refresh, with whatever waveform is current by then.
+ */
+void OscilloscopeWindow::ScheduleDisplayUpdate()
+{
+	//Already have an update coming, it'll pick up this waveform (or a newer one)
+	if(m_displayUpdateConnection.connected())
+		return;
+
+	double interval = 1.0 / GetDisplayRefreshRate();
+	double twait = m_tLastDisplayUpdate + interval - GetTime();
+	if(twait <= 0)
+	{
+		UpdateDisplay();
+		return;
 	}
 
-	//Evaluate the blocks, taking advantage of parallelism between them
-	for(auto& block : blocks)
+	m_displayUpdateConnection = Glib::signal_timeout().connect(
+		sigc::mem_fun(*this, &OscilloscopeWindow::OnDisplayUpdateTimer),
+		max(1, static_cast<int>(ceil(twait * 1000))));
+}
+
+bool OscilloscopeWindow::OnDisplayUpdateTimer()
+{
+	//If the processing thread is in the middle of the filter graph, try again shortly rather than stalling the UI
+	unique_lock<recursive_mutex> lock(m_waveformDataMutex, try_to_lock);
+	if(!lock.owns_lock())
+		return true;
+
+	UpdateDisplay();
+	return false;
+}
+
+/**
+	@brief Gets the refresh rate of the monitor the window is on, in Hz
+ */
+double OscilloscopeWindow::GetDisplayRefreshRate()
+{
+	auto window = get_window();
+	if(window)
 	{
-		#pragma omp parallel for
-		for(size_t i=0; i<block.size(); i++)
-			block[i]->RefreshIfDirty();
+		auto monitor = get_display()->get_monitor_at_window(window);
+		if(monitor)
+		{
+			//Reported in mHz, or zero if unknown
+			int rate = monitor->get_refresh_rate();
+			if(rate > 0)
+				return rate / 1000.0;
+		}
 	}
 
+	return 60;
+}
+
+/**
+	@brief Re-evaluates every filter whose inputs or settings have changed
+
+	@param memoize	Reuse (and save) filter outputs from the output cache. Used when browsing history.
+ */
+void OscilloscopeWindow::RefreshAllFilters(bool memoize)
+{
+	lock_guard<recursive_mutex> lock(m_waveformDataMutex);
+	double tstart = GetTime();
+
+	SyncFilterColors();
+
+	m_filterGraph.Refresh(memoize);
+	g_latencyTracker.Record(LATENCY_FILTER, GetTime() - tstart);
+
 	//Update statistic displays after the filter graph update is complete
 	for(auto g : m_waveformGroups)
 		g->RefreshMeasurements();
 }
 
+/**
+	@brief Tells the filter graph which filters' outputs are actually used, so it can skip everything else
+
+	Must be called from the UI thread. Filters are refreshed from the waveform processing thread too, but that just
+	uses whatever was current as of the last UI update.
+ */
+void OscilloscopeWindow::UpdateFilterSinks()
+{
+	set<FlowGraphNode*> sinks;
+
+	//Anything being displayed
+	for(auto w : m_waveformAreas)
+	{
+		sinks.emplace(w->GetChannel().m_channel);
+		for(size_t i=0; i<w->GetOverlayCount(); i++)
+			sinks.emplace(w->GetOverlay(i).m_channel);
+	}
+	for(auto a : m_analyzers)
+		sinks.emplace(a->GetDecoder());
+	for(auto g : m_waveformGroups)
+	{
+		for(auto it : g->m_columnToIndexMap)
+			sinks.emplace(it.first.m_channel);
+	}
+
+	//Anything we need to look at for other reasons
+	if(m_haltConditionsDialog.IsHaltEnabled())
+	{
+		auto chan = m_haltConditionsDialog.GetHaltChannel();
+		if(chan.m_channel)
+			sinks.emplace(chan.m_channel);
+	}
+	if(m_recorder.IsRecording())
+	{
+		for(auto it : m_recorder.GetFilters())
+			sinks.emplace(it.first);
+	}
+
+	m_filterGraph.SetSinks(sinks);
+}
+
 void OscilloscopeWindow::RefreshAllViews()
 {
 	for(auto g : m_waveformGroups)
@@ -3466,9 +3475,24 @@ void OscilloscopeWindow::UpdateStatusBar()
 	if(m_totalWaveforms > 0)
 	{
 		double fps = m_framesClock.GetAverageHz();
-		snprintf(tmp, sizeof(tmp), "%zu WFMs, %.2f FPS. ", m_totalWaveforms, fps);
+		if(m_displayDecimation)
+		{
+			snprintf(tmp, sizeof(tmp), "%zu WFMs, %.2f WFM/s, %.2f FPS. ",
+				m_totalWaveforms, fps, m_displayClock.GetAverageHz());
+		}
+		else
+			snprintf(tmp, sizeof(tmp), "%zu WFMs, %.2f FPS. ", m_totalWaveforms, fps);
 		m_waveformRateLabel.set_label(tmp);
 	}
+
+	if(m_recorder.IsRecording())
+	{
+		snprintf(tmp, sizeof(tmp), "REC: %zu WFMs, %.1f MB/s, %zu dropped. ",
+			m_recorder.GetWrittenCount(),
+			m_recorder.GetThroughput() / (1024 * 1024),
+			m_recorder.GetDroppedCount());
+		m_recordLabel.set_label(tmp);
+	}
 }
 
 void OscilloscopeWindow::OnStart()
@@ -3492,12 +3516,10 @@ void OscilloscopeWindow::OnStop()
 	m_triggerArmed = false;
 
 	for(auto scope : m_scopes)
-	{
 		scope->Stop();
 
-		//Clear out any pending data (the user doesn't want it, and we don't want stale stuff hanging around)
-		scope->ClearPendingWaveforms();
-	}
+	//Clear out any pending data (the user doesn't want it, and we don't want stale stuff hanging around)
+	DiscardAllPendingWaveforms();
 }
 
 void OscilloscopeWindow::ArmTrigger(TriggerType type)
@@ -3509,6 +3531,7 @@ void OscilloscopeWindow::ArmTrigger(TriggerType type)
 	{
 		m_tArm = GetTime();
 		m_triggerArmed = true;
+		g_waveformThreadWakeEvent.Signal();
 		return;
 	}
 
@@ -3520,7 +3543,6 @@ void OscilloscopeWindow::ArmTrigger(TriggerType type)
 		Also, order of arming is critical. Secondaries must be completely armed before the primary (instrument 0) to
 		ensure that the primary doesn't trigger until the secondaries are ready for the event.
 	*/
-	m_tPrimaryTrigger = -1;
 	if(!oneshot && (m_scopes.size() > 1) )
 		m_multiScopeFreeRun = true;
 	else
@@ -3537,7 +3559,7 @@ void OscilloscopeWindow::ArmTrigger(TriggerType type)
 			if(m_scopes[i]->HasPendingWaveforms())
 			{
 				LogWarning("Scope %s had pending waveforms before arming\n", m_scopes[i]->m_nickname.c_str());
-				m_scopes[i]->ClearPendingWaveforms();
+				DiscardPendingWaveforms(m_scopes[i]);
 			}
 		}
 	}
@@ -3598,11 +3620,15 @@ void OscilloscopeWindow::ArmTrigger(TriggerType type)
 			}
 
 			//Scope is armed. Clear any garbage in the pending queue
-			m_scopes[i]->ClearPendingWaveforms();
+			DiscardPendingWaveforms(m_scopes[i]);
 		}
 	}
 	m_tArm = GetTime();
 	m_triggerArmed = true;
+
+	//Kick the processing thread in case it's idle, and pick up anything that arrived while we were disarmed
+	g_waveformThreadWakeEvent.Signal();
+	m_waveformReadyDispatcher.emit();
 }
 
 /**
@@ -3615,7 +3641,9 @@ void OscilloscopeWindow::OnHistoryUpdated()
 	//Stop triggering if we select a saved waveform
 	OnStop();
 
-	RefreshAllFilters();
+	//We may well have seen these waveforms before, so don't recompute anything we don't have to
+	UpdateFilterSinks();
+	RefreshAllFilters(true);
 
 	//Update the views
 	for(auto w : m_waveformAreas)
@@ -3648,6 +3676,48 @@ void OscilloscopeWindow::JumpToHistory(TimePoint timestamp)
 		it.second->JumpToHistory(timestamp);
 }
 
+/**
+	@brief Frees the least recently used history, across all instruments, until it fits in the global budget
+
+	Each history window enforces its own budget. This only looks at the per-window totals, so it's cheap no matter
+	how much history there is.
+ */
+void OscilloscopeWindow::EnforceHistoryBudget()
+{
+	if(m_historyBudget == 0)
+		return;
+
+	size_t total = 0;
+	for(auto it : m_historyWindows)
+		total += it.second->GetMemoryUsage();
+
+	while(total > m_historyBudget)
+	{
+		//Find the instrument whose deletable history was used longest ago
+		HistoryWindow* oldest = NULL;
+		uint64_t oldestStamp = 0;
+		for(auto it : m_historyWindows)
+		{
+			uint64_t stamp;
+			if(!it.second->GetLeastRecentlyUsed(stamp))
+				continue;
+			if( (oldest == NULL) || (stamp < oldestStamp) )
+			{
+				oldest = it.second;
+				oldestStamp = stamp;
+			}
+		}
+
+		//Everything left is pinned or being displayed
+		if(oldest == NULL)
+			break;
+
+		size_t before = oldest->GetMemoryUsage();
+		oldest->FreeLeastRecentlyUsed();
+		total = total - before + oldest->GetMemoryUsage();
+	}
+}
+
 void OscilloscopeWindow::OnTimebaseSettings()
 {
 	if(!m_timebasePropertiesDialog)
@@ -3670,13 +3740,20 @@ void OscilloscopeWindow::OnScopeSync()
 			m_scopeSyncWizard = new ScopeSyncWizard(this);
 
 		m_scopeSyncWizard->show();
-		m_syncComplete = false;
 	}
 }
 
 void OscilloscopeWindow::OnSyncComplete()
 {
-	m_syncComplete = true;
+	//Can't delete the wizard from inside its own event handler, so clean it up once we're back in the main loop
+	Glib::signal_idle().connect(sigc::mem_fun(*this, &OscilloscopeWindow::OnSyncWizardIdle));
+}
+
+bool OscilloscopeWindow::OnSyncWizardIdle()
+{
+	delete m_scopeSyncWizard;
+	m_scopeSyncWizard = NULL;
+	return false;
 }
 
 /**
@@ -3685,7 +3762,7 @@ void OscilloscopeWindow::OnSyncComplete()
 void OscilloscopeWindow::OnChannelRenamed(OscilloscopeChannel* chan)
 {
 	//Check all filters to see if they use this as input
-	auto filters = Filter::GetAllInstances();
+	auto filters = g_filterRegistry.GetSessionFilters();
 	for(auto f : filters)
 	{
 		//If using a custom name, don't change that
@@ -3728,7 +3805,7 @@ void OscilloscopeWindow::OnGenerateFilter(string name)
 {
 	//need to modeless dialog
 	string color = GetDefaultChannelColor(g_numDecodes);
-	m_pendingGenerator = Filter::CreateFilter(name, color);
+	m_pendingGenerator = g_filterRegistry.CreateFilter(name, color);
 
 	if(m_addFilterDialog)
 		delete m_addFilterDialog;
@@ -3810,8 +3887,9 @@ void OscilloscopeWindow::RefreshGenerateAndImportMenu()
 	Filter::EnumProtocols(names);
 	for(auto p : names)
 	{
-		//Create a test filter
-		auto d = Filter::CreateFilter(p, "");
+		//Create a test filter. Private, so the filter graph never sees it.
+		auto d = g_filterRegistry.CreatePrivateFilter(p, "");
+		d->AddRef();
 		if(d->GetInputCount() == 0)
 		{
 			auto item = Gtk::manage(new Gtk::MenuItem(p, false));
@@ -3830,7 +3908,7 @@ void OscilloscopeWindow::RefreshGenerateAndImportMenu()
 			item->signal_activate().connect(
 				sigc::bind<string>(sigc::mem_fun(*this, &OscilloscopeWindow::OnGenerateFilter), p));
 		}
-		delete d;
+		g_filterRegistry.ReleasePrivateFilter(d);
 	}
 }
 
@@ -3864,7 +3942,7 @@ void OscilloscopeWindow::RefreshChannelsMenu()
 	}
 
 	//Add filters
-	auto filters = Filter::GetAllInstances();
+	auto filters = g_filterRegistry.GetSessionFilters();
 	for(auto f : filters)
 		chans.push_back(f);
 
@@ -4104,7 +4182,7 @@ void OscilloscopeWindow::OnExport(string format)
 
 	//Make a list of all the channels (both scope channels and filters)
 	vector<OscilloscopeChannel*> channels;
-	auto filters = Filter::GetAllInstances();
+	auto filters = g_filterRegistry.GetSessionFilters();
 	for(auto f : filters)
 		channels.push_back(f);
 	for(auto scope : m_scopes)
@@ -4213,6 +4291,13 @@ void OscilloscopeWindow::OnFilterGraph()
 	}
 }
 
+void OscilloscopeWindow::OnPerformance()
+{
+	if(!m_performanceWindow)
+		m_performanceWindow = new PerformanceWindow(this);
+	m_performanceWindow->show();
+}
+
 void OscilloscopeWindow::LoadRecentlyUsedList()
 {
 	try
@@ -47,10 +47,15 @@
 #include "FileProgressDialog.h"
 #include "PreferenceManager.h"
 #include "FilterGraphEditor.h"
+#include "WaveformPipeline.h"
+#include "WaveformMatcher.h"
+#include "FilterGraphRunner.h"
+#include "WaveformRecorder.h"
 #include "../xptools/HzClock.h"
 #include "Marker.h"
 
 class FilterGraphEditor;
+class PerformanceWindow;
 class PreferenceDialog;
 class MultimeterDialog;
 class ScopeInfoWindow;
@@ -100,6 +105,7 @@ public:
 	{ return m_scopes.size(); }
 
 	bool HasOnlineScopes();
+	std::vector<Oscilloscope*> GetOnlineScopes();
 
 	Oscilloscope* GetScope(size_t i)
 	{ return m_scopes[i]; }
@@ -107,6 +113,18 @@ public:
 	void HideHistory()
 	{ m_btnHistory.set_active(0); }
 
+	WaveformMatcher& GetWaveformMatcher()
+	{ return m_waveformMatcher; }
+
+	FilterGraphExecutor& GetGraphExecutor()
+	{ return m_filterGraph.GetExecutor(); }
+
+	FilterGraphRunner& GetFilterGraph()
+	{ return m_filterGraph; }
+
+	const std::set<ProtocolAnalyzerWindow*>& GetProtocolAnalyzers()
+	{ return m_analyzers; }
+
 	void OnHistoryUpdated();
 	void RefreshProtocolAnalyzers();
 	void RemoveProtocolHistoryFrom(TimePoint timestamp);
@@ -118,6 +136,7 @@ public:
 	void AddMarker(TimePoint timestamp, int64_t offset, const std::string& name);
 
 	void JumpToHistory(TimePoint timestamp);
+	void EnforceHistoryBudget();
 
 	std::string GetEyeColor()
 	{ return m_eyeColor; }
@@ -143,9 +162,12 @@ public:
 	};
 	void ArmTrigger(TriggerType type);
 	void OnStop();
+	void DiscardPendingWaveforms(Oscilloscope* scope);
+	void DiscardAllPendingWaveforms();
 
 	//Clean up the sync wizard
 	void OnSyncComplete();
+	bool OnSyncWizardIdle();
 
 	/**
 		@brief Checks if a file load is in progress.
@@ -189,6 +211,7 @@ protected:
 						Gtk::Menu m_recentInstrumentsMenu;
 					Gtk::MenuItem m_exportMenuItem;
 						Gtk::Menu m_exportMenu;
+					Gtk::CheckMenuItem m_recordMenuItem;
 			Gtk::MenuItem m_setupMenuItem;
 				Gtk::Menu m_setupMenu;
 					Gtk::MenuItem m_setupSyncMenuItem;
@@ -222,6 +245,7 @@ protected:
 						Gtk::Menu m_windowMultimeterMenu;
 					Gtk::MenuItem m_windowScopeInfoMenuItem;
 						Gtk::Menu m_windowScopeInfoMenu;
+					Gtk::MenuItem m_windowPerformanceMenuItem;
 					Gtk::MenuItem m_windowScpiConsoleMenuItem;
 						Gtk::Menu m_windowScpiConsoleMenu;
 			Gtk::MenuItem m_helpMenuItem;
@@ -243,6 +267,7 @@ protected:
 			Gtk::HScale m_alphaslider;
 		//main app windows go here
 		Gtk::HBox m_statusbar;
+			Gtk::Label m_recordLabel;
 			Gtk::Label m_waveformRateLabel;
 			Gtk::Label m_triggerConfigLabel;
 
@@ -271,7 +296,7 @@ public:
 	std::map<Oscilloscope*, TriggerPropertiesDialog*> m_triggerPropertiesDialogs;
 
 	//Event handlers
-	bool OnTimer(int timer);
+	void OnWaveformReady();
 
 	//Menu event handlers
 	void OnFileSave(bool saveToCurrentFile, bool saveLayout, bool saveWaveforms);
@@ -280,6 +305,8 @@ public:
 	void OnFileOpen();
 	void DoFileOpen(const std::string& filename, bool loadLayout = true, bool loadWaveform = true, bool reconnect = true);
 	void OnFileImport();
+	void OnFileRecord();
+	void StopRecording();
 	void LoadInstruments(const YAML::Node& node, bool reconnect, IDTable& table);
 	void LoadDecodes(const YAML::Node& node, IDTable& table);
 	void LoadUIConfiguration(const YAML::Node& node, IDTable& table);
@@ -292,17 +319,6 @@ public:
 		FileProgressDialog& progress,
 		float base_progress,
 		float progress_range);
-	static void DoLoadWaveformDataForScope(
-		int channel_index,
-		int stream,
-		Oscilloscope* scope,
-		std::string datadir,
-		int scope_id,
-		int waveform_id,
-		std::string format,
-		volatile float* progress,
-		volatile int* done
-		);
 	void OnEyeColorChanged(std::string color, Gtk::RadioMenuItem* item);
 	void OnTriggerProperties(Oscilloscope* scope);
 	void OnFullscreen();
@@ -316,6 +332,7 @@ public:
 	void OnShowFunctionGenerator(FunctionGenerator* gen);
 	void OnShowSCPIConsole(SCPIDevice* device);
 	void OnFilterGraph();
+	void OnPerformance();
 	void OnAddMultimeter();
 	void ConnectToMultimeter(std::string path);
 	SCPITransport* ConnectToTransport(const std::string& name, const std::string& args);
@@ -363,10 +380,12 @@ public:
 	}
 
 	//Protocol decoding etc
-	std::mutex m_filterUpdatingMutex;
-	void RefreshAllFilters();
+	FilterGraphRunner m_filterGraph;
+	void RefreshAllFilters(bool memoize = false);
+	void UpdateFilterSinks();
 	void RefreshAllViews();
 	void SyncFilterColors();
+	void SyncAcquisitionPreferences();
 
 	virtual bool on_delete_event(GdkEventAny* any_event);
 
@@ -382,9 +401,21 @@ public:
 	//Status polling
 	void OnAllWaveformsUpdated(bool reconfiguring = false, bool updateFilters = true);
 
+	//Display updates
+	void UpdateDisplay();
+	void ScheduleDisplayUpdate();
+	bool OnDisplayUpdateTimer();
+	double GetDisplayRefreshRate();
+	bool m_displayDecimation{false};
+	double m_tLastDisplayUpdate{0};
+	sigc::connection m_displayUpdateConnection;
+
 	//Performance profiling
 	double m_tArm;
 	double m_tLastFlush;
+	double m_tInstalledTrigger{-1};		//Trigger time of the set most recently installed by the processing thread
+	double m_tDisplayTrigger{-1};		//Trigger time of the data waiting to be drawn, or negative if already drawn
+	std::atomic<double> m_tWaveformReady{0};	//Time the processing thread finished the filter graph on the newest set
 
 	bool m_toggleInProgress;
 
@@ -407,6 +438,7 @@ public:
 
 	//FPS performance info
 	HzClock m_framesClock;
+	HzClock m_displayClock;
 
 	//Fullscreen state
 	bool m_fullscreen;
@@ -414,15 +446,14 @@ public:
 
 	//Special processing needed for multi-scope synchronization
 	bool m_multiScopeFreeRun;
-	double m_tPrimaryTrigger;
 
 	//Instrument sync wizard
 	ScopeSyncWizard* m_scopeSyncWizard;
-	bool m_syncComplete;
 
 	//Modeless properties dialogs
 	PreferenceDialog* m_preferenceDialog{nullptr};
 	FilterGraphEditor* m_graphEditor;
+	PerformanceWindow* m_performanceWindow{nullptr};
 	HaltConditionsDialog m_haltConditionsDialog;
 	TimebasePropertiesDialog* m_timebasePropertiesDialog;
 	void RefreshTimebasePropertiesDialog();
@@ -432,23 +463,48 @@ public:
 	void OnStreamCountChanged(Filter* filter);
 
 	//If false, ignore incoming waveforms (scope thread might have an extra trigger after you press stop)
-	bool m_triggerArmed;
+	std::atomic<bool> m_triggerArmed;
 
 	//If true, trigger is currently armed in single-shot mode
 	bool m_triggerOneShot;
 
 	//True if shutting down (don't process any more updates after this point
-	bool m_shuttingDown;
+	std::atomic<bool> m_shuttingDown;
 
 	//True if file load is in progress
 	bool m_loadInProgress;
 
+	//Waveforms downloaded from each instrument, waiting for the other instruments' waveforms from the same trigger
+	WaveformMatcher m_waveformMatcher;
+
+	//Streams waveforms to disk while recording
+	WaveformRecorder m_recorder;
+
+	//History depth of each instrument before we started recording
+	std::map<Oscilloscope*, int> m_preRecordHistoryDepth;
+
+	//Waveform sets downloaded from the instruments but not yet processed.
+	//Must be declared before the processing thread since it's used as soon as the thread starts.
+	WaveformPipeline m_waveformPipeline;
+
+	//Wakes up the UI thread when the waveform processing thread has a new waveform ready
+	Glib::Dispatcher m_waveformReadyDispatcher;
+
+	//Asks the UI thread to throw away waveforms which arrived after the trigger was stopped.
+	//Only the UI thread discards, so it can't race OnStop() etc.
+	Glib::Dispatcher m_discardDispatcher;
+	std::atomic<bool> m_discardRequested;
+	void RequestDiscard();
+	void OnDiscardRequested();
+
 	//Thread object for waveform processing / DSP
 	std::thread m_waveformProcessingThread;
 
 	//Waveform downloading and processing
 	bool CheckForPendingWaveforms();
+	void DownloadWaveform(Oscilloscope* scope);
 	void DownloadWaveforms();
+	bool InstallStagedWaveforms();
 
 	/**
 		@brief Hold this any time we touch waveform data.
@@ -473,6 +529,9 @@ public:
 	//Markers
 	std::map<TimePoint, std::vector<Marker*> > m_markers;
 	int m_nextMarker;
+
+	//Maximum RAM used by the history of all instruments, in bytes (zero for no limit)
+	size_t m_historyBudget;
 };
 
 #endif
@@ -0,0 +1,222 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of PerformanceWindow
+ */
+
+#include "glscopeclient.h"
+#include "PerformanceWindow.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+PerformanceWindow::PerformanceWindow(OscilloscopeWindow* oscWindow)
+	: Gtk::Dialog("Performance")
+	, m_oscWindow(oscWindow)
+	, m_resetButton("Reset")
+	, m_saveButton("Save Report")
+{
+	set_skip_taskbar_hint();
+	set_type_hint(Gdk::WINDOW_TYPE_HINT_DIALOG);
+
+	get_vbox()->pack_start(m_grid, Gtk::PACK_EXPAND_WIDGET);
+		m_grid.set_column_spacing(20);
+		m_grid.set_row_spacing(2);
+		m_grid.set_margin_left(10);
+		m_grid.set_margin_right(10);
+	get_vbox()->pack_start(m_syncLabel, Gtk::PACK_SHRINK);
+		m_syncLabel.set_halign(Gtk::ALIGN_START);
+		m_syncLabel.set_margin_left(10);
+		m_syncLabel.set_margin_top(5);
+	get_vbox()->pack_start(m_poolLabel, Gtk::PACK_SHRINK);
+		m_poolLabel.set_halign(Gtk::ALIGN_START);
+		m_poolLabel.set_margin_left(10);
+	get_vbox()->pack_start(m_cacheLabel, Gtk::PACK_SHRINK);
+		m_cacheLabel.set_halign(Gtk::ALIGN_START);
+		m_cacheLabel.set_margin_left(10);
+	get_vbox()->pack_start(m_graphLabel, Gtk::PACK_SHRINK);
+		m_graphLabel.set_halign(Gtk::ALIGN_START);
+		m_graphLabel.set_margin_left(10);
+	get_vbox()->pack_start(m_buttonBox, Gtk::PACK_SHRINK);
+		m_buttonBox.pack_end(m_saveButton, Gtk::PACK_SHRINK);
+			m_saveButton.signal_clicked().connect(
+				sigc::mem_fun(*this, &PerformanceWindow::OnSaveClicked));
+		m_buttonBox.pack_end(m_resetButton, Gtk::PACK_SHRINK);
+			m_resetButton.signal_clicked().connect(
+				sigc::mem_fun(*this, &PerformanceWindow::OnResetClicked));
+
+	//Column headers
+	const char* headers[] = {"Stage", "Count", "Mean", "p50", "p99", "Max"};
+	for(int i=0; i<6; i++)
+	{
+		auto label = Gtk::make_managed<Gtk::Label>();
+		label->set_markup(string("<b>") + headers[i] + "</b>");
+		label->set_halign( (i == 0) ? Gtk::ALIGN_START : Gtk::ALIGN_END);
+		m_grid.attach(*label, i, 0, 1, 1);
+	}
+
+	//One row per stage
+	for(int i=0; i<LATENCY_STAGE_COUNT; i++)
+	{
+		auto name = Gtk::make_managed<Gtk::Label>(LatencyTracker::GetStageName(static_cast<LatencyStage>(i)));
+		name->set_halign(Gtk::ALIGN_START);
+		name->set_hexpand(true);
+		m_grid.attach(*name, 0, i+1, 1, 1);
+
+		auto& row = m_rows[i];
+		Gtk::Label** cols[] = {&row.m_count, &row.m_mean, &row.m_p50, &row.m_p99, &row.m_max};
+		for(int j=0; j<5; j++)
+		{
+			*cols[j] = Gtk::make_managed<Gtk::Label>();
+			(*cols[j])->set_halign(Gtk::ALIGN_END);
+			m_grid.attach(**cols[j], j+1, i+1, 1, 1);
+		}
+	}
+
+	Glib::signal_timeout().connect(sigc::mem_fun(*this, &PerformanceWindow::OnTick), 250);
+	OnTick();
+
+	show_all();
+}
+
+PerformanceWindow::~PerformanceWindow()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Event handlers
+
+bool PerformanceWindow::OnTick()
+{
+	if(!is_visible())
+		return true;
+
+	Unit fs(Unit::UNIT_FS);
+	for(int i=0; i<LATENCY_STAGE_COUNT; i++)
+	{
+		auto& h = g_latencyTracker.GetHistogram(static_cast<LatencyStage>(i));
+		auto& row = m_rows[i];
+
+		row.m_count->set_text(to_string(h.GetCount()));
+		if(h.GetCount() == 0)
+		{
+			row.m_mean->set_text("-");
+			row.m_p50->set_text("-");
+			row.m_p99->set_text("-");
+			row.m_max->set_text("-");
+		}
+		else
+		{
+			row.m_mean->set_text(fs.PrettyPrint(h.GetMean() * FS_PER_SECOND));
+			row.m_p50->set_text(fs.PrettyPrint(h.GetPercentile(50) * FS_PER_SECOND));
+			row.m_p99->set_text(fs.PrettyPrint(h.GetPercentile(99) * FS_PER_SECOND));
+			row.m_max->set_text(fs.PrettyPrint(h.GetMax() * FS_PER_SECOND));
+		}
+	}
+
+	//Multi-instrument sync counters
+	auto& matcher = m_oscWindow->GetWaveformMatcher();
+	char tmp[256];
+	snprintf(tmp, sizeof(tmp), "Instrument sync: %zu matched, %zu orphaned, %zu discarded, %zu waiting",
+		matcher.GetMatchCount(),
+		matcher.GetOrphanCount(),
+		matcher.GetDiscardCount(),
+		matcher.GetQueuedCount());
+	m_syncLabel.set_text(tmp);
+
+	//Waveform recycling
+	snprintf(tmp, sizeof(tmp), "Waveform pool: %.1f%% hit rate (%zu hits, %zu misses), %zu waveforms / %.1f MB pooled",
+		g_waveformPool.GetHitRate() * 100,
+		g_waveformPool.GetHitCount(),
+		g_waveformPool.GetMissCount(),
+		g_waveformPool.GetPooledCount(),
+		g_waveformPool.GetPooledBytes() / (1024.0 * 1024.0));
+	m_poolLabel.set_text(tmp);
+
+	//Filter output memoization
+	auto& cache = m_oscWindow->GetGraphExecutor().GetOutputCache();
+	snprintf(tmp, sizeof(tmp), "Filter output cache: %.1f%% hit rate (%zu hits, %zu misses), %zu outputs / %.1f MB cached",
+		cache.GetHitRate() * 100,
+		cache.GetHitCount(),
+		cache.GetMissCount(),
+		cache.GetEntryCount(),
+		cache.GetBytes() / (1024.0 * 1024.0));
+	m_cacheLabel.set_text(tmp);
+
+	//What the filter graph actually did last time
+	auto& executor = m_oscWindow->GetGraphExecutor();
+	snprintf(tmp, sizeof(tmp),
+		"Last filter graph refresh: %zu evaluated (%zu in tiles), %zu from cache, %zu skipped (output not used)",
+		executor.GetLastEvaluatedCount(),
+		executor.GetLastTiledCount(),
+		executor.GetLastCachedCount(),
+		executor.GetLastSkippedCount());
+	m_graphLabel.set_text(tmp);
+
+	return true;
+}
+
+void PerformanceWindow::OnResetClicked()
+{
+	g_latencyTracker.Reset();
+	m_oscWindow->GetWaveformMatcher().ResetCounters();
+	g_waveformPool.ResetCounters();
+	m_oscWindow->GetGraphExecutor().GetOutputCache().ResetCounters();
+	OnTick();
+}
+
+void PerformanceWindow::OnSaveClicked()
+{
+	//Prompt for the file
+	Gtk::FileChooserDialog dlg(*this, "Save Performance Report", Gtk::FILE_CHOOSER_ACTION_SAVE);
+	auto filter = Gtk::FileFilter::create();
+	filter->add_pattern("*.csv");
+	filter->set_name("CSV files (*.csv)");
+	dlg.add_filter(filter);
+	dlg.add_button("Save", Gtk::RESPONSE_OK);
+	dlg.add_button("Cancel", Gtk::RESPONSE_CANCEL);
+	dlg.set_do_overwrite_confirmation();
+	auto response = dlg.run();
+	if(response != Gtk::RESPONSE_OK)
+		return;
+
+	auto fname = dlg.get_filename();
+	if(!g_latencyTracker.WriteReport(fname))
+	{
+		string msg = string("Output file ") + fname + " cannot be opened";
+		Gtk::MessageDialog errdlg(msg, false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK, true);
+		errdlg.set_title("Cannot save performance report\n");
+		errdlg.run();
+	}
+}
@@ -0,0 +1,79 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Dialog for viewing latency of each stage of the acquisition and display pipeline
+ */
+
+#ifndef PerformanceWindow_h
+#define PerformanceWindow_h
+
+/**
+	@brief Labels for one row of the performance table
+ */
+class PerformanceRow
+{
+public:
+	Gtk::Label* m_count;
+	Gtk::Label* m_mean;
+	Gtk::Label* m_p50;
+	Gtk::Label* m_p99;
+	Gtk::Label* m_max;
+};
+
+/**
+	@brief Dialog showing latency histogram statistics for every pipeline stage
+ */
+class PerformanceWindow : public Gtk::Dialog
+{
+public:
+	PerformanceWindow(OscilloscopeWindow* oscWindow);
+	virtual ~PerformanceWindow();
+
+protected:
+	OscilloscopeWindow* m_oscWindow;
+
+	Gtk::Grid m_grid;
+		PerformanceRow m_rows[LATENCY_STAGE_COUNT];
+	Gtk::Label m_syncLabel;
+	Gtk::Label m_poolLabel;
+	Gtk::Label m_cacheLabel;
+	Gtk::Label m_graphLabel;
+	Gtk::HBox m_buttonBox;
+		Gtk::Button m_resetButton;
+		Gtk::Button m_saveButton;
+
+	void OnResetClicked();
+	void OnSaveClicked();
+	bool OnTick();
+};
+
+#endif
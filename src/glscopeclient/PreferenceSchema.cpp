@@ -32,6 +32,158 @@
 
 void PreferenceManager::InitializeDefaults()
 {
+	auto& acquisition = this->m_treeRoot.AddCategory("Acquisition");
+		auto& memory = acquisition.AddCategory("Memory");
+			memory.AddPreference(
+				Preference::Real("instrument_budget", 2048)
+				.Label("Queue budget per instrument (MB)")
+				.Description(
+					"Maximum size of waveforms acquired from a single instrument but not yet processed.\n\n"
+					"Once this is reached, glscopeclient stops pulling data from the instrument until the queue drains. "
+					"One waveform is always allowed even if it's bigger than the budget.")
+				.Unit(Unit::UNIT_COUNTS));
+			memory.AddPreference(
+				Preference::Real("global_budget", 4096)
+				.Label("Queue budget for all instruments (MB)")
+				.Description(
+					"Maximum size of waveforms acquired from all instruments combined but not yet processed.")
+				.Unit(Unit::UNIT_COUNTS));
+			memory.AddPreference(
+				Preference::Real("pool_budget", 64)
+				.Label("Waveform recycling pool (MB)")
+				.Description(
+					"Maximum size of old waveforms kept around for reuse instead of being freed.\n\n"
+					"Reusing buffers avoids allocation and page fault overhead at high waveform rates, but the pool "
+					"stays resident even when idle. It only needs to hold a few waveforms to help, so raise this for "
+					"deep captures at high rates and set it to zero to disable recycling entirely.")
+				.Unit(Unit::UNIT_COUNTS));
+			memory.AddPreference(
+				Preference::Real("filter_cache_budget", 512)
+				.Label("Filter output cache (MB)")
+				.Description(
+					"Maximum size of filter outputs kept around while browsing history.\n\n"
+					"Going back to a history entry whose filters have already been evaluated redisplays the cached "
+					"outputs instead of running the filters again. Set to zero to disable.")
+				.Unit(Unit::UNIT_COUNTS));
+		auto& pipeline = acquisition.AddCategory("Pipeline");
+			pipeline.AddPreference(
+				Preference::Real("staged_waveforms", 2)
+				.Label("Staged waveform sets")
+				.Description(
+					"Number of waveform sets which may be downloaded from the instruments and queued for the filter "
+					"graph while the UI is still processing the previous waveform.")
+				.Unit(Unit::UNIT_COUNTS));
+		auto& tiling = acquisition.AddCategory("Tiling");
+			tiling.AddPreference(
+				Preference::Bool("enabled", false)
+				.Label("Tiled evaluation")
+				.Description(
+					"Run groups of simple filters over very deep waveforms one tile at a time.\n\n"
+					"Only the outputs something is looking at are kept at full length, so intermediate results never "
+					"need more memory than one tile."));
+			tiling.AddPreference(
+				Preference::Real("tile_size", 4 * 1024 * 1024)
+				.Label("Tile size (samples)")
+				.Description("Number of samples of the deepest input processed at a time.")
+				.Unit(Unit::UNIT_COUNTS));
+			tiling.AddPreference(
+				Preference::Real("min_depth", 64 * 1024 * 1024)
+				.Label("Minimum depth (samples)")
+				.Description("Only waveforms at least this deep are tiled. Anything smaller is processed in one go.")
+				.Unit(Unit::UNIT_COUNTS));
+			tiling.AddPreference(
+				Preference::Real("overlap", 1024)
+				.Label("Tile overlap (samples)")
+				.Description(
+					"Number of samples before each tile which are also fed to the filters, so filters which look back "
+					"at previous samples (edge detection, hysteresis) start each tile in the right state.")
+				.Unit(Unit::UNIT_COUNTS));
+			tiling.AddPreference(
+				Preference::String("protocols", "Add, Subtract, Multiply, Divide, Invert, Scale, Threshold")
+				.Label("Tileable filters")
+				.Description(
+					"Comma separated names of filter types which only depend on nearby samples, and so produce the "
+					"same output whether they're run on a whole waveform or one slice of it at a time."));
+		auto& history = acquisition.AddCategory("History");
+			history.AddPreference(
+				Preference::Bool("compress", true)
+				.Label("Compress old waveforms")
+				.Description(
+					"Losslessly compress waveforms in the history once they're no longer among the most recent few.\n\n"
+					"Compression runs in the background. Compressed waveforms are expanded again when selected."));
+			history.AddPreference(
+				Preference::Real("uncompressed_depth", 4)
+				.Label("Uncompressed waveforms")
+				.Description("Number of most recent waveforms in the history which are never compressed.")
+				.Unit(Unit::UNIT_COUNTS));
+			history.AddPreference(
+				Preference::Real("instrument_budget", 0)
+				.Label("History budget per instrument (MB)")
+				.Description(
+					"Maximum RAM used by the history of a single instrument, including compressed waveforms.\n\n"
+					"Once this is reached, the least recently viewed waveforms which aren't pinned are deleted. "
+					"The history depth limit still applies as well. Set to zero for no limit.")
+				.Unit(Unit::UNIT_COUNTS));
+			history.AddPreference(
+				Preference::Real("global_budget", 0)
+				.Label("History budget for all instruments (MB)")
+				.Description(
+					"Maximum RAM used by the history of all instruments combined. Set to zero for no limit.")
+				.Unit(Unit::UNIT_COUNTS));
+			history.AddPreference(
+				Preference::Bool("spill", false)
+				.Label("Spill to disk")
+				.Description(
+					"Write the least recently viewed waveforms to disk when the history is over budget, rather than "
+					"deleting them.\n\n"
+					"Spilled waveforms are mapped back in when selected, and linked into place when the session is "
+					"saved. They're deleted when glscopeclient exits."));
+			history.AddPreference(
+				Preference::String("spill_directory", "")
+				.Label("Spill directory")
+				.Description(
+					"Directory spilled waveforms are written to. If empty, the system temp directory is used.\n\n"
+					"Put this on the same filesystem as your sessions to make saving them fast."));
+		auto& sync = acquisition.AddCategory("Sync");
+			sync.AddPreference(
+				Preference::Real("max_skew", 0.1 * FS_PER_SECOND)
+				.Label("Maximum trigger skew")
+				.Description(
+					"Maximum difference between the timestamps of waveforms from different instruments for them to be "
+					"treated as the same trigger event.\n\n"
+					"Waveforms with no match on the other instruments are discarded.")
+				.Unit(Unit::UNIT_FS));
+			sync.AddPreference(
+				Preference::Real("timeout", FS_PER_SECOND)
+				.Label("Match timeout")
+				.Description(
+					"Maximum time a waveform from one instrument may wait for the other instruments to trigger "
+					"before it's discarded and the trigger is re-armed.")
+				.Unit(Unit::UNIT_FS));
+		auto& record = acquisition.AddCategory("Record");
+			record.AddPreference(
+				Preference::Real("history_depth", 10)
+				.Label("History depth while recording")
+				.Description(
+					"Number of waveforms kept in the in-memory history while recording to disk.\n\n"
+					"The previous history depth is restored when recording stops.")
+				.Unit(Unit::UNIT_COUNTS));
+			record.AddPreference(
+				Preference::Real("write_buffer", 1024)
+				.Label("Write buffer (MB)")
+				.Description(
+					"Maximum size of waveforms copied for recording but not yet written to disk.\n\n"
+					"If the disk can't keep up and this fills, new waveforms are dropped from the recording (and "
+					"counted in the status bar) rather than slowing down acquisition.")
+				.Unit(Unit::UNIT_COUNTS));
+			record.AddPreference(
+				Preference::String("filters", "")
+				.Label("Filter outputs to record")
+				.Description(
+					"Comma separated names of filters whose outputs are recorded along with the instrument "
+					"waveforms.\n\n"
+					"Filter outputs are saved in filter_N_waveforms directories next to the instrument data."));
+
 	auto& appearance = this->m_treeRoot.AddCategory("Appearance");
 		auto& cursors = appearance.AddCategory("Cursors");
 			cursors.AddPreference(
@@ -154,6 +306,14 @@ void PreferenceManager::InitializeDefaults()
 				Preference::Color("disabled_port_color", Gdk::Color("#404040"))
 				.Label("Disabled port color")
 				.Description("Color for ports which cannot be selected in the current mode"));
+			graph.AddPreference(
+				Preference::Color("profile_cold_color", Gdk::Color("#204020"))
+				.Label("Profile cold color")
+				.Description("Node background for the fastest filters when showing profiling data"));
+			graph.AddPreference(
+				Preference::Color("profile_hot_color", Gdk::Color("#a00000"))
+				.Label("Profile hot color")
+				.Description("Node background for the slowest filters when showing profiling data"));
 
 		auto& peaks = appearance.AddCategory("Peaks");
 			peaks.AddPreference(
@@ -279,6 +439,67 @@ void PreferenceManager::InitializeDefaults()
 					.EnumValue("OpenGL (compute shader)", ACCEL_OPENGL)
 					.EnumValue("OpenCL", ACCEL_OPENCL)
 				);
+			backend.AddPreference(
+				Preference::Bool("display_decimation", false)
+				.Label("Decimate display updates")
+				.Description(
+					"Limit waveform display updates to the monitor refresh rate, always showing the newest waveform.\n\n"
+					"Every waveform is still run through the filter graph, measurements, protocol analyzers, and "
+					"history, so acquisition can run at the instrument's full trigger rate even if rendering can't "
+					"keep up."));
+
+	auto& threading = this->m_treeRoot.AddCategory("Threading");
+		threading.AddPreference(
+			Preference::Real("total_threads", 0)
+			.Label("Total threads")
+			.Description(
+				"Number of threads to divide between acquisition, filtering, and geometry.\n\n"
+				"Set to zero to use every available core.")
+			.Unit(Unit::UNIT_COUNTS));
+		threading.AddPreference(
+			Preference::Bool("physical_cores_only", true)
+			.Label("One thread per physical core")
+			.Description(
+				"Only use one hardware thread of each physical core when counting available cores and pinning "
+				"threads.\n\n"
+				"Waveform processing is mostly limited by memory bandwidth and vector units, so hyperthreads rarely "
+				"help."));
+		threading.AddPreference(
+			Preference::Real("acquisition_threads", 0)
+			.Label("Acquisition threads")
+			.Description(
+				"Number of threads reserved for downloading and decoding waveforms in the instrument drivers.\n\n"
+				"Set to zero to give acquisition a quarter of the cores not explicitly reserved.")
+			.Unit(Unit::UNIT_COUNTS));
+		threading.AddPreference(
+			Preference::Real("filter_threads", 0)
+			.Label("Filter graph threads")
+			.Description(
+				"Number of threads reserved for evaluating the filter graph.\n\n"
+				"Set to zero to give filtering half of the cores not explicitly reserved.")
+			.Unit(Unit::UNIT_COUNTS));
+		threading.AddPreference(
+			Preference::Real("geometry_threads", 0)
+			.Label("Geometry threads")
+			.Description(
+				"Number of threads reserved for preparing waveforms for display, and other parallel work done by "
+				"the user interface.\n\n"
+				"Set to zero to give geometry a quarter of the cores not explicitly reserved.")
+			.Unit(Unit::UNIT_COUNTS));
+		threading.AddPreference(
+			Preference::Bool("pin_threads", false)
+			.Label("Pin threads to cores")
+			.Description(
+				"Restrict each group of threads to its own set of cores, so they can't be migrated onto cores "
+				"reserved for something else.\n\n"
+				"Not supported on macOS."));
+		threading.AddPreference(
+			Preference::Bool("numa_aware", false)
+			.Label("Keep reservations within a NUMA node")
+			.Description(
+				"When pinning threads, hand out cores one NUMA node at a time rather than in CPU number order, so "
+				"each group of threads shares a memory controller as far as possible.\n\n"
+				"Only useful on multi-socket or multi-die systems."));
 
 	auto& privacy = this->m_treeRoot.AddCategory("Privacy");
 		 privacy.AddPreference(
@@ -541,10 +541,30 @@ void ProtocolAnalyzerWindow::OnWaveformDataReady()
 	auto data = m_decoder->GetData(0);
 	if(data == NULL)
 		return;
-	auto packets = m_decoder->GetPackets();
+	auto& packets = m_decoder->GetPackets();
 	if(packets.empty())
 		return;
 
+	vector<PacketGroup> groups;
+	HistoryReplayer::GroupPackets(m_decoder, packets, groups);
+	AppendPackets(TimePoint(data->m_startTimestamp, data->m_startFemtoseconds), groups);
+	for(auto& g : groups)
+		delete g.m_header;
+
+	ScrollToEnd();
+}
+
+/**
+	@brief Adds rows for a single waveform's worth of packets
+
+	@param stamp	Timestamp of the waveform the packets came from
+	@param groups	Packets to add, as grouped by HistoryReplayer::GroupPackets()
+ */
+void ProtocolAnalyzerWindow::AppendPackets(TimePoint stamp, const vector<PacketGroup>& groups)
+{
+	if(groups.empty())
+		return;
+
 	auto headers = m_decoder->GetHeaders();
 
 	m_updating = true;
@@ -552,83 +572,60 @@ void ProtocolAnalyzerWindow::OnWaveformDataReady()
 	//Get ready to filter new packets
 	size_t j = 0;
 	ProtocolDisplayFilter filter(m_filterBox.get_text(), j);
-	bool filtering = filter.Validate(m_decoder->GetHeaders());
-
-	Packet* first_packet_in_group = NULL;
-	Packet* last_packet = NULL;
-	Gtk::TreeModel::iterator last_top_row = m_model->children().end();
+	bool filtering = filter.Validate(headers);
 
-	auto npackets = packets.size();
-	for(size_t i=0; i<npackets; i++)
+	for(auto& g : groups)
 	{
-		auto p = packets[i];
-
-		//See if we should start a new merge group
-		bool starting_new_group;
-		if(i+1 >= npackets)									//No next packet to merge with
-			starting_new_group = false;
-		else if(!m_decoder->CanMerge(p, p, packets[i+1]))	//This packet isn't compatible with the next
-			starting_new_group = false;
-		else if(first_packet_in_group == NULL)				//If we get here, we're merging. But are we already?
-			starting_new_group = true;
-		else												//Already in a group, but it's not the same as the new one
-			starting_new_group = !m_decoder->CanMerge(first_packet_in_group, last_packet, p);
-
-		if(starting_new_group)
+		//Create the summary row for a merge group. Default to not being shown
+		Gtk::TreeModel::iterator top_row;
+		if(g.m_header != NULL)
 		{
-			//Create the summary packet
-			first_packet_in_group = p;
-			auto parent_packet = m_decoder->CreateMergedHeader(p, i);
-
-			//Add it
-			last_top_row = *m_internalmodel->append();
-			FillOutRow(*last_top_row, parent_packet, data, headers);
-			delete parent_packet;
-
-			//Default to not being shown
-			(*last_top_row)[m_columns.m_visible] = false;
+			top_row = m_internalmodel->append();
+			FillOutRow(*top_row, g.m_header, stamp, headers);
+			(*top_row)[m_columns.m_visible] = false;
 		}
 
-		//End a merge group
-		else if( (first_packet_in_group != NULL) && !m_decoder->CanMerge(first_packet_in_group, last_packet, p) )
-			first_packet_in_group = NULL;
-
-		//Create a row for the new packet. This might be top level or under a merge group
-		Gtk::TreeModel::iterator row;
-		if(first_packet_in_group != NULL)
-			row = m_internalmodel->append(last_top_row->children());
-		else
+		for(auto p : g.m_packets)
 		{
-			row = m_internalmodel->append();
-			last_top_row = row;
-		}
+			//Create a row for the new packet. This might be top level or under a merge group
+			Gtk::TreeModel::iterator row;
+			if(g.m_header != NULL)
+				row = m_internalmodel->append(top_row->children());
+			else
+				row = m_internalmodel->append();
 
-		//Populate the row
-		FillOutRow(*row, p, data, headers);
+			//Populate the row
+			FillOutRow(*row, p, stamp, headers);
 
-		//Check against filters
-		if(filtering)
-		{
-			bool visible = filter.Match(*row, m_columns);
-			(*row)[m_columns.m_visible] = visible;
+			//Check against filters
+			if(filtering)
+			{
+				bool visible = filter.Match(*row, m_columns);
+				(*row)[m_columns.m_visible] = visible;
 
-			//Show expandable rows if at least one is visible
-			if(visible && first_packet_in_group != NULL)
-				(*last_top_row)[m_columns.m_visible] = true;
-		}
-		else
-		{
-			(*row)[m_columns.m_visible] = true;
+				//Show expandable rows if at least one is visible
+				if(visible && (g.m_header != NULL) )
+					(*top_row)[m_columns.m_visible] = true;
+			}
+			else
+			{
+				(*row)[m_columns.m_visible] = true;
 
-			//If not filtering, show the parent row
-			if(first_packet_in_group != NULL)
-				(*last_top_row)[m_columns.m_visible] = true;
+				//If not filtering, show the parent row
+				if(g.m_header != NULL)
+					(*top_row)[m_columns.m_visible] = true;
+			}
 		}
-
-		last_packet = p;
 	}
 
-	//Select the last row
+	m_updating = false;
+}
+
+/**
+	@brief Scrolls to the most recent packet
+ */
+void ProtocolAnalyzerWindow::ScrollToEnd()
+{
 	auto len = m_model->children().size();
 	if(len != 0)
 	{
@@ -637,19 +634,17 @@ void ProtocolAnalyzerWindow::OnWaveformDataReady()
 		m_tree.expand_to_path(path);
 		m_tree.scroll_to_row(path);
 	}
-
-	m_updating = false;
 }
 
 void ProtocolAnalyzerWindow::FillOutRow(
 	const Gtk::TreeRow& row,
 	Packet* p,
-	WaveformBase* data,
+	TimePoint stamp,
 	vector<string>& headers)
 {
 	//Need a bit of math in case the capture is >1 second long
-	time_t capstart = data->m_startTimestamp;
-	int64_t fs = data->m_startFemtoseconds + p->m_offset;
+	time_t capstart = stamp.first;
+	int64_t fs = stamp.second + p->m_offset;
 	if(fs > FS_PER_SECOND)
 	{
 		capstart += (fs / FS_PER_SECOND);
@@ -667,7 +662,7 @@ void ProtocolAnalyzerWindow::FillOutRow(
 	row[m_columns.m_bgcolor] = p->m_displayBackgroundColor;
 	row[m_columns.m_fgcolor] = p->m_displayForegroundColor;
 	row[m_columns.m_timestamp] = stime;
-	row[m_columns.m_capturekey] = TimePoint(data->m_startTimestamp, data->m_startFemtoseconds);
+	row[m_columns.m_capturekey] = stamp;
 	row[m_columns.m_offset] = p->m_offset;
 	row[m_columns.m_len] = p->m_len;
 
@@ -783,7 +778,20 @@ void ProtocolAnalyzerWindow::RemoveHistoryFrom(TimePoint timestamp)
 	//This results in empty() returning false, and the foreach loop attempting to dereference null iterators.
 	//The only observed reliable means of determining when the end of the container has been reached is by calling
 	//operator bool() on the iterator.
-	if(children.size() != 0)
+	if(m_internalmodel->IsTimeOrdered())
+	{
+		//Rows are sorted by capture time, so everything from this waveform is one contiguous block
+		auto& rows = m_internalmodel->GetRows();
+		auto first = lower_bound(rows.begin(), rows.end(), timestamp,
+			[](const ProtocolTreeRow& row, const TimePoint& key) { return row.m_capturekey < key; });
+		for(auto it = first; (it != rows.end()) && (it->m_capturekey == timestamp); it++)
+		{
+			Gtk::TreePath path;
+			path.push_back(it - rows.begin());
+			paths.push_back(path);
+		}
+	}
+	else if(children.size() != 0)
 	{
 		for(auto it = children.begin(); (bool)it; it++)
 		{
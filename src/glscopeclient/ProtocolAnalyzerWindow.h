@@ -38,8 +38,7 @@
 class OscilloscopeWindow;
 
 #include "../../lib/scopehal/PacketDecoder.h"
-
-typedef std::pair<time_t, int64_t> TimePoint;
+#include "HistoryReplayer.h"
 
 class ProtocolTreeRow
 {
@@ -100,6 +99,10 @@ public:
 	const ProtocolTreeChildren& GetRows()
 	{ return m_rows; }
 
+	///@brief True if the top level rows are sorted by capture key, so they can be binary searched
+	bool IsTimeOrdered()
+	{ return m_timeOrdered; }
+
 protected:
 	const Gtk::TreeModelColumnRecord& m_columns;
 
@@ -108,6 +111,7 @@ protected:
 
 	ProtocolTreeChildren m_rows;
 	int m_nheaders;
+	bool m_timeOrdered;
 };
 
 class ProtocolAnalyzerColumns : public Gtk::TreeModel::ColumnRecord
@@ -202,6 +206,8 @@ public:
 	~ProtocolAnalyzerWindow();
 
 	void OnWaveformDataReady();
+	void AppendPackets(TimePoint stamp, const std::vector<PacketGroup>& groups);
+	void ScrollToEnd();
 	void RemoveHistoryFrom(TimePoint timestamp);
 
 	PacketDecoder* GetDecoder()
@@ -238,7 +244,7 @@ protected:
 
 	void OnSelectionChanged();
 
-	void FillOutRow(const Gtk::TreeRow& row, Packet* p, WaveformBase* data, std::vector<std::string>& headers);
+	void FillOutRow(const Gtk::TreeRow& row, Packet* p, TimePoint stamp, std::vector<std::string>& headers);
 
 	bool m_updating;
 };
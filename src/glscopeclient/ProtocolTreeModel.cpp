@@ -41,6 +41,7 @@ ProtocolTreeModel::ProtocolTreeModel(const Gtk::TreeModelColumnRecord& columns)
 	 : Glib::ObjectBase(typeid(ProtocolTreeModel))
 	 , Gtk::TreeModel()
 	 , m_columns(columns)
+	 , m_timeOrdered(true)
 {
 	m_nheaders = columns.size() - 10;
 }
@@ -335,6 +336,16 @@ void ProtocolTreeModel::set_value_impl(const iterator& row, int column, const Gl
 
 		case 5:
 			p->m_capturekey = reinterpret_cast<const Gtk::TreeModelColumn<TimePoint>::ValueType&>(value).get();
+
+			//Packets normally arrive in capture order. If one doesn't, stop binary searching top level rows
+			if(GPOINTER_TO_INT(row.gobj()->user_data2) < 0)
+			{
+				int nrow = GPOINTER_TO_INT(row.gobj()->user_data);
+				if( (nrow > 0) && (p->m_capturekey < m_rows[nrow-1].m_capturekey) )
+					m_timeOrdered = false;
+				if( (nrow+1 < (int)m_rows.size()) && (m_rows[nrow+1].m_capturekey < p->m_capturekey) )
+					m_timeOrdered = false;
+			}
 			break;
 
 		case 6:
@@ -449,6 +460,8 @@ Gtk::TreeModel::iterator ProtocolTreeModel::erase(const iterator& iter)
 	if(second <= 0)
 	{
 		m_rows.erase(m_rows.begin() + nrow);
+		if(m_rows.empty())
+			m_timeOrdered = true;
 
 		//Get iterator to the next row, if there is one
 		if(nrow >= (int)m_rows.size())
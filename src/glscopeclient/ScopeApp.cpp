@@ -86,25 +86,25 @@ void ScopeApp::run(
 
 		if(f.find(".wav") != string::npos)
 		{
-			filter = Filter::CreateFilter("WAV Import", color);
+			filter = g_filterRegistry.CreateFilter("WAV Import", color);
 			filter->GetParameter("WAV File").SetFileName(f);
 		}
 
 		//Complex I/Q: user probably will have to override format later
 		else if(f.find(".complex") != string::npos)
 		{
-			filter = Filter::CreateFilter("Complex Import", color);
+			filter = g_filterRegistry.CreateFilter("Complex Import", color);
 			filter->GetParameter("Complex File").SetFileName(f);
 		}
 
 		else if(f.find(".csv") != string::npos)
 		{
-			filter = Filter::CreateFilter("CSV Import", color);
+			filter = g_filterRegistry.CreateFilter("CSV Import", color);
 			filter->GetParameter("CSV File").SetFileName(f);
 		}
 		else if(f.find(".vcd") != string::npos)
 		{
-			filter = Filter::CreateFilter("VCD Import", color);
+			filter = g_filterRegistry.CreateFilter("VCD Import", color);
 			filter->GetParameter("VCD File").SetFileName(f);
 		}
 
@@ -119,7 +119,7 @@ void ScopeApp::run(
 
 		else if( (f.find(".s") != string::npos) && (f[f.length()-1] == 'p') )
 		{
-			filter = Filter::CreateFilter("Touchstone Import", color);
+			filter = g_filterRegistry.CreateFilter("Touchstone Import", color);
 			filter->GetParameter("Touchstone File").SetFileName(f);
 		}
 
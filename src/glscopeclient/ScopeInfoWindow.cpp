@@ -49,6 +49,10 @@ ScopeInfoWindow::ScopeInfoWindow(OscilloscopeWindow* oscWindow, Oscilloscope* sc
 	, m_bufferedWaveformParam(FilterParameter::TYPE_INT, Unit(Unit::UNIT_COUNTS))
 	, m_bufferedWaveformTimeParam(FilterParameter::TYPE_FLOAT, Unit(Unit::UNIT_FS))
 	, m_uiDisplayRate(FilterParameter::TYPE_FLOAT, Unit(Unit::UNIT_HZ))
+	, m_queuedBytesParam(FilterParameter::TYPE_FLOAT, Unit(Unit::UNIT_COUNTS))
+	, m_backpressureParam(FilterParameter::TYPE_STRING)
+	, m_blockedTimeParam(FilterParameter::TYPE_FLOAT, Unit(Unit::UNIT_FS))
+	, m_droppedWaveformsParam(FilterParameter::TYPE_INT, Unit(Unit::UNIT_COUNTS))
 	, m_saveButton("Save Diagnostics")
 	, m_graphWindow( string("Scope Info: ") + scope->m_nickname + string(" (Graphs)"))
 {
@@ -90,13 +94,21 @@ ScopeInfoWindow::ScopeInfoWindow(OscilloscopeWindow* oscWindow, Oscilloscope* sc
 	m_uiDisplayRate.SetFloatVal(0);
 	m_bufferedWaveformParam.SetIntVal(0);
 	m_bufferedWaveformTimeParam.SetFloatVal(0);
+	m_queuedBytesParam.SetFloatVal(0);
+	m_backpressureParam.SetStringVal("Running");
+	m_blockedTimeParam.SetFloatVal(0);
+	m_droppedWaveformsParam.SetIntVal(0);
 
 	std::vector<std::pair<std::string, FilterParameter*>> to_bind = {
 		{"Driver", &m_driver},
 		{"Transport", &m_transport},
 		{"Rendering Rate", &m_uiDisplayRate},
 		{"Buffered Waveforms (Count)", &m_bufferedWaveformParam},
-		{"Buffered Waveforms (Time)", &m_bufferedWaveformTimeParam}
+		{"Buffered Waveforms (Time)", &m_bufferedWaveformTimeParam},
+		{"Buffered Waveforms (MB)", &m_queuedBytesParam},
+		{"Acquisition Backpressure", &m_backpressureParam},
+		{"Backpressure Blocked Time", &m_blockedTimeParam},
+		{"Dropped Waveforms", &m_droppedWaveformsParam}
 	};
 
 	for (auto& i : to_bind)
@@ -135,6 +147,13 @@ bool ScopeInfoWindow::OnTick()
 	m_bufferedWaveformParam.SetIntVal(depth);
 	m_bufferedWaveformTimeParam.SetFloatVal(ms * 1000000000000);
 
+	//Backpressure state
+	auto qstate = g_acquisitionBudget.GetState(m_scope);
+	m_queuedBytesParam.SetFloatVal(qstate->GetBytesQueued() / (1024.0 * 1024.0));
+	m_backpressureParam.SetStringVal(qstate->m_blocked ? "Blocked" : "Running");
+	m_blockedTimeParam.SetFloatVal(qstate->m_blockedMicroseconds * 1e9);
+	m_droppedWaveformsParam.SetIntVal(qstate->m_drops);
+
 	for (auto& i : m_scope->GetDiagnosticsValues())
 	{
 		auto found_pair = m_valuesLabels.find(i.first);
@@ -250,6 +269,11 @@ void ScopeInfoWindow::OnSaveClicked()
 	fprintf(fp, "Scope Pending Waveforms = %ld\n", m_scope->GetPendingWaveformCount());
 	fprintf(fp, "Main UI Render Rate = %f Hz\n", m_oscWindow->m_framesClock.GetAverageHz());
 
+	auto qstate = g_acquisitionBudget.GetState(m_scope);
+	fprintf(fp, "Queued Waveform Data = %zu bytes\n", qstate->GetBytesQueued());
+	fprintf(fp, "Backpressure Blocked Time = %.3f ms\n", qstate->m_blockedMicroseconds * 1e-3);
+	fprintf(fp, "Dropped Waveforms = %zu\n", static_cast<size_t>(qstate->m_drops));
+
 	fprintf(fp, "\n[Diagnostic Parameters]\n");
 
 	for (auto& i : m_scope->GetDiagnosticsValues())
@@ -85,6 +85,10 @@ protected:
 	FilterParameter m_bufferedWaveformParam;
 	FilterParameter m_bufferedWaveformTimeParam;
 	FilterParameter m_uiDisplayRate;
+	FilterParameter m_queuedBytesParam;
+	FilterParameter m_backpressureParam;
+	FilterParameter m_blockedTimeParam;
+	FilterParameter m_droppedWaveformsParam;
 
 	Gtk::Grid m_grid;
 		Gtk::Grid				m_commonValuesGrid;
@@ -369,7 +369,9 @@ bool ScopeSyncWizard::OnTimer()
 	m_activeSecondaryPage->m_progressBar.set_text("Cross-correlate skew reference waveform");
 	m_activeSecondaryPage->m_progressBar.set_fraction(progress);
 
+	//We're on the UI thread, so share the geometry cores rather than fighting the filter graph for its own
 	std::mutex cmutex;
+	g_threadBudget.BindThread(ThreadBudget::ROLE_GEOMETRY);
 	#pragma omp parallel for
 	for(int64_t d = m_delta; d < blockEnd; d ++)
 	{
@@ -0,0 +1,211 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of SessionLoader
+ */
+#include "../scopehal/scopehal.h"
+#include "../scopehal/Filter.h"
+#include "../scopehal/MockOscilloscope.h"
+#include "FilterRegistry.h"
+#include "SessionLoader.h"
+
+using namespace std;
+
+/**
+	@brief Reconnect to existing instruments and reconfigure them
+
+	If reconnecting is disabled or fails, a MockOscilloscope is created in place of the real instrument.
+
+	@param node			The "instruments" node of the session
+	@param reconnect	True to try connecting to the actual hardware
+	@param table		ID table for the session
+	@param errors		Problems found while loading, one message per problem
+
+	@return The instruments, in the order they appear in the file
+ */
+vector<Oscilloscope*> SessionLoader::LoadInstruments(
+	const YAML::Node& node,
+	bool reconnect,
+	IDTable& table,
+	vector<string>& errors)
+{
+	vector<Oscilloscope*> scopes;
+
+	if(!node)
+	{
+		LogError("Save file missing instruments node\n");
+		return scopes;
+	}
+
+	//Load each instrument
+	for(auto it : node)
+	{
+		auto inst = it.second;
+
+		Oscilloscope* scope = NULL;
+
+		auto transtype = inst["transport"].as<string>();
+		auto driver = inst["driver"].as<string>();
+
+		if(reconnect)
+		{
+			if( (transtype == "null") && (driver != "demo") )
+			{
+				errors.push_back(
+					"Cannot reconnect to instrument because the .scopesession file does not contain any connection "
+					"information.\n\n"
+					"Loading file in offline mode.");
+			}
+			else
+			{
+				//Create the scope
+				auto transport = SCPITransport::CreateTransport(transtype, inst["args"].as<string>());
+
+				//Check if the transport failed to initialize
+				if((transport == NULL) || !transport->IsConnected())
+				{
+					errors.push_back(
+						string("Failed to connect to instrument using connection string ") + inst["args"].as<string>());
+				}
+
+				//All good, try to connect
+				else
+				{
+					scope = Oscilloscope::CreateOscilloscope(driver, transport);
+
+					//Sanity check make/model/serial. If mismatch, stop
+					string message;
+					bool fail = false;
+					if(inst["name"].as<string>() != scope->GetName())
+					{
+						message = string("Unable to connect to oscilloscope: instrument has model name \"") +
+							scope->GetName() + "\", save file has model name \"" + inst["name"].as<string>()  + "\"";
+						fail = true;
+					}
+					else if(inst["vendor"].as<string>() != scope->GetVendor())
+					{
+						message = string("Unable to connect to oscilloscope: instrument has vendor \"") +
+							scope->GetVendor() + "\", save file has vendor \"" + inst["vendor"].as<string>()  + "\"";
+						fail = true;
+					}
+					else if(inst["serial"].as<string>() != scope->GetSerial())
+					{
+						message = string("Unable to connect to oscilloscope: instrument has serial \"") +
+							scope->GetSerial() + "\", save file has serial \"" + inst["serial"].as<string>()  + "\"";
+						fail = true;
+					}
+					if(fail)
+					{
+						errors.push_back(message);
+						delete scope;
+						scope = NULL;
+					}
+				}
+			}
+		}
+
+		if(!scope)
+		{
+			//Create the mock scope
+			scope = new MockOscilloscope(
+				inst["name"].as<string>(),
+				inst["vendor"].as<string>(),
+				inst["serial"].as<string>(),
+				transtype,
+				driver,
+				inst["args"].as<string>()
+				);
+		}
+
+		//All good. Add to our list of scopes etc
+		scopes.push_back(scope);
+		table.emplace(inst["id"].as<int>(), scope);
+
+		//Configure the scope
+		scope->LoadConfiguration(inst, table);
+	}
+
+	return scopes;
+}
+
+/**
+	@brief Load protocol decoder configuration
+
+	@param node			The "decodes" node of the session
+	@param table		ID table for the session
+	@param errors		Problems found while loading, one message per problem
+
+	@return The filters which were successfully created
+ */
+vector<Filter*> SessionLoader::LoadDecodes(const YAML::Node& node, IDTable& table, vector<string>& errors)
+{
+	vector<Filter*> filters;
+
+	//No protocol decodes? Skip this section
+	if(!node)
+		return filters;
+
+	//Load each decode
+	for(auto it : node)
+	{
+		auto dnode = it.second;
+
+		//Create the decode
+		auto proto = dnode["protocol"].as<string>();
+		auto filter = g_filterRegistry.CreateFilter(proto, dnode["color"].as<string>());
+		if(filter == NULL)
+		{
+			errors.push_back(string("Unable to create filter \"") + proto + "\". Skipping...\n");
+			continue;
+		}
+
+		filters.push_back(filter);
+		table.emplace(dnode["id"].as<int>(), filter);
+
+		//Load parameters during the first pass.
+		//Parameters can't have dependencies on other channels etc.
+		//More importantly, parameters may change bus width etc
+		filter->LoadParameters(dnode, table);
+	}
+
+	//Make a second pass to configure the filter inputs, once all of them have been instantiated.
+	//Filters may depend on other filters as inputs, and serialization is not guaranteed to be a topological sort.
+	for(auto it : node)
+	{
+		auto dnode = it.second;
+		auto filter = static_cast<Filter*>(table[dnode["id"].as<int>()]);
+		if(filter)
+			filter->LoadInputs(dnode, table);
+	}
+
+	return filters;
+}
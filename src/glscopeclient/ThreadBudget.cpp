@@ -0,0 +1,387 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of ThreadBudget
+ */
+#include "../scopehal/scopehal.h"
+#include "ThreadBudget.h"
+#include <algorithm>
+#include <thread>
+#include <omp.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+ThreadBudget g_threadBudget;
+
+ThreadBudget::ThreadBudget()
+	: m_nodeCount(1)
+	, m_totalThreads(0)
+	, m_physicalOnly(true)
+	, m_pin(false)
+	, m_numa(false)
+	, m_generation(1)
+{
+	for(size_t i=0; i<ROLE_COUNT; i++)
+	{
+		m_reservations[i] = 0;
+		m_counts[i] = 1;
+	}
+
+	DetectTopology();
+	Rebalance();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Topology detection
+
+#ifdef __linux__
+/**
+	@brief Reads a sysfs CPU list (like "0-3,8-11") into a vector of CPU IDs
+ */
+static bool ReadCPUList(const string& path, vector<int>& cpus)
+{
+	FILE* fp = fopen(path.c_str(), "r");
+	if(!fp)
+		return false;
+
+	char buf[4096] = {0};
+	if(!fgets(buf, sizeof(buf), fp))
+	{
+		fclose(fp);
+		return false;
+	}
+	fclose(fp);
+
+	char* p = buf;
+	while(*p)
+	{
+		char* end;
+		long first = strtol(p, &end, 10);
+		if(end == p)
+			break;
+		long last = first;
+		p = end;
+		if(*p == '-')
+		{
+			last = strtol(p+1, &end, 10);
+			p = end;
+		}
+		for(long i=first; i<=last; i++)
+			cpus.push_back(i);
+		if(*p == ',')
+			p++;
+	}
+
+	return true;
+}
+#endif
+
+/**
+	@brief Finds every logical CPU, which physical core it belongs to, and which NUMA node it's on
+ */
+void ThreadBudget::DetectTopology()
+{
+	size_t nprocs = max(thread::hardware_concurrency(), 1U);
+
+#ifdef __linux__
+	vector<int> online;
+	if(ReadCPUList("/sys/devices/system/cpu/online", online) && !online.empty())
+	{
+		for(auto id : online)
+		{
+			CPU cpu;
+			cpu.m_id = id;
+			cpu.m_node = 0;
+			cpu.m_primary = true;
+
+			//The lowest numbered sibling of each core counts as the core itself
+			vector<int> siblings;
+			char path[128];
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", id);
+			if(ReadCPUList(path, siblings) && !siblings.empty())
+				cpu.m_primary = (siblings[0] == id);
+
+			m_cpus.push_back(cpu);
+		}
+
+		//Nodes are numbered contiguously, stop at the first one that doesn't exist
+		for(int node=0; ; node++)
+		{
+			vector<int> cpus;
+			char path[128];
+			snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+			if(!ReadCPUList(path, cpus))
+				break;
+
+			m_nodeCount = node + 1;
+			for(auto& cpu : m_cpus)
+			{
+				if(find(cpus.begin(), cpus.end(), cpu.m_id) != cpus.end())
+					cpu.m_node = node;
+			}
+		}
+
+		return;
+	}
+#endif
+
+	//No topology info, so assume hyperthreading is enabled and adjacent CPUs share a core
+	for(size_t i=0; i<nprocs; i++)
+	{
+		CPU cpu;
+		cpu.m_id = i;
+		cpu.m_node = 0;
+		cpu.m_primary = (nprocs == 1) || ( (i % 2) == 0);
+		m_cpus.push_back(cpu);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Configuration
+
+/**
+	@brief Sets the total number of threads to divide between the roles, or zero to use every available core
+ */
+void ThreadBudget::SetTotalThreads(size_t threads)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_totalThreads = threads;
+	Rebalance();
+}
+
+/**
+	@brief Sets the number of threads reserved for a role, or zero to give it a share of whatever is left over
+ */
+void ThreadBudget::SetReservation(Role role, size_t threads)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_reservations[role] = threads;
+	Rebalance();
+}
+
+/**
+	@brief Sets whether only one hardware thread of each physical core is used
+ */
+void ThreadBudget::SetPhysicalCoresOnly(bool physical)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_physicalOnly = physical;
+	Rebalance();
+}
+
+/**
+	@brief Sets whether threads are pinned to their role's CPUs
+ */
+void ThreadBudget::SetPinning(bool pin)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_pin = pin;
+	Rebalance();
+}
+
+/**
+	@brief Sets whether each role's CPUs are allocated node by node, rather than in CPU ID order
+ */
+void ThreadBudget::SetNumaAware(bool numa)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_numa = numa;
+	Rebalance();
+}
+
+/**
+	@brief Recalculates the allocation after a configuration change. Must be called with m_mutex held.
+ */
+void ThreadBudget::Rebalance()
+{
+	//Figure out which CPUs we can use, and what order to hand them out in
+	vector<CPU> usable;
+	for(auto& cpu : m_cpus)
+	{
+		if(cpu.m_primary || !m_physicalOnly)
+			usable.push_back(cpu);
+	}
+	if(usable.empty())
+		usable = m_cpus;
+	if(m_numa)
+	{
+		stable_sort(usable.begin(), usable.end(),
+			[](const CPU& a, const CPU& b) { return a.m_node < b.m_node; });
+	}
+
+	size_t total = m_totalThreads ? m_totalThreads : usable.size();
+
+	//Explicit reservations come off the top, then the rest is split between everything else
+	static const size_t weights[ROLE_COUNT] = { 1, 2, 1 };
+	size_t reserved = 0;
+	size_t autoWeight = 0;
+	for(size_t i=0; i<ROLE_COUNT; i++)
+	{
+		reserved += m_reservations[i];
+		if(m_reservations[i] == 0)
+			autoWeight += weights[i];
+	}
+	size_t remaining = (total > reserved) ? (total - reserved) : 0;
+
+	size_t start = 0;
+	for(size_t i=0; i<ROLE_COUNT; i++)
+	{
+		size_t count = m_reservations[i];
+		if(count == 0)
+			count = remaining * weights[i] / autoWeight;
+		count = max(count, (size_t)1);
+		m_counts[i] = count;
+
+		//If we're oversubscribed, wrap around and share CPUs with the roles allocated first
+		m_roleCPUs[i].clear();
+		for(size_t j=0; j<count; j++)
+			m_roleCPUs[i].push_back(usable[(start + j) % usable.size()].m_id);
+		start += count;
+	}
+
+	m_generation ++;
+}
+
+/**
+	@brief Gets the CPUs a role's threads are pinned to (whether or not pinning is currently enabled)
+ */
+vector<int> ThreadBudget::GetCPUs(Role role)
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_roleCPUs[role];
+}
+
+const char* ThreadBudget::GetRoleName(Role role)
+{
+	switch(role)
+	{
+		case ROLE_ACQUISITION:
+			return "acquisition";
+
+		case ROLE_FILTER:
+			return "filtering";
+
+		case ROLE_GEOMETRY:
+			return "geometry";
+
+		default:
+			return "unknown";
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Thread binding
+
+/**
+	@brief Binds the calling thread to a role.
+
+	Pins the thread to the role's CPUs if pinning is enabled, and sets the size of OpenMP teams it starts. Only does
+	anything if the role or the allocation has changed since the last call, so it's cheap enough to call every time
+	around a thread's main loop (which is how threads pick up preference changes).
+
+	@param role			The role the thread is working for
+	@param ompThreads	OpenMP team size, or zero for the role's full thread count
+ */
+void ThreadBudget::BindThread(Role role, size_t ompThreads)
+{
+	static thread_local uint64_t boundGeneration = 0;
+	static thread_local int boundRole = -1;
+	static thread_local size_t boundOmpThreads = 0;
+	static thread_local bool pinned = false;
+
+	uint64_t generation = m_generation;
+	if( (generation == boundGeneration) && (boundRole == role) && (boundOmpThreads == ompThreads) )
+		return;
+
+	vector<int> cpus;
+	bool pin;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		pin = m_pin;
+		if(pin)
+			cpus = m_roleCPUs[role];
+
+		//Undo any previous pinning
+		else if(pinned)
+		{
+			for(auto& cpu : m_cpus)
+				cpus.push_back(cpu.m_id);
+		}
+	}
+
+	if(!cpus.empty())
+		SetAffinity(cpus);
+	pinned = pin;
+
+	omp_set_num_threads(ompThreads ? ompThreads : m_counts[role].load());
+
+	boundGeneration = generation;
+	boundRole = role;
+	boundOmpThreads = ompThreads;
+}
+
+/**
+	@brief Restricts the calling thread to a set of CPUs. OpenMP threads it starts later inherit the same set.
+ */
+void ThreadBudget::SetAffinity(const vector<int>& cpus)
+{
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for(auto cpu : cpus)
+	{
+		if(cpu < CPU_SETSIZE)
+			CPU_SET(cpu, &set);
+	}
+	if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		LogWarning("Failed to set thread affinity\n");
+#elif defined(_WIN32)
+	DWORD_PTR mask = 0;
+	for(auto cpu : cpus)
+	{
+		if(cpu < 64)
+			mask |= (DWORD_PTR)1 << cpu;
+	}
+	if(mask && !SetThreadAffinityMask(GetCurrentThread(), mask))
+		LogWarning("Failed to set thread affinity\n");
+#else
+	//No thread affinity API (e.g. macOS), just use the thread counts
+	(void)cpus;
+#endif
+}
@@ -0,0 +1,133 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of ThreadBudget
+ */
+#ifndef ThreadBudget_h
+#define ThreadBudget_h
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/**
+	@brief Divides the machine's cores between the parts of the application which run parallel work.
+
+	Each role gets a reservation: a number of threads, and (if pinning is enabled) a set of CPUs which no other role
+	uses. Reservations left at zero split whatever cores aren't explicitly reserved, with filtering getting twice the
+	share of the others. Threads doing work for a role call BindThread(), which pins them and sizes their OpenMP teams
+	to match, so nested parallel regions in different parts of the application don't oversubscribe each other.
+
+	CPU topology is read from sysfs on Linux. Elsewhere, every logical CPU is assumed to be one half of a
+	hyperthreaded core, and pinning is only supported on Windows.
+
+	Has no GUI dependencies, so it can be shared by the window, headless mode, and the filter graph executor.
+ */
+class ThreadBudget
+{
+public:
+	ThreadBudget();
+
+	enum Role
+	{
+		///@brief Scope threads (waveform download and decoding in the drivers)
+		ROLE_ACQUISITION,
+
+		///@brief Filter graph workers
+		ROLE_FILTER,
+
+		///@brief Geometry preparation, and any other parallel work done on the UI thread
+		ROLE_GEOMETRY,
+
+		ROLE_COUNT
+	};
+
+	void SetTotalThreads(size_t threads);
+	void SetReservation(Role role, size_t threads);
+	void SetPhysicalCoresOnly(bool physical);
+	void SetPinning(bool pin);
+	void SetNumaAware(bool numa);
+
+	///@brief Number of threads available to a role
+	size_t GetThreadCount(Role role)
+	{ return m_counts[role]; }
+
+	std::vector<int> GetCPUs(Role role);
+
+	///@brief Number of NUMA nodes found on the system
+	size_t GetNodeCount()
+	{ return m_nodeCount; }
+
+	void BindThread(Role role, size_t ompThreads = 0);
+
+	static const char* GetRoleName(Role role);
+
+protected:
+	void DetectTopology();
+	void Rebalance();
+	static void SetAffinity(const std::vector<int>& cpus);
+
+	///@brief A single logical CPU
+	class CPU
+	{
+	public:
+		int m_id;
+		int m_node;
+
+		///@brief False if this is the second (or later) hardware thread of a physical core
+		bool m_primary;
+	};
+
+	std::mutex m_mutex;
+
+	///@brief Every logical CPU on the system, in ID order
+	std::vector<CPU> m_cpus;
+	size_t m_nodeCount;
+
+	//Configuration
+	size_t m_totalThreads;
+	size_t m_reservations[ROLE_COUNT];
+	bool m_physicalOnly;
+	bool m_pin;
+	bool m_numa;
+
+	//Current allocation
+	std::atomic<size_t> m_counts[ROLE_COUNT];
+	std::vector<int> m_roleCPUs[ROLE_COUNT];
+
+	///@brief Bumped every time the allocation changes, so bound threads know to re-apply it
+	std::atomic<uint64_t> m_generation;
+};
+
+extern ThreadBudget g_threadBudget;
+
+#endif
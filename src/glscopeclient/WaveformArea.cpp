@@ -354,8 +354,9 @@ void WaveformArea::CreateWidgets()
 			item->signal_activate().connect(
 				sigc::bind<string, bool>(sigc::mem_fun(*this, &WaveformArea::OnProtocolDecode), p, false));
 
-			//Create a test decode and see where it goes
-			auto d = Filter::CreateFilter(p, "");
+			//Create a test decode and see where it goes. Private, so the filter graph never sees it.
+			auto d = g_filterRegistry.CreatePrivateFilter(p, "");
+			d->AddRef();
 			switch(d->GetCategory())
 			{
 				case Filter::CAT_ANALYSIS:
@@ -426,7 +427,7 @@ void WaveformArea::CreateWidgets()
 					m_decodeMiscMenu.append(*item);
 					break;
 			}
-			delete d;
+			g_filterRegistry.ReleasePrivateFilter(d);
 
 			//Make a second menu item and put on the alphabetical list
 			item = Gtk::manage(new Gtk::MenuItem(p, false));
@@ -519,7 +519,7 @@ void WaveformArea::OnDoubleClick(GdkEventButton* /*event*/, int64_t /*timestamp*
 
 						//Clear any waveforms acquired while the dialog was open
 						for(size_t i=0; i<m_parent->GetScopeCount(); i++)
-							m_parent->GetScope(i)->ClearPendingWaveforms();
+							m_parent->DiscardPendingWaveforms(m_parent->GetScope(i));
 
 						//TODO: only if ADC bit depth changed?
 						//(if changed we really want to clear persistence for all channels in the group...)
@@ -1138,7 +1138,7 @@ void WaveformArea::OnProtocolDecode(string name, bool forceStats)
 	string color = GetDefaultChannelColor(g_numDecodes);
 	if(m_pendingDecode)
 		delete m_pendingDecode;
-	m_pendingDecode = Filter::CreateFilter(name, color);
+	m_pendingDecode = g_filterRegistry.CreateFilter(name, color);
 
 	//Only one input with no config required? Do default configuration
 	if( (m_pendingDecode->GetInputCount() == 1) && !m_pendingDecode->NeedsConfig())
@@ -1532,18 +1532,16 @@ void WaveformArea::UpdateContextMenu()
 			if(menu == NULL)
 				continue;
 
-			//Need to synchronize with OscilloscopeWindow::RefreshAllFilters().
-			//Otherwise there's a chance that this filter will be added to the working set and updated
-			//after we've deleted it.
-			lock_guard<mutex> lock(m_parent->m_filterUpdatingMutex);
-			auto filter = Filter::CreateFilter(
+			//Private, so OscilloscopeWindow::RefreshAllFilters() never adds it to the working set
+			auto filter = g_filterRegistry.CreatePrivateFilter(
 				menu->get_label(),
 				"");
+			filter->AddRef();
 			if(filter->GetInputCount() == 0)
 				menu->set_sensitive();	//filters with no inputs always are legal
 			else
 				menu->set_sensitive(filter->ValidateChannel(0, m_selectedChannel));
-			delete filter;
+			g_filterRegistry.ReleasePrivateFilter(filter);
 		}
 	}
 
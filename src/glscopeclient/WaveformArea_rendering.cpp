@@ -380,6 +380,7 @@ bool WaveformArea::on_render(const Glib::RefPtr<Gdk::GLContext>& /*context*/)
 		return true;
 
 	LogIndenter li;
+	double tstart = GetTime();
 	float persistDecay = GetPersistenceDecayCoefficient();
 
 	//Overlay positions need to be calculated before geometry download,
@@ -486,6 +487,15 @@ bool WaveformArea::on_render(const Glib::RefPtr<Gdk::GLContext>& /*context*/)
 	//Done, not clearing persistence
 	m_persistenceClear = false;
 
+	//Update performance counters. Trigger-to-display latency ends at the first area to draw the new waveform.
+	double now = GetTime();
+	g_latencyTracker.Record(LATENCY_RENDER, now - tstart);
+	if(m_parent->m_tDisplayTrigger > 0)
+	{
+		g_latencyTracker.Record(LATENCY_TRIGGER_TO_DISPLAY, now - m_parent->m_tDisplayTrigger);
+		m_parent->m_tDisplayTrigger = -1;
+	}
+
 	return true;
 }
 
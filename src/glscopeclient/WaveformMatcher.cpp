@@ -0,0 +1,273 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of WaveformMatcher
+ */
+#include "../scopehal/scopehal.h"
+#include "AcquisitionBudget.h"
+#include "WaveformPipeline.h"
+#include "WaveformMatcher.h"
+#include "WaveformPool.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+WaveformMatcher::WaveformMatcher()
+	: m_maxSkew(static_cast<int64_t>(0.1 * FS_PER_SECOND))
+	, m_timeout(1)
+	, m_matches(0)
+	, m_orphans(0)
+	, m_discards(0)
+{
+}
+
+WaveformMatcher::~WaveformMatcher()
+{
+	Clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Queue management
+
+/**
+	@brief Adds a waveform popped from an instrument's driver queue. The matcher takes ownership of the waveforms.
+ */
+void WaveformMatcher::Add(Oscilloscope* scope, const map<StreamDescriptor, WaveformBase*>& data, double tTrigger)
+{
+	//Timestamp of the set is the timestamp of the first waveform in it
+	TimePoint timestamp(0, 0);
+	for(auto& it : data)
+	{
+		if(it.second)
+		{
+			timestamp = TimePoint(it.second->m_startTimestamp, it.second->m_startFemtoseconds);
+			break;
+		}
+	}
+
+	g_acquisitionBudget.GetState(scope)->m_stagedBytes += WaveformPipeline::GetSetMemoryUsage(data);
+
+	lock_guard<mutex> lock(m_mutex);
+	m_queues[scope].push_back(PendingWaveform{data, timestamp, tTrigger, GetTime()});
+}
+
+/**
+	@brief Discards orphans until the oldest waveform of each instrument forms a matched set, or we run out of data.
+
+	@param scopes	The online instruments, primary first
+
+	@return True if a matched set is ready to Pop()
+ */
+bool WaveformMatcher::Align(const vector<Oscilloscope*>& scopes)
+{
+	lock_guard<mutex> lock(m_mutex);
+	if(scopes.empty())
+		return false;
+
+	auto& primary = m_queues[scopes[0]];
+	while(!primary.empty())
+	{
+		auto ref = primary.front().m_timestamp;
+		bool ready = true;
+		bool primaryOrphaned = false;
+		for(size_t i=1; i<scopes.size(); i++)
+		{
+			auto& queue = m_queues[scopes[i]];
+
+			//Anything older than the primary's waveform by more than the skew window can never be matched
+			while(!queue.empty() && (GetSkew(queue.front().m_timestamp, ref) < -m_maxSkew) )
+			{
+				LogVerbose("Discarding unmatched waveform from %s\n", scopes[i]->m_nickname.c_str());
+				DeleteFront(scopes[i], queue);
+				m_orphans ++;
+			}
+
+			//Still waiting for this instrument
+			if(queue.empty())
+				ready = false;
+
+			//Waveforms arrive in order, so if the secondary is already past the skew window the primary's
+			//waveform can never be matched either
+			else if(GetSkew(queue.front().m_timestamp, ref) > m_maxSkew)
+				primaryOrphaned = true;
+		}
+
+		if(primaryOrphaned)
+		{
+			LogVerbose("Discarding unmatched waveform from %s\n", scopes[0]->m_nickname.c_str());
+			DeleteFront(scopes[0], primary);
+			m_orphans ++;
+			continue;
+		}
+
+		return ready;
+	}
+
+	return false;
+}
+
+/**
+	@brief Removes the oldest matched set. The caller takes ownership of the waveforms.
+
+	@param scopes	The online instruments, primary first
+	@param set		The matched set
+	@param tTrigger	Time of the earliest trigger in the set, or negative if unknown
+
+	@return True if a set was removed, false if no matched set was ready
+ */
+bool WaveformMatcher::Pop(const vector<Oscilloscope*>& scopes, WaveformSet& set, double& tTrigger)
+{
+	if(!Align(scopes))
+		return false;
+
+	lock_guard<mutex> lock(m_mutex);
+
+	//Make sure nobody cleared the queues since we aligned them
+	for(auto scope : scopes)
+	{
+		if(m_queues[scope].empty())
+			return false;
+	}
+
+	tTrigger = -1;
+	for(auto scope : scopes)
+	{
+		auto& queue = m_queues[scope];
+		auto& front = queue.front();
+
+		set[scope] = front.m_data;
+		if( (front.m_tTrigger >= 0) && ( (tTrigger < 0) || (front.m_tTrigger < tTrigger) ) )
+			tTrigger = front.m_tTrigger;
+
+		g_acquisitionBudget.GetState(scope)->m_stagedBytes -= WaveformPipeline::GetSetMemoryUsage(front.m_data);
+		queue.pop_front();
+	}
+	g_acquisitionBudget.NotifySpaceAvailable();
+
+	m_matches ++;
+	return true;
+}
+
+/**
+	@brief Discards waveforms which have been waiting longer than the timeout for the other instruments to trigger
+
+	@return Number of waveforms discarded
+ */
+size_t WaveformMatcher::ExpireOrphans()
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	double tcutoff = GetTime() - m_timeout;
+	size_t count = 0;
+	for(auto& it : m_queues)
+	{
+		auto& queue = it.second;
+		while(!queue.empty() && (queue.front().m_tArrived < tcutoff) )
+		{
+			DeleteFront(it.first, queue);
+			count ++;
+		}
+	}
+
+	m_orphans += count;
+	return count;
+}
+
+/**
+	@brief Discards every queued waveform, e.g. because the trigger was stopped
+ */
+void WaveformMatcher::Clear()
+{
+	lock_guard<mutex> lock(m_mutex);
+	for(auto& it : m_queues)
+	{
+		while(!it.second.empty())
+		{
+			DeleteFront(it.first, it.second);
+			m_discards ++;
+		}
+	}
+	m_queues.clear();
+}
+
+/**
+	@brief Recycles the oldest waveform in one instrument's queue and counts it as dropped
+ */
+void WaveformMatcher::DeleteFront(Oscilloscope* scope, deque<PendingWaveform>& queue)
+{
+	auto& front = queue.front();
+
+	g_acquisitionBudget.GetState(scope)->m_stagedBytes -= WaveformPipeline::GetSetMemoryUsage(front.m_data);
+	g_acquisitionBudget.OnWaveformsDiscarded(scope, 1);
+
+	for(auto& it : front.m_data)
+		g_waveformPool.Return(it.second);
+	queue.pop_front();
+}
+
+/**
+	@brief Gets the total number of single-instrument waveforms waiting for a match
+ */
+size_t WaveformMatcher::GetQueuedCount()
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	size_t count = 0;
+	for(auto& it : m_queues)
+		count += it.second.size();
+	return count;
+}
+
+void WaveformMatcher::ResetCounters()
+{
+	m_matches = 0;
+	m_orphans = 0;
+	m_discards = 0;
+}
+
+/**
+	@brief Gets the difference between two instrument timestamps (a - b) in femtoseconds
+
+	Saturates instead of overflowing if the timestamps are hours apart.
+ */
+int64_t WaveformMatcher::GetSkew(const TimePoint& a, const TimePoint& b)
+{
+	int64_t dsec = a.first - b.first;
+	if(dsec > 1000)
+		return INT64_MAX;
+	if(dsec < -1000)
+		return -INT64_MAX;
+
+	return dsec * static_cast<int64_t>(FS_PER_SECOND) + (a.second - b.second);
+}
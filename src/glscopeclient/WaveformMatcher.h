@@ -0,0 +1,124 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of WaveformMatcher
+ */
+#ifndef WaveformMatcher_h
+#define WaveformMatcher_h
+
+#include <deque>
+#include <mutex>
+
+/**
+	@brief One instrument's waveform, pulled out of the driver queue and waiting for a match
+ */
+class PendingWaveform
+{
+public:
+	std::map<StreamDescriptor, WaveformBase*> m_data;
+
+	///@brief Instrument timestamp of the waveform
+	TimePoint m_timestamp;
+
+	///@brief Time the trigger was seen by the ScopeThread, or negative if unknown
+	double m_tTrigger;
+
+	///@brief Time the waveform was added to the matcher
+	double m_tArrived;
+};
+
+/**
+	@brief Pairs up waveforms from multiple instruments by trigger timestamp.
+
+	Every waveform popped from an instrument's driver queue is added to that instrument's queue here. A set is complete
+	once the oldest waveform of the primary (first) instrument has a waveform on every secondary within the skew window.
+	Waveforms which can never be matched (orphans) are deleted without disturbing the rest of the queues.
+ */
+class WaveformMatcher
+{
+public:
+	WaveformMatcher();
+	~WaveformMatcher();
+
+	void SetMaxSkew(int64_t fs)
+	{ m_maxSkew = fs; }
+
+	int64_t GetMaxSkew()
+	{ return m_maxSkew; }
+
+	void SetTimeout(double seconds)
+	{ m_timeout = seconds; }
+
+	void Add(Oscilloscope* scope, const std::map<StreamDescriptor, WaveformBase*>& data, double tTrigger);
+	bool Align(const std::vector<Oscilloscope*>& scopes);
+	bool Pop(const std::vector<Oscilloscope*>& scopes, WaveformSet& set, double& tTrigger);
+	size_t ExpireOrphans();
+	void Clear();
+
+	size_t GetQueuedCount();
+
+	///@brief Number of complete sets returned by Pop()
+	size_t GetMatchCount()
+	{ return m_matches; }
+
+	///@brief Number of single-instrument waveforms deleted because nothing else triggered close enough to them
+	size_t GetOrphanCount()
+	{ return m_orphans; }
+
+	///@brief Number of single-instrument waveforms deleted by Clear(), e.g. when the trigger was stopped
+	size_t GetDiscardCount()
+	{ return m_discards; }
+
+	void ResetCounters();
+
+	static int64_t GetSkew(const TimePoint& a, const TimePoint& b);
+
+protected:
+	void DeleteFront(Oscilloscope* scope, std::deque<PendingWaveform>& queue);
+
+	std::mutex m_mutex;
+
+	///@brief Waveforms waiting for a match, oldest first
+	std::map<Oscilloscope*, std::deque<PendingWaveform> > m_queues;
+
+	///@brief Max difference between instrument timestamps in one set, in femtoseconds
+	std::atomic<int64_t> m_maxSkew;
+
+	///@brief Max time a waveform can wait for the other instruments, in seconds
+	std::atomic<double> m_timeout;
+
+	std::atomic<size_t> m_matches;
+	std::atomic<size_t> m_orphans;
+	std::atomic<size_t> m_discards;
+};
+
+#endif
@@ -0,0 +1,153 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of WaveformPipeline
+ */
+#include "../scopehal/scopehal.h"
+#include "AcquisitionBudget.h"
+#include "LatencyTracker.h"
+#include "WaveformPipeline.h"
+#include "WaveformPool.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+WaveformPipeline::WaveformPipeline()
+	: m_depth(2)
+{
+}
+
+WaveformPipeline::~WaveformPipeline()
+{
+	Clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Queue management
+
+/**
+	@brief Checks if we've staged as many sets as we're allowed to
+ */
+bool WaveformPipeline::IsFull()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_staged.size() >= m_depth;
+}
+
+size_t WaveformPipeline::GetStagedCount()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_staged.size();
+}
+
+/**
+	@brief Adds a newly downloaded set to the end of the pipeline. The pipeline takes ownership of the waveforms.
+ */
+void WaveformPipeline::Push(const WaveformSet& set, double tTrigger)
+{
+	for(auto& it : set)
+		g_acquisitionBudget.GetState(it.first)->m_stagedBytes += GetSetMemoryUsage(it.second);
+
+	lock_guard<mutex> lock(m_mutex);
+	m_staged.push_back(StagedWaveformSet{set, tTrigger, GetTime()});
+}
+
+/**
+	@brief Removes the oldest staged set from the pipeline. The caller takes ownership of the waveforms.
+
+	@param set			The popped set
+	@param tTrigger		Time of the earliest trigger in the set, or negative if unknown
+
+	@return True if a set was removed, false if the pipeline was empty
+ */
+bool WaveformPipeline::Pop(WaveformSet& set, double& tTrigger)
+{
+	lock_guard<mutex> lock(m_mutex);
+	if(m_staged.empty())
+		return false;
+
+	auto& staged = m_staged.front();
+	set = staged.m_data;
+	tTrigger = staged.m_tTrigger;
+	g_latencyTracker.Record(LATENCY_STAGED, GetTime() - staged.m_tStaged);
+	m_staged.pop_front();
+
+	for(auto& it : set)
+		g_acquisitionBudget.GetState(it.first)->m_stagedBytes -= GetSetMemoryUsage(it.second);
+	g_acquisitionBudget.NotifySpaceAvailable();
+
+	return true;
+}
+
+/**
+	@brief Discards all staged sets, freeing their waveforms
+ */
+void WaveformPipeline::Clear()
+{
+	lock_guard<mutex> lock(m_mutex);
+	for(auto& staged : m_staged)
+	{
+		for(auto& it : staged.m_data)
+		{
+			g_acquisitionBudget.GetState(it.first)->m_stagedBytes -= GetSetMemoryUsage(it.second);
+			g_acquisitionBudget.OnWaveformsDiscarded(it.first, 1);
+		}
+		DeleteSet(staged.m_data);
+	}
+	m_staged.clear();
+}
+
+/**
+	@brief Gets the total size of one instrument's waveforms in a set
+ */
+size_t WaveformPipeline::GetSetMemoryUsage(const map<StreamDescriptor, WaveformBase*>& data)
+{
+	size_t bytes = 0;
+	for(auto& it : data)
+		bytes += GetWaveformMemoryUsage(it.second);
+	return bytes;
+}
+
+/**
+	@brief Recycles every waveform in a set that was never installed in a channel
+ */
+void WaveformPipeline::DeleteSet(WaveformSet& set)
+{
+	for(auto& it : set)
+	{
+		for(auto& jt : it.second)
+			g_waveformPool.Return(jt.second);
+	}
+	set.clear();
+}
@@ -0,0 +1,105 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of WaveformPipeline
+ */
+#ifndef WaveformPipeline_h
+#define WaveformPipeline_h
+
+#include <deque>
+#include <mutex>
+
+/**
+	@brief Waveform data from a single trigger event on every online instrument.
+
+	The waveforms have been pulled out of the driver's pending queue, but are not yet installed in any channel and are
+	owned by whoever holds the set.
+ */
+typedef std::map<Oscilloscope*, std::map<StreamDescriptor, WaveformBase*> > WaveformSet;
+
+/**
+	@brief A waveform set waiting in the pipeline, plus the timing info needed for latency tracking
+ */
+class StagedWaveformSet
+{
+public:
+	WaveformSet m_data;
+
+	///@brief Time of the earliest trigger in the set, or negative if unknown
+	double m_tTrigger;
+
+	///@brief Time the set was staged
+	double m_tStaged;
+};
+
+/**
+	@brief Bounded queue of waveform sets staged between download and the filter graph.
+
+	The waveform processing thread stages incoming sets here while the UI thread is still working on the previous
+	one, so the next set is ready to install the moment the live channel data is released.
+ */
+class WaveformPipeline
+{
+public:
+	WaveformPipeline();
+	~WaveformPipeline();
+
+	/**
+		@brief Sets the maximum number of waveform sets which may be staged at once
+	 */
+	void SetDepth(size_t depth)
+	{ m_depth = std::max(depth, (size_t)1); }
+
+	size_t GetDepth()
+	{ return m_depth; }
+
+	bool IsFull();
+	size_t GetStagedCount();
+
+	void Push(const WaveformSet& set, double tTrigger);
+	bool Pop(WaveformSet& set, double& tTrigger);
+	void Clear();
+
+	static void DeleteSet(WaveformSet& set);
+	static size_t GetSetMemoryUsage(const std::map<StreamDescriptor, WaveformBase*>& data);
+
+protected:
+	std::mutex m_mutex;
+
+	///@brief Staged sets, oldest first
+	std::deque<StagedWaveformSet> m_staged;
+
+	///@brief Max number of sets we can hold
+	std::atomic<size_t> m_depth;
+};
+
+#endif
@@ -0,0 +1,296 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of WaveformPool
+ */
+#include "../scopehal/scopehal.h"
+#include "WaveformPool.h"
+
+using namespace std;
+
+WaveformPool g_waveformPool;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+WaveformPool::WaveformPool()
+	: m_maxBytes(64 * 1024 * 1024)
+	, m_pooledBytes(0)
+	, m_pooledCount(0)
+	, m_hits(0)
+	, m_misses(0)
+{
+}
+
+WaveformPool::~WaveformPool()
+{
+	Clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Allocation
+
+/**
+	@brief Gets an empty analog waveform with room for at least the requested number of samples
+ */
+AnalogWaveform* WaveformPool::GetAnalog(size_t capacity)
+{
+	auto wfm = Take(POOL_ANALOG, capacity);
+	if(wfm)
+		return static_cast<AnalogWaveform*>(wfm);
+
+	auto ret = new AnalogWaveform;
+	ret->m_offsets.reserve(capacity);
+	ret->m_durations.reserve(capacity);
+	ret->m_samples.reserve(capacity);
+	return ret;
+}
+
+/**
+	@brief Gets an empty digital waveform with room for at least the requested number of samples
+ */
+DigitalWaveform* WaveformPool::GetDigital(size_t capacity)
+{
+	auto wfm = Take(POOL_DIGITAL, capacity);
+	if(wfm)
+		return static_cast<DigitalWaveform*>(wfm);
+
+	auto ret = new DigitalWaveform;
+	ret->m_offsets.reserve(capacity);
+	ret->m_durations.reserve(capacity);
+	ret->m_samples.reserve(capacity);
+	return ret;
+}
+
+/**
+	@brief Gets an empty waveform of the same type as an existing one, if the pool has one big enough
+
+	@return The pooled waveform, or NULL if the type isn't pooled or nothing big enough is available
+ */
+WaveformBase* WaveformPool::GetLike(WaveformBase* like, size_t capacity)
+{
+	auto type = GetType(like);
+	if(type == POOL_NONE)
+		return NULL;
+	return Take(type, capacity);
+}
+
+/**
+	@brief Removes a waveform with at least the requested capacity from the pool, and resets it to empty
+ */
+WaveformBase* WaveformPool::Take(PoolType type, size_t capacity)
+{
+	//Bin the request would be returned to
+	int bin = 0;
+	while( (static_cast<size_t>(2) << bin) <= capacity)
+		bin ++;
+
+	WaveformBase* wfm = NULL;
+	{
+		lock_guard<mutex> lock(m_mutex);
+
+		//Look for an exact fit in our own bin first (the common case: same record length as last time),
+		//then take anything from the next bin up, which is guaranteed to be big enough.
+		//Don't go any higher than that, bigger buffers are better saved for bigger requests.
+		for(int i=bin; (i<=bin+1) && !wfm; i++)
+		{
+			auto it = m_free.find(PoolKey(type, i));
+			if(it == m_free.end())
+				continue;
+
+			auto& entries = it->second;
+			for(size_t j=entries.size(); j>0; j--)
+			{
+				if(entries[j-1].first >= capacity)
+				{
+					wfm = entries[j-1].second;
+					entries.erase(entries.begin() + (j-1));
+					break;
+				}
+			}
+		}
+
+		if(wfm)
+		{
+			m_pooledBytes -= GetBytes(wfm);
+			m_pooledCount --;
+		}
+	}
+
+	if(!wfm)
+	{
+		m_misses ++;
+		return NULL;
+	}
+	m_hits ++;
+
+	//Clear out the old contents, but keep the buffers
+	wfm->m_timescale = 0;
+	wfm->m_startTimestamp = 0;
+	wfm->m_startFemtoseconds = 0;
+	wfm->m_triggerPhase = 0;
+	wfm->m_densePacked = false;
+	wfm->m_offsets.clear();
+	wfm->m_durations.clear();
+	if(type == POOL_ANALOG)
+		static_cast<AnalogWaveform*>(wfm)->m_samples.clear();
+	else
+		static_cast<DigitalWaveform*>(wfm)->m_samples.clear();
+
+	return wfm;
+}
+
+/**
+	@brief Hands a waveform we're done with back to the pool. The pool takes ownership.
+
+	Types which aren't pooled, and anything which would put the pool over its size limit, are simply freed.
+ */
+void WaveformPool::Return(WaveformBase* wfm)
+{
+	if(!wfm)
+		return;
+
+	auto type = GetType(wfm);
+	size_t capacity = GetCapacity(wfm);
+	size_t bytes = GetBytes(wfm);
+	if( (type == POOL_NONE) || (capacity == 0) || (m_pooledBytes + bytes > m_maxBytes) )
+	{
+		delete wfm;
+		return;
+	}
+
+	//Bin by the largest power of two the capacity is at least
+	int bin = 0;
+	while( (static_cast<size_t>(2) << bin) <= capacity)
+		bin ++;
+
+	lock_guard<mutex> lock(m_mutex);
+	m_free[PoolKey(type, bin)].push_back(PoolEntry(capacity, wfm));
+	m_pooledBytes += bytes;
+	m_pooledCount ++;
+}
+
+/**
+	@brief Frees everything in the pool
+ */
+void WaveformPool::Clear()
+{
+	lock_guard<mutex> lock(m_mutex);
+	for(auto& it : m_free)
+	{
+		for(auto& entry : it.second)
+			delete entry.second;
+	}
+	m_free.clear();
+	m_pooledBytes = 0;
+	m_pooledCount = 0;
+}
+
+/**
+	@brief Sets the max size of waveforms held in the pool. Anything returned past this is freed.
+
+	If the pool is already holding more than the new limit, it's emptied so lowering the limit (or setting it to zero)
+	gives the memory back right away.
+ */
+void WaveformPool::SetMaxBytes(size_t bytes)
+{
+	m_maxBytes = bytes;
+	if(m_pooledBytes > bytes)
+		Clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Statistics
+
+/**
+	@brief Gets the fraction of requests satisfied from the pool
+ */
+double WaveformPool::GetHitRate()
+{
+	size_t hits = m_hits;
+	size_t total = hits + m_misses;
+	if(total == 0)
+		return 0;
+	return hits * 1.0 / total;
+}
+
+void WaveformPool::ResetCounters()
+{
+	m_hits = 0;
+	m_misses = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers
+
+WaveformPool::PoolType WaveformPool::GetType(WaveformBase* wfm)
+{
+	if(dynamic_cast<AnalogWaveform*>(wfm) != NULL)
+		return POOL_ANALOG;
+	if(dynamic_cast<DigitalWaveform*>(wfm) != NULL)
+		return POOL_DIGITAL;
+	return POOL_NONE;
+}
+
+/**
+	@brief Gets the number of samples a waveform can hold without reallocating any of its buffers
+ */
+size_t WaveformPool::GetCapacity(WaveformBase* wfm)
+{
+	size_t capacity = min(wfm->m_offsets.capacity(), wfm->m_durations.capacity());
+
+	auto acap = dynamic_cast<AnalogWaveform*>(wfm);
+	if(acap)
+		capacity = min(capacity, acap->m_samples.capacity());
+	auto dcap = dynamic_cast<DigitalWaveform*>(wfm);
+	if(dcap)
+		capacity = min(capacity, dcap->m_samples.capacity());
+
+	return capacity;
+}
+
+/**
+	@brief Gets the size of a waveform's sample buffers
+ */
+size_t WaveformPool::GetBytes(WaveformBase* wfm)
+{
+	size_t bytes = sizeof(int64_t) * (wfm->m_offsets.capacity() + wfm->m_durations.capacity());
+
+	auto acap = dynamic_cast<AnalogWaveform*>(wfm);
+	if(acap)
+		bytes += sizeof(float) * acap->m_samples.capacity();
+	auto dcap = dynamic_cast<DigitalWaveform*>(wfm);
+	if(dcap)
+		bytes += sizeof(bool) * dcap->m_samples.capacity();
+
+	return bytes;
+}
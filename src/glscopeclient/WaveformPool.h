@@ -0,0 +1,124 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of WaveformPool
+ */
+#ifndef WaveformPool_h
+#define WaveformPool_h
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/**
+	@brief Recycles waveform objects, and their sample buffers, instead of freeing them.
+
+	Waveforms evicted from history (or otherwise thrown away) are returned here, binned by type and by the largest power
+	of two their sample capacity is at least. Anything that needs a new waveform of a given size can then take one that's
+	already big enough, skipping the allocation and the page faults of touching fresh memory.
+
+	Has no GUI dependencies, so it can be shared by the window, file loading, and headless mode.
+ */
+class WaveformPool
+{
+public:
+	WaveformPool();
+	~WaveformPool();
+
+	AnalogWaveform* GetAnalog(size_t capacity);
+	DigitalWaveform* GetDigital(size_t capacity);
+	WaveformBase* GetLike(WaveformBase* like, size_t capacity);
+	void Return(WaveformBase* wfm);
+	void Clear();
+
+	void SetMaxBytes(size_t bytes);
+
+	size_t GetMaxBytes()
+	{ return m_maxBytes; }
+
+	///@brief Number of requests satisfied from the pool
+	size_t GetHitCount()
+	{ return m_hits; }
+
+	///@brief Number of requests which had to allocate a new waveform
+	size_t GetMissCount()
+	{ return m_misses; }
+
+	double GetHitRate();
+
+	///@brief Total size of the waveforms currently held in the pool
+	size_t GetPooledBytes()
+	{ return m_pooledBytes; }
+
+	///@brief Number of waveforms currently held in the pool
+	size_t GetPooledCount()
+	{ return m_pooledCount; }
+
+	void ResetCounters();
+
+protected:
+	enum PoolType
+	{
+		POOL_ANALOG,
+		POOL_DIGITAL,
+		POOL_NONE
+	};
+
+	///@brief Waveform type, and log2 of the minimum sample capacity of every waveform in the bin
+	typedef std::pair<PoolType, int> PoolKey;
+
+	///@brief Sample capacity of a pooled waveform, and the waveform
+	typedef std::pair<size_t, WaveformBase*> PoolEntry;
+
+	WaveformBase* Take(PoolType type, size_t capacity);
+
+	static PoolType GetType(WaveformBase* wfm);
+	static size_t GetCapacity(WaveformBase* wfm);
+	static size_t GetBytes(WaveformBase* wfm);
+
+	std::mutex m_mutex;
+
+	///@brief Free waveforms, most recently returned last
+	std::map<PoolKey, std::vector<PoolEntry> > m_free;
+
+	std::atomic<size_t> m_maxBytes;
+	std::atomic<size_t> m_pooledBytes;
+	std::atomic<size_t> m_pooledCount;
+
+	std::atomic<size_t> m_hits;
+	std::atomic<size_t> m_misses;
+};
+
+extern WaveformPool g_waveformPool;
+
+#endif
@@ -37,34 +37,73 @@
 
 using namespace std;
 
+//Signaled whenever the waveform processing thread may have new work to do:
+//a ScopeThread pushed a new acquisition into its instrument's pending queue, or the UI released the last waveform
+Event g_waveformThreadWakeEvent;
+
 Event g_waveformReadyEvent;
 Event g_waveformProcessedEvent;
 
 void WaveformProcessingThread(OscilloscopeWindow* window)
 {
 	pthread_setname_np_compat("WaveformThread");
+
+	//True if the UI thread is still working on the last waveform set we gave it
+	bool uiBusy = false;
+
 	while(!window->m_shuttingDown)
 	{
-		//Wait for data to be available from all scopes
-		if(!window->CheckForPendingWaveforms())
+		//Waveforms which arrive after the trigger is stopped have to be thrown away, or they'd cause a spurious
+		//trigger later. Have the UI thread do it, since it also discards when stopping the trigger.
+		//Nothing else to do until we're re-armed (which wakes us up), shut down, or another waveform shows up.
+		if(!window->m_triggerArmed)
 		{
-			this_thread::sleep_for(chrono::milliseconds(50));
+			window->RequestDiscard();
+			g_waveformThreadWakeEvent.Block();
 			continue;
 		}
 
 		//If no waveform areas, nothing to do
 		if(window->m_waveformAreas.empty())
 		{
-			this_thread::sleep_for(chrono::milliseconds(50));
+			g_waveformThreadWakeEvent.Block(chrono::milliseconds(50));
 			continue;
 		}
 
-		//We've got data. Download it, then run the filter graph
-		window->DownloadWaveforms();
-		window->RefreshAllFilters();
+		//Pull sets out of the instrument queues as soon as every scope has a waveform from the same trigger.
+		//This keeps going while the UI is busy with the previous set, up to the pipeline depth.
+		while(!window->m_waveformPipeline.IsFull() && window->CheckForPendingWaveforms())
+			window->DownloadWaveforms();
+
+		//See if the UI is done with the live channel data yet
+		if(uiBusy && g_waveformProcessedEvent.Peek())
+			uiBusy = false;
+
+		//Install the next staged set and run the filter graph on it, then hand it off to the UI thread.
+		//Hold the data lock across both so a deferred display update never sees new inputs with stale filter outputs.
+		bool installed = false;
+		if(!uiBusy)
+		{
+			lock_guard<recursive_mutex> lock(window->m_waveformDataMutex);
+			installed = window->InstallStagedWaveforms();
+			if(installed)
+				window->RefreshAllFilters();
+		}
+		if(installed)
+		{
+			//Wake up the UI thread
+			uiBusy = true;
+			window->m_tWaveformReady = GetTime();
+			g_waveformReadyEvent.Signal();
+			window->m_waveformReadyDispatcher.emit();
+			continue;
+		}
 
-		//Unblock the UI threads, then wait for acknowledgement that it's processed
-		g_waveformReadyEvent.Signal();
-		g_waveformProcessedEvent.Block();
+		//Sleep until a scope thread reports new data or the UI releases the last set.
+		//If waveforms are waiting for a match, time out periodically so we notice multi-scope sync timeouts.
+		if(window->m_waveformMatcher.GetQueuedCount())
+			g_waveformThreadWakeEvent.Block(chrono::milliseconds(50));
+		else
+			g_waveformThreadWakeEvent.Block();
 	}
 }
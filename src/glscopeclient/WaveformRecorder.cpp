@@ -0,0 +1,429 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of WaveformRecorder
+ */
+#include "../scopehal/scopehal.h"
+#include "../scopehal/Filter.h"
+#include "WaveformSerializer.h"
+#include "WaveformPool.h"
+#include "WaveformRecorder.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+double GetTime();
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+WaveformRecorder::WaveformRecorder()
+	: m_nextID(1)
+	, m_stopping(false)
+	, m_recording(false)
+	, m_maxQueueBytes(1024LL * 1024LL * 1024LL)
+	, m_queuedBytes(0)
+	, m_writtenCount(0)
+	, m_droppedCount(0)
+	, m_writtenBytes(0)
+	, m_throughput(0)
+{
+}
+
+WaveformRecorder::~WaveformRecorder()
+{
+	Stop();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Control
+
+static void MakeDirectory(const string& path)
+{
+#ifdef _WIN32
+	mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+/**
+	@brief Starts a new recording
+
+	@param fileName		Path to the .scopesession file. Waveforms go in the _data directory next to it.
+	@param config		Serialized session configuration
+	@param scopes		Instruments to record, and their IDs in the session configuration
+	@param filters		Filters whose outputs should also be recorded, and their IDs in the session configuration
+
+	@return True on success, false if the session file or data directory couldn't be created
+ */
+bool WaveformRecorder::Start(
+	const string& fileName,
+	const string& config,
+	const map<Oscilloscope*, int>& scopes,
+	const map<Filter*, int>& filters)
+{
+	Stop();
+
+	static const char* extension = ".scopesession";
+	if(fileName.length() <= strlen(extension))
+		return false;
+	m_dataDirName = fileName.substr(0, fileName.length() - strlen(extension)) + "_data";
+
+	//Write the configuration up front, so the session can be opened even if we never get a clean stop
+	FILE* fp = fopen(fileName.c_str(), "w");
+	if(!fp)
+	{
+		LogError("Could not create %s\n", fileName.c_str());
+		return false;
+	}
+	bool ok = (config.length() == fwrite(config.c_str(), 1, config.length(), fp));
+	fclose(fp);
+	if(!ok)
+	{
+		LogError("Error writing to %s\n", fileName.c_str());
+		return false;
+	}
+
+	//Make the directory structure and open the metadata files
+	MakeDirectory(m_dataDirName);
+	m_scopes = scopes;
+	m_filters = filters;
+
+	vector<pair<string, int> > sources;
+	for(auto it : m_scopes)
+		sources.push_back(pair<string, int>("scope", it.second));
+	for(auto it : m_filters)
+		sources.push_back(pair<string, int>("filter", it.second));
+
+	for(auto& s : sources)
+	{
+		char tmp[512];
+		snprintf(tmp, sizeof(tmp), "%s/%s_%d_waveforms", m_dataDirName.c_str(), s.first.c_str(), s.second);
+		MakeDirectory(tmp);
+
+		snprintf(tmp, sizeof(tmp), "%s/%s_%d_metadata.yml", m_dataDirName.c_str(), s.first.c_str(), s.second);
+		fp = fopen(tmp, "w");
+		if(!fp)
+		{
+			LogError("Could not create %s\n", tmp);
+			for(auto jt : m_metadataFiles)
+				fclose(jt.second);
+			m_metadataFiles.clear();
+			m_scopes.clear();
+			m_filters.clear();
+			return false;
+		}
+		fprintf(fp, "waveforms:\n");
+		fflush(fp);
+		m_metadataFiles[s] = fp;
+	}
+
+	//Keep the filters around until we stop, even if the user closes every view of one in the meantime
+	for(auto it : m_filters)
+		it.first->AddRef();
+
+	m_nextID = 1;
+	m_writtenCount = 0;
+	m_droppedCount = 0;
+	m_writtenBytes = 0;
+	m_throughput = 0;
+	m_stopping = false;
+	m_recording = true;
+	m_thread = thread(&WaveformRecorder::WriterThread, this);
+	return true;
+}
+
+/**
+	@brief Stops recording once everything still in the queue has been written out
+ */
+void WaveformRecorder::Stop()
+{
+	if(!m_recording)
+		return;
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_cond.notify_one();
+	m_thread.join();
+
+	for(auto it : m_metadataFiles)
+		fclose(it.second);
+	m_metadataFiles.clear();
+	m_scopes.clear();
+	for(auto it : m_filters)
+		it.first->Release();
+	m_filters.clear();
+
+	m_recording = false;
+}
+
+/**
+	@brief Copies the current data from every recorded instrument and filter into the write queue.
+
+	Must be called with the waveform data lock held, after the filter graph has been run on the new data.
+	If the queue is already at its size limit, the acquisition is dropped instead.
+ */
+void WaveformRecorder::Record()
+{
+	if(!m_recording)
+		return;
+
+	RecordedWaveformSet set;
+	set.m_key = TimePoint(0, 0);
+	set.m_bytes = 0;
+
+	for(auto it : m_scopes)
+	{
+		auto scope = it.first;
+		if(scope->IsOffline())
+			continue;
+
+		auto& data = set.m_scopeData[scope];
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto chan = scope->GetChannel(i);
+			if(chan->IsEnabled())
+				CopyStreams(chan, data, set.m_bytes);
+		}
+
+		//Use the timestamp from the first enabled channel of the first instrument, same as history
+		if(!data.empty() && (set.m_key == TimePoint(0, 0)) )
+		{
+			auto wfm = data.begin()->second;
+			set.m_key = TimePoint(wfm->m_startTimestamp, wfm->m_startFemtoseconds);
+		}
+	}
+	for(auto it : m_filters)
+		CopyStreams(it.first, set.m_filterData[it.first], set.m_bytes);
+
+	if(set.m_bytes == 0)
+	{
+		DeleteSet(set);
+		return;
+	}
+
+	//Drop it if the disk isn't keeping up.
+	//Always allow one set through so a single huge acquisition doesn't block recording entirely.
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if(!m_queue.empty() && (m_queuedBytes + set.m_bytes > m_maxQueueBytes) )
+		{
+			m_droppedCount ++;
+			DeleteSet(set);
+			return;
+		}
+
+		set.m_id = m_nextID ++;
+		m_queuedBytes += set.m_bytes;
+		m_queue.push_back(set);
+	}
+	m_cond.notify_one();
+}
+
+/**
+	@brief Copies every stream of a channel which has data
+ */
+void WaveformRecorder::CopyStreams(OscilloscopeChannel* chan, map<StreamDescriptor, WaveformBase*>& data, size_t& bytes)
+{
+	for(size_t j=0; j<chan->GetStreamCount(); j++)
+	{
+		auto copy = CopyWaveform(chan->GetData(j));
+		if(!copy)
+			continue;
+
+		data[StreamDescriptor(chan, j)] = copy;
+
+		//Only count what will actually be written
+		size_t len = copy->m_offsets.size();
+		if(!copy->m_densePacked)
+			bytes += 2 * sizeof(int64_t) * len;
+		if(dynamic_cast<AnalogWaveform*>(copy))
+			bytes += sizeof(float) * len;
+		else
+			bytes += sizeof(bool) * len;
+	}
+}
+
+/**
+	@brief Makes a copy of a waveform, using a recycled buffer if one is available
+
+	@return The copy, or NULL if the waveform is NULL or a type that can't be saved
+ */
+WaveformBase* WaveformRecorder::CopyWaveform(WaveformBase* wfm)
+{
+	//TODO: support other waveform types (buses, eyes, etc) once the serializer does
+	auto awfm = dynamic_cast<AnalogWaveform*>(wfm);
+	auto dwfm = dynamic_cast<DigitalWaveform*>(wfm);
+	if(!awfm && !dwfm)
+		return NULL;
+
+	size_t len = wfm->m_offsets.size();
+	WaveformBase* copy;
+	if(awfm)
+		copy = g_waveformPool.GetAnalog(len);
+	else
+		copy = g_waveformPool.GetDigital(len);
+	copy->m_timescale = wfm->m_timescale;
+	copy->m_startTimestamp = wfm->m_startTimestamp;
+	copy->m_startFemtoseconds = wfm->m_startFemtoseconds;
+	copy->m_triggerPhase = wfm->m_triggerPhase;
+	copy->m_densePacked = wfm->m_densePacked;
+
+	//Vector assignment reuses the recycled capacity rather than reallocating
+	copy->m_offsets = wfm->m_offsets;
+	copy->m_durations = wfm->m_durations;
+	if(awfm)
+		dynamic_cast<AnalogWaveform*>(copy)->m_samples = awfm->m_samples;
+	else
+		dynamic_cast<DigitalWaveform*>(copy)->m_samples = dwfm->m_samples;
+
+	return copy;
+}
+
+void WaveformRecorder::DeleteSet(RecordedWaveformSet& set)
+{
+	for(auto& it : set.m_scopeData)
+	{
+		for(auto jt : it.second)
+			g_waveformPool.Return(jt.second);
+	}
+	for(auto& it : set.m_filterData)
+	{
+		for(auto jt : it.second)
+			g_waveformPool.Return(jt.second);
+	}
+	set.m_scopeData.clear();
+	set.m_filterData.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Writing
+
+void WaveformRecorder::WriterThread()
+{
+	pthread_setname_np_compat("WaveformRecord");
+
+	double tWindowStart = GetTime();
+	size_t windowBytes = 0;
+
+	while(true)
+	{
+		RecordedWaveformSet set;
+		set.m_bytes = 0;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_cond.wait_for(lock, chrono::milliseconds(250), [&]{ return m_stopping || !m_queue.empty(); });
+
+			if(m_queue.empty())
+			{
+				if(m_stopping)
+					break;
+			}
+			else
+			{
+				set = m_queue.front();
+				m_queue.pop_front();
+			}
+		}
+
+		if(set.m_bytes)
+		{
+			Write(set);
+			DeleteSet(set);
+
+			m_queuedBytes -= set.m_bytes;
+			m_writtenBytes += set.m_bytes;
+			m_writtenCount ++;
+			windowBytes += set.m_bytes;
+		}
+
+		//Update throughput about once a second (decays to zero if nothing is coming in)
+		double now = GetTime();
+		double dt = now - tWindowStart;
+		if(dt >= 1)
+		{
+			m_throughput = windowBytes / dt;
+			tWindowStart = now;
+			windowBytes = 0;
+		}
+	}
+}
+
+/**
+	@brief Writes one acquisition to disk
+ */
+void WaveformRecorder::Write(RecordedWaveformSet& set)
+{
+	for(auto& it : set.m_scopeData)
+		WriteSource("scope", m_scopes[it.first], set.m_id, set.m_key, it.second);
+	for(auto& it : set.m_filterData)
+		WriteSource("filter", m_filters[it.first], set.m_id, set.m_key, it.second);
+}
+
+/**
+	@brief Writes the sample data from one instrument or filter, then appends its metadata.
+
+	Metadata goes last so a recording that's cut short never refers to sample data that isn't there.
+ */
+void WaveformRecorder::WriteSource(
+	const string& prefix,
+	int sourceID,
+	int id,
+	TimePoint key,
+	const map<StreamDescriptor, WaveformBase*>& data)
+{
+	if(data.empty())
+		return;
+
+	char tmp[512];
+	snprintf(tmp, sizeof(tmp), "%s/%s_%d_waveforms/waveform_%d", m_dataDirName.c_str(), prefix.c_str(), sourceID, id);
+	MakeDirectory(tmp);
+	string wname = tmp;
+
+	for(auto it : data)
+	{
+		float progress = 0;
+		int done = 0;
+		WaveformSerializer::SaveStream(wname, it.first, it.second, &progress, &done);
+	}
+
+	auto fp = m_metadataFiles[pair<string, int>(prefix, sourceID)];
+	string metadata = WaveformSerializer::SerializeWaveformMetadata(id, key, false, "", data);
+	fwrite(metadata.c_str(), 1, metadata.length(), fp);
+	fflush(fp);
+}
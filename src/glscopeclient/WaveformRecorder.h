@@ -0,0 +1,172 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of WaveformRecorder
+ */
+#ifndef WaveformRecorder_h
+#define WaveformRecorder_h
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+	@brief One acquisition copied out of the live channels, waiting to be written to disk
+ */
+class RecordedWaveformSet
+{
+public:
+	///@brief ID of the waveform within the recording
+	int m_id;
+
+	///@brief Timestamp of the acquisition
+	TimePoint m_key;
+
+	///@brief Copies of the instrument channel data
+	std::map<Oscilloscope*, std::map<StreamDescriptor, WaveformBase*> > m_scopeData;
+
+	///@brief Copies of the filter output data
+	std::map<Filter*, std::map<StreamDescriptor, WaveformBase*> > m_filterData;
+
+	///@brief Total size of the sample data
+	size_t m_bytes;
+};
+
+/**
+	@brief Streams every acquired waveform to a session data directory as it comes in.
+
+	The UI thread copies each acquisition into a bounded write-behind queue, and a background thread writes it out in
+	the same format as File | Save Layout and Waveforms, so the recording can be opened like any other session.
+	If the disk can't keep up and the queue is full, new waveforms are dropped (and counted) rather than stalling
+	acquisition.
+
+	Has no GUI dependencies, so it can be shared by the window and headless mode.
+ */
+class WaveformRecorder
+{
+public:
+	WaveformRecorder();
+	~WaveformRecorder();
+
+	bool Start(
+		const std::string& fileName,
+		const std::string& config,
+		const std::map<Oscilloscope*, int>& scopes,
+		const std::map<Filter*, int>& filters);
+	void Record();
+	void Stop();
+
+	bool IsRecording()
+	{ return m_recording; }
+
+	/**
+		@brief Gets the filters whose outputs are being recorded, and their IDs in the session file
+
+		The recorder holds a reference to each of them until recording stops.
+	 */
+	const std::map<Filter*, int>& GetFilters()
+	{ return m_filters; }
+
+	///@brief Gets the name of the data directory being recorded to
+	std::string GetDataDirName()
+	{ return m_dataDirName; }
+
+	///@brief Sets the max size of waveforms copied but not yet written to disk
+	void SetMaxQueueBytes(size_t bytes)
+	{ m_maxQueueBytes = bytes; }
+
+	///@brief Number of waveforms written to disk
+	size_t GetWrittenCount()
+	{ return m_writtenCount; }
+
+	///@brief Number of waveforms dropped because the write queue was full
+	size_t GetDroppedCount()
+	{ return m_droppedCount; }
+
+	///@brief Total size of the sample data written to disk
+	size_t GetWrittenBytes()
+	{ return m_writtenBytes; }
+
+	///@brief Size of the sample data waiting to be written
+	size_t GetQueuedBytes()
+	{ return m_queuedBytes; }
+
+	///@brief Write throughput over the last second or so, in bytes per second
+	double GetThroughput()
+	{ return m_throughput; }
+
+	static WaveformBase* CopyWaveform(WaveformBase* wfm);
+
+protected:
+	void WriterThread();
+	void Write(RecordedWaveformSet& set);
+	void WriteSource(
+		const std::string& prefix,
+		int sourceID,
+		int id,
+		TimePoint key,
+		const std::map<StreamDescriptor, WaveformBase*>& data);
+	void CopyStreams(OscilloscopeChannel* chan, std::map<StreamDescriptor, WaveformBase*>& data, size_t& bytes);
+	static void DeleteSet(RecordedWaveformSet& set);
+
+	std::string m_dataDirName;
+
+	///@brief IDs of the instruments and filters being recorded, matching the session file
+	std::map<Oscilloscope*, int> m_scopes;
+	std::map<Filter*, int> m_filters;
+
+	///@brief Metadata file for each instrument or filter, by file name prefix and ID
+	std::map<std::pair<std::string, int>, FILE*> m_metadataFiles;
+
+	///@brief ID of the next waveform to be recorded
+	int m_nextID;
+
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::deque<RecordedWaveformSet> m_queue;
+	bool m_stopping;
+
+	std::atomic<bool> m_recording;
+	std::atomic<size_t> m_maxQueueBytes;
+	std::atomic<size_t> m_queuedBytes;
+	std::atomic<size_t> m_writtenCount;
+	std::atomic<size_t> m_droppedCount;
+	std::atomic<size_t> m_writtenBytes;
+	std::atomic<double> m_throughput;
+};
+
+#endif
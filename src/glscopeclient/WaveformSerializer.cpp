@@ -0,0 +1,697 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Implementation of WaveformSerializer
+ */
+#include "../scopehal/scopehal.h"
+#include "DensePack.h"
+#include "WaveformSerializer.h"
+#include "WaveformPool.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Saving
+
+/**
+	@brief Generates the metadata block for one waveform in a scope_N_metadata.yml file
+
+	@param id		Waveform ID, which is also the number of the directory the sample data is stored in
+	@param key		Timestamp of the waveform
+	@param pinned	True if the waveform is pinned in history
+	@param label	User-specified label for the waveform
+	@param data		Waveform data for each stream of the instrument
+ */
+string WaveformSerializer::SerializeWaveformMetadata(
+	int id,
+	TimePoint key,
+	bool pinned,
+	const string& label,
+	const map<StreamDescriptor, WaveformBase*>& data)
+{
+	char tmp[512];
+	string config;
+
+	snprintf(tmp, sizeof(tmp), "    wfm%d:\n", id);
+	config += tmp;
+	snprintf(tmp, sizeof(tmp), "        timestamp: %ld\n", key.first);
+	config += tmp;
+	snprintf(tmp, sizeof(tmp), "        time_fsec: %ld\n", key.second);
+	config += tmp;
+	snprintf(tmp, sizeof(tmp), "        id:        %d\n", id);
+	config += tmp;
+	if(pinned)
+		config += "        pinned:    1\n";
+	else
+		config += "        pinned:    0\n";
+	string elabel = str_replace("\"", "\\\"", label);
+	snprintf(tmp, sizeof(tmp), "        label:     \"%s\"\n", elabel.c_str());
+	config += tmp;
+	config += "        channels:\n";
+
+	for(auto jt : data)
+	{
+		auto wave = jt.second;
+		if(wave == NULL)
+			continue;
+
+		int index = jt.first.m_channel->GetIndex();
+		size_t nstream = jt.first.m_stream;
+
+		snprintf(tmp, sizeof(tmp), "            ch%ds%zu:\n", index, nstream);
+		config += tmp;
+		snprintf(tmp, sizeof(tmp), "                format:       %s\n", GetStreamFormat(wave).c_str());
+		config += tmp;
+		snprintf(tmp, sizeof(tmp), "                index:        %d\n", index);
+		config += tmp;
+		snprintf(tmp, sizeof(tmp), "                stream:       %zu\n", nstream);
+		config += tmp;
+		snprintf(tmp, sizeof(tmp), "                timescale:    %ld\n", wave->m_timescale);
+		config += tmp;
+		snprintf(tmp, sizeof(tmp), "                trigphase:    %zd\n", wave->m_triggerPhase);
+		config += tmp;
+	}
+
+	return config;
+}
+
+/**
+	@brief Gets the name of the file one stream's sample data is stored in
+
+	@param dir		Directory for the waveform
+	@param index	Channel index
+	@param stream	Stream index within the channel
+ */
+string WaveformSerializer::GetStreamFileName(const string& dir, int index, size_t stream)
+{
+	//First stream has no suffix for compat
+	char tmp[512];
+	if(stream == 0)
+		snprintf(tmp, sizeof(tmp), "%s/channel_%d.bin", dir.c_str(), index);
+	else
+		snprintf(tmp, sizeof(tmp), "%s/channel_%d_stream%zu.bin", dir.c_str(), index, stream);
+	return tmp;
+}
+
+/**
+	@brief Gets the name of the format SaveStream() will store a waveform in
+ */
+string WaveformSerializer::GetStreamFormat(WaveformBase* wave)
+{
+	if(wave->m_densePacked)
+		return "densev1";
+	else
+		return "sparsev1";
+}
+
+/**
+	@brief Saves waveform sample data in whichever format fits it best
+
+	@return True on success, false if the file couldn't be written
+ */
+bool WaveformSerializer::SaveStream(
+	string wname,
+	StreamDescriptor stream,
+	WaveformBase* wave,
+	volatile float* progress,
+	volatile int* done
+	)
+{
+	if((wave == NULL) || wave->m_densePacked)
+		return SaveDenseStream(wname, stream, wave, progress, done);
+	else
+		return SaveSparseStream(wname, stream, wave, progress, done);
+}
+
+/**
+	@brief Saves waveform sample data in the "sparsev1" file format.
+
+	Interleaved (slow):
+		int64 offset
+		int64 len
+		for analog
+			float voltage
+		for digital
+			bool voltage
+ */
+bool WaveformSerializer::SaveSparseStream(
+	std::string wname,
+	StreamDescriptor stream,
+	WaveformBase* wave,
+	volatile float* progress,
+	volatile int* done
+	)
+{
+	auto chan = stream.m_channel;
+	int index = chan->GetIndex();
+	size_t nstream = stream.m_stream;
+	if(wave == NULL)		//trigger, disabled, etc
+	{
+		*done = 1;
+		*progress = 1;
+		return true;
+	}
+
+	string fname = GetStreamFileName(wname, index, nstream);
+	FILE* fp = fopen(fname.c_str(), "wb");
+	if(!fp)
+	{
+		LogError("couldn't create %s\n", fname.c_str());
+		*done = 1;
+		*progress = 1;
+		return false;
+	}
+	bool ok = true;
+
+	auto achan = dynamic_cast<AnalogWaveform*>(wave);
+	auto dchan = dynamic_cast<DigitalWaveform*>(wave);
+	size_t len = wave->m_offsets.size();
+
+	//Analog channels
+	const size_t samples_per_block = 10000;
+	if(achan)
+	{
+		#pragma pack(push, 1)
+		class asample_t
+		{
+		public:
+			int64_t off;
+			int64_t dur;
+			float voltage;
+
+			asample_t(int64_t o=0, int64_t d=0, float v=0)
+			: off(o), dur(d), voltage(v)
+			{}
+		};
+		#pragma pack(pop)
+
+		//Copy sample data
+		vector<asample_t,	AlignedAllocator<asample_t, 64 > > samples;
+		samples.reserve(len);
+		for(size_t i=0; i<len; i++)
+			samples.push_back(asample_t(wave->m_offsets[i], wave->m_durations[i], achan->m_samples[i]));
+
+		//Write it
+		for(size_t i=0; i<len; i+= samples_per_block)
+		{
+			*progress = i * 1.0 / len;
+			size_t blocklen = min(len-i, samples_per_block);
+
+			if(blocklen != fwrite(&samples[i], sizeof(asample_t), blocklen, fp))
+			{
+				LogError("file write error\n");
+				ok = false;
+				break;
+			}
+		}
+	}
+	else if(dchan)
+	{
+		#pragma pack(push, 1)
+		class dsample_t
+		{
+		public:
+			int64_t off;
+			int64_t dur;
+			bool voltage;
+
+			dsample_t(int64_t o=0, int64_t d=0, bool v=0)
+			: off(o), dur(d), voltage(v)
+			{}
+		};
+		#pragma pack(pop)
+
+		//Copy sample data
+		vector<dsample_t,	AlignedAllocator<dsample_t, 64 > > samples;
+		samples.reserve(len);
+		for(size_t i=0; i<len; i++)
+			samples.push_back(dsample_t(wave->m_offsets[i], wave->m_durations[i], dchan->m_samples[i]));
+
+		//Write it
+		for(size_t i=0; i<len; i+= samples_per_block)
+		{
+			*progress = i * 1.0 / len;
+			size_t blocklen = min(len-i, samples_per_block);
+
+			if(blocklen != fwrite(&samples[i], sizeof(dsample_t), blocklen, fp))
+			{
+				LogError("file write error\n");
+				ok = false;
+				break;
+			}
+		}
+	}
+	else
+	{
+		//TODO: support other waveform types (buses, eyes, etc)
+		LogError("unrecognized sample type\n");
+		ok = false;
+	}
+
+	if(0 != fclose(fp))
+		ok = false;
+
+	*done = 1;
+	*progress = 1;
+	return ok;
+}
+
+/**
+	@brief Saves waveform sample data in the "densev1" file format.
+
+	for analog
+		float[] voltage
+	for digital
+		bool[] voltage
+
+	Durations are implied {1....1} and offsets are implied {0...n-1}.
+ */
+bool WaveformSerializer::SaveDenseStream(
+	std::string wname,
+	StreamDescriptor stream,
+	WaveformBase* wave,
+	volatile float* progress,
+	volatile int* done
+	)
+{
+	auto chan = stream.m_channel;
+	int index = chan->GetIndex();
+	size_t nstream = stream.m_stream;
+	if(wave == NULL)		//trigger, disabled, etc
+	{
+		*done = 1;
+		*progress = 1;
+		return true;
+	}
+
+	string fname = GetStreamFileName(wname, index, nstream);
+	FILE* fp = fopen(fname.c_str(), "wb");
+	if(!fp)
+	{
+		LogError("couldn't create %s\n", fname.c_str());
+		*done = 1;
+		*progress = 1;
+		return false;
+	}
+	bool ok = true;
+
+	auto achan = dynamic_cast<AnalogWaveform*>(wave);
+	auto dchan = dynamic_cast<DigitalWaveform*>(wave);
+	size_t len = wave->m_offsets.size();
+
+	//Analog channels
+	const size_t samples_per_block = 10000;
+	if(achan)
+	{
+		//Write it
+		for(size_t i=0; i<len; i+= samples_per_block)
+		{
+			*progress = i * 1.0 / len;
+			size_t blocklen = min(len-i, samples_per_block);
+
+			if(blocklen != fwrite(&achan->m_samples[i], sizeof(float), blocklen, fp))
+			{
+				LogError("file write error\n");
+				ok = false;
+				break;
+			}
+		}
+	}
+	else if(dchan)
+	{
+		//Write it
+		for(size_t i=0; i<len; i+= samples_per_block)
+		{
+			*progress = i * 1.0 / len;
+			size_t blocklen = min(len-i, samples_per_block);
+
+			if(blocklen != fwrite(&dchan->m_samples[i], sizeof(bool), blocklen, fp))
+			{
+				LogError("file write error\n");
+				ok = false;
+				break;
+			}
+		}
+	}
+	else
+	{
+		//TODO: support other waveform types (buses, eyes, etc)
+		LogError("unrecognized sample type\n");
+		ok = false;
+	}
+
+	if(0 != fclose(fp))
+		ok = false;
+
+	*done = 1;
+	*progress = 1;
+	return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Loading
+
+/**
+	@brief Parses the metadata for one waveform in a scope_N_metadata.yml file.
+
+	Creates an empty waveform with the saved timebase for each saved stream and installs it in the channel, ready for
+	LoadStream() to fill in the sample data.
+
+	@param wfm			Metadata node for the waveform
+	@param scope		Instrument the waveform belongs to
+	@param time			Timestamp of the waveform
+	@param pinned		True if the waveform was pinned in history
+	@param label		User-specified label for the waveform
+	@param channels		The (channel, stream) index of each saved stream
+	@param formats		Storage format of each saved stream
+
+	@return The waveform ID
+ */
+int WaveformSerializer::LoadWaveformMetadata(
+	const YAML::Node& wfm,
+	Oscilloscope* scope,
+	TimePoint& time,
+	bool& pinned,
+	string& label,
+	vector<pair<int, int> >& channels,
+	vector<string>& formats)
+{
+	//Top level metadata
+	bool timebase_is_ps = true;
+	time.first = wfm["timestamp"].as<long long>();
+	if(wfm["time_psec"])
+	{
+		time.second = wfm["time_psec"].as<long long>() * 1000;
+		timebase_is_ps = true;
+	}
+	else
+	{
+		time.second = wfm["time_fsec"].as<long long>();
+		timebase_is_ps = false;
+	}
+	int waveform_id = wfm["id"].as<int>();
+	pinned = false;
+	if(wfm["pinned"])
+		pinned = wfm["pinned"].as<int>();
+	label = "";
+	if(wfm["label"])
+		label = wfm["label"].as<string>();
+
+	//Set up channel metadata first (serialized)
+	auto chans = wfm["channels"];
+	for(auto jt : chans)
+	{
+		auto ch = jt.second;
+		int channel_index = ch["index"].as<int>();
+		int stream = 0;
+		if(ch["stream"])
+			stream = ch["stream"].as<int>();
+		auto chan = scope->GetChannel(channel_index);
+		channels.push_back(pair<int, int>(channel_index, stream));
+
+		//Waveform format defaults to sparsev1 as that's what was used before
+		//the metadata file contained a format ID at all
+		string format = "sparsev1";
+		if(ch["format"])
+			format = ch["format"].as<string>();
+		formats.push_back(format);
+
+		//TODO: support non-analog/digital captures (eyes, spectrograms, etc)
+		WaveformBase* cap = NULL;
+		if(chan->GetType() == OscilloscopeChannel::CHANNEL_TYPE_ANALOG)
+			cap = new AnalogWaveform;
+		else
+			cap = new DigitalWaveform;
+
+		//Channel waveform metadata
+		cap->m_timescale = ch["timescale"].as<long>();
+		cap->m_startTimestamp = time.first;
+		cap->m_startFemtoseconds = time.second;
+		if(timebase_is_ps)
+		{
+			cap->m_timescale *= 1000;
+			cap->m_triggerPhase = ch["trigphase"].as<float>() * 1000;
+		}
+		else
+			cap->m_triggerPhase = ch["trigphase"].as<long long>();
+
+		chan->Detach(stream);
+		chan->SetData(cap, stream);
+	}
+
+	return waveform_id;
+}
+
+/**
+	@brief Loads sample data for one stream of a saved waveform, in either the "sparsev1" or "densev1" format.
+
+	The waveform object must already have been created by LoadWaveformMetadata().
+ */
+void WaveformSerializer::LoadStream(
+	int channel_index,
+	int stream,
+	Oscilloscope* scope,
+	string datadir,
+	int scope_id,
+	int waveform_id,
+	string format,
+	volatile float* progress,
+	volatile int* done
+	)
+{
+	auto chan = scope->GetChannel(channel_index);
+	auto cap = chan->GetData(stream);
+
+	char tmp[512];
+	snprintf(tmp, sizeof(tmp), "%s/scope_%d_waveforms/waveform_%d", datadir.c_str(), scope_id, waveform_id);
+	string fname = GetStreamFileName(tmp, channel_index, stream);
+
+	//Swap the empty waveform for the loaded one
+	auto loaded = LoadStreamFile(fname, format, cap, progress);
+	if(loaded)
+	{
+		chan->Detach(stream);
+		chan->SetData(loaded, stream);
+		delete cap;
+	}
+
+	*done = 1;
+	*progress = 1;
+}
+
+/**
+	@brief Loads sample data from one file in either the "sparsev1" or "densev1" format.
+
+	The samples are loaded into a waveform from the pool, which already has room for them, rather than a new one.
+
+	@param fname	Path to the sample data
+	@param format	Storage format of the file
+	@param like		Empty waveform of the same type, whose timebase and timestamp are copied to the loaded waveform
+	@param progress	Progress of the load
+
+	@return The loaded waveform, or NULL on failure
+ */
+WaveformBase* WaveformSerializer::LoadStreamFile(
+	const string& fname,
+	const string& format,
+	WaveformBase* like,
+	volatile float* progress)
+{
+	if( (format != "sparsev1") && (format != "densev1") )
+	{
+		LogError(
+			"Unknown waveform format \"%s\", perhaps this file was created by a newer version of glscopeclient?\n",
+			format.c_str());
+		return NULL;
+	}
+
+	bool analog = (dynamic_cast<AnalogWaveform*>(like) != NULL);
+	if(!analog && !dynamic_cast<DigitalWaveform*>(like))
+		return NULL;
+
+	//Load samples into memory
+	unsigned char* buf = NULL;
+
+	//Windows: use generic file reads for now
+	#ifdef _WIN32
+		FILE* fp = fopen(fname.c_str(), "rb");
+		if(!fp)
+		{
+			LogError("couldn't open %s\n", fname.c_str());
+			return NULL;
+		}
+
+		//Read the whole file into a buffer a megabyte at a time
+		fseek(fp, 0, SEEK_END);
+		long len = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+		buf = new unsigned char[len];
+		long len_remaining = len;
+		long blocksize = 1024*1024;
+		long read_offset = 0;
+		while(len_remaining > 0)
+		{
+			if(blocksize > len_remaining)
+				blocksize = len_remaining;
+
+			//Most time is spent on the fread's when using this path
+			*progress = read_offset * 1.0 / len;
+			fread(buf + read_offset, 1, blocksize, fp);
+
+			len_remaining -= blocksize;
+			read_offset += blocksize;
+		}
+		fclose(fp);
+
+	//On POSIX, just memory map the file
+	#else
+		int fd = open(fname.c_str(), O_RDONLY);
+		if(fd < 0)
+		{
+			LogError("couldn't open %s\n", fname.c_str());
+			return NULL;
+		}
+		size_t len = lseek(fd, 0, SEEK_END);
+		if(len > 0)
+		{
+			buf = (unsigned char*)mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(buf == MAP_FAILED)
+			{
+				LogError("couldn't map %s\n", fname.c_str());
+				::close(fd);
+				return NULL;
+			}
+
+			//We're going to read the whole thing front to back
+			madvise(buf, len, MADV_SEQUENTIAL);
+		}
+
+		//For now, report progress complete upon the file being fully read
+		*progress = 1;
+	#endif
+
+	//Figure out how many samples we have
+	size_t samplesize;
+	if(format == "sparsev1")
+		samplesize = 2*sizeof(int64_t);
+	else
+		samplesize = 0;
+	if(analog)
+		samplesize += sizeof(float);
+	else
+		samplesize += sizeof(bool);
+	size_t nsamples = len / samplesize;
+
+	WaveformBase* cap;
+	if(analog)
+		cap = g_waveformPool.GetAnalog(nsamples);
+	else
+		cap = g_waveformPool.GetDigital(nsamples);
+	cap->m_timescale = like->m_timescale;
+	cap->m_startTimestamp = like->m_startTimestamp;
+	cap->m_startFemtoseconds = like->m_startFemtoseconds;
+	cap->m_triggerPhase = like->m_triggerPhase;
+	cap->Resize(nsamples);
+	auto acap = dynamic_cast<AnalogWaveform*>(cap);
+	auto dcap = dynamic_cast<DigitalWaveform*>(cap);
+
+	//Sparse interleaved
+	if(format == "sparsev1")
+	{
+		//TODO: AVX this?
+		for(size_t j=0; j<nsamples; j++)
+		{
+			size_t offset = j*samplesize;
+
+			//Read start time and duration
+			int64_t* stime = reinterpret_cast<int64_t*>(buf+offset);
+			offset += 2*sizeof(int64_t);
+			cap->m_offsets[j] = stime[0];
+			cap->m_durations[j] = stime[1];
+
+			//Read sample data
+			if(acap)
+			{
+				//The file format assumes "float" is IEEE754 32-bit float.
+				//If your platform doesn't do that, good luck.
+				//cppcheck-suppress invalidPointerCast
+				acap->m_samples[j] = *reinterpret_cast<float*>(buf+offset);
+			}
+
+			else
+				dcap->m_samples[j] = *reinterpret_cast<bool*>(buf+offset);
+
+			//TODO: progress updates
+		}
+
+		//Check if the waveform is dense packed, even if it was stored as sparse
+		DetectDensePacked(cap);
+	}
+
+	//Dense packed
+	else
+	{
+		cap->m_densePacked = true;
+
+		//Read sample data
+		if(nsamples > 0)
+		{
+			if(acap)
+				memcpy(&acap->m_samples[0], buf, nsamples*sizeof(float));
+			else
+				memcpy(&dcap->m_samples[0], buf, nsamples*sizeof(bool));
+		}
+
+		//TODO: vectorized initialization of timestamps and durations
+		for(size_t i=0; i<nsamples; i++)
+		{
+			cap->m_offsets[i] = i;
+			cap->m_durations[i] = 1;
+		}
+	}
+
+	#ifdef _WIN32
+		delete[] buf;
+	#else
+		if(buf)
+			munmap(buf, len);
+		::close(fd);
+	#endif
+
+	return cap;
+}
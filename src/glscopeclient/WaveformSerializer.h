@@ -0,0 +1,110 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief  Declaration of WaveformSerializer
+ */
+#ifndef WaveformSerializer_h
+#define WaveformSerializer_h
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+	@brief Reads and writes waveform data in the .scopesession data directory format.
+
+	Has no GUI dependencies, so it can be shared by the history window, file loading, and headless mode.
+ */
+class WaveformSerializer
+{
+public:
+	static std::string SerializeWaveformMetadata(
+		int id,
+		TimePoint key,
+		bool pinned,
+		const std::string& label,
+		const std::map<StreamDescriptor, WaveformBase*>& data);
+
+	static std::string GetStreamFileName(const std::string& dir, int index, size_t stream);
+	static std::string GetStreamFormat(WaveformBase* wave);
+
+	static bool SaveStream(
+		std::string wname,
+		StreamDescriptor stream,
+		WaveformBase* wave,
+		volatile float* progress,
+		volatile int* done
+		);
+	static bool SaveSparseStream(
+		std::string wname,
+		StreamDescriptor stream,
+		WaveformBase* wave,
+		volatile float* progress,
+		volatile int* done
+		);
+	static bool SaveDenseStream(
+		std::string wname,
+		StreamDescriptor stream,
+		WaveformBase* wave,
+		volatile float* progress,
+		volatile int* done
+		);
+
+	static int LoadWaveformMetadata(
+		const YAML::Node& wfm,
+		Oscilloscope* scope,
+		TimePoint& time,
+		bool& pinned,
+		std::string& label,
+		std::vector<std::pair<int, int> >& channels,
+		std::vector<std::string>& formats);
+
+	static void LoadStream(
+		int channel_index,
+		int stream,
+		Oscilloscope* scope,
+		std::string datadir,
+		int scope_id,
+		int waveform_id,
+		std::string format,
+		volatile float* progress,
+		volatile int* done
+		);
+
+	static WaveformBase* LoadStreamFile(
+		const std::string& fname,
+		const std::string& format,
+		WaveformBase* like,
+		volatile float* progress);
+};
+
+#endif
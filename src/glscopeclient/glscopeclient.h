@@ -80,6 +80,12 @@
 
 #include "PreferenceTypes.h"
 
+#include "AcquisitionBudget.h"
+#include "FilterRegistry.h"
+#include "LatencyTracker.h"
+#include "ThreadBudget.h"
+#include "WaveformPool.h"
+
 #include "OscilloscopeWindow.h"
 #include "ScopeApp.h"
 
@@ -88,6 +94,7 @@ extern bool g_noglint64;
 
 void WaveformProcessingThread(OscilloscopeWindow* window);
 
+extern Event g_waveformThreadWakeEvent;
 extern Event g_waveformReadyEvent;
 extern Event g_waveformProcessedEvent;
 
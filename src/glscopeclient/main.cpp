@@ -53,6 +53,7 @@
 #endif
 
 #include "PreferenceManager.h"
+#include "HeadlessSession.h"
 using namespace std;
 
 //for color selection
@@ -75,6 +76,8 @@ void help()
 			"\n"
 			"  [general options]:\n"
 			"    --help      : this message...\n"
+			"    --headless  : run the filter graph of a .scopesession without opening any windows, and write the\n"
+			"                  resulting waveforms, packets, and statistics to the output directory\n"
 			"    --nodata    : when loading a .scopesession from the command line, only load instrument/UI settings\n"
 			"                  (default is to load waveform data too)\n"
 			"    --reconnect : when loading a .scopesession from the command line, reconnect to the instrument\n"
@@ -83,6 +86,11 @@ void help()
 			"                  (default is to be paused)\n"
 			"    --version   : print version number. (not yet implemented)\n"
 			"\n"
+			"  [headless options]:\n"
+			"    --count <n>                   : number of waveforms to acquire or replay\n"
+			"                                    (default is one live waveform, or every saved waveform)\n"
+			"    --output <dir>                : directory to write results to (default is \"headless_output\")\n"
+			"\n"
 			"  [logger options]:\n"
 			"    levels: ERROR, WARNING, NOTICE, VERBOSE, DEBUG\n"
 			"    --quiet|-q                    : reduce logging level by one step\n"
@@ -110,6 +118,7 @@ void help()
 			"    glscopeclient --debug myscope:siglent:lxi:192.166.1.123\n"
 			"    glscopeclient --debug --trace SCPITMCTransport myscope:siglent:usbtmc:/dev/usbtmc0\n"
 			"    glscopeclient --reconnect --retrigger foobar.scopesession\n"
+			"    glscopeclient --headless --count 100 --output results foobar.scopesession\n"
 			"\n"
 	);
 }
@@ -118,6 +127,8 @@ void help()
 void Relaunch(int argc, char* argv[]);
 #endif
 
+int RunHeadless(const vector<string>& filesToLoad, bool reconnect, bool nodata, size_t count, const string& outdir);
+
 int main(int argc, char* argv[])
 {
 	//Global settings
@@ -131,6 +142,9 @@ int main(int argc, char* argv[])
 	bool retrigger = false;
 	bool noavx2 = false;
 	bool noavx512f = false;
+	bool headless = false;
+	size_t count = 0;
+	string outdir = "headless_output";
 	for(int i=1; i<argc; i++)
 	{
 		string s(argv[i]);
@@ -156,6 +170,28 @@ int main(int argc, char* argv[])
 			nodata = true;
 		else if(s == "--retrigger")
 			retrigger = true;
+		else if(s == "--headless")
+			headless = true;
+		else if(s == "--count")
+		{
+			if(i+1 < argc)
+				count = strtoul(argv[++i], NULL, 10);
+			else
+			{
+				fprintf(stderr, "--count requires an argument\n");
+				return 1;
+			}
+		}
+		else if(s == "--output")
+		{
+			if(i+1 < argc)
+				outdir = argv[++i];
+			else
+			{
+				fprintf(stderr, "--output requires an argument\n");
+				return 1;
+			}
+		}
 		else if(s == "--noglint64")
 			g_noglint64 = true;
 		else if(s == "--noopencl")
@@ -239,7 +275,9 @@ int main(int argc, char* argv[])
 		}
 	#endif
 
-	g_app = new ScopeApp;
+	//Headless mode only needs scopehal, not GTK
+	if(!headless)
+		g_app = new ScopeApp;
 
 	//Initialize object creation tables for predefined libraries
 	TransportStaticInit();
@@ -262,6 +300,9 @@ int main(int argc, char* argv[])
 	//Initialize object creation tables for plugins
 	InitializePlugins();
 
+	if(headless)
+		return RunHeadless(filesToLoad, reconnect, nodata, count, outdir);
+
 	//Connect to the scope(s)
 	g_app->run(
 		g_app->ConnectToScopes(scopes),
@@ -277,6 +318,31 @@ int main(int argc, char* argv[])
 	return 0;
 }
 
+/**
+	@brief Runs a single .scopesession in headless mode
+ */
+int RunHeadless(const vector<string>& filesToLoad, bool reconnect, bool nodata, size_t count, const string& outdir)
+{
+	if( (filesToLoad.size() != 1) || (filesToLoad[0].find(".scopesession") == string::npos) )
+	{
+		LogError("--headless requires exactly one .scopesession file\n");
+		return 1;
+	}
+
+	//Same numeric locale handling as the GUI, so files are written with '.' as the decimal separator
+	Unit::SetLocale(setlocale(LC_NUMERIC, NULL));
+	setlocale(LC_NUMERIC, "C");
+
+	bool ok;
+	{
+		HeadlessSession session;
+		ok = session.Load(filesToLoad[0], reconnect, !nodata) && session.Run(count, outdir);
+	}
+
+	ScopehalStaticCleanup();
+	return ok ? 0 : 1;
+}
+
 #ifndef _WIN32
 void Relaunch(int argc, char* argv[])
 {
@@ -316,50 +382,38 @@ void ScopeThread(Oscilloscope* scope)
 
 	auto sscope = dynamic_cast<SCPIOscilloscope*>(scope);
 
-	//Assume hyperthreading is enabled and only use one thread per physical core
-	omp_set_num_threads(omp_get_num_procs() / 2);
+	auto qstate = g_acquisitionBudget.GetState(scope);
 
 	double tlast = GetTime();
 	size_t npolls = 0;
 	double dt = 0;
 	while(!g_app->IsTerminating())
 	{
+		//Stay on the acquisition cores, and size OpenMP teams in the driver to match.
+		//Checked every time around so preference changes take effect without restarting the thread.
+		g_threadBudget.BindThread(ThreadBudget::ROLE_ACQUISITION);
+
 		//Push any pending queued commands
 		if(sscope)
 			sscope->GetTransport()->FlushCommandQueue();
 
-		//If the queue is too big, stop grabbing data
+		//If the queue is over its memory budget, stop grabbing data until the UI catches up.
+		//Always allow one waveform in flight, even if it alone is bigger than the budget.
 		size_t npending = scope->GetPendingWaveformCount();
-		if(npending > 20)
+		qstate->m_driverQueueBytes = npending * qstate->m_bytesPerWaveform;
+		if( (npending > 0) && g_acquisitionBudget.IsOverBudget(scope) )
 		{
-			LogTrace("Queue is too big, sleeping\n");
-			std::this_thread::sleep_for(std::chrono::milliseconds(50));
-			tlast = GetTime();
+			LogTrace("Queue is over memory budget, sleeping\n");
 
-			/*
-			if(!sscope)
-				continue;
-			auto dtransport = dynamic_cast<SCPITwinLanTransport*>(sscope->GetTransport());
-			if(!dtransport)
-				continue;
-			int hsock = dtransport->GetSecondarySocket();
-			int bytesReady = 0;
-			if(ioctl(hsock, FIONREAD, &bytesReady) >= 0)
-				LogDebug("socket has %d bytes ready\n", bytesReady);
-			*/
-
-			continue;
-		}
-
-		//If the queue is more than 5 sec long, wait for a while before polling any more.
-		//We've gotten ahead of the UI!
-		if(npending > 1 && npending*dt > 5)
-		{
-			LogTrace("Capture thread got 5 sec ahead of UI, sleeping\n");
-			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			qstate->m_blocked = true;
+			double tstart = GetTime();
+			g_acquisitionBudget.WaitForSpace();
 			tlast = GetTime();
+			qstate->m_blockedMicroseconds += static_cast<int64_t>((tlast - tstart) * 1e6);
+
 			continue;
 		}
+		qstate->m_blocked = false;
 
 		//If trigger isn't armed, don't even bother polling for a while.
 		if(!scope->IsTriggerArmed())
@@ -370,7 +424,10 @@ void ScopeThread(Oscilloscope* scope)
 			continue;
 		}
 
+		double tpoll = GetTime();
 		auto stat = scope->PollTrigger();
+		double ttrigger = GetTime();
+		g_latencyTracker.Record(LATENCY_POLL_TRIGGER, ttrigger - tpoll);
 
 		if(stat == Oscilloscope::TRIGGER_MODE_TRIGGERED)
 		{
@@ -380,9 +437,15 @@ void ScopeThread(Oscilloscope* scope)
 				tlast = GetTime();
 				continue;
 			}
+			double now = GetTime();
+			g_latencyTracker.OnAcquisition(scope, ttrigger, now);
+
+			//Update the memory usage estimate for queued waveforms, then wake up the waveform processing thread
+			qstate->m_bytesPerWaveform = EstimateWaveformMemoryUsage(scope);
+			qstate->m_driverQueueBytes = scope->GetPendingWaveformCount() * qstate->m_bytesPerWaveform;
+			g_waveformThreadWakeEvent.Signal();
 
 			//Measure how long the acquisition took
-			double now = GetTime();
 			dt = now - tlast;
 			tlast = now;
 			//LogDebug("Triggered, dt = %.3f ms (npolls = %zu)\n",
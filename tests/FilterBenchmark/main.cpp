@@ -0,0 +1,391 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Filter graph throughput benchmark
+
+	Loads the instruments and filter graph from a .scopesession, feeds every scope channel the graph uses with synthetic
+	data, and times a fixed number of full refreshes. Results are written as JSON so they can be compared between runs.
+ */
+
+#include "../../lib/scopehal/scopehal.h"
+#include "../../lib/scopehal/Filter.h"
+#include "../../lib/scopeprotocols/scopeprotocols.h"
+#include "../../lib/scopehal/TestWaveformSource.h"
+#include "../../src/glscopeclient/FilterGraphExecutor.h"
+#include "../../src/glscopeclient/SessionLoader.h"
+#include <chrono>
+#include <cinttypes>
+#include <random>
+
+using namespace std;
+
+void help();
+string EscapeJSON(const string& str);
+WaveformBase* GenerateInput(OscilloscopeChannel* chan, TestWaveformSource& source, size_t depth, int64_t period);
+size_t GetInputSamples(Filter* f);
+
+void help()
+{
+	fprintf(stderr,
+			"FilterBenchmark [general options] [logger options] session.scopesession\n"
+			"\n"
+			"  [general options]:\n"
+			"    --help             : this message...\n"
+			"    --depth N          : number of samples in each synthetic input waveform (default 1000000)\n"
+			"    --iterations N     : number of timed refreshes (default 20)\n"
+			"    --warmup N         : number of untimed refreshes to run first (default 2)\n"
+			"    --period FS        : sample period of the synthetic input waveforms, in fs (default 20000)\n"
+			"    --threads N        : number of filter graph worker threads (default: executor default)\n"
+			"    --output FILE      : write results to FILE instead of stdout\n"
+			"\n"
+			"  [logger options]:\n"
+			"    levels: ERROR, WARNING, NOTICE, VERBOSE, DEBUG\n"
+			"    --quiet|-q                    : reduce logging level by one step\n"
+			"    --verbose                     : set logging level to VERBOSE\n"
+			"    --debug                       : set logging level to DEBUG\n"
+			"\n"
+			"  Every scope channel feeding the filter graph is bound to a noisy sine wave (analog channels) or thresholded\n"
+			"  PRBS31 (digital channels) of the requested depth. Throughput of each filter is the number of samples on its\n"
+			"  inputs divided by its mean run time.\n"
+	);
+}
+
+int main(int argc, char* argv[])
+{
+	//Results go to stdout by default, so keep the console quiet unless asked otherwise
+	Severity console_verbosity = Severity::WARNING;
+
+	string sessionFile;
+	string outputFile;
+	size_t depth = 1000000;
+	size_t iterations = 20;
+	size_t warmup = 2;
+	int64_t period = 20000;
+	size_t threads = 0;
+	for(int i=1; i<argc; i++)
+	{
+		string s(argv[i]);
+
+		//Let the logger eat its args first
+		if(ParseLoggerArguments(i, argc, argv, console_verbosity))
+			continue;
+
+		if(s == "--help")
+		{
+			help();
+			return 0;
+		}
+		else if( (s == "--depth") && (i+1 < argc) )
+			depth = strtoull(argv[++i], NULL, 10);
+		else if( (s == "--iterations") && (i+1 < argc) )
+			iterations = strtoull(argv[++i], NULL, 10);
+		else if( (s == "--warmup") && (i+1 < argc) )
+			warmup = strtoull(argv[++i], NULL, 10);
+		else if( (s == "--period") && (i+1 < argc) )
+			period = strtoll(argv[++i], NULL, 10);
+		else if( (s == "--threads") && (i+1 < argc) )
+			threads = strtoull(argv[++i], NULL, 10);
+		else if( (s == "--output") && (i+1 < argc) )
+			outputFile = argv[++i];
+		else if(s[0] == '-')
+		{
+			fprintf(stderr, "Unrecognized command-line argument \"%s\", use --help\n", s.c_str());
+			return 1;
+		}
+		else
+			sessionFile = s;
+	}
+
+	if(sessionFile.empty() || (depth == 0) || (iterations == 0) || (period <= 0) )
+	{
+		help();
+		return 1;
+	}
+
+	g_log_sinks.emplace(g_log_sinks.begin(), new ColoredSTDLogSink(console_verbosity));
+
+	//Global scopehal initialization
+	TransportStaticInit();
+	DriverStaticInit();
+	InitializePlugins();
+	ScopeProtocolStaticInit();
+
+	//Load the session the same way the GUI does, but never touch real hardware
+	IDTable table;
+	vector<Oscilloscope*> scopes;
+	vector<Filter*> filters;
+	try
+	{
+		auto docs = YAML::LoadAllFromFile(sessionFile);
+		auto node = docs[0];
+
+		vector<string> errors;
+		scopes = SessionLoader::LoadInstruments(node["instruments"], false, table, errors);
+		filters = SessionLoader::LoadDecodes(node["decodes"], table, errors);
+		for(auto& e : errors)
+			LogError("%s\n", e.c_str());
+	}
+	catch(const YAML::Exception& ex)
+	{
+		LogError("Unable to load session file %s: %s\n", sessionFile.c_str(), ex.what());
+		return 1;
+	}
+
+	if(filters.empty())
+	{
+		LogError("Session %s did not contain any filters\n", sessionFile.c_str());
+		return 1;
+	}
+
+	for(auto f : filters)
+		f->AddRef();
+
+	//Bind every scope channel the graph reads from to synthetic data
+	minstd_rand rng;
+	rng.seed(0);
+	TestWaveformSource source(rng);
+	set<OscilloscopeChannel*> inputs;
+	for(auto f : filters)
+	{
+		for(size_t i=0; i<f->GetInputCount(); i++)
+		{
+			auto chan = f->GetInput(i).m_channel;
+			if( (chan == NULL) || (dynamic_cast<Filter*>(chan) != NULL) )
+				continue;
+			inputs.emplace(chan);
+		}
+	}
+
+	size_t inputSamples = 0;
+	for(auto chan : inputs)
+	{
+		auto wfm = GenerateInput(chan, source, depth, period);
+		if(wfm == NULL)
+		{
+			LogWarning("Don't know how to generate data for channel %s, leaving it empty\n",
+				chan->GetDisplayName().c_str());
+			continue;
+		}
+		chan->SetData(wfm, 0);
+		inputSamples += wfm->m_offsets.size();
+	}
+	LogNotice("Loaded %zu filters, %zu input channels, %zu samples per input\n",
+		filters.size(), inputs.size(), depth);
+
+	//Run the graph
+	FilterGraphExecutor executor;
+	if(threads != 0)
+		executor.SetThreadCount(threads);
+	set<Filter*> graph(filters.begin(), filters.end());
+
+	for(size_t i=0; i<warmup; i++)
+	{
+		executor.MarkAllDirty();
+		executor.RunBlocking(graph);
+	}
+	executor.ResetProfiles();
+
+	LatencyHistogram refreshTimes;
+	double tTotal = 0;
+	for(size_t i=0; i<iterations; i++)
+	{
+		executor.MarkAllDirty();
+
+		auto start = chrono::steady_clock::now();
+		executor.RunBlocking(graph);
+		double dt = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		refreshTimes.Record(dt);
+		tTotal += dt;
+	}
+
+	//Write the results
+	FILE* fp = stdout;
+	if(!outputFile.empty())
+	{
+		fp = fopen(outputFile.c_str(), "w");
+		if(!fp)
+		{
+			LogError("Unable to open output file %s\n", outputFile.c_str());
+			return 1;
+		}
+	}
+
+	size_t graphSamples = 0;
+	fprintf(fp, "{\n");
+	fprintf(fp, "\t\"session\": \"%s\",\n", EscapeJSON(sessionFile).c_str());
+	fprintf(fp, "\t\"depth\": %zu,\n", depth);
+	fprintf(fp, "\t\"sample_period_fs\": %" PRId64 ",\n", period);
+	fprintf(fp, "\t\"iterations\": %zu,\n", iterations);
+	fprintf(fp, "\t\"threads\": %zu,\n", executor.GetThreadCount());
+	fprintf(fp, "\t\"filters\": [\n");
+	for(size_t i=0; i<filters.size(); i++)
+	{
+		auto f = filters[i];
+		auto profile = executor.GetProfile(f);
+
+		//Filters with no waveform inputs (signal generators etc) are rated by how much they produce instead
+		size_t samples = GetInputSamples(f);
+		if(samples == 0)
+			samples = profile->m_outputSamples;
+		graphSamples += samples;
+
+		double mean = profile->m_times.GetMean();
+		double rate = (mean > 0) ? (samples / mean) : 0;
+
+		fprintf(fp, "\t\t{\n");
+		fprintf(fp, "\t\t\t\"name\": \"%s\",\n", EscapeJSON(f->GetDisplayName()).c_str());
+		fprintf(fp, "\t\t\t\"protocol\": \"%s\",\n", EscapeJSON(f->GetProtocolDisplayName()).c_str());
+		fprintf(fp, "\t\t\t\"evaluations\": %" PRIu64 ",\n", profile->m_times.GetCount());
+		fprintf(fp, "\t\t\t\"mean_us\": %.3f,\n", mean * 1e6);
+		fprintf(fp, "\t\t\t\"p50_us\": %.3f,\n", profile->m_times.GetPercentile(50) * 1e6);
+		fprintf(fp, "\t\t\t\"p99_us\": %.3f,\n", profile->m_times.GetPercentile(99) * 1e6);
+		fprintf(fp, "\t\t\t\"max_us\": %.3f,\n", profile->m_times.GetMax() * 1e6);
+		fprintf(fp, "\t\t\t\"samples\": %zu,\n", samples);
+		fprintf(fp, "\t\t\t\"output_samples\": %zu,\n", (size_t)profile->m_outputSamples);
+		fprintf(fp, "\t\t\t\"samples_per_second\": %.1f\n", rate);
+		fprintf(fp, "\t\t}%s\n", (i+1 < filters.size()) ? "," : "");
+	}
+	fprintf(fp, "\t],\n");
+
+	double mean = tTotal / iterations;
+	fprintf(fp, "\t\"total\": {\n");
+	fprintf(fp, "\t\t\"time_s\": %.6f,\n", tTotal);
+	fprintf(fp, "\t\t\"mean_refresh_us\": %.3f,\n", mean * 1e6);
+	fprintf(fp, "\t\t\"p99_refresh_us\": %.3f,\n", refreshTimes.GetPercentile(99) * 1e6);
+	fprintf(fp, "\t\t\"refreshes_per_second\": %.3f,\n", 1 / mean);
+	fprintf(fp, "\t\t\"input_samples\": %zu,\n", inputSamples);
+	fprintf(fp, "\t\t\"samples_per_second\": %.1f,\n", inputSamples / mean);
+	fprintf(fp, "\t\t\"graph_samples\": %zu,\n", graphSamples);
+	fprintf(fp, "\t\t\"graph_samples_per_second\": %.1f\n", graphSamples / mean);
+	fprintf(fp, "\t}\n");
+	fprintf(fp, "}\n");
+
+	if(fp != stdout)
+		fclose(fp);
+
+	//Clean up
+	for(auto f : filters)
+		f->Release();
+	for(auto scope : scopes)
+		delete scope;
+
+	return 0;
+}
+
+/**
+	@brief Creates a synthetic waveform suitable for the given channel, or NULL if we can't
+ */
+WaveformBase* GenerateInput(OscilloscopeChannel* chan, TestWaveformSource& source, size_t depth, int64_t period)
+{
+	switch(chan->GetType())
+	{
+		//1 GHz-ish sine, with a different phase on each channel so they aren't all identical
+		case OscilloscopeChannel::CHANNEL_TYPE_ANALOG:
+			{
+				float phase = (chan->GetIndex() % 8) * M_PI / 4;
+				return source.GenerateNoisySinewave(0.5, phase, 1e6 + chan->GetIndex() * 1e4, period, depth, 0.01);
+			}
+
+		//Threshold a PRBS at zero, 10 samples per bit
+		case OscilloscopeChannel::CHANNEL_TYPE_DIGITAL:
+			{
+				auto analog = dynamic_cast<AnalogWaveform*>(
+					source.GeneratePRBS31(0.5, period * 10, period, depth, false, 0));
+				if(analog == NULL)
+					return NULL;
+
+				auto cap = new DigitalWaveform;
+				cap->m_timescale = analog->m_timescale;
+				cap->m_triggerPhase = analog->m_triggerPhase;
+				cap->m_startTimestamp = analog->m_startTimestamp;
+				cap->m_startFemtoseconds = analog->m_startFemtoseconds;
+				size_t len = analog->m_samples.size();
+				cap->m_offsets.reserve(len);
+				cap->m_durations.reserve(len);
+				cap->m_samples.reserve(len);
+				for(size_t i=0; i<len; i++)
+				{
+					cap->m_offsets.push_back(analog->m_offsets[i]);
+					cap->m_durations.push_back(analog->m_durations[i]);
+					cap->m_samples.push_back(analog->m_samples[i] > 0);
+				}
+				delete analog;
+				return cap;
+			}
+
+		default:
+			return NULL;
+	}
+}
+
+/**
+	@brief Total number of samples on a filter's inputs
+ */
+size_t GetInputSamples(Filter* f)
+{
+	size_t samples = 0;
+	for(size_t i=0; i<f->GetInputCount(); i++)
+	{
+		auto data = f->GetInput(i).GetData();
+		if(data)
+			samples += data->m_offsets.size();
+	}
+	return samples;
+}
+
+/**
+	@brief Escapes a string for use in a JSON string literal
+ */
+string EscapeJSON(const string& str)
+{
+	string ret;
+	for(auto c : str)
+	{
+		if( (c == '"') || (c == '\\') )
+		{
+			ret += '\\';
+			ret += c;
+		}
+		else if(c == '\n')
+			ret += "\\n";
+		else if( (unsigned char)c < 0x20)
+		{
+			char tmp[8];
+			snprintf(tmp, sizeof(tmp), "\\u%04x", c);
+			ret += tmp;
+		}
+		else
+			ret += c;
+	}
+	return ret;
+}
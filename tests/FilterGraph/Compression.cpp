@@ -0,0 +1,154 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test for lossless history compression
+ */
+#include <catch2/catch.hpp>
+
+#include "FilterGraph.h"
+#include "../../src/glscopeclient/HistoryCompressor.h"
+#include "../../src/glscopeclient/WaveformPool.h"
+#include <cstring>
+
+using namespace std;
+
+static bool SameSample(float a, float b)
+{
+	//Compare bit patterns, so NaNs and negative zero count too
+	return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static bool SameSample(bool a, bool b)
+{
+	return a == b;
+}
+
+/**
+	@brief Compresses and decompresses a waveform, and checks we got back exactly what we started with
+ */
+template<class T>
+static void VerifyRoundTrip(T* wfm)
+{
+	unique_ptr<CompressedWaveform> c(CompressedWaveform::Compress(wfm));
+	REQUIRE(c != NULL);
+
+	auto out = dynamic_cast<T*>(c->Decompress());
+	REQUIRE(out != NULL);
+
+	REQUIRE(out->m_timescale == wfm->m_timescale);
+	REQUIRE(out->m_startTimestamp == wfm->m_startTimestamp);
+	REQUIRE(out->m_startFemtoseconds == wfm->m_startFemtoseconds);
+	REQUIRE(out->m_triggerPhase == wfm->m_triggerPhase);
+	REQUIRE(out->m_densePacked == wfm->m_densePacked);
+	REQUIRE(out->m_samples.size() == wfm->m_samples.size());
+	for(size_t i=0; i<wfm->m_samples.size(); i++)
+	{
+		REQUIRE(out->m_offsets[i] == wfm->m_offsets[i]);
+		REQUIRE(out->m_durations[i] == wfm->m_durations[i]);
+		REQUIRE(SameSample(out->m_samples[i], wfm->m_samples[i]));
+	}
+
+	g_waveformPool.Return(out);
+}
+
+TEST_CASE("CompressedWaveform")
+{
+	const size_t depth = 100000;
+
+	SECTION("ADC codes")
+	{
+		//8-bit ADC with a noisy sine
+		AnalogWaveform wfm;
+		wfm.m_timescale = 1000;
+		wfm.m_startTimestamp = 1234;
+		wfm.m_startFemtoseconds = 5678;
+		wfm.m_triggerPhase = 42;
+		wfm.m_densePacked = true;
+		wfm.Resize(depth);
+		for(size_t i=0; i<depth; i++)
+		{
+			int code = 128 + 100*sin(i * 0.001) + (g_rng() % 5) - 2;
+			wfm.m_offsets[i] = i;
+			wfm.m_durations[i] = 1;
+			wfm.m_samples[i] = code * 0.0123f - 1.5f;
+		}
+		VerifyRoundTrip(&wfm);
+
+		//Should be at least 8x smaller than raw, since dense timing takes no space at all
+		unique_ptr<CompressedWaveform> c(CompressedWaveform::Compress(&wfm));
+		REQUIRE(c->GetCompressedSize() * 8 < c->GetRawSize());
+	}
+
+	SECTION("Arbitrary floats")
+	{
+		AnalogWaveform wfm;
+		wfm.m_timescale = 1;
+		wfm.Resize(depth);
+		for(size_t i=0; i<depth; i++)
+		{
+			wfm.m_offsets[i] = i*3 + (g_rng() % 2);
+			wfm.m_durations[i] = 3;
+			wfm.m_samples[i] = static_cast<float>(g_rng()) / g_rng.max() - 0.5f;
+		}
+		wfm.m_samples[10] = NAN;
+		wfm.m_samples[11] = INFINITY;
+		wfm.m_samples[12] = -0.0f;
+		VerifyRoundTrip(&wfm);
+	}
+
+	SECTION("Digital")
+	{
+		DigitalWaveform wfm;
+		wfm.m_timescale = 1;
+		wfm.Resize(depth);
+		for(size_t i=0; i<depth; i++)
+		{
+			wfm.m_offsets[i] = i * 10;
+			wfm.m_durations[i] = 10;
+			wfm.m_samples[i] = (g_rng() & 1);
+		}
+		VerifyRoundTrip(&wfm);
+	}
+
+	SECTION("Empty and single sample")
+	{
+		AnalogWaveform empty;
+		VerifyRoundTrip(&empty);
+
+		AnalogWaveform one;
+		one.Resize(1);
+		one.m_offsets[0] = 100;
+		one.m_durations[0] = 7;
+		one.m_samples[0] = 3.3f;
+		VerifyRoundTrip(&one);
+	}
+}
@@ -0,0 +1,160 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test for dense pack detection
+ */
+#include <catch2/catch.hpp>
+
+#include "FilterGraph.h"
+#include "../../src/glscopeclient/DensePack.h"
+#include "../../src/glscopeclient/FilterGraphExecutor.h"
+
+using namespace std;
+
+static void FillDense(WaveformBase* wfm, size_t len)
+{
+	wfm->Resize(len);
+	for(size_t i=0; i<len; i++)
+	{
+		wfm->m_offsets[i] = i;
+		wfm->m_durations[i] = 1;
+	}
+}
+
+/**
+	@brief Checks the SIMD and generic paths agree on a waveform
+ */
+static bool CheckBothPaths(WaveformBase* wfm)
+{
+	bool avx2 = g_hasAvx2;
+
+	g_hasAvx2 = false;
+	bool generic = IsDensePackable(wfm);
+	g_hasAvx2 = avx2;
+	bool ret = IsDensePackable(wfm);
+
+	REQUIRE(ret == generic);
+	return ret;
+}
+
+TEST_CASE("DensePack")
+{
+	AnalogWaveform wfm;
+	wfm.m_timescale = 1;
+
+	SECTION("Empty waveforms aren't dense")
+	{
+		REQUIRE(!CheckBothPaths(&wfm));
+		REQUIRE(!DetectDensePacked(&wfm));
+	}
+
+	SECTION("Dense waveforms of any length are detected")
+	{
+		//Lengths around the SIMD width and block size
+		for(size_t len : {1, 3, 4, 5, 1023, 1024, 1025, 4099, 100000})
+		{
+			FillDense(&wfm, len);
+			wfm.m_densePacked = false;
+			REQUIRE(CheckBothPaths(&wfm));
+			REQUIRE(DetectDensePacked(&wfm));
+			REQUIRE(wfm.m_densePacked);
+
+			//Already flagged, nothing to do
+			REQUIRE(!DetectDensePacked(&wfm));
+		}
+	}
+
+	SECTION("A single gap anywhere is caught")
+	{
+		const size_t len = 4099;
+		for(int trial=0; trial<200; trial++)
+		{
+			FillDense(&wfm, len);
+			wfm.m_densePacked = false;
+
+			//Offsets or durations, anywhere but the ends (which are checked separately)
+			size_t i = 1 + g_rng() % (len - 2);
+			if(g_rng() % 2)
+				wfm.m_offsets[i] ++;
+			else
+				wfm.m_durations[i] = 2;
+
+			REQUIRE(!CheckBothPaths(&wfm));
+			REQUIRE(!DetectDensePacked(&wfm));
+			REQUIRE(!wfm.m_densePacked);
+		}
+	}
+
+	SECTION("Sparse waveforms are rejected")
+	{
+		const size_t len = 1000;
+		wfm.Resize(len);
+		for(size_t i=0; i<len; i++)
+		{
+			wfm.m_offsets[i] = i*2;
+			wfm.m_durations[i] = 2;
+		}
+		REQUIRE(!CheckBothPaths(&wfm));
+	}
+}
+
+TEST_CASE("DensePack_FilterOutput")
+{
+	auto chan = StreamDescriptor(g_scope.GetChannel(0), 0);
+
+	TestGraph graph;
+	auto f = graph.Subtract(chan, chan);
+	auto filters = graph.GetFilters();
+
+	//Dense input the driver didn't flag
+	const size_t len = 10000;
+	auto wfm = MakeRamp(len);
+	wfm->m_densePacked = false;
+	g_scope.GetChannel(0)->SetData(wfm, 0);
+
+	FilterGraphExecutor executor;
+	executor.RunBlocking(filters);
+	auto out = f->GetData(0);
+	REQUIRE(out != NULL);
+	REQUIRE(out->m_densePacked);
+
+	//Going sparse must not leave the flag behind, even if the filter reuses its output buffer
+	for(size_t i=0; i<len; i++)
+	{
+		wfm->m_offsets[i] = i*2;
+		wfm->m_durations[i] = 2;
+	}
+	executor.MarkDirty(f);
+	executor.RunBlocking(filters);
+	out = f->GetData(0);
+	REQUIRE(out != NULL);
+	REQUIRE(!out->m_densePacked);
+}
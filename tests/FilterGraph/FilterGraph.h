@@ -0,0 +1,63 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+#ifndef FilterGraph_h
+#define FilterGraph_h
+
+#include "../../lib/scopehal/scopehal.h"
+#include "../../lib/scopehal/Filter.h"
+#include "../../lib/scopeprotocols/scopeprotocols.h"
+#include "MockOscilloscope.h"
+#include <random>
+
+extern MockOscilloscope g_scope;
+extern std::minstd_rand g_rng;
+
+AnalogWaveform* MakeRamp(size_t len, int64_t femtoseconds = 0, time_t timestamp = 0);
+
+/**
+	@brief Filters created by a test, released when the test ends (even if it fails)
+ */
+class TestGraph
+{
+public:
+	~TestGraph();
+
+	Filter* Create(const std::string& protocol);
+	Filter* Subtract(StreamDescriptor a, StreamDescriptor b);
+
+	///@brief Every filter created so far
+	const std::set<Filter*>& GetFilters()
+	{ return m_filters; }
+
+protected:
+	std::vector<Filter*> m_nodes;
+	std::set<Filter*> m_filters;
+};
+
+#endif
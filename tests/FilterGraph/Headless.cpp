@@ -0,0 +1,212 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test for HeadlessSession, replaying a saved session through the filter graph
+ */
+#include <catch2/catch.hpp>
+
+#include "FilterGraph.h"
+#include "../../src/glscopeclient/FileSystem.h"
+#include "../../src/glscopeclient/FilterRegistry.h"
+#include "../../src/glscopeclient/HeadlessSession.h"
+#include "../../src/glscopeclient/WaveformSerializer.h"
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static void MakeDirectory(const string& path)
+{
+#ifdef _WIN32
+	mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+static bool WriteFile(const string& fname, const string& contents)
+{
+	FILE* fp = fopen(fname.c_str(), "w");
+	if(!fp)
+		return false;
+	bool ok = (contents.length() == fwrite(contents.c_str(), 1, contents.length(), fp));
+	fclose(fp);
+	return ok;
+}
+
+static vector<string> ReadLines(const string& fname)
+{
+	vector<string> lines;
+	ifstream in(fname);
+	string line;
+	while(getline(in, line))
+		lines.push_back(line);
+	return lines;
+}
+
+/**
+	@brief Writes a session with one mock instrument, a Subtract filter on it, and a few saved waveforms
+
+	Laid out the same way File | Save and HeadlessSession write it: foo.scopesession plus foo_data/.
+ */
+static void WriteSession(const string& fname, size_t count, size_t depth)
+{
+	MockOscilloscope scope("Headless Scope", "Antikernel Labs", "67890", "null", "mock", "");
+	scope.AddChannel(new OscilloscopeChannel(
+		&scope, "CH1", OscilloscopeChannel::CHANNEL_TYPE_ANALOG, "#ffffff", 0, true));
+	auto chan = scope.GetChannel(0);
+	StreamDescriptor stream(chan, 0);
+
+	IDTable table;
+	string config = "instruments:\n";
+	config += scope.SerializeConfiguration(table);
+	{
+		TestGraph graph;
+		auto f = graph.Subtract(stream, stream);
+		config += "decodes:\n";
+		config += f->SerializeConfiguration(table);
+	}
+
+	string datadir = fname.substr(0, fname.length() - strlen(".scopesession")) + "_data";
+	MakeDirectory(datadir);
+	char tmp[512];
+	snprintf(tmp, sizeof(tmp), "%s/scope_%d_waveforms", datadir.c_str(), table[&scope]);
+	string wavedir = tmp;
+	MakeDirectory(wavedir);
+
+	//Waveform i is captured at time 100+i
+	string metadata = "waveforms:\n";
+	for(size_t i=0; i<count; i++)
+	{
+		int id = i + 1;
+		auto wfm = MakeRamp(depth, 0, 100 + i);
+		chan->SetData(wfm, 0);
+
+		map<StreamDescriptor, WaveformBase*> data;
+		data[stream] = wfm;
+		metadata += WaveformSerializer::SerializeWaveformMetadata(
+			id, TimePoint(wfm->m_startTimestamp, wfm->m_startFemtoseconds), false, "", data);
+
+		snprintf(tmp, sizeof(tmp), "%s/waveform_%d", wavedir.c_str(), id);
+		MakeDirectory(tmp);
+		float progress = 0;
+		int done = 0;
+		REQUIRE(WaveformSerializer::SaveStream(tmp, stream, wfm, &progress, &done));
+	}
+
+	snprintf(tmp, sizeof(tmp), "%s/scope_%d_metadata.yml", datadir.c_str(), table[&scope]);
+	REQUIRE(WriteFile(tmp, metadata));
+	REQUIRE(WriteFile(fname, config));
+}
+
+TEST_CASE("HeadlessSession")
+{
+	const size_t count = 4;
+	const size_t depth = 1000;
+
+	const char* root = getenv("TMPDIR");
+	if(!root)
+		root = "/tmp";
+	char tmp[512];
+	snprintf(tmp, sizeof(tmp), "%s/glscopeclient-headless-test-%d", root, (int)getpid());
+	string dir = tmp;
+	MakeDirectory(dir);
+
+	string input = dir + "/input.scopesession";
+	WriteSession(input, count, depth);
+	auto before = g_filterRegistry.GetSessionFilters();
+
+	SECTION("Every saved waveform is processed and written out")
+	{
+		string outdir = dir + "/out";
+		{
+			HeadlessSession session;
+			REQUIRE(session.Load(input, false, true));
+
+			//The session's filter was loaded and is part of the session
+			auto filters = g_filterRegistry.GetSessionFilters();
+			REQUIRE(filters.size() == before.size() + 1);
+
+			REQUIRE(session.Run(count, outdir));
+
+			//The filter graph ran on the last waveform
+			for(auto f : filters)
+			{
+				if(before.count(f))
+					continue;
+				auto out = f->GetData(0);
+				REQUIRE(out != NULL);
+				REQUIRE(out->m_offsets.size() == depth);
+				REQUIRE(out->m_startTimestamp == (time_t)(100 + count - 1));
+			}
+		}
+
+		//A header, then one row of stats per waveform, in order
+		auto stats = ReadLines(outdir + "/stats.csv");
+		REQUIRE(stats.size() == count + 1);
+		for(size_t i=0; i<count; i++)
+		{
+			snprintf(tmp, sizeof(tmp), "%zu,%zu,", i, 100 + i);
+			REQUIRE(stats[i + 1].find(tmp) == 0);
+		}
+
+		//The output is itself a session which can be replayed, with the same waveforms
+		HeadlessSession replay;
+		REQUIRE(replay.Load(outdir + "/capture.scopesession", false, true));
+		REQUIRE(replay.Run(0, dir + "/replay"));
+		REQUIRE(ReadLines(dir + "/replay/stats.csv").size() == count + 1);
+	}
+
+	SECTION("Asking for more waveforms than were saved loops over them")
+	{
+		HeadlessSession session;
+		REQUIRE(session.Load(input, false, true));
+		REQUIRE(session.Run(count * 2 + 1, dir + "/loop"));
+
+		auto stats = ReadLines(dir + "/loop/stats.csv");
+		REQUIRE(stats.size() == count * 2 + 2);
+		snprintf(tmp, sizeof(tmp), "%zu,%zu,", count * 2, (size_t)100);
+		REQUIRE(stats.back().find(tmp) == 0);
+	}
+
+	SECTION("Missing sessions are rejected")
+	{
+		HeadlessSession session;
+		REQUIRE(!session.Load(dir + "/nonexistent.scopesession", false, true));
+	}
+
+	//Everything the sessions loaded was freed with them
+	REQUIRE(g_filterRegistry.GetSessionFilters() == before);
+
+	RemoveDirectory(dir);
+}
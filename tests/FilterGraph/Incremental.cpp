@@ -0,0 +1,171 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test for FilterGraphExecutor change propagation
+ */
+#include <catch2/catch.hpp>
+
+#include "FilterGraph.h"
+#include "../../src/glscopeclient/FilterGraphRunner.h"
+
+using namespace std;
+
+TEST_CASE("FilterGraphExecutor_Incremental")
+{
+	auto chan = StreamDescriptor(g_scope.GetChannel(0), 0);
+
+	//Two chains off the scope channel: a -> b, and c
+	TestGraph graph;
+	auto a = graph.Subtract(chan, chan);
+	auto b = graph.Subtract(StreamDescriptor(a, 0), StreamDescriptor(a, 0));
+	graph.Subtract(chan, chan);
+	auto filters = graph.GetFilters();
+
+	g_scope.GetChannel(0)->SetData(MakeRamp(1000), 0);
+
+	FilterGraphExecutor executor;
+
+	//Everything is new the first time
+	executor.RunBlocking(filters);
+	REQUIRE(executor.GetLastEvaluatedCount() == 3);
+
+	//Nothing changed
+	executor.RunBlocking(filters);
+	REQUIRE(executor.GetLastEvaluatedCount() == 0);
+
+	//Marking a filter dirty re-evaluates it and everything downstream, but nothing else
+	executor.MarkDirty(b);
+	executor.RunBlocking(filters);
+	REQUIRE(executor.GetLastEvaluatedCount() == 1);
+
+	executor.MarkDirty(a);
+	executor.RunBlocking(filters);
+	REQUIRE(executor.GetLastEvaluatedCount() == 2);
+
+	//Reconnecting an input dirties the filter it was reconnected on
+	b->SetInput(1, chan);
+	executor.RunBlocking(filters);
+	REQUIRE(executor.GetLastEvaluatedCount() == 1);
+
+	//A new waveform on the scope channel dirties everything fed by it
+	g_scope.GetChannel(0)->SetData(MakeRamp(500, 1000), 0);
+	executor.RunBlocking(filters);
+	REQUIRE(executor.GetLastEvaluatedCount() == 3);
+}
+
+TEST_CASE("FilterGraphExecutor_Demand")
+{
+	auto chan = StreamDescriptor(g_scope.GetChannel(0), 0);
+
+	//a -> b, and c with nobody looking at it
+	TestGraph graph;
+	auto a = graph.Subtract(chan, chan);
+	auto b = graph.Subtract(StreamDescriptor(a, 0), StreamDescriptor(a, 0));
+	auto c = graph.Subtract(chan, chan);
+	auto filters = graph.GetFilters();
+
+	g_scope.GetChannel(0)->SetData(MakeRamp(1000), 0);
+
+	FilterGraphExecutor executor;
+
+	//Only b is used, so c is skipped but a has to run to feed it
+	executor.SetSinks({b});
+	executor.RunBlocking(filters);
+	REQUIRE(executor.GetLastEvaluatedCount() == 2);
+	REQUIRE(executor.GetLastSkippedCount() == 1);
+	REQUIRE(c->GetData(0) == NULL);
+
+	//c stays out of date until someone looks at it, then catches up without any new input
+	executor.RunBlocking(filters);
+	REQUIRE(executor.GetLastEvaluatedCount() == 0);
+	REQUIRE(executor.GetLastSkippedCount() == 1);
+
+	executor.SetSinks({b, c});
+	executor.RunBlocking(filters);
+	REQUIRE(executor.GetLastEvaluatedCount() == 1);
+	REQUIRE(executor.GetLastSkippedCount() == 0);
+	REQUIRE(c->GetData(0) != NULL);
+
+	//No sinks at all means evaluate everything
+	executor.ClearSinks();
+	executor.MarkAllDirty();
+	executor.RunBlocking(filters);
+	REQUIRE(executor.GetLastEvaluatedCount() == 3);
+}
+
+TEST_CASE("FilterGraphRunner_Demand")
+{
+	auto scopechan = g_scope.GetChannel(0);
+	auto chan = StreamDescriptor(scopechan, 0);
+
+	//a -> b, and c off to the side. The scope channel is displayed too, which doesn't need any filters.
+	TestGraph graph;
+	auto a = graph.Subtract(chan, chan);
+	auto b = graph.Subtract(StreamDescriptor(a, 0), chan);
+	auto c = graph.Subtract(chan, chan);
+
+	recursive_mutex dataMutex;
+	FilterGraphRunner runner(dataMutex);
+	auto& executor = runner.GetExecutor();
+
+	//Only b is on screen
+	runner.SetSinks({scopechan, b});
+	scopechan->SetData(MakeRamp(1000, 0, 1), 0);
+	runner.Refresh();
+	REQUIRE(executor.GetLastEvaluatedCount() == 2);
+	REQUIRE(executor.GetLastSkippedCount() == 1);
+
+	//Editing c, or acquiring new data, doesn't run it while it's hidden
+	runner.OnFilterChanged(c);
+	runner.Refresh();
+	REQUIRE(executor.GetLastEvaluatedCount() == 0);
+
+	scopechan->SetData(MakeRamp(500, 0, 2), 0);
+	runner.Refresh();
+	REQUIRE(executor.GetLastEvaluatedCount() == 2);
+	REQUIRE(executor.GetLastSkippedCount() == 1);
+
+	//Opening a view of c catches it up with the current waveform, and nothing else
+	runner.SetSinks({scopechan, b, c});
+	runner.Refresh();
+	REQUIRE(executor.GetLastEvaluatedCount() == 1);
+	REQUIRE(executor.GetLastSkippedCount() == 0);
+	REQUIRE(c->GetData(0) != NULL);
+	REQUIRE(c->GetData(0)->m_offsets.size() == 500);
+
+	//Closing the view of b leaves a with nobody to feed
+	runner.SetSinks({scopechan, c});
+	runner.OnChannelChanged(scopechan);
+	runner.Refresh();
+	REQUIRE(executor.GetLastEvaluatedCount() == 1);
+	REQUIRE(executor.GetLastSkippedCount() == 2);
+}
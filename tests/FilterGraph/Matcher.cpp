@@ -0,0 +1,234 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test for WaveformMatcher, pairing up waveforms from multiple instruments
+ */
+#include <catch2/catch.hpp>
+
+#include "FilterGraph.h"
+#include "../../src/glscopeclient/AcquisitionBudget.h"
+#include "../../src/glscopeclient/WaveformPipeline.h"
+#include "../../src/glscopeclient/WaveformMatcher.h"
+#include <thread>
+
+using namespace std;
+
+/**
+	@brief Adds a one-channel waveform with the given instrument timestamp to the matcher
+ */
+static void AddWaveform(WaveformMatcher& matcher, Oscilloscope* scope, time_t sec, int64_t fs, double tTrigger = -1)
+{
+	map<StreamDescriptor, WaveformBase*> data;
+	data[StreamDescriptor(g_scope.GetChannel(0), 0)] = MakeRamp(10, fs, sec);
+	matcher.Add(scope, data, tTrigger);
+}
+
+/**
+	@brief Gets the femtoseconds part of the timestamp of one instrument's waveform in a matched set
+ */
+static int64_t GetFemtoseconds(WaveformSet& set, Oscilloscope* scope)
+{
+	return set[scope].begin()->second->m_startFemtoseconds;
+}
+
+TEST_CASE("WaveformMatcher_Skew")
+{
+	const int64_t second = static_cast<int64_t>(FS_PER_SECOND);
+	REQUIRE(WaveformMatcher::GetSkew(TimePoint(1, 0), TimePoint(0, 5)) == second - 5);
+	REQUIRE(WaveformMatcher::GetSkew(TimePoint(0, 5), TimePoint(1, 0)) == 5 - second);
+
+	//Up to 1000 seconds apart fits in an int64 without saturating
+	REQUIRE(WaveformMatcher::GetSkew(TimePoint(1000, 0), TimePoint(0, 0)) == 1000 * second);
+
+	//Anything further apart would overflow
+	REQUIRE(WaveformMatcher::GetSkew(TimePoint(1001, 0), TimePoint(0, 0)) == INT64_MAX);
+	REQUIRE(WaveformMatcher::GetSkew(TimePoint(0, 0), TimePoint(1001, 0)) == -INT64_MAX);
+	REQUIRE(WaveformMatcher::GetSkew(TimePoint(1700000000, 0), TimePoint(0, 0)) == INT64_MAX);
+}
+
+TEST_CASE("WaveformMatcher")
+{
+	MockOscilloscope primary("Primary", "Antikernel Labs", "1", "null", "mock", "");
+	MockOscilloscope secondary("Secondary", "Antikernel Labs", "2", "null", "mock", "");
+	vector<Oscilloscope*> scopes = {&primary, &secondary};
+
+	{
+		WaveformMatcher matcher;
+		matcher.SetMaxSkew(100);
+		WaveformSet set;
+		double tTrigger;
+
+		SECTION("Waveforms within the skew window are matched")
+		{
+			AddWaveform(matcher, &primary, 0, 1000, 5);
+			REQUIRE(!matcher.Align(scopes));
+			REQUIRE(!matcher.Pop(scopes, set, tTrigger));
+
+			AddWaveform(matcher, &secondary, 0, 1050, 3);
+			REQUIRE(matcher.Pop(scopes, set, tTrigger));
+			REQUIRE(set.size() == 2);
+			REQUIRE(GetFemtoseconds(set, &primary) == 1000);
+			REQUIRE(GetFemtoseconds(set, &secondary) == 1050);
+			REQUIRE(tTrigger == 3);
+			WaveformPipeline::DeleteSet(set);
+
+			REQUIRE(matcher.GetMatchCount() == 1);
+			REQUIRE(matcher.GetOrphanCount() == 0);
+			REQUIRE(matcher.GetQueuedCount() == 0);
+		}
+
+		SECTION("The edges of the skew window are inside it")
+		{
+			AddWaveform(matcher, &primary, 0, 1000);
+			AddWaveform(matcher, &secondary, 0, 1100);
+			REQUIRE(matcher.Pop(scopes, set, tTrigger));
+			REQUIRE(tTrigger < 0);
+			WaveformPipeline::DeleteSet(set);
+
+			AddWaveform(matcher, &primary, 0, 2000);
+			AddWaveform(matcher, &secondary, 0, 1900);
+			REQUIRE(matcher.Pop(scopes, set, tTrigger));
+			WaveformPipeline::DeleteSet(set);
+
+			//One fs further out isn't
+			AddWaveform(matcher, &primary, 0, 3000);
+			AddWaveform(matcher, &secondary, 0, 3101);
+			REQUIRE(!matcher.Pop(scopes, set, tTrigger));
+
+			AddWaveform(matcher, &primary, 0, 4000);
+			AddWaveform(matcher, &secondary, 0, 3899);
+			REQUIRE(!matcher.Pop(scopes, set, tTrigger));
+
+			REQUIRE(matcher.GetMatchCount() == 2);
+			REQUIRE(matcher.GetOrphanCount() == 3);
+			REQUIRE(matcher.GetQueuedCount() == 1);
+		}
+
+		SECTION("An orphan on a secondary is dropped without losing the next set")
+		{
+			AddWaveform(matcher, &secondary, 0, 500);
+			AddWaveform(matcher, &secondary, 0, 1010);
+			AddWaveform(matcher, &primary, 0, 1000);
+
+			REQUIRE(matcher.Pop(scopes, set, tTrigger));
+			REQUIRE(GetFemtoseconds(set, &primary) == 1000);
+			REQUIRE(GetFemtoseconds(set, &secondary) == 1010);
+			WaveformPipeline::DeleteSet(set);
+
+			REQUIRE(matcher.GetOrphanCount() == 1);
+			REQUIRE(g_acquisitionBudget.GetState(&secondary)->m_drops == 1);
+			REQUIRE(g_acquisitionBudget.GetState(&primary)->m_drops == 0);
+		}
+
+		SECTION("An orphan on the primary is dropped without losing the next set")
+		{
+			AddWaveform(matcher, &primary, 0, 1000);
+			AddWaveform(matcher, &primary, 0, 2000);
+			AddWaveform(matcher, &secondary, 0, 2050);
+
+			REQUIRE(matcher.Pop(scopes, set, tTrigger));
+			REQUIRE(GetFemtoseconds(set, &primary) == 2000);
+			REQUIRE(GetFemtoseconds(set, &secondary) == 2050);
+			WaveformPipeline::DeleteSet(set);
+
+			REQUIRE(matcher.GetOrphanCount() == 1);
+			REQUIRE(g_acquisitionBudget.GetState(&primary)->m_drops == 1);
+			REQUIRE(g_acquisitionBudget.GetState(&secondary)->m_drops == 0);
+		}
+
+		SECTION("Timestamps hours apart don't overflow")
+		{
+			AddWaveform(matcher, &primary, 0, 0);
+			AddWaveform(matcher, &secondary, 36000, 0);
+			REQUIRE(!matcher.Pop(scopes, set, tTrigger));
+			REQUIRE(matcher.GetOrphanCount() == 1);
+			REQUIRE(matcher.GetQueuedCount() == 1);
+
+			AddWaveform(matcher, &primary, 36000, 50);
+			REQUIRE(matcher.Pop(scopes, set, tTrigger));
+			WaveformPipeline::DeleteSet(set);
+		}
+
+		SECTION("Waveforms nothing else triggered on expire")
+		{
+			AddWaveform(matcher, &primary, 0, 1000);
+			AddWaveform(matcher, &primary, 0, 2000);
+
+			matcher.SetTimeout(3600);
+			REQUIRE(matcher.ExpireOrphans() == 0);
+			REQUIRE(matcher.GetQueuedCount() == 2);
+
+			matcher.SetTimeout(0);
+			this_thread::sleep_for(chrono::milliseconds(1));
+			REQUIRE(matcher.ExpireOrphans() == 2);
+			REQUIRE(matcher.GetOrphanCount() == 2);
+			REQUIRE(matcher.GetDiscardCount() == 0);
+			REQUIRE(matcher.GetQueuedCount() == 0);
+			REQUIRE(g_acquisitionBudget.GetState(&primary)->m_drops == 2);
+		}
+
+		SECTION("Clearing discards everything queued")
+		{
+			AddWaveform(matcher, &primary, 0, 1000);
+			AddWaveform(matcher, &primary, 0, 2000);
+			AddWaveform(matcher, &secondary, 5, 0);
+
+			matcher.Clear();
+			REQUIRE(matcher.GetDiscardCount() == 3);
+			REQUIRE(matcher.GetOrphanCount() == 0);
+			REQUIRE(matcher.GetMatchCount() == 0);
+			REQUIRE(matcher.GetQueuedCount() == 0);
+			REQUIRE(g_acquisitionBudget.GetState(&primary)->m_drops == 2);
+			REQUIRE(g_acquisitionBudget.GetState(&secondary)->m_drops == 1);
+
+			matcher.ResetCounters();
+			REQUIRE(matcher.GetDiscardCount() == 0);
+		}
+
+		SECTION("A single instrument never waits")
+		{
+			vector<Oscilloscope*> one = {&primary};
+			AddWaveform(matcher, &primary, 0, 1000);
+			REQUIRE(matcher.Pop(one, set, tTrigger));
+			REQUIRE(set.size() == 1);
+			WaveformPipeline::DeleteSet(set);
+		}
+
+		matcher.Clear();
+	}
+
+	//Everything staged was either handed out or freed
+	REQUIRE(g_acquisitionBudget.GetState(&primary)->m_stagedBytes == 0);
+	REQUIRE(g_acquisitionBudget.GetState(&secondary)->m_stagedBytes == 0);
+	g_acquisitionBudget.RemoveInstrument(&primary);
+	g_acquisitionBudget.RemoveInstrument(&secondary);
+}
@@ -0,0 +1,189 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test for FilterGraphExecutor output memoization
+ */
+#include <catch2/catch.hpp>
+
+#include "FilterGraph.h"
+#include "../../src/glscopeclient/FilterGraphRunner.h"
+
+using namespace std;
+
+TEST_CASE("FilterGraphExecutor_Memoize")
+{
+	auto scopechan = g_scope.GetChannel(0);
+	auto chan = StreamDescriptor(scopechan, 0);
+
+	//a -> b, both off the scope channel
+	TestGraph graph;
+	auto a = graph.Subtract(chan, chan);
+	auto b = graph.Subtract(StreamDescriptor(a, 0), chan);
+	auto filters = graph.GetFilters();
+
+	//Two "history entries", owned by the test rather than the channel
+	auto first = MakeRamp(1000, 0);
+	auto second = MakeRamp(500, 1000);
+
+	FilterGraphExecutor executor;
+
+	scopechan->Detach(0);
+	scopechan->SetData(first, 0);
+	executor.RunBlocking(filters, true);
+	REQUIRE(executor.GetLastEvaluatedCount() == 2);
+	auto firstOutput = b->GetData(0);
+
+	scopechan->Detach(0);
+	scopechan->SetData(second, 0);
+	executor.RunBlocking(filters, true);
+	REQUIRE(executor.GetLastEvaluatedCount() == 2);
+	REQUIRE(b->GetData(0) != firstOutput);
+	REQUIRE(b->GetData(0)->m_offsets.size() == 500);
+
+	//Going back to the first waveform shouldn't run anything
+	scopechan->Detach(0);
+	scopechan->SetData(first, 0);
+	executor.RunBlocking(filters, true);
+	REQUIRE(executor.GetLastEvaluatedCount() == 0);
+	REQUIRE(executor.GetLastCachedCount() == 2);
+	REQUIRE(b->GetData(0) == firstOutput);
+	REQUIRE(b->GetData(0)->m_offsets.size() == 1000);
+
+	//Changing a setting throws away the cached output of that filter, but not of anything upstream
+	b->SetInput(1, StreamDescriptor(a, 0));
+	scopechan->Detach(0);
+	scopechan->SetData(second, 0);
+	executor.RunBlocking(filters, true);
+	REQUIRE(executor.GetLastCachedCount() == 1);
+	REQUIRE(executor.GetLastEvaluatedCount() == 1);
+
+	//No budget, no cache
+	executor.GetOutputCache().SetMaxBytes(0);
+	REQUIRE(executor.GetOutputCache().GetEntryCount() == 0);
+	scopechan->Detach(0);
+	scopechan->SetData(first, 0);
+	executor.RunBlocking(filters, true);
+	REQUIRE(executor.GetLastEvaluatedCount() == 2);
+
+	scopechan->Detach(0);
+	delete first;
+	delete second;
+}
+
+TEST_CASE("FilterGraphRunner_MemoizeReloaded")
+{
+	auto scopechan = g_scope.GetChannel(0);
+	auto chan = StreamDescriptor(scopechan, 0);
+
+	TestGraph graph;
+	auto a = graph.Subtract(chan, chan);
+	graph.Subtract(StreamDescriptor(a, 0), chan);
+
+	recursive_mutex dataMutex;
+	FilterGraphRunner runner(dataMutex);
+	auto& executor = runner.GetExecutor();
+
+	//Select one history entry, then another
+	scopechan->SetData(MakeRamp(1000, 0, 5), 0);
+	runner.Refresh(true);
+	REQUIRE(executor.GetLastEvaluatedCount() == 2);
+
+	scopechan->SetData(MakeRamp(500, 1000, 5), 0);
+	runner.Refresh(true);
+	REQUIRE(executor.GetLastEvaluatedCount() == 2);
+
+	//The first entry comes back in a new waveform object (decompressed, paged in, or just at a different address).
+	//It's the same acquisition, so everything should come from the cache.
+	scopechan->SetData(MakeRamp(1000, 0, 5), 0);
+	runner.Refresh(true);
+	REQUIRE(executor.GetLastEvaluatedCount() == 0);
+	REQUIRE(executor.GetLastCachedCount() == 2);
+
+	//A different acquisition of the same length isn't
+	scopechan->SetData(MakeRamp(1000, 0, 6), 0);
+	runner.Refresh(true);
+	REQUIRE(executor.GetLastEvaluatedCount() == 2);
+}
+
+TEST_CASE("FilterGraphRunner_MemoizeEdits")
+{
+	auto scopechan = g_scope.GetChannel(0);
+	auto chan = StreamDescriptor(scopechan, 0);
+
+	//a -> b
+	TestGraph graph;
+	auto a = graph.Subtract(chan, chan);
+	auto b = graph.Subtract(StreamDescriptor(a, 0), chan);
+
+	recursive_mutex dataMutex;
+	FilterGraphRunner runner(dataMutex);
+	auto& executor = runner.GetExecutor();
+
+	//Select each of two history entries
+	scopechan->SetData(MakeRamp(1000, 0, 1), 0);
+	runner.Refresh(true);
+	scopechan->SetData(MakeRamp(1000, 0, 2), 0);
+	runner.Refresh(true);
+	REQUIRE(executor.GetLastEvaluatedCount() == 2);
+
+	//Editing b from the UI means nothing cached for it is valid any more, but a's outputs still are
+	runner.OnFilterChanged(b);
+	scopechan->SetData(MakeRamp(1000, 0, 1), 0);
+	runner.Refresh(true);
+	REQUIRE(executor.GetLastCachedCount() == 1);
+	REQUIRE(executor.GetLastEvaluatedCount() == 1);
+
+	scopechan->SetData(MakeRamp(1000, 0, 2), 0);
+	runner.Refresh(true);
+	REQUIRE(executor.GetLastCachedCount() == 1);
+	REQUIRE(executor.GetLastEvaluatedCount() == 1);
+
+	//Both entries have been seen with the new settings now
+	scopechan->SetData(MakeRamp(1000, 0, 1), 0);
+	runner.Refresh(true);
+	REQUIRE(executor.GetLastCachedCount() == 2);
+	REQUIRE(executor.GetLastEvaluatedCount() == 0);
+
+	//Clearing sweeps throws away everything
+	runner.OnSweepsCleared();
+	scopechan->SetData(MakeRamp(1000, 0, 2), 0);
+	runner.Refresh(true);
+	REQUIRE(executor.GetLastCachedCount() == 0);
+	REQUIRE(executor.GetLastEvaluatedCount() == 2);
+
+	//Live data never comes from the cache, even if it looks the same
+	scopechan->SetData(MakeRamp(1000, 0, 1), 0);
+	runner.Refresh();
+	REQUIRE(executor.GetLastCachedCount() == 0);
+	REQUIRE(executor.GetLastEvaluatedCount() == 2);
+	REQUIRE(a->GetData(0) != NULL);
+}
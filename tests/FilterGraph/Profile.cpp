@@ -0,0 +1,148 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test for FilterGraphExecutor profiling
+ */
+#include <catch2/catch.hpp>
+
+#include "FilterGraph.h"
+#include "../../src/glscopeclient/FilterGraphRunner.h"
+#include <fstream>
+#include <unistd.h>
+
+using namespace std;
+
+TEST_CASE("FilterGraphExecutor_Profile")
+{
+	auto chan = StreamDescriptor(g_scope.GetChannel(0), 0);
+
+	TestGraph graph;
+	auto a = graph.Subtract(chan, chan);
+	auto filters = graph.GetFilters();
+
+	g_scope.GetChannel(0)->SetData(MakeRamp(1000), 0);
+
+	FilterGraphExecutor executor;
+
+	//Nothing to report until the filter has been part of a refresh
+	REQUIRE(executor.GetProfile(a) == NULL);
+
+	for(int i=0; i<3; i++)
+	{
+		executor.MarkAllDirty();
+		executor.RunBlocking(filters);
+	}
+
+	auto profile = executor.GetProfile(a);
+	REQUIRE(profile != NULL);
+	REQUIRE(profile->m_times.GetCount() == 3);
+	REQUIRE(profile->m_outputSamples == 1000);
+	REQUIRE(profile->m_outputBytes >= 1000 * sizeof(float));
+
+	//The first evaluation had to create the output from scratch
+	REQUIRE(profile->m_totalAllocBytes >= 1000 * sizeof(float));
+
+	//Clean filters aren't evaluated, so they don't get timed
+	executor.RunBlocking(filters);
+	REQUIRE(profile->m_times.GetCount() == 3);
+
+	executor.ResetProfiles();
+	REQUIRE(profile->m_times.GetCount() == 0);
+	REQUIRE(profile->m_totalAllocBytes == 0);
+}
+
+TEST_CASE("FilterGraphRunner_Profile")
+{
+	auto scopechan = g_scope.GetChannel(0);
+	auto chan = StreamDescriptor(scopechan, 0);
+
+	//a -> b
+	TestGraph graph;
+	auto a = graph.Subtract(chan, chan);
+	auto b = graph.Subtract(StreamDescriptor(a, 0), chan);
+
+	recursive_mutex dataMutex;
+	FilterGraphRunner runner(dataMutex);
+	auto& executor = runner.GetExecutor();
+
+	//Three new waveforms run everything three times
+	for(time_t i=0; i<3; i++)
+	{
+		scopechan->SetData(MakeRamp(1000, 0, i), 0);
+		runner.Refresh();
+	}
+	REQUIRE(executor.GetProfile(a)->m_times.GetCount() == 3);
+	REQUIRE(executor.GetProfile(b)->m_times.GetCount() == 3);
+
+	//Editing a filter only times what it re-ran
+	runner.OnFilterChanged(b);
+	runner.Refresh();
+	REQUIRE(executor.GetProfile(a)->m_times.GetCount() == 3);
+	REQUIRE(executor.GetProfile(b)->m_times.GetCount() == 4);
+
+	//The exported report has a row for every filter in the session
+	const char* root = getenv("TMPDIR");
+	if(!root)
+		root = "/tmp";
+	char fname[512];
+	snprintf(fname, sizeof(fname), "%s/glscopeclient-profile-test-%d.csv", root, (int)getpid());
+	REQUIRE(runner.WriteProfileReport(fname));
+
+	ifstream in(fname);
+	vector<string> lines;
+	string line;
+	while(getline(in, line))
+		lines.push_back(line);
+	in.close();
+	unlink(fname);
+
+	REQUIRE(lines.size() == 3);
+	REQUIRE(lines[0].find("filter,protocol,count,") == 0);
+	string prefix = string("\"") + b->GetDisplayName() + "\",";
+	size_t nfound = 0;
+	for(size_t i=1; i<lines.size(); i++)
+	{
+		if(lines[i].find(prefix) == 0)
+		{
+			REQUIRE(lines[i].find("\",4,") != string::npos);
+			nfound ++;
+		}
+	}
+	REQUIRE(nfound == 1);
+
+	//Can't write somewhere that doesn't exist
+	REQUIRE(!runner.WriteProfileReport(string(root) + "/nonexistent-directory/profile.csv"));
+
+	runner.ResetProfiles();
+	REQUIRE(executor.GetProfile(a)->m_times.GetCount() == 0);
+	REQUIRE(executor.GetProfile(b)->m_times.GetCount() == 0);
+}
@@ -0,0 +1,182 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test for HistoryReplayer
+ */
+#include <catch2/catch.hpp>
+
+#include "FilterGraph.h"
+#include "../../src/glscopeclient/HistoryReplayer.h"
+#include "../../src/glscopeclient/FilterRegistry.h"
+
+using namespace std;
+
+typedef vector<tuple<bool, int64_t, vector<uint8_t> > > FlatPackets;
+
+static FlatPackets Flatten(const vector<PacketGroup>& groups)
+{
+	FlatPackets ret;
+	for(auto& g : groups)
+	{
+		if(g.m_header)
+			ret.push_back(make_tuple(true, g.m_header->m_offset, g.m_header->m_data));
+		for(auto p : g.m_packets)
+			ret.push_back(make_tuple(false, p->m_offset, p->m_data));
+	}
+	return ret;
+}
+
+/**
+	@brief Generates a 115200 baud 8N1 UART waveform at 16 samples per bit
+ */
+static AnalogWaveform* GenerateUART(const string& text, time_t stamp)
+{
+	const int64_t samples_per_bit = 16;
+	auto wfm = new AnalogWaveform;
+	wfm->m_timescale = FS_PER_SECOND / (115200 * samples_per_bit);
+	wfm->m_densePacked = true;
+	wfm->m_startTimestamp = stamp;
+
+	//Idle, then each byte LSB first with start and stop bits, then idle again
+	vector<bool> bits(20, true);
+	for(auto c : text)
+	{
+		bits.push_back(false);
+		for(int i=0; i<8; i++)
+			bits.push_back( (c >> i) & 1);
+		bits.push_back(true);
+	}
+	bits.resize(bits.size() + 20, true);
+
+	wfm->Resize(bits.size() * samples_per_bit);
+	for(size_t i=0; i<wfm->m_samples.size(); i++)
+	{
+		wfm->m_offsets[i] = i;
+		wfm->m_durations[i] = 1;
+		wfm->m_samples[i] = bits[i / samples_per_bit] ? 1 : -1;
+	}
+	return wfm;
+}
+
+TEST_CASE("HistoryReplayer")
+{
+	auto chan = g_scope.GetChannel(0);
+
+	TestGraph graph;
+	auto thresh = graph.Create("Threshold");
+	auto uart = dynamic_cast<PacketDecoder*>(graph.Create("UART"));
+	REQUIRE(uart != NULL);
+	thresh->SetInput(0, StreamDescriptor(chan, 0));
+	uart->SetInput(0, StreamDescriptor(thresh, 0));
+	auto filters = graph.GetFilters();
+
+	//Make some history, and decode it one waveform at a time for reference
+	const size_t count = 16;
+	vector<HistoryReplayer::Entry> entries;
+	vector<FlatPackets> expected;
+	FilterGraphExecutor executor;
+	for(size_t i=0; i<count; i++)
+	{
+		auto wfm = GenerateUART(string("hello ") + to_string(i), i);
+		map<StreamDescriptor, WaveformBase*> hist;
+		hist[StreamDescriptor(chan, 0)] = wfm;
+		entries.push_back(HistoryReplayer::Entry(TimePoint(i, 0), hist));
+
+		chan->Detach(0);
+		chan->SetData(wfm, 0);
+		executor.RunBlocking(filters);
+
+		vector<PacketGroup> groups;
+		HistoryReplayer::GroupPackets(uart, uart->GetPackets(), groups);
+		expected.push_back(Flatten(groups));
+		for(auto& g : groups)
+			delete g.m_header;
+
+		REQUIRE(!expected.back().empty());
+	}
+	chan->Detach(0);
+
+	REQUIRE(HistoryReplayer::CanReplay(uart, {StreamDescriptor(chan, 0)}));
+	REQUIRE(!HistoryReplayer::CanReplay(uart, {}));
+
+	auto before = Filter::GetAllInstances();
+	HistoryReplayer replayer;
+
+	SECTION("Results match sequential decoding, in order")
+	{
+		atomic<size_t> notified(0);
+		replayer.Start({uart}, entries, 4, [&]() { notified ++; });
+
+		//Private copies must not leak into the session
+		REQUIRE(g_filterRegistry.GetSessionFilters() == before);
+		auto all = Filter::GetAllInstances();
+		REQUIRE(all.size() > before.size());
+		for(auto f : all)
+			REQUIRE(g_filterRegistry.IsPrivate(f) == (before.count(f) == 0));
+		REQUIRE(replayer.GetTotalCount() == count);
+
+		size_t i = 0;
+		while(!replayer.IsDone())
+		{
+			auto result = replayer.PopResult();
+			if(!result)
+			{
+				this_thread::yield();
+				continue;
+			}
+
+			REQUIRE(result->m_stamp == TimePoint(i, 0));
+			REQUIRE(Flatten(result->m_packets[uart]) == expected[i]);
+			i++;
+		}
+		REQUIRE(i == count);
+
+		//Workers count an entry as completed just after handing over its result, so wait for them to exit
+		replayer.Stop();
+		REQUIRE(replayer.GetCompletedCount() == count);
+		REQUIRE(notified == count);
+		REQUIRE(Filter::GetAllInstances() == before);
+	}
+
+	SECTION("Stopping early cleans up")
+	{
+		replayer.Start({uart}, entries, 4);
+		replayer.Stop();
+		REQUIRE(Filter::GetAllInstances() == before);
+	}
+
+	for(auto& e : entries)
+	{
+		for(auto it : e.m_data)
+			delete it.second;
+	}
+}
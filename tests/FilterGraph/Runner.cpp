@@ -0,0 +1,129 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test for FilterGraphRunner, the session wiring in front of FilterGraphExecutor
+ */
+#include <catch2/catch.hpp>
+
+#include "FilterGraph.h"
+#include "../../src/glscopeclient/FilterGraphRunner.h"
+#include "../../src/glscopeclient/FilterRegistry.h"
+#include <thread>
+
+using namespace std;
+
+TEST_CASE("FilterGraphRunner")
+{
+	auto chan = StreamDescriptor(g_scope.GetChannel(0), 0);
+
+	//Two chains off the scope channel: a -> b, and c
+	TestGraph graph;
+	auto a = graph.Subtract(chan, chan);
+	auto b = graph.Subtract(StreamDescriptor(a, 0), StreamDescriptor(a, 0));
+	auto c = graph.Subtract(chan, chan);
+
+	g_scope.GetChannel(0)->SetData(MakeRamp(1000), 0);
+
+	recursive_mutex dataMutex;
+	FilterGraphRunner runner(dataMutex);
+	auto& executor = runner.GetExecutor();
+
+	//The whole session is picked up without being handed a filter set
+	runner.Refresh();
+	REQUIRE(executor.GetLastEvaluatedCount() == 3);
+	REQUIRE(c->GetData(0) != NULL);
+
+	runner.Refresh();
+	REQUIRE(executor.GetLastEvaluatedCount() == 0);
+
+	SECTION("Editing a filter re-evaluates it and everything downstream")
+	{
+		runner.OnFilterChanged(a);
+		runner.Refresh();
+		REQUIRE(executor.GetLastEvaluatedCount() == 2);
+	}
+
+	SECTION("Changing a channel re-evaluates everything it feeds")
+	{
+		runner.OnChannelChanged(g_scope.GetChannel(0));
+		runner.Refresh();
+		REQUIRE(executor.GetLastEvaluatedCount() == 3);
+
+		runner.OnChannelChanged(b);
+		runner.Refresh();
+		REQUIRE(executor.GetLastEvaluatedCount() == 1);
+	}
+
+	SECTION("Clearing sweeps re-evaluates everything")
+	{
+		runner.OnSweepsCleared();
+		runner.Refresh();
+		REQUIRE(executor.GetLastEvaluatedCount() == 3);
+	}
+
+	SECTION("Throwaway filters used to build menus don't disturb the graph")
+	{
+		auto before = g_filterRegistry.GetSessionFilters();
+		size_t nbuilds = executor.GetScheduleBuildCount();
+
+		auto probe = g_filterRegistry.CreatePrivateFilter("Subtract", "");
+		probe->AddRef();
+		REQUIRE(g_filterRegistry.GetSessionFilters() == before);
+		runner.Refresh();
+		g_filterRegistry.ReleasePrivateFilter(probe);
+
+		runner.Refresh();
+		REQUIRE(executor.GetLastEvaluatedCount() == 0);
+		REQUIRE(executor.GetScheduleBuildCount() == nbuilds);
+		REQUIRE(g_filterRegistry.GetSessionFilters() == before);
+	}
+
+	SECTION("Changes wait for the data lock")
+	{
+		atomic<bool> marked(false);
+		unique_lock<recursive_mutex> lock(dataMutex);
+		thread t([&]()
+			{
+				runner.OnFilterChanged(c);
+				marked = true;
+			});
+		this_thread::sleep_for(chrono::milliseconds(50));
+		CHECK(!marked);
+
+		lock.unlock();
+		t.join();
+		REQUIRE(marked);
+
+		runner.Refresh();
+		REQUIRE(executor.GetLastEvaluatedCount() == 1);
+	}
+}
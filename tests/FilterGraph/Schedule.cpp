@@ -0,0 +1,258 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test and benchmark for FilterGraphExecutor scheduling
+ */
+#include <catch2/catch.hpp>
+
+#include "FilterGraph.h"
+#include "../../src/glscopeclient/FilterGraphRunner.h"
+#include "../../src/glscopeclient/FilterRegistry.h"
+#include <thread>
+
+using namespace std;
+
+/**
+	@brief Verifies that every filter in the graph is scheduled exactly once, after all of its inputs
+ */
+static void VerifySchedule(const set<Filter*>& filters, const vector<FilterGraphExecutor::FilterBlock>& blocks)
+{
+	map<FlowGraphNode*, size_t> levels;
+	for(size_t i=0; i<blocks.size(); i++)
+	{
+		for(auto f : blocks[i])
+		{
+			REQUIRE(levels.find(f) == levels.end());
+			levels[f] = i;
+		}
+	}
+	REQUIRE(levels.size() == filters.size());
+
+	for(auto f : filters)
+	{
+		for(size_t i=0; i<f->GetInputCount(); i++)
+		{
+			auto in = f->GetInput(i).m_channel;
+			if(levels.find(in) != levels.end())
+				REQUIRE(levels[in] < levels[f]);
+		}
+	}
+}
+
+TEST_CASE("FilterGraphExecutor_Schedule")
+{
+	auto chan = StreamDescriptor(g_scope.GetChannel(0), 0);
+
+	const size_t sizes[] = {100, 300, 1000};
+	for(auto size : sizes)
+	{
+		LogVerbose("Graph size: %zu filters\n", size);
+		LogIndenter li;
+
+		//Make a random DAG: each input comes from the scope, or any filter created before this one
+		TestGraph graph;
+		vector<Filter*> nodes;
+		for(size_t i=0; i<size; i++)
+		{
+			auto f = graph.Subtract(chan, chan);
+			for(size_t j=0; j<f->GetInputCount(); j++)
+			{
+				if(nodes.empty() || (g_rng() % 4 == 0) )
+					f->SetInput(j, chan);
+				else
+					f->SetInput(j, StreamDescriptor(nodes[g_rng() % nodes.size()], 0));
+			}
+
+			nodes.push_back(f);
+		}
+		auto filters = graph.GetFilters();
+
+		FilterGraphExecutor executor;
+		VerifySchedule(filters, executor.GetSchedule(filters));
+		REQUIRE(executor.GetScheduleBuildCount() == 1);
+
+		//Time refreshes of an unchanged graph, which should reuse the cached schedule
+		const size_t niter = 1000;
+		auto start = chrono::steady_clock::now();
+		for(size_t i=0; i<niter; i++)
+			executor.GetSchedule(filters);
+		auto cached = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / niter;
+		REQUIRE(executor.GetScheduleBuildCount() == 1);
+
+		//Time refreshes with a full rebuild every time, for comparison
+		start = chrono::steady_clock::now();
+		for(size_t i=0; i<niter; i++)
+		{
+			executor.InvalidateSchedule();
+			executor.GetSchedule(filters);
+		}
+		auto rebuilt = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / niter;
+
+		LogVerbose("%zu blocks\n", executor.GetSchedule(filters).size());
+		LogVerbose("Scheduling overhead per refresh: %.2f us cached, %.2f us rebuilt\n", cached, rebuilt);
+
+		//Reconnecting an input must be noticed
+		size_t nbuilds = executor.GetScheduleBuildCount();
+		auto last = nodes[size-1];
+		last->SetInput(0, chan);
+		last->SetInput(1, chan);
+		VerifySchedule(filters, executor.GetSchedule(filters));
+		REQUIRE(executor.GetScheduleBuildCount() == nbuilds + 1);
+
+		//So must deleting a filter
+		filters.erase(last);
+		VerifySchedule(filters, executor.GetSchedule(filters));
+		REQUIRE(executor.GetScheduleBuildCount() == nbuilds + 2);
+	}
+}
+
+TEST_CASE("FilterGraphExecutor_ReusedAddress")
+{
+	auto chan = StreamDescriptor(g_scope.GetChannel(0), 0);
+
+	//a -> b
+	TestGraph graph;
+	auto a = graph.Subtract(chan, chan);
+	auto b = graph.Subtract(StreamDescriptor(a, 0), chan);
+	auto filters = graph.GetFilters();
+
+	g_scope.GetChannel(0)->SetData(MakeRamp(1000), 0);
+
+	FilterGraphExecutor executor;
+	executor.RunBlocking(filters);
+	executor.RunBlocking(filters);
+	REQUIRE(executor.GetLastEvaluatedCount() == 0);
+	auto oldProfile = executor.GetProfile(a);
+	REQUIRE(oldProfile->m_times.GetCount() == 1);
+	size_t nbuilds = executor.GetScheduleBuildCount();
+	auto id = g_filterRegistry.GetID(a);
+
+	//Registering a again is exactly what happens when a new filter is created at the address of a deleted one.
+	//Same pointer, same inputs, same waveform, but it's a different filter and must not inherit anything.
+	g_filterRegistry.Register(a);
+	REQUIRE(g_filterRegistry.GetID(a) != id);
+	executor.RunBlocking(filters);
+	REQUIRE(executor.GetScheduleBuildCount() == nbuilds + 1);
+	REQUIRE(executor.GetLastEvaluatedCount() == 2);
+	REQUIRE(executor.GetProfile(a) != oldProfile);
+	REQUIRE(executor.GetProfile(a)->m_times.GetCount() == 1);
+
+	//Filters that didn't change keep their state across the rebuild
+	REQUIRE(executor.GetProfile(b)->m_times.GetCount() == 2);
+
+	//And once it's been seen, it's up to date like anything else
+	executor.RunBlocking(filters);
+	REQUIRE(executor.GetLastEvaluatedCount() == 0);
+}
+
+TEST_CASE("FilterGraphRunner_Parallel")
+{
+	auto scopechan = g_scope.GetChannel(0);
+	auto chan = StreamDescriptor(scopechan, 0);
+
+	//A long chain with a fan-out hanging off every link, so there's always something to steal.
+	//Each link passes the scope waveform through unchanged, and each leaf subtracts it again.
+	TestGraph graph;
+	auto zero = graph.Subtract(chan, chan);
+	vector<Filter*> chain;
+	vector<Filter*> leaves;
+	auto prev = chan;
+	for(size_t i=0; i<20; i++)
+	{
+		auto f = graph.Subtract(prev, StreamDescriptor(zero, 0));
+		chain.push_back(f);
+		for(size_t j=0; j<10; j++)
+			leaves.push_back(graph.Subtract(StreamDescriptor(f, 0), chan));
+		prev = StreamDescriptor(f, 0);
+	}
+	size_t nfilters = graph.GetFilters().size();
+
+	//Same setup as the main window
+	recursive_mutex dataMutex;
+	FilterGraphRunner runner(dataMutex);
+	auto& executor = runner.GetExecutor();
+	executor.SetThreadCount(4);
+
+	//Someone editing the graph from the UI thread the whole time
+	atomic<bool> done(false);
+	thread editor([&]()
+		{
+			while(!done)
+			{
+				runner.OnFilterChanged(chain[g_rng() % chain.size()]);
+				this_thread::yield();
+			}
+		});
+
+	const size_t depth = 1000;
+	for(size_t iter=0; iter<20; iter++)
+	{
+		//Scale the ramp every time, so a filter run before its inputs were ready would see the last waveform
+		auto wfm = MakeRamp(depth, 0, iter);
+		for(size_t i=0; i<depth; i++)
+			wfm->m_samples[i] *= (iter + 1);
+		scopechan->SetData(wfm, 0);
+
+		runner.Refresh();
+		REQUIRE(executor.GetLastEvaluatedCount() == nfilters);
+
+		auto last = dynamic_cast<AnalogWaveform*>(chain.back()->GetData(0));
+		REQUIRE(last != NULL);
+		REQUIRE(last->m_samples.size() == depth);
+		REQUIRE(last->m_samples[depth-1] == (depth-1) * (iter + 1));
+
+		size_t nwrong = 0;
+		for(auto f : leaves)
+		{
+			auto out = dynamic_cast<AnalogWaveform*>(f->GetData(0));
+			REQUIRE(out != NULL);
+			REQUIRE(out->m_samples.size() == depth);
+			for(auto v : out->m_samples)
+			{
+				if(v != 0)
+					nwrong ++;
+			}
+		}
+		REQUIRE(nwrong == 0);
+	}
+
+	done = true;
+	editor.join();
+
+	//Edits still land once nobody else is touching the graph: everything but the zero filter is downstream of here
+	runner.Refresh();
+	runner.OnFilterChanged(chain[0]);
+	runner.Refresh();
+	REQUIRE(executor.GetLastEvaluatedCount() == nfilters - 1);
+	runner.Refresh();
+	REQUIRE(executor.GetLastEvaluatedCount() == 0);
+}
@@ -0,0 +1,188 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test for HistorySpillStore
+ */
+#include <catch2/catch.hpp>
+
+#include "FilterGraph.h"
+#include "../../src/glscopeclient/HistorySpillStore.h"
+#include "../../src/glscopeclient/WaveformPool.h"
+#include <cstring>
+
+using namespace std;
+
+/**
+	@brief Loads a spilled waveform back in, and checks we got back exactly what we started with
+ */
+template<class T>
+static void VerifyLoad(SpilledWaveform& spilled, T* wfm)
+{
+	auto out = dynamic_cast<T*>(spilled.Load());
+	REQUIRE(out != NULL);
+
+	REQUIRE(out->m_timescale == wfm->m_timescale);
+	REQUIRE(out->m_startTimestamp == wfm->m_startTimestamp);
+	REQUIRE(out->m_startFemtoseconds == wfm->m_startFemtoseconds);
+	REQUIRE(out->m_triggerPhase == wfm->m_triggerPhase);
+	REQUIRE(out->m_densePacked == wfm->m_densePacked);
+	REQUIRE(out->m_samples.size() == wfm->m_samples.size());
+	for(size_t i=0; i<wfm->m_samples.size(); i++)
+	{
+		REQUIRE(out->m_offsets[i] == wfm->m_offsets[i]);
+		REQUIRE(out->m_durations[i] == wfm->m_durations[i]);
+		REQUIRE(out->m_samples[i] == wfm->m_samples[i]);
+	}
+
+	g_waveformPool.Return(out);
+}
+
+static bool FileExists(const string& fname)
+{
+	FILE* fp = fopen(fname.c_str(), "rb");
+	if(!fp)
+		return false;
+	fclose(fp);
+	return true;
+}
+
+TEST_CASE("HistorySpillStore")
+{
+	const size_t depth = 100000;
+	auto chan = g_scope.GetChannel(0);
+	StreamDescriptor dense(chan, 0);
+	StreamDescriptor sparse(chan, 1);
+	StreamDescriptor evicted(chan, 2);
+
+	//Dense analog waveform, resident in RAM
+	AnalogWaveform awfm;
+	awfm.m_timescale = 1000;
+	awfm.m_startTimestamp = 1234;
+	awfm.m_startFemtoseconds = 5678;
+	awfm.m_triggerPhase = 42;
+	awfm.m_densePacked = true;
+	awfm.Resize(depth);
+	for(size_t i=0; i<depth; i++)
+	{
+		awfm.m_offsets[i] = i;
+		awfm.m_durations[i] = 1;
+		awfm.m_samples[i] = static_cast<float>(g_rng()) / g_rng.max() - 0.5f;
+	}
+
+	//Sparse digital waveform, resident in RAM
+	DigitalWaveform dwfm;
+	dwfm.m_timescale = 1;
+	dwfm.m_startTimestamp = 1234;
+	dwfm.m_startFemtoseconds = 5678;
+	dwfm.Resize(depth);
+	for(size_t i=0; i<depth; i++)
+	{
+		dwfm.m_offsets[i] = i*5;
+		dwfm.m_durations[i] = 3 + (g_rng() % 2);
+		dwfm.m_samples[i] = (g_rng() % 2) != 0;
+	}
+
+	//Analog waveform which only exists in compressed form
+	AnalogWaveform cwfm;
+	cwfm.m_timescale = 500;
+	cwfm.m_startTimestamp = 1234;
+	cwfm.m_startFemtoseconds = 5678;
+	cwfm.m_densePacked = true;
+	cwfm.Resize(depth);
+	for(size_t i=0; i<depth; i++)
+	{
+		cwfm.m_offsets[i] = i;
+		cwfm.m_durations[i] = 1;
+		cwfm.m_samples[i] = (g_rng() % 256) * 0.01f;
+	}
+
+	map<StreamDescriptor, WaveformBase*> data;
+	data[dense] = &awfm;
+	data[sparse] = &dwfm;
+	data[evicted] = NULL;
+	CompressedHistory compressed;
+	compressed[evicted] = shared_ptr<CompressedWaveform>(CompressedWaveform::Compress(&cwfm));
+
+	TimePoint key(1234, 5678);
+	HistorySpillStore store;
+
+	SECTION("Spilled waveforms load back unchanged")
+	{
+		store.Submit(key, data, compressed);
+		REQUIRE(store.IsPending(key));
+
+		TimePoint rkey;
+		SpilledHistory spilled;
+		bool ok = false;
+		while(!store.PopResult(rkey, spilled, ok))
+			this_thread::sleep_for(chrono::milliseconds(1));
+		REQUIRE(!store.IsPending(key));
+
+		REQUIRE(ok);
+		REQUIRE(rkey == key);
+		REQUIRE(spilled.size() == 3);
+		REQUIRE(spilled[dense].m_format == "densev1");
+		REQUIRE(spilled[sparse].m_format == "sparsev1");
+
+		VerifyLoad(spilled[dense], &awfm);
+		VerifyLoad(spilled[sparse], &dwfm);
+		VerifyLoad(spilled[evicted], &cwfm);
+
+		//Exported copies are usable on their own. Put this one outside the entry's directory, like a saved session.
+		string fname = spilled[sparse].m_fname;
+		fname = fname.substr(0, fname.rfind('/'));
+		fname = fname.substr(0, fname.rfind('/')) + "/export.bin";
+		REQUIRE(HistorySpillStore::Export(spilled[sparse], fname));
+		SpilledWaveform exported = spilled[sparse];
+		exported.m_fname = fname;
+		VerifyLoad(exported, &dwfm);
+
+		//Removing the spilled copy leaves the export alone
+		HistorySpillStore::Remove(spilled);
+		REQUIRE(!FileExists(spilled[dense].m_fname));
+		REQUIRE(!FileExists(spilled[sparse].m_fname));
+		REQUIRE(FileExists(fname));
+		remove(fname.c_str());
+	}
+
+	SECTION("Cancelled jobs leave nothing behind")
+	{
+		store.Submit(key, data, compressed);
+		store.Cancel(key);
+		REQUIRE(!store.IsPending(key));
+
+		TimePoint rkey;
+		SpilledHistory spilled;
+		bool ok;
+		REQUIRE(!store.PopResult(rkey, spilled, ok));
+	}
+}
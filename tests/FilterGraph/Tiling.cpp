@@ -0,0 +1,105 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test for FilterGraphExecutor tiled evaluation
+ */
+#include <catch2/catch.hpp>
+
+#include "FilterGraph.h"
+#include "../../src/glscopeclient/FilterGraphExecutor.h"
+
+using namespace std;
+
+TEST_CASE("FilterGraphExecutor_Tiling")
+{
+	auto chan = StreamDescriptor(g_scope.GetChannel(0), 0);
+
+	//a = chan - chan, b = a - chan = -chan
+	TestGraph graph;
+	auto a = graph.Subtract(chan, chan);
+	auto b = graph.Subtract(StreamDescriptor(a, 0), chan);
+	auto filters = graph.GetFilters();
+
+	const size_t depth = 1000;
+	auto wfm = MakeRamp(depth);
+	g_scope.GetChannel(0)->SetData(wfm, 0);
+
+	FilterGraphExecutor executor;
+	executor.SetTiling(128, 0, 4);
+	executor.SetTileableProtocols({"Subtract"});
+
+	SECTION("Output matches untiled evaluation")
+	{
+		executor.RunBlocking(filters);
+		REQUIRE(executor.GetLastTiledCount() == 2);
+
+		//The scope channel got its own waveform back
+		REQUIRE(g_scope.GetChannel(0)->GetData(0) == wfm);
+
+		auto out = dynamic_cast<AnalogWaveform*>(b->GetData(0));
+		REQUIRE(out != NULL);
+		REQUIRE(out->m_offsets.size() == depth);
+
+		//Stitched output was sized for the whole record up front, not grown one tile at a time
+		REQUIRE(out->m_offsets.capacity() == depth);
+		REQUIRE(out->m_samples.capacity() == depth);
+
+		for(size_t i=0; i<depth; i++)
+		{
+			REQUIRE(out->m_offsets[i] * out->m_timescale + out->m_triggerPhase == (int64_t)i);
+			REQUIRE(out->m_samples[i] == -(float)i);
+		}
+	}
+
+	SECTION("Intermediate outputs are dropped")
+	{
+		executor.SetSinks({b});
+		executor.RunBlocking(filters);
+		REQUIRE(executor.GetLastTiledCount() == 2);
+		REQUIRE(a->GetData(0) == NULL);
+		REQUIRE(b->GetData(0) != NULL);
+
+		//Looking at the intermediate brings it back
+		executor.SetSinks({a, b});
+		executor.RunBlocking(filters);
+		REQUIRE(a->GetData(0) != NULL);
+		REQUIRE(a->GetData(0)->m_offsets.size() == depth);
+	}
+
+	SECTION("Shallow waveforms aren't tiled")
+	{
+		executor.SetTiling(128, 2 * depth, 4);
+		executor.RunBlocking(filters);
+		REQUIRE(executor.GetLastTiledCount() == 0);
+		REQUIRE(executor.GetLastEvaluatedCount() == 2);
+	}
+}
@@ -0,0 +1,110 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test for waking up the UI thread when a new waveform is ready
+ */
+#include <catch2/catch.hpp>
+#include <glibmm.h>
+
+#include "FilterGraph.h"
+#include "../../src/glscopeclient/Event.h"
+#include "../../src/glscopeclient/LatencyHistogram.h"
+#include <thread>
+
+using namespace std;
+
+TEST_CASE("UIWakeup")
+{
+	//Same handshake as WaveformProcessingThread() and OscilloscopeWindow::OnWaveformReady(), measured the same way as
+	//LATENCY_UI_WAKEUP: the worker emits a dispatcher, then waits for the main loop to finish before sending another
+	Glib::init();
+	auto loop = Glib::MainLoop::create();
+	Glib::Dispatcher dispatcher;
+
+	const size_t count = 200;
+	atomic<double> tready(0);
+	atomic<size_t> sent(0);
+	Event processed;
+	LatencyHistogram wakeup;
+	size_t received = 0;
+	size_t outOfOrder = 0;
+
+	dispatcher.connect([&]()
+		{
+			wakeup.Record(GetTime() - tready);
+
+			//Each wakeup must be for the waveform the worker is waiting on, not a later or repeated one
+			if(sent != received + 1)
+				outOfOrder ++;
+
+			processed.Signal();
+			if(++received == count)
+				loop->quit();
+		});
+
+	//Don't hang if the dispatcher never fires. This is generous since it's not a timing test.
+	Glib::signal_timeout().connect_once([&]() { loop->quit(); }, 60000);
+
+	atomic<bool> done(false);
+	thread worker([&]()
+		{
+			for(size_t i=0; (i < count) && !done; i++)
+			{
+				//Waveforms don't show up back to back
+				this_thread::sleep_for(chrono::microseconds(1000 + g_rng() % 4000));
+				tready = GetTime();
+				sent = i + 1;
+				dispatcher.emit();
+
+				//However slow the main loop is, wait for it before sending another
+				while(!done && !processed.Block(chrono::milliseconds(100)))
+				{}
+			}
+		});
+
+	loop->run();
+	done = true;
+	worker.join();
+
+	//Latency depends on how busy the machine is, so it's only logged.
+	//Compare with the 5 ms polling timer this replaced, which had a median of half its period.
+	LogVerbose("UI wakeup: mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+		wakeup.GetMean() * 1e6,
+		wakeup.GetPercentile(50) * 1e6,
+		wakeup.GetPercentile(99) * 1e6,
+		wakeup.GetMax() * 1e6);
+
+	//Every wakeup delivered, one at a time, in order
+	REQUIRE(received == count);
+	REQUIRE(sent == count);
+	REQUIRE(outOfOrder == 0);
+}
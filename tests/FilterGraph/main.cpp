@@ -0,0 +1,116 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Main code for FilterGraph test case
+ */
+
+#define CATCH_CONFIG_RUNNER
+#include <catch2/catch.hpp>
+#include "FilterGraph.h"
+#include "../../src/glscopeclient/FilterRegistry.h"
+
+using namespace std;
+
+MockOscilloscope g_scope("Test Scope", "Antikernel Labs", "12345", "null", "mock", "");
+minstd_rand g_rng;
+
+int main(int argc, char* argv[])
+{
+	g_log_sinks.emplace(g_log_sinks.begin(), new ColoredSTDLogSink(Severity::VERBOSE));
+
+	//Global scopehal initialization
+	TransportStaticInit();
+	DriverStaticInit();
+	InitializePlugins();
+	ScopeProtocolStaticInit();
+
+	//Initialize the RNG
+	g_rng.seed(0);
+
+	//Create some fake scope channels
+	g_scope.AddChannel(new OscilloscopeChannel(
+		&g_scope, "CH1", OscilloscopeChannel::CHANNEL_TYPE_ANALOG, "#ffffff", 0, true));
+
+	//Run the actual test
+	return Catch::Session().run(argc, argv);
+}
+
+/**
+	@brief Makes a dense packed waveform, one fs per sample, whose sample values count up from zero
+ */
+AnalogWaveform* MakeRamp(size_t len, int64_t femtoseconds, time_t timestamp)
+{
+	auto wfm = new AnalogWaveform;
+	wfm->m_timescale = 1;
+	wfm->m_startTimestamp = timestamp;
+	wfm->m_startFemtoseconds = femtoseconds;
+	wfm->m_densePacked = true;
+	wfm->Resize(len);
+	for(size_t i=0; i<len; i++)
+	{
+		wfm->m_offsets[i] = i;
+		wfm->m_durations[i] = 1;
+		wfm->m_samples[i] = i;
+	}
+	return wfm;
+}
+
+TestGraph::~TestGraph()
+{
+	//Downstream filters first, so nothing is freed while still in use
+	for(auto it = m_nodes.rbegin(); it != m_nodes.rend(); it++)
+		(*it)->Release();
+}
+
+/**
+	@brief Creates a filter the same way the application does
+ */
+Filter* TestGraph::Create(const string& protocol)
+{
+	auto f = g_filterRegistry.CreateFilter(protocol, "#ffffff");
+	REQUIRE(f != NULL);
+	f->AddRef();
+	m_nodes.push_back(f);
+	m_filters.emplace(f);
+	return f;
+}
+
+/**
+	@brief Creates a filter computing a - b
+ */
+Filter* TestGraph::Subtract(StreamDescriptor a, StreamDescriptor b)
+{
+	auto f = Create("Subtract");
+	f->SetInput(0, a);
+	f->SetInput(1, b);
+	return f;
+}